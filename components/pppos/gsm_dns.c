@@ -0,0 +1,360 @@
+/*
+ *  DNS cache for the PPPoS link
+ *
+*/
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include "lwip/dns.h"
+
+#include "libGSM.h"
+#include "gsm_dns.h"
+
+
+#ifdef CONFIG_GSM_DEBUG
+#define GSM_DEBUG 1
+#else
+#define GSM_DEBUG 0
+#endif
+
+#define DNS_PORT			53
+#define DNS_QUERY_TIMEOUT	3000	// DNS server response timeout in miliseconds
+#define DNS_QUERY_RETRIES	2
+#define DNS_MSG_SIZE		512
+#define DNS_CACHE_MAGIC		0x444E5343
+#define DNSMUTEX_TIMEOUT	1000 / portTICK_RATE_MS
+
+typedef struct
+{
+	char		name[GSM_DNS_NAME_MAX];
+	uint32_t	addr;		// IPv4 address, network byte order
+	uint32_t	expires;	// time since boot in seconds when the entry expires, 0 if expired
+	uint32_t	rtt_ms;		// time needed to resolve the entry
+}dns_entry_t;
+
+// Cache is kept in RTC memory, it survives PPP reconnects and deep sleep
+RTC_DATA_ATTR static uint32_t dns_cache_magic;
+RTC_DATA_ATTR static dns_entry_t dns_cache[GSM_DNS_CACHE_SIZE];
+RTC_DATA_ATTR static gsm_dns_stats_t dns_stats;
+
+static QueueHandle_t dns_mutex = NULL;
+#ifdef CONFIG_GSM_STATIC_ALLOC
+static StaticSemaphore_t dns_mutex_buf;
+#endif
+
+#if GSM_DEBUG
+static const char *TAG = "[GSM DNS]";
+#endif
+
+
+// Monotonic time in seconds, not affected by setting the system time from the network
+//-----------------------
+static uint32_t dns_now()
+{
+	return (uint32_t)(esp_timer_get_time() / 1000000) + 1;
+}
+
+//-----------------------
+static int dns_lock()
+{
+	if (dns_mutex == NULL) return 0;
+	if (xSemaphoreTake(dns_mutex, DNSMUTEX_TIMEOUT) != pdTRUE) return 0;
+	return 1;
+}
+
+//------------------------
+static void dns_unlock()
+{
+	xSemaphoreGive(dns_mutex);
+}
+
+// Find the cache entry for the host, must be called with mutex taken
+//-------------------------------------------------
+static dns_entry_t *dns_find(const char *host)
+{
+	for (int i=0; i<GSM_DNS_CACHE_SIZE; i++) {
+		if ((dns_cache[i].name[0] != '\0') && (strcasecmp(dns_cache[i].name, host) == 0)) return &dns_cache[i];
+	}
+	return NULL;
+}
+
+// Store the entry into cache, the expired or the oldest entry is replaced
+//---------------------------------------------------------------------------------
+static void dns_store(const char *host, uint32_t addr, uint32_t ttl, uint32_t rtt_ms)
+{
+	dns_entry_t *entry = dns_find(host);
+	if (entry == NULL) {
+		entry = &dns_cache[0];
+		for (int i=1; i<GSM_DNS_CACHE_SIZE; i++) {
+			if (dns_cache[i].expires < entry->expires) entry = &dns_cache[i];
+		}
+	}
+
+	if (ttl < GSM_DNS_MIN_TTL) ttl = GSM_DNS_MIN_TTL;
+	if (ttl > GSM_DNS_MAX_TTL) ttl = GSM_DNS_MAX_TTL;
+
+	strncpy(entry->name, host, GSM_DNS_NAME_MAX-1);
+	entry->name[GSM_DNS_NAME_MAX-1] = '\0';
+	entry->addr = addr;
+	entry->expires = dns_now() + ttl;
+	entry->rtt_ms = rtt_ms;
+}
+
+// Skip the (possibly compressed) name in DNS message
+// Returns pointer after the name or NULL on error
+//-----------------------------------------------------------------------------------
+static const uint8_t *dns_skip_name(const uint8_t *p, const uint8_t *end)
+{
+	while (p < end) {
+		if (*p == 0) return p+1;
+		if ((*p & 0xC0) == 0xC0) return ((p+2) <= end) ? p+2 : NULL;
+		p += *p + 1;
+	}
+	return NULL;
+}
+
+// Send A record query to the PPP link DNS server and parse the response
+// Returns 1 on success
+//-------------------------------------------------------------------------------
+static int dns_query(const char *host, uint32_t *addr, uint32_t *ttl)
+{
+	const ip_addr_t *dns_server = dns_getserver(0);
+	if ((dns_server == NULL) || (ip_addr_isany(dns_server))) return 0;
+
+	#ifdef CONFIG_GSM_STATIC_ALLOC
+	uint8_t msg[DNS_MSG_SIZE];	// on caller's stack
+	#else
+	uint8_t *msg = gsm_bufAlloc(DNS_MSG_SIZE);
+	if (msg == NULL) return 0;
+	#endif
+
+	int res = 0;
+	int sock = -1;
+	uint16_t id = (uint16_t)esp_random();
+
+	// ** Build the query
+	memset(msg, 0, 12);
+	msg[0] = id >> 8;
+	msg[1] = id & 0xFF;
+	msg[2] = 0x01;	// recursion desired
+	msg[5] = 1;		// one question
+	int len = 12;
+	const char *label = host;
+	while (*label) {
+		const char *dot = strchr(label, '.');
+		int llen = (dot) ? (dot - label) : strlen(label);
+		if ((llen == 0) || (llen > 63) || ((len + llen + 6) > DNS_MSG_SIZE)) goto exit;
+		msg[len++] = llen;
+		memcpy(msg+len, label, llen);
+		len += llen;
+		label += llen;
+		if (*label == '.') label++;
+	}
+	msg[len++] = 0;
+	msg[len++] = 0; msg[len++] = 1;	// type A
+	msg[len++] = 0; msg[len++] = 1;	// class IN
+	int qlen = len;
+
+	sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0) goto exit;
+	int tmo = DNS_QUERY_TIMEOUT;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tmo, sizeof(int));
+
+	struct sockaddr_in server;
+	memset(&server, 0, sizeof(server));
+	server.sin_family = AF_INET;
+	server.sin_port = htons(DNS_PORT);
+	server.sin_addr.s_addr = ip4_addr_get_u32(ip_2_ip4(dns_server));
+
+	for (int retry = 0; retry < DNS_QUERY_RETRIES; retry++) {
+		if (sendto(sock, msg, qlen, 0, (struct sockaddr *)&server, sizeof(server)) != qlen) continue;
+
+		len = recvfrom(sock, msg, DNS_MSG_SIZE, 0, NULL, NULL);
+		if (len < 12) continue;
+		if ((((msg[0] << 8) | msg[1]) != id) || ((msg[2] & 0x80) == 0)) continue;
+		if ((msg[3] & 0x0F) != 0) break;	// server error or name not found
+
+		// ** Parse the response
+		const uint8_t *end = msg + len;
+		const uint8_t *p = dns_skip_name(msg + 12, end);
+		if ((p == NULL) || ((p + 4) > end)) break;
+		p += 4;	// skip question type and class
+		int nans = (msg[6] << 8) | msg[7];
+		for (int i=0; i<nans; i++) {
+			p = dns_skip_name(p, end);
+			if ((p == NULL) || ((p + 10) > end)) break;
+			uint16_t type = (p[0] << 8) | p[1];
+			uint32_t rttl = (p[4] << 24) | (p[5] << 16) | (p[6] << 8) | p[7];
+			uint16_t rdlen = (p[8] << 8) | p[9];
+			p += 10;
+			if ((p + rdlen) > end) break;
+			if ((type == 1) && (rdlen == 4)) {
+				memcpy(addr, p, 4);
+				*ttl = rttl;
+				res = 1;
+				break;
+			}
+			p += rdlen;	// CNAME or other record
+		}
+		break;
+	}
+
+exit:
+	if (sock >= 0) close(sock);
+	#ifndef CONFIG_GSM_STATIC_ALLOC
+	free(msg);
+	#endif
+	return res;
+}
+
+// Resolve the host using lwIP resolver, used if the direct query fails
+//-----------------------------------------------------------
+static int dns_lwip_resolve(const char *host, uint32_t *addr)
+{
+	const struct addrinfo hints = {
+		.ai_family = AF_INET,
+		.ai_socktype = SOCK_STREAM,
+	};
+	struct addrinfo *res = NULL;
+
+	int err = getaddrinfo(host, NULL, &hints, &res);
+	if ((err != 0) || (res == NULL)) return 0;
+
+	*addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr.s_addr;
+	freeaddrinfo(res);
+	return 1;
+}
+
+// Resolve the host and store it into cache
+//-------------------------------------------------------------
+static int dns_lookup(const char *host, uint32_t *addr)
+{
+	uint32_t ttl = GSM_DNS_DEFAULT_TTL;
+	uint32_t t_start = xTaskGetTickCount();
+
+	int res = dns_query(host, addr, &ttl);
+	if (res == 0) res = dns_lwip_resolve(host, addr);
+	uint32_t rtt = (xTaskGetTickCount() - t_start) * portTICK_PERIOD_MS;
+
+	if (dns_lock() == 0) return res;
+	if (res) {
+		dns_store(host, *addr, ttl, rtt);
+		dns_stats.lookup_ms += rtt;
+	}
+	else dns_stats.failures++;
+	dns_unlock();
+
+	#if GSM_DEBUG
+	if (res) ESP_LOGI(TAG, "%s resolved in %u ms, TTL=%u", host, rtt, ttl);
+	else ESP_LOGE(TAG, "%s not resolved", host);
+	#endif
+	return res;
+}
+
+//================
+int gsm_dns_init()
+{
+	if (dns_mutex != NULL) return 1;
+
+	#ifdef CONFIG_GSM_STATIC_ALLOC
+	dns_mutex = xSemaphoreCreateMutexStatic(&dns_mutex_buf);
+	#else
+	dns_mutex = xSemaphoreCreateMutex();
+	#endif
+	if (dns_mutex == NULL) return 0;
+
+	if (dns_cache_magic != DNS_CACHE_MAGIC) {
+		// RTC memory not initialized (power on)
+		memset(dns_cache, 0, sizeof(dns_cache));
+		memset(&dns_stats, 0, sizeof(gsm_dns_stats_t));
+		dns_cache_magic = DNS_CACHE_MAGIC;
+	}
+	else {
+		// Expiry times of the previous boot (deep sleep) are not valid, the names are kept for prefetch
+		for (int i=0; i<GSM_DNS_CACHE_SIZE; i++) dns_cache[i].expires = 0;
+	}
+	return 1;
+}
+
+//========================================================
+int gsm_dns_resolve(const char *host, struct in_addr *addr)
+{
+	if (host == NULL) return 0;
+
+	// Numeric address does not need resolving
+	if (inet_aton(host, addr)) return 1;
+	// Names too long for the cache are resolved by lwIP every time
+	if (strlen(host) >= GSM_DNS_NAME_MAX) return dns_lwip_resolve(host, &addr->s_addr);
+
+	if (dns_lock() == 0) return 0;
+	dns_entry_t *entry = dns_find(host);
+	if ((entry) && (entry->expires > dns_now())) {
+		addr->s_addr = entry->addr;
+		dns_stats.hits++;
+		dns_stats.saved_ms += entry->rtt_ms;
+		dns_unlock();
+		return 1;
+	}
+	dns_stats.misses++;
+	dns_unlock();
+
+	uint32_t ip;
+	if (dns_lookup(host, &ip) == 0) return 0;
+	addr->s_addr = ip;
+	return 1;
+}
+
+//====================
+int gsm_dns_prefetch()
+{
+	char host[GSM_DNS_NAME_MAX];
+	uint32_t addr;
+	int n = 0;
+
+	for (int i=0; i<GSM_DNS_CACHE_SIZE; i++) {
+		if (dns_lock() == 0) return n;
+		host[0] = '\0';
+		if ((dns_cache[i].name[0] != '\0') && (dns_cache[i].expires < (dns_now() + GSM_DNS_PREFETCH_TIME))) {
+			strcpy(host, dns_cache[i].name);
+		}
+		dns_unlock();
+
+		if ((host[0] != '\0') && (dns_lookup(host, &addr))) {
+			n++;
+			if (dns_lock()) {
+				dns_stats.prefetches++;
+				dns_unlock();
+			}
+		}
+	}
+	return n;
+}
+
+//==================
+void gsm_dns_flush()
+{
+	if (dns_lock() == 0) return;
+	memset(dns_cache, 0, sizeof(dns_cache));
+	dns_unlock();
+}
+
+//========================================================
+void gsm_dns_getStats(gsm_dns_stats_t *stats, uint8_t rst)
+{
+	if (dns_lock() == 0) {
+		memset(stats, 0, sizeof(gsm_dns_stats_t));
+		return;
+	}
+	memcpy(stats, &dns_stats, sizeof(gsm_dns_stats_t));
+	if (rst) memset(&dns_stats, 0, sizeof(gsm_dns_stats_t));
+	dns_unlock();
+}
@@ -0,0 +1,82 @@
+/*
+ *  DNS cache for the PPPoS link
+ *
+ *  Resolves host names with the DNS server negotiated on the PPP link,
+ *  caches the results for the record TTL and keeps the cache in RTC memory,
+ *  so it survives ppposDisconnect()/ppposInit() cycles. After deep sleep
+ *  the cached names are kept and refreshed by gsm_dns_prefetch().
+ *
+*/
+
+
+#ifndef _GSM_DNS_H_
+#define _GSM_DNS_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "lwip/sockets.h"
+
+#ifdef CONFIG_GSM_DNS_CACHE_SIZE
+#define GSM_DNS_CACHE_SIZE	CONFIG_GSM_DNS_CACHE_SIZE
+#else
+#define GSM_DNS_CACHE_SIZE	8
+#endif
+#define GSM_DNS_NAME_MAX		64		// max cached host name length
+#define GSM_DNS_MIN_TTL			30		// minimal TTL used for cached entries in seconds
+#define GSM_DNS_MAX_TTL			86400	// maximal TTL used for cached entries in seconds
+#define GSM_DNS_DEFAULT_TTL		300		// TTL used when the address is obtained from lwIP resolver
+#define GSM_DNS_PREFETCH_TIME	60		// entries expiring within this time are refreshed by gsm_dns_prefetch()
+
+typedef struct
+{
+	uint32_t	hits;			// lookups answered from cache
+	uint32_t	misses;			// lookups sent to the DNS server
+	uint32_t	failures;		// failed lookups
+	uint32_t	prefetches;		// entries refreshed by gsm_dns_prefetch()
+	uint32_t	saved_ms;		// sum of lookup times saved by cache hits
+	uint32_t	lookup_ms;		// sum of lookup times of cache misses
+}gsm_dns_stats_t;
+
+/*
+ * Initialize the DNS cache, called from gsmCreate()
+ * The cache can be used after the first GSM instance is created
+ *
+ * Returns 1 on success, 0 on error
+ */
+//=================
+int gsm_dns_init();
+
+/*
+ * Resolve host name to IPv4 address
+ * The cached address is returned if its TTL has not expired,
+ * otherwise the DNS server is queried and the result is cached
+ * Names of GSM_DNS_NAME_MAX or more characters are not cached
+ *
+ * Returns 1 on success, 0 on error
+ */
+//=======================================================
+int gsm_dns_resolve(const char *host, struct in_addr *addr);
+
+/*
+ * Refresh the cached entries which expire in less than GSM_DNS_PREFETCH_TIME seconds
+ * Should be called when the PPP link is up, before the requests are made
+ *
+ * Returns the number of refreshed entries
+ */
+//=====================
+int gsm_dns_prefetch();
+
+/*
+ * Remove all entries from DNS cache
+ */
+//===================
+void gsm_dns_flush();
+
+/*
+ * Get DNS cache statistics
+ * If 'rst' = 1, resets the statistics
+ */
+//=========================================================
+void gsm_dns_getStats(gsm_dns_stats_t *stats, uint8_t rst);
+
+#endif
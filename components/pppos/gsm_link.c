@@ -0,0 +1,324 @@
+/*
+ *  Link manager for multiple PPP links
+ *
+*/
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_log.h"
+
+#include "lwip/sockets.h"
+
+#include "gsm_link.h"
+
+
+#ifdef CONFIG_GSM_DEBUG
+#define GSM_DEBUG 1
+#else
+#define GSM_DEBUG 0
+#endif
+
+#define LINKMUTEX_TIMEOUT	1000 / portTICK_RATE_MS
+
+typedef struct
+{
+	gsm_handle	gsm;
+	uint8_t		weight;
+	int			current;		// smooth weighted round-robin state
+	uint8_t		up;
+	uint32_t	ip;				// local address of the PPP interface
+	uint32_t	active;
+	uint32_t	connections;
+	uint32_t	failures;
+	uint32_t	failovers;
+	uint32_t	rtt_ms;			// moving average of TCP connect time, 0 if not measured
+	uint32_t	throughput;		// moving average of bytes/second, 0 if not measured
+	uint32_t	bytes;
+}link_t;
+
+static link_t links[GSM_LINK_MAX];
+static int num_links = 0;
+static uint8_t link_mode = GSM_LINK_MODE_WRR;
+static int default_link = -1;		// link used as default lwIP interface
+static uint8_t default_pending = 0;	// default interface has to be moved to another link
+
+static QueueHandle_t link_mutex = NULL;
+#ifdef CONFIG_GSM_STATIC_ALLOC
+static StaticSemaphore_t link_mutex_buf;
+#endif
+
+#if GSM_DEBUG
+static const char *TAG = "[GSM LINK]";
+#endif
+
+
+//------------------------
+static int link_lock()
+{
+	if (link_mutex == NULL) return 0;
+	if (xSemaphoreTake(link_mutex, LINKMUTEX_TIMEOUT) != pdTRUE) return 0;
+	return 1;
+}
+
+//-------------------------
+static void link_unlock()
+{
+	xSemaphoreGive(link_mutex);
+}
+
+// Called from lwIP tcpip thread when the link goes up or down
+// pppapi functions can't be used here, the default interface is changed on next gsm_link_connect()
+//----------------------------------------------------------------------
+static void link_status_cb(gsm_handle gsm, int status, void *arg)
+{
+	link_t *l = (link_t *)arg;
+	uint32_t ip = gsm_GetIP(gsm);
+
+	if (link_lock() == 0) return;
+	int idx = l - links;
+	if (status == GSM_STATE_CONNECTED) {
+		l->up = 1;
+		l->ip = ip;
+		if ((default_link < 0) || (links[default_link].up == 0)) default_pending = 1;
+	}
+	else if (l->up) {
+		l->up = 0;
+		l->ip = 0;
+		if (l->active) l->failovers++;
+		if (idx == default_link) default_pending = 1;
+	}
+	link_unlock();
+
+	#if GSM_DEBUG
+	ESP_LOGI(TAG, "Link %d %s", idx, (status == GSM_STATE_CONNECTED) ? "up" : "down");
+	#endif
+}
+
+// Select the link for the new connection, must be called with mutex taken
+// Links whose bit is set in 'tried' are not selected
+//--------------------------------------
+static int link_select(uint32_t tried)
+{
+	int best = -1;
+	int total = 0;
+
+	for (int i=0; i<num_links; i++) {
+		link_t *l = &links[i];
+		if ((l->up == 0) || (l->weight == 0) || (tried & (1 << i))) continue;
+
+		switch (link_mode) {
+			case GSM_LINK_MODE_RTT:
+				// not measured links are probed first
+				if ((best < 0) || (l->rtt_ms < links[best].rtt_ms)) best = i;
+				break;
+			case GSM_LINK_MODE_TPUT:
+				// not measured links are probed first
+				if ((best < 0) || ((links[best].throughput != 0) && ((l->throughput == 0) ||
+						((l->throughput / (l->active + 1)) > (links[best].throughput / (links[best].active + 1)))))) best = i;
+				break;
+			default:
+				// smooth weighted round-robin
+				l->current += l->weight;
+				total += l->weight;
+				if ((best < 0) || (l->current > links[best].current)) best = i;
+				break;
+		}
+	}
+	if ((best >= 0) && (link_mode == GSM_LINK_MODE_WRR)) links[best].current -= total;
+
+	if (best < 0) {
+		// use the links with weight 0 only if no other link is available
+		for (int i=0; i<num_links; i++) {
+			if ((links[i].up) && ((tried & (1 << i)) == 0)) {
+				best = i;
+				break;
+			}
+		}
+	}
+	return best;
+}
+
+// Move the default lwIP interface to the best available link
+//--------------------------------
+static void link_update_default()
+{
+	if (link_lock() == 0) return;
+	int idx = -1;
+	if (default_pending) {
+		for (int i=0; i<num_links; i++) {
+			if ((links[i].up) && ((idx < 0) || (links[i].weight > links[idx].weight))) idx = i;
+		}
+		default_pending = 0;
+	}
+	gsm_handle gsm = (idx >= 0) ? links[idx].gsm : NULL;
+	link_unlock();
+
+	if ((idx >= 0) && (gsm_SetDefault(gsm))) {
+		if (link_lock()) {
+			default_link = idx;
+			link_unlock();
+		}
+		#if GSM_DEBUG
+		ESP_LOGI(TAG, "Link %d is the default interface", idx);
+		#endif
+	}
+}
+
+//=================
+int gsm_link_init()
+{
+	if (link_mutex != NULL) return 1;
+
+	#ifdef CONFIG_GSM_STATIC_ALLOC
+	link_mutex = xSemaphoreCreateMutexStatic(&link_mutex_buf);
+	#else
+	link_mutex = xSemaphoreCreateMutex();
+	#endif
+	return (link_mutex != NULL);
+}
+
+//=================================================
+int gsm_link_add(gsm_handle gsm, uint8_t weight)
+{
+	// Links are matched by handle, the default instance must be added by its handle
+	if (gsm == NULL) return -1;
+	if (link_lock() == 0) return -1;
+	if (num_links >= GSM_LINK_MAX) {
+		link_unlock();
+		return -1;
+	}
+	for (int i=0; i<num_links; i++) {
+		if (links[i].gsm == gsm) {
+			links[i].weight = weight;
+			link_unlock();
+			return i;
+		}
+	}
+	int idx = num_links++;
+	link_t *l = &links[idx];
+	memset(l, 0, sizeof(link_t));
+	l->gsm = gsm;
+	l->weight = weight;
+	link_unlock();
+
+	gsmSetStatusCallback(gsm, link_status_cb, l);
+	// the link may already be connected
+	if (ppposStatus(gsm) == GSM_STATE_CONNECTED) link_status_cb(gsm, GSM_STATE_CONNECTED, l);
+
+	return idx;
+}
+
+//===================================
+void gsm_link_setMode(uint8_t mode)
+{
+	if (link_lock() == 0) return;
+	link_mode = mode;
+	link_unlock();
+}
+
+//=====================================================================
+int gsm_link_connect(const struct sockaddr_in *server, int *link)
+{
+	uint32_t tried = 0;
+	*link = -1;
+
+	link_update_default();
+
+	for (int n=0; n<GSM_LINK_MAX; n++) {
+		if (link_lock() == 0) return -1;
+		int idx = link_select(tried);
+		uint32_t ip = (idx >= 0) ? links[idx].ip : 0;
+		link_unlock();
+		if (idx < 0) break;
+		tried |= (1 << idx);
+
+		int s = socket(AF_INET, SOCK_STREAM, 0);
+		if (s < 0) return -1;
+
+		// Bind to the link's address, lwIP routes the packets by source address to the link's netif
+		struct sockaddr_in local;
+		memset(&local, 0, sizeof(local));
+		local.sin_family = AF_INET;
+		local.sin_addr.s_addr = ip;
+		local.sin_port = 0;
+
+		uint32_t t_start = xTaskGetTickCount();
+		if ((bind(s, (struct sockaddr *)&local, sizeof(local)) == 0) &&
+				(connect(s, (struct sockaddr *)server, sizeof(struct sockaddr_in)) == 0)) {
+			uint32_t rtt = (xTaskGetTickCount() - t_start) * portTICK_PERIOD_MS;
+			if (rtt == 0) rtt = 1;
+			if (link_lock()) {
+				link_t *l = &links[idx];
+				l->connections++;
+				l->active++;
+				l->rtt_ms = (l->rtt_ms == 0) ? rtt : ((l->rtt_ms * 3) + rtt) / 4;
+				link_unlock();
+			}
+			*link = idx;
+			#if GSM_DEBUG
+			ESP_LOGI(TAG, "Connected over link %d in %u ms", idx, rtt);
+			#endif
+			return s;
+		}
+
+		close(s);
+		if (link_lock()) {
+			links[idx].failures++;
+			link_unlock();
+		}
+		#if GSM_DEBUG
+		ESP_LOGW(TAG, "Connect over link %d failed, errno=%d", idx, errno);
+		#endif
+	}
+	return -1;
+}
+
+//==============================================================
+void gsm_link_done(int link, uint32_t bytes, uint32_t time_ms)
+{
+	if ((link < 0) || (link >= num_links)) return;
+	if (link_lock() == 0) return;
+
+	link_t *l = &links[link];
+	if (l->active) l->active--;
+	l->bytes += bytes;
+	if ((time_ms > 0) && (bytes > 0)) {
+		uint32_t tput = (uint32_t)(((uint64_t)bytes * 1000) / time_ms);
+		l->throughput = (l->throughput == 0) ? tput : ((l->throughput * 3) + tput) / 4;
+	}
+	link_unlock();
+}
+
+//====================
+int gsm_link_count()
+{
+	return num_links;
+}
+
+//=========================================================
+int gsm_link_getStats(int link, gsm_link_stats_t *stats)
+{
+	if ((link < 0) || (link >= num_links)) return 0;
+	if (link_lock() == 0) return 0;
+
+	uint64_t total = 0;
+	for (int i=0; i<num_links; i++) total += links[i].bytes;
+
+	link_t *l = &links[link];
+	stats->up = l->up;
+	stats->weight = l->weight;
+	stats->active = l->active;
+	stats->connections = l->connections;
+	stats->failures = l->failures;
+	stats->failovers = l->failovers;
+	stats->rtt_ms = l->rtt_ms;
+	stats->throughput = l->throughput;
+	stats->bytes = l->bytes;
+	stats->utilisation = (total) ? (uint8_t)(((uint64_t)l->bytes * 100) / total) : 0;
+	link_unlock();
+
+	return 1;
+}
@@ -0,0 +1,99 @@
+/*
+ *  Link manager for multiple PPP links
+ *
+ *  Spreads outgoing TCP connections over the PPP links of several GSM
+ *  instances. The link is selected by weighted round-robin, measured
+ *  connect RTT or measured throughput. A link is removed from selection
+ *  as soon as its PPP status callback reports the link down and the
+ *  default lwIP interface is moved to another link.
+ *
+*/
+
+
+#ifndef _GSM_LINK_H_
+#define _GSM_LINK_H_
+
+#include <stdint.h>
+#include "lwip/sockets.h"
+#include "libGSM.h"
+
+#define GSM_LINK_MAX			GSM_MAX_MODEMS
+
+// Link selection modes
+#define GSM_LINK_MODE_WRR		0	// weighted round-robin
+#define GSM_LINK_MODE_RTT		1	// lowest measured connect time
+#define GSM_LINK_MODE_TPUT		2	// highest measured throughput per active connection
+
+typedef struct
+{
+	uint8_t		up;				// link is connected
+	uint8_t		weight;			// weight used in round-robin mode
+	uint32_t	active;			// connections currently open on the link
+	uint32_t	connections;	// connections opened on the link
+	uint32_t	failures;		// failed connection attempts
+	uint32_t	failovers;		// times the link went down with connections open
+	uint32_t	rtt_ms;			// average TCP connect time
+	uint32_t	throughput;		// average throughput in bytes/second
+	uint32_t	bytes;			// bytes transfered over the link's connections
+	uint8_t		utilisation;	// share of all transfered bytes in %
+}gsm_link_stats_t;
+
+/*
+ * Initialize the link manager, called from gsmCreate()
+ *
+ * Returns 1 on success, 0 on error
+ */
+//==================
+int gsm_link_init();
+
+/*
+ * Add GSM instance to the link manager
+ * 'weight' is used in round-robin mode, links with weight 0 are used only if no other link is up
+ * Replaces the instance's status callback set with gsmSetStatusCallback()
+ * 'gsm' must be the handle returned by gsmCreate(), NULL is not accepted
+ *
+ * Returns the link index or -1 on error
+ */
+//=================================================
+int gsm_link_add(gsm_handle gsm, uint8_t weight);
+
+/*
+ * Set link selection mode (GSM_LINK_MODE_xxx)
+ */
+//===================================
+void gsm_link_setMode(uint8_t mode);
+
+/*
+ * Create TCP socket and connect it to the server over the selected link
+ * The socket is bound to the link's local address; if connecting fails,
+ * the other links which are up are tried
+ * The index of the used link is returned in 'link', it must be passed
+ * to gsm_link_done() when the connection is closed
+ *
+ * Returns the connected socket or -1 on error
+ */
+//=====================================================================
+int gsm_link_connect(const struct sockaddr_in *server, int *link);
+
+/*
+ * Report the closed connection
+ * 'bytes' transfered in 'time_ms' are used for throughput measurement
+ */
+//==============================================================
+void gsm_link_done(int link, uint32_t bytes, uint32_t time_ms);
+
+/*
+ * Get the number of links
+ */
+//====================
+int gsm_link_count();
+
+/*
+ * Get the link statistics
+ *
+ * Returns 1 on success, 0 if the link does not exist
+ */
+//=========================================================
+int gsm_link_getStats(int link, gsm_link_stats_t *stats);
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ *  Connection lifecycle metrics of the GSM instance
+ *
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "gsm_metrics.h"
+
+
+// Number of used buckets (without trailing empty buckets)
+//------------------------------------------
+static int hist_used(const gsm_hist_t *hist)
+{
+	int n = GSM_HIST_BUCKETS;
+	while ((n > 0) && (hist->bucket[n-1] == 0)) n--;
+	return n;
+}
+
+//=================================================
+void gsm_hist_add(gsm_hist_t *hist, uint32_t value)
+{
+	int b = 0;
+	uint32_t v = value;
+	while ((v > 0) && (b < (GSM_HIST_BUCKETS-1))) {
+		v >>= 1;
+		b++;
+	}
+	hist->bucket[b]++;
+	if ((hist->count == 0) || (value < hist->min)) hist->min = value;
+	if (value > hist->max) hist->max = value;
+	hist->sum += value;
+	hist->count++;
+}
+
+//===========================================================
+uint32_t gsm_hist_percentile(const gsm_hist_t *hist, int pct)
+{
+	if (hist->count == 0) return 0;
+	if (pct > 100) pct = 100;
+
+	uint32_t target = ((uint64_t)hist->count * pct + 99) / 100;
+	if (target == 0) target = 1;
+	uint32_t n = 0;
+	for (int b=0; b<GSM_HIST_BUCKETS; b++) {
+		n += hist->bucket[b];
+		if (n >= target) {
+			if (b == (GSM_HIST_BUCKETS-1)) return hist->max;
+			uint32_t upper = (1UL << b) - 1;
+			return (upper < hist->max) ? upper : hist->max;
+		}
+	}
+	return hist->max;
+}
+
+//=====================================================
+uint32_t gsm_ewma_update(uint32_t avg, uint32_t sample)
+{
+	if (avg == 0) return sample;
+	return (uint32_t)((int32_t)avg + (((int32_t)sample - (int32_t)avg) >> GSM_EWMA_SHIFT));
+}
+
+// Append formatted text to the JSON buffer, returns 0 if it does not fit
+//----------------------------------------------------------------------
+static int json_add(char *buf, int size, int *len, const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(buf + *len, size - *len, fmt, args);
+	va_end(args);
+	if ((n < 0) || ((*len + n) >= size)) return 0;
+	*len += n;
+	return 1;
+}
+
+//-------------------------------------------------------------------------------------------
+static int json_hist(char *buf, int size, int *len, const char *name, const gsm_hist_t *hist)
+{
+	if (json_add(buf, size, len, "\"%s\":{\"n\":%u,\"min\":%u,\"max\":%u,\"sum\":%llu,\"p50\":%u,\"p90\":%u,\"b\":[",
+			name, hist->count, hist->min, hist->max, (unsigned long long)hist->sum,
+			gsm_hist_percentile(hist, 50), gsm_hist_percentile(hist, 90)) == 0) return 0;
+	int nb = hist_used(hist);
+	for (int b=0; b<nb; b++) {
+		if (json_add(buf, size, len, (b) ? ",%u" : "%u", hist->bucket[b]) == 0) return 0;
+	}
+	return json_add(buf, size, len, "]},");
+}
+
+//=================================================================
+int gsm_metrics_toJSON(const gsm_metrics_t *m, char *buf, int size)
+{
+	int len = 0;
+
+	if (json_add(buf, size, &len, "{\"v\":%d,", GSM_METRICS_VERSION) == 0) return 0;
+	if (json_hist(buf, size, &len, "at", &m->at_latency) == 0) return 0;
+	if (json_hist(buf, size, &len, "init", &m->init_time) == 0) return 0;
+	if (json_hist(buf, size, &len, "connect", &m->connect_time) == 0) return 0;
+	if (json_hist(buf, size, &len, "session", &m->session_time) == 0) return 0;
+	if (json_hist(buf, size, &len, "at_queue", &m->at_queue_time) == 0) return 0;
+	if (json_hist(buf, size, &len, "reg", &m->reg_time) == 0) return 0;
+	if (json_hist(buf, size, &len, "recover", &m->recover_time) == 0) return 0;
+	if (json_add(buf, size, &len, "\"at_cmds\":%u,\"at_tmo\":%u,\"at_err\":%u,\"init_fail\":%u,\"connects\":%u,\"at_req\":%u,\"at_exp\":%u,\"reg_tmo\":%u,\"reconn\":%u,\"disc\":[",
+			m->at_commands, m->at_timeouts, m->at_errors, m->init_failures, m->connects, m->at_requests, m->at_expired,
+			m->reg_timeouts, m->reconnects) == 0) return 0;
+	for (int i=0; i<GSM_METRICS_ERR_NUM; i++) {
+		if (json_add(buf, size, &len, (i) ? ",%u" : "%u", m->disconnects[i]) == 0) return 0;
+	}
+	if (json_add(buf, size, &len, "],\"rx_bps\":%u,\"tx_bps\":%u,\"rx_bps_max\":%u,\"tx_bps_max\":%u}",
+			m->rx_rate, m->tx_rate, m->rx_rate_max, m->tx_rate_max) == 0) return 0;
+	return len;
+}
+
+//------------------------------------------------
+static uint8_t *pack_u32(uint8_t *p, uint32_t val)
+{
+	p[0] = val & 0xFF;
+	p[1] = (val >> 8) & 0xFF;
+	p[2] = (val >> 16) & 0xFF;
+	p[3] = val >> 24;
+	return p + 4;
+}
+
+//-----------------------------------------------------------
+static uint8_t *pack_hist(uint8_t *p, const gsm_hist_t *hist)
+{
+	int nb = hist_used(hist);
+	p = pack_u32(p, hist->count);
+	p = pack_u32(p, hist->min);
+	p = pack_u32(p, hist->max);
+	p = pack_u32(p, (uint32_t)hist->sum);
+	p = pack_u32(p, (uint32_t)(hist->sum >> 32));
+	*p++ = nb;
+	for (int b=0; b<nb; b++) p = pack_u32(p, hist->bucket[b]);
+	return p;
+}
+
+//==================================================================
+int gsm_metrics_pack(const gsm_metrics_t *m, uint8_t *buf, int size)
+{
+	const gsm_hist_t *hist[GSM_METRICS_HIST_NUM] = {&m->at_latency, &m->init_time, &m->connect_time, &m->session_time, &m->at_queue_time,
+			&m->reg_time, &m->recover_time};
+	uint32_t counters[GSM_METRICS_CNT_NUM] = {m->at_commands, m->at_timeouts, m->at_errors, m->init_failures,
+			m->connects, m->rx_rate, m->tx_rate, m->rx_rate_max, m->tx_rate_max, m->at_requests, m->at_expired,
+			m->reg_timeouts, m->reconnects};
+
+	// Check the record size
+	int len = 4 + 2 + sizeof(counters) + (GSM_METRICS_ERR_NUM * 4);
+	for (int i=0; i<GSM_METRICS_HIST_NUM; i++) len += 21 + (hist_used(hist[i]) * 4);
+	if (len > size) return 0;
+
+	uint8_t *p = buf;
+	*p++ = 'G';
+	*p++ = 'M';
+	*p++ = GSM_METRICS_VERSION;
+	*p++ = GSM_METRICS_HIST_NUM;
+	for (int i=0; i<GSM_METRICS_HIST_NUM; i++) p = pack_hist(p, hist[i]);
+	*p++ = sizeof(counters) / sizeof(uint32_t);
+	for (int i=0; i<(sizeof(counters) / sizeof(uint32_t)); i++) p = pack_u32(p, counters[i]);
+	*p++ = GSM_METRICS_ERR_NUM;
+	for (int i=0; i<GSM_METRICS_ERR_NUM; i++) p = pack_u32(p, m->disconnects[i]);
+	return p - buf;
+}
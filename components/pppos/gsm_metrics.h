@@ -0,0 +1,109 @@
+/*
+ *  Connection lifecycle metrics of the GSM instance
+ *
+ *  Latencies and durations are collected in log2 histograms (in miliseconds),
+ *  PPP disconnects are counted by lwIP PPPERR_xxx code and the link throughput
+ *  is tracked as exponentially weighted moving average.
+ *  The snapshot obtained with gsm_GetMetrics() can be dumped as JSON
+ *  or packed into a compact binary record for collecting fleet-wide statistics.
+ *
+*/
+
+
+#ifndef _GSM_METRICS_H_
+#define _GSM_METRICS_H_
+
+#include <stdint.h>
+
+#define GSM_METRICS_VERSION		2
+#define GSM_HIST_BUCKETS		24		// bucket 0: < 1 ms, bucket n: 2^(n-1) .. 2^n - 1 ms, last bucket: >= 2^22 ms
+#define GSM_METRICS_ERR_NUM		16		// counted PPPERR_xxx codes, higher codes are counted in the last one
+#define GSM_EWMA_SHIFT			3		// EWMA weight of the new sample is 1/8
+#define GSM_RATE_PERIOD_MS		1000	// throughput sample period
+#define GSM_METRICS_HIST_NUM	7		// histograms in 'gsm_metrics_t'
+#define GSM_METRICS_CNT_NUM		13		// counters in 'gsm_metrics_t', without disconnect counters
+
+// Max length of the JSON written by gsm_metrics_toJSON(), all values at their max number of digits
+#define GSM_METRICS_JSON_HIST	(64 + (5 * 10) + 20 + (GSM_HIST_BUCKETS * 11))
+#define GSM_METRICS_JSON_MAX	(16 + (GSM_METRICS_HIST_NUM * GSM_METRICS_JSON_HIST) + 192 + \
+								(GSM_METRICS_CNT_NUM * 11) + (GSM_METRICS_ERR_NUM * 11) + 1)
+
+// Log2 histogram of values in miliseconds
+typedef struct
+{
+	uint32_t	count;
+	uint32_t	min;
+	uint32_t	max;
+	uint64_t	sum;
+	uint32_t	bucket[GSM_HIST_BUCKETS];
+}gsm_hist_t;
+
+typedef struct
+{
+	gsm_hist_t	at_latency;		// AT command round trip
+	gsm_hist_t	init_time;		// initialization sequence, start to CONNECT
+	gsm_hist_t	connect_time;	// initialization start to PPP link up (PPPERR_NONE)
+	gsm_hist_t	session_time;	// PPP link up to link down
+	gsm_hist_t	at_queue_time;	// queued AT request, submit to execution start
+	gsm_hist_t	reg_time;		// RF on to network registration (home or roaming)
+	gsm_hist_t	recover_time;	// PPP link lost to link up again
+	uint32_t	at_commands;	// AT commands sent
+	uint32_t	at_timeouts;	// AT commands without response
+	uint32_t	at_errors;		// AT commands with unexpected response
+	uint32_t	init_failures;	// failed initialization sequences
+	uint32_t	connects;		// PPP link up events
+	uint32_t	at_requests;	// AT requests submitted to the queue
+	uint32_t	at_expired;		// queued AT requests not executed (modem not in command mode)
+	uint32_t	reg_timeouts;	// registration attempts not completed in time
+	uint32_t	reconnects;		// connection attempts and initialization restarts scheduled after a failure or lost link
+	uint32_t	disconnects[GSM_METRICS_ERR_NUM];	// PPP link down events by PPPERR_xxx code
+	uint32_t	rx_rate;		// received bytes per second, EWMA
+	uint32_t	tx_rate;		// sent bytes per second, EWMA
+	uint32_t	rx_rate_max;	// highest received bytes per second sample
+	uint32_t	tx_rate_max;	// highest sent bytes per second sample
+}gsm_metrics_t;
+
+/*
+ * Add the value (in miliseconds) to the histogram
+ */
+//==================================================
+void gsm_hist_add(gsm_hist_t *hist, uint32_t value);
+
+/*
+ * Get the approximate percentile ('pct' = 0 ~ 100) of the histogram values
+ * The upper limit of the bucket containing the percentile is returned
+ */
+//============================================================
+uint32_t gsm_hist_percentile(const gsm_hist_t *hist, int pct);
+
+/*
+ * Update the exponentially weighted moving average with new sample
+ */
+//======================================================
+uint32_t gsm_ewma_update(uint32_t avg, uint32_t sample);
+
+/*
+ * Write the metrics as JSON object to 'buf'
+ * Histogram buckets are written without the trailing empty buckets
+ * The buffer of GSM_METRICS_JSON_MAX bytes is large enough for any metrics values
+ * Returns the length of the JSON string or 0 if the buffer is too small
+ */
+//==================================================================
+int gsm_metrics_toJSON(const gsm_metrics_t *m, char *buf, int size);
+
+/*
+ * Pack the metrics into compact binary record (little endian):
+ *   'G','M', version, histogram count (7),
+ *   for each histogram: count, min, max (u32), sum (u64), number of buckets (u8), buckets (u32),
+ *   histograms: at_latency, init_time, connect_time, session_time, at_queue_time, reg_time, recover_time,
+ *   number of counters (u8), counters (u32): at_commands, at_timeouts, at_errors, init_failures,
+ *   connects, rx_rate, tx_rate, rx_rate_max, tx_rate_max, at_requests, at_expired, reg_timeouts, reconnects,
+ *   number of disconnect counters (u8), disconnect counters (u32)
+ * Trailing empty histogram buckets are not written, new histograms and counters are appended
+ * so readers of older versions can skip them
+ * Returns the record length or 0 if the buffer is too small
+ */
+//===================================================================
+int gsm_metrics_pack(const gsm_metrics_t *m, uint8_t *buf, int size);
+
+#endif
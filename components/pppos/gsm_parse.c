@@ -0,0 +1,289 @@
+/*
+ *  Modem response parsers
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "gsm_parse.h"
+
+#define CMGL_TAG		"+CMGL: "
+#define CMGL_TAG_LEN	7
+#define CGDCONT_TAG		"+CGDCONT: "
+#define CGDCONT_TAG_LEN	10
+
+#define SMS_FIELD_IDX	0
+#define SMS_FIELD_STAT	1
+#define SMS_FIELD_FROM	2
+#define SMS_FIELD_TIME	4		// field 3 is the sender's phonebook name, empty on most modems
+
+// Unsolicited result codes, matched at the start of the line
+typedef struct
+{
+	const char	*prefix;
+	uint8_t		urc;
+	uint8_t		final;		// can also be the final result code of a command
+}gsm_urc_t;
+
+static const gsm_urc_t gsm_urcs[] =
+{
+	{ "RING",				GSM_URC_RING,		0 },
+	{ "NO CARRIER",			GSM_URC_NOCARRIER,	1 },
+	{ "+CREG:",				GSM_URC_REG,		0 },
+	{ "+CGREG:",			GSM_URC_REG,		0 },
+	{ "+CEREG:",			GSM_URC_REG,		0 },
+	{ "+CMTI:",				GSM_URC_SMS,		0 },
+	{ "+CMT:",				GSM_URC_SMS,		0 },
+	{ "+CPIN:",				GSM_URC_SIM,		0 },
+	{ "UNDER-VOLTAGE",		GSM_URC_POWER,		0 },
+	{ "OVER-VOLTAGE",		GSM_URC_POWER,		0 },
+	{ "NORMAL POWER DOWN",	GSM_URC_POWER,		0 },
+	{ "RDY",				GSM_URC_READY,		0 },
+	{ "+CFUN:",				GSM_URC_READY,		0 },
+	{ "Call Ready",			GSM_URC_READY,		0 },
+	{ "SMS Ready",			GSM_URC_READY,		0 },
+	{ "+CTZV:",				GSM_URC_TIME,		0 },
+	{ "+CTZE:",				GSM_URC_TIME,		0 },
+	{ "*PSUTTZ:",			GSM_URC_TIME,		0 },
+	{ "DST:",				GSM_URC_TIME,		0 },
+	{ "+PDP: DEACT",		GSM_URC_PDP,		0 },
+	{ "+CGEV:",				GSM_URC_PDP,		0 },
+};
+
+#define GSM_URCS_SIZE	(sizeof(gsm_urcs)/sizeof(gsm_urc_t))
+
+
+//========================================================
+int gsm_parseTime(const char *str, struct tm *tm, int *tz)
+{
+	int yy, mn, dd, hh, mm, ss, z = 0;
+
+	if (sscanf(str, "%d/%d/%d,%d:%d:%d%d", &yy, &mn, &dd, &hh, &mm, &ss, &z) < 6) return 0;
+	if ((yy < 0) || (yy > 99) || (mn < 1) || (mn > 12) || (dd < 1) || (dd > 31)) return 0;
+	if ((hh < 0) || (hh > 23) || (mm < 0) || (mm > 59) || (ss < 0) || (ss > 60)) return 0;
+
+	memset(tm, 0, sizeof(struct tm));
+	tm->tm_year = yy+100;
+	tm->tm_mon = mn-1;
+	tm->tm_mday = dd;
+	tm->tm_hour = hh;
+	tm->tm_min = mm;
+	tm->tm_sec = ss;
+	if (tz) *tz = z;
+	return 1;
+}
+
+//=====================================
+int gsm_parseSMSCount(const char *resp)
+{
+	int nmsg = 0;
+	while ((resp = strstr(resp, CMGL_TAG)) != NULL) {
+		nmsg++;
+		resp += CMGL_TAG_LEN;
+	}
+	return nmsg;
+}
+
+// Copy the field of 'len' bytes at 'src' to 'dst' of 'size' bytes, without the quotes
+//-------------------------------------------------------------------
+static void _copyField(char *dst, int size, const char *src, int len)
+{
+	if ((len >= 2) && (src[0] == '"') && (src[len-1] == '"')) {
+		src++;
+		len -= 2;
+	}
+	if (len >= size) len = size-1;
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+}
+
+//==========================================================================
+int gsm_parseSMS(const char **resp, SMS_Msg *msg, char *text, int text_size)
+{
+	const char *p = strstr(*resp, CMGL_TAG);
+	if (p == NULL) {
+		*resp += strlen(*resp);
+		return -1;
+	}
+	p += CMGL_TAG_LEN;
+	*resp = p;
+	memset(msg, 0, sizeof(SMS_Msg));
+
+	// Message info: index,"stat","from",[name],"time"[,...]
+	// fields are separated by commas, the time contains a comma inside the quotes
+	const char *eol = strstr(p, "\r\n");
+	if (eol == NULL) return 0;
+
+	const char *start = p;
+	int field = 0;
+	int quoted = 0;
+	for (const char *c = p; c <= eol; c++) {
+		if (c < eol) {
+			if (*c == '"') quoted ^= 1;
+			if ((*c != ',') || (quoted)) continue;
+		}
+		int len = c - start;
+		if (field == SMS_FIELD_IDX) msg->idx = (int)strtol(start, NULL, 10);
+		else if (field == SMS_FIELD_STAT) _copyField(msg->stat, sizeof(msg->stat), start, len);
+		else if (field == SMS_FIELD_FROM) _copyField(msg->from, sizeof(msg->from), start, len);
+		else if (field == SMS_FIELD_TIME) _copyField(msg->time, sizeof(msg->time), start, len);
+		field++;
+		start = c + 1;
+	}
+
+	// Message text, up to the end of line
+	p = eol + 2;
+	eol = strstr(p, "\r\n");
+	if (eol == NULL) return 0;
+	*resp = eol + 2;
+
+	int len = eol - p;
+	if (text == NULL) {
+		text = malloc(len+1);
+		if (text == NULL) return 0;
+	}
+	else if (len >= text_size) len = text_size-1;
+	memcpy(text, p, len);
+	text[len] = '\0';
+	msg->msg = text;
+
+	// Convert message time to Linux time and time zone in hours
+	struct tm tm;
+	int tz;
+	if (gsm_parseTime(msg->time, &tm, &tz)) {
+		msg->time_value = mktime(&tm);
+		msg->tz = tz/4;
+	}
+	return 1;
+}
+
+//=================================================
+int gsm_parseURC(const char *line, const char *cmd)
+{
+	for (int i=0; i<GSM_URCS_SIZE; i++) {
+		int len = strlen(gsm_urcs[i].prefix);
+		if (strncmp(line, gsm_urcs[i].prefix, len) != 0) continue;
+		if (cmd == NULL) return gsm_urcs[i].urc;
+		if (gsm_urcs[i].final) return GSM_URC_NONE;
+
+		// "+XXX:" line is the response to "AT+XXX", "AT+XXX?" or "AT+XXX=?" command, set command has no such response
+		// each of the commands concatenated with ';' ("AT+XXX?;+YYY?") is checked
+		if ((line[0] == '+') && (strncmp(cmd, "AT", 2) == 0)) {
+			const char *c = cmd + 2;
+			while (c != NULL) {
+				if (strncmp(c, line, len-1) == 0) {
+					const char *e = c + len - 1;
+					if ((e[0] == '?') || (e[0] == ';') || (e[0] == '\r') || (e[0] == '\0') || (strncmp(e, "=?", 2) == 0)) return GSM_URC_NONE;
+				}
+				c = strchr(c, ';');
+				if (c != NULL) c++;
+			}
+		}
+		return gsm_urcs[i].urc;
+	}
+	return GSM_URC_NONE;
+}
+
+//============================================
+int gsm_isURCPrefix(const char *line, int len)
+{
+	for (int i=0; i<GSM_URCS_SIZE; i++) {
+		int plen = strlen(gsm_urcs[i].prefix);
+		if (strncmp(line, gsm_urcs[i].prefix, (len < plen) ? len : plen) == 0) return 1;
+	}
+	return 0;
+}
+
+//==============================================
+int gsm_isFinalResult(const char *resp, int len)
+{
+	if ((len < 4) || (resp[len-2] != '\r') || (resp[len-1] != '\n')) return 0;
+
+	// start of the last line
+	int i = len - 2;
+	while ((i > 0) && (resp[i-1] != '\n')) i--;
+	const char *line = resp + i;
+	int llen = len - 2 - i;
+
+	if ((llen == 2) && (strncmp(line, "OK", 2) == 0)) return 1;
+	if ((llen == 5) && (strncmp(line, "ERROR", 5) == 0)) return 1;
+	if ((llen > 11) && ((strncmp(line, "+CME ERROR:", 11) == 0) || (strncmp(line, "+CMS ERROR:", 11) == 0))) return 1;
+	return 0;
+}
+
+// Parse the optional hex field (quoted, can be empty) at '*p' after the comma
+//---------------------------------------
+static uint32_t _hexField(const char **p)
+{
+	const char *c = *p;
+	char *end;
+	if (*c != ',') return 0;
+	c++;
+	if (*c == '"') c++;
+	uint32_t val = strtoul(c, &end, 16);
+	c = end;
+	if (*c == '"') c++;
+	*p = c;
+	return val;
+}
+
+//================================================
+int gsm_parseReg(const char *line, gsm_reg_t *reg)
+{
+	const char *p;
+	char *end;
+
+	memset(reg, 0, sizeof(gsm_reg_t));
+	if (strncmp(line, "+CREG:", 6) == 0) {
+		reg->type = GSM_REG_CS;
+		p = line + 6;
+	}
+	else if (strncmp(line, "+CGREG:", 7) == 0) {
+		reg->type = GSM_REG_GPRS;
+		p = line + 7;
+	}
+	else if (strncmp(line, "+CEREG:", 7) == 0) {
+		reg->type = GSM_REG_EPS;
+		p = line + 7;
+	}
+	else return 0;
+
+	int stat = strtol(p, &end, 10);
+	if (end == p) return 0;
+	p = end;
+	// In the response the status follows the unsolicited mode <n>, in URC the location is quoted
+	if ((p[0] == ',') && (isdigit((int)p[1]))) {
+		stat = strtol(p+1, &end, 10);
+		p = end;
+	}
+	reg->stat = stat;
+	reg->lac = _hexField(&p);
+	reg->ci = _hexField(&p);
+	if ((p[0] == ',') && (isdigit((int)p[1]))) reg->act = strtol(p+1, NULL, 10);
+	return 1;
+}
+
+//=============================================================================================
+int gsm_parsePDPContext(const char *resp, int cid, char *type, int tsize, char *apn, int asize)
+{
+	const char *p = resp;
+	char *end;
+
+	while ((p = strstr(p, CGDCONT_TAG)) != NULL) {
+		p += CGDCONT_TAG_LEN;
+		if ((strtol(p, &end, 10) != cid) || (end == p) || (*end != ',')) continue;
+
+		// "<type>","<apn>", the fields end at the comma or line end
+		p = end + 1;
+		int len = strcspn(p, ",\r\n");
+		_copyField(type, tsize, p, len);
+		p += len;
+		if (*p == ',') p++;
+		len = strcspn(p, ",\r\n");
+		_copyField(apn, asize, p, len);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,133 @@
+/*
+ *  Modem response parsers
+ *
+ *  Plain C, without ESP-IDF or FreeRTOS dependencies, the parsers can be built
+ *  and measured on host together with gsm_metrics.c.
+ *
+*/
+
+
+#ifndef _GSM_PARSE_H_
+#define _GSM_PARSE_H_
+
+#include <stdint.h>
+#include <time.h>
+
+typedef struct
+{
+	int		idx;
+	char	*msg;
+	char	stat[32];
+	char	from[32];
+	char	time[32];
+	time_t	time_value;
+	int		tz;
+}SMS_Msg;
+
+typedef struct
+{
+	int		nmsg;
+	SMS_Msg	*messages;
+}SMS_Messages;
+
+// Network registration types
+#define GSM_REG_CS			0	// circuit switched, +CREG
+#define GSM_REG_GPRS		1	// GPRS, +CGREG
+#define GSM_REG_EPS			2	// LTE, +CEREG
+#define GSM_REG_TYPES		3
+
+// Registration status, home network or roaming is registered
+#define GSM_REG_HOME		1
+#define GSM_REG_ROAMING		5
+#define GSM_REG_REGISTERED(stat)	(((stat) == GSM_REG_HOME) || ((stat) == GSM_REG_ROAMING))
+
+// Network registration state
+typedef struct
+{
+	uint8_t		type;			// GSM_REG_xxx
+	uint8_t		stat;			// 0 not registered, 1 home, 2 searching, 3 denied, 4 unknown, 5 roaming
+	uint8_t		act;			// access technology (0 GSM, 3 EGPRS, 7 LTE, 8 LTE-M, 9 NB-IoT), 0 if not reported
+	uint16_t	lac;			// location (tracking) area code, 0 if not reported
+	uint32_t	ci;				// cell id, 0 if not reported
+}gsm_reg_t;
+
+// Unsolicited result code classes
+#define GSM_URC_NONE		0	// not an unsolicited line
+#define GSM_URC_RING		1	// RING
+#define GSM_URC_NOCARRIER	2	// NO CARRIER outside of a command (data connection lost)
+#define GSM_URC_REG			3	// +CREG, +CGREG, +CEREG network registration change
+#define GSM_URC_SMS			4	// +CMTI new message stored, +CMT new message
+#define GSM_URC_SIM			5	// +CPIN SIM state change
+#define GSM_URC_POWER		6	// under/over-voltage warnings, power down
+#define GSM_URC_READY		7	// RDY, +CFUN, Call Ready, SMS Ready (modem restarted)
+#define GSM_URC_TIME		8	// +CTZV, +CTZE, *PSUTTZ, DST network time update
+#define GSM_URC_PDP			9	// +PDP: DEACT, +CGEV packet data context change
+#define GSM_URC_NUM			10
+#define GSM_URC_MASK(urc)	(1UL << (urc))
+#define GSM_URC_ALL			0xFFFFFFFFUL
+
+/*
+ * Parse modem time string "yy/MM/dd,hh:mm:ss±zz" (+CCLK, SMS time stamp)
+ * 'tz' (if not NULL) is set to the time zone in quarters of an hour, 0 if not present
+ * Returns 1 on success, 0 if the string is not a valid time
+ */
+//=========================================================
+int gsm_parseTime(const char *str, struct tm *tm, int *tz);
+
+/*
+ * Count the messages in AT+CMGL response
+ */
+//======================================
+int gsm_parseSMSCount(const char *resp);
+
+/*
+ * Parse the next message in AT+CMGL response starting at '*resp' into 'msg'
+ * '*resp' is advanced past the parsed message
+ * The text is copied to 'text' buffer of 'text_size' bytes (truncated if longer),
+ * if 'text' is NULL the text buffer is allocated and must be freed by the caller
+ * Returns 1 if the message was parsed, 0 if it is not complete (or allocation failed),
+ * -1 if there are no more messages
+ */
+//===========================================================================
+int gsm_parseSMS(const char **resp, SMS_Msg *msg, char *text, int text_size);
+
+/*
+ * Classify the received line (without line end) as unsolicited result code
+ * 'cmd' is the command waiting for the response, NULL if there is none;
+ * the response lines of the command ("+CREG: " after "AT+CREG?") and final result codes
+ * (NO CARRIER) are not unsolicited while the command is waiting
+ * Returns GSM_URC_xxx class, GSM_URC_NONE if the line is not unsolicited
+ */
+//==================================================
+int gsm_parseURC(const char *line, const char *cmd);
+
+/*
+ * Check if the incomplete line of 'len' bytes can be the start of unsolicited result code
+ */
+//=============================================
+int gsm_isURCPrefix(const char *line, int len);
+
+/*
+ * Check if the response of 'len' bytes ends with the final result code line
+ * (OK, ERROR, +CME ERROR: <err> or +CMS ERROR: <err>)
+ */
+//===============================================
+int gsm_isFinalResult(const char *resp, int len);
+
+/*
+ * Parse network registration line, unsolicited "+CREG: <stat>[,<lac>,<ci>[,<act>]]"
+ * or response to AT+CREG? "+CREG: <n>,<stat>[,<lac>,<ci>[,<act>]]"; +CGREG and +CEREG are parsed the same way
+ * Returns 1 if the line was parsed, 0 if it is not a registration line
+ */
+//=================================================
+int gsm_parseReg(const char *line, gsm_reg_t *reg);
+
+/*
+ * Find PDP context 'cid' in AT+CGDCONT? response, "+CGDCONT: <cid>,"<type>","<apn>",..." line
+ * PDP type and APN are copied without quotes to 'type' and 'apn' of 'tsize' and 'asize' bytes (truncated if longer)
+ * Returns 1 if the context is defined, 0 if not
+ */
+//==============================================================================================
+int gsm_parsePDPContext(const char *resp, int cid, char *type, int tsize, char *apn, int asize);
+
+#endif
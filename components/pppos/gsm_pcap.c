@@ -0,0 +1,399 @@
+/*
+ *  PPP frame capture in pcap format
+ *
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "libGSM.h"
+#include "hdlc.h"
+#include "gsm_pcap.h"
+
+#ifdef CONFIG_GSM_PCAP
+
+#ifdef CONFIG_GSM_DEBUG
+#define GSM_DEBUG 1
+#else
+#define GSM_DEBUG 0
+#endif
+
+#define PCAPMUTEX_TIMEOUT	1000 / portTICK_RATE_MS
+#define PCAP_DUMP_LINE		32		// bytes per console dump line
+
+// Frame record header, kept in the ring before the frame data
+typedef struct
+{
+	uint32_t	sec;
+	uint32_t	usec;
+	uint16_t	len;		// captured length
+	uint16_t	orig;		// frame length
+	uint8_t		dir;
+	uint8_t		inst;
+	uint16_t	reserved;
+}pcap_rec_t;
+
+// HDLC deframing state of one direction
+typedef struct
+{
+	uint8_t		*buf;
+	int			len;
+	uint8_t		escape;
+}pcap_deframer_t;
+
+static uint8_t *pcap_mem = NULL;		// ring and deframer buffers
+static uint8_t *ring = NULL;
+static int ring_size = 0;
+static int ring_head = 0;				// next byte to write
+static int ring_tail = 0;				// oldest record
+static int ring_used = 0;
+static int ring_records = 0;
+static pcap_deframer_t deframer[GSM_MAX_MODEMS][2];
+static volatile uint8_t capturing = 0;
+static gsm_pcap_stats_t pcap_stats;
+
+static QueueHandle_t pcap_mutex = NULL;
+#ifdef CONFIG_GSM_STATIC_ALLOC
+static StaticSemaphore_t pcap_mutex_buf;
+#endif
+
+#if GSM_DEBUG
+static const char *TAG = "[GSM PCAP]";
+#endif
+
+
+//--------------------
+static int pcap_lock()
+{
+	if (pcap_mutex == NULL) {
+		#ifdef CONFIG_GSM_STATIC_ALLOC
+		pcap_mutex = xSemaphoreCreateMutexStatic(&pcap_mutex_buf);
+		#else
+		pcap_mutex = xSemaphoreCreateMutex();
+		#endif
+		if (pcap_mutex == NULL) return 0;
+	}
+	if (xSemaphoreTake(pcap_mutex, PCAPMUTEX_TIMEOUT) != pdTRUE) return 0;
+	return 1;
+}
+
+//-----------------------
+static void pcap_unlock()
+{
+	xSemaphoreGive(pcap_mutex);
+}
+
+// Copy data to the ring at 'pos', returns the next position
+//-----------------------------------------------------
+static int ring_put(int pos, const void *data, int len)
+{
+	int n = ring_size - pos;
+	if (n > len) n = len;
+	memcpy(ring + pos, data, n);
+	if (n < len) memcpy(ring, (const uint8_t *)data + n, len - n);
+	return (pos + len) % ring_size;
+}
+
+// Copy data from the ring at 'pos', returns the next position
+//-----------------------------------------------
+static int ring_get(int pos, void *data, int len)
+{
+	int n = ring_size - pos;
+	if (n > len) n = len;
+	memcpy(data, ring + pos, n);
+	if (n < len) memcpy((uint8_t *)data + n, ring, len - n);
+	return (pos + len) % ring_size;
+}
+
+// Add the frame to the ring, the oldest frames are dropped if there is no space
+// Called with the capture mutex taken
+//--------------------------------------------------------------------------------------
+static void pcap_add(uint8_t inst, uint8_t dir, const uint8_t *frame, int len, int orig)
+{
+	pcap_rec_t rec;
+	struct timeval tv;
+
+	int total = sizeof(pcap_rec_t) + len;
+	if (total > ring_size) return;
+
+	gettimeofday(&tv, NULL);
+	rec.sec = tv.tv_sec;
+	rec.usec = tv.tv_usec;
+	rec.len = len;
+	rec.orig = orig;
+	rec.dir = dir;
+	rec.inst = inst;
+	rec.reserved = 0;
+
+	while ((ring_size - ring_used) < total) {
+		pcap_rec_t old;
+		ring_get(ring_tail, &old, sizeof(pcap_rec_t));
+		ring_tail = (ring_tail + sizeof(pcap_rec_t) + old.len) % ring_size;
+		ring_used -= sizeof(pcap_rec_t) + old.len;
+		ring_records--;
+		pcap_stats.dropped++;
+	}
+	ring_head = ring_put(ring_head, &rec, sizeof(pcap_rec_t));
+	ring_head = ring_put(ring_head, frame, len);
+	ring_used += total;
+	ring_records++;
+	pcap_stats.frames++;
+	pcap_stats.bytes += len;
+	if (orig > len) pcap_stats.truncated++;
+}
+
+//==========================
+int gsm_pcap_start(int size)
+{
+	if (capturing) return 1;
+	if (size <= 0) size = GSM_PCAP_SIZE;
+
+	if (pcap_lock() == 0) return 0;
+	if (pcap_mem == NULL) {
+		int dsize = GSM_PCAP_FRAME_MAX + 2;	// frame and FCS
+		pcap_mem = gsm_bufAlloc(size + (GSM_MAX_MODEMS * 2 * dsize));
+		if (pcap_mem == NULL) {
+			pcap_unlock();
+			#if GSM_DEBUG
+			ESP_LOGE(TAG, "Failed to allocate capture buffer (%d bytes)", size);
+			#endif
+			return 0;
+		}
+		ring = pcap_mem;
+		ring_size = size;
+		ring_head = 0;
+		ring_tail = 0;
+		ring_used = 0;
+		ring_records = 0;
+		memset(&pcap_stats, 0, sizeof(gsm_pcap_stats_t));
+		for (int i=0; i<GSM_MAX_MODEMS; i++) {
+			for (int d=0; d<2; d++) {
+				deframer[i][d].buf = pcap_mem + size + (((i * 2) + d) * dsize);
+				deframer[i][d].len = 0;
+				deframer[i][d].escape = 0;
+			}
+		}
+	}
+	pcap_unlock();
+	capturing = 1;
+	return 1;
+}
+
+//==================
+void gsm_pcap_stop()
+{
+	capturing = 0;
+}
+
+//==================
+void gsm_pcap_free()
+{
+	capturing = 0;
+	if (pcap_lock() == 0) return;
+	if (pcap_mem) free(pcap_mem);
+	pcap_mem = NULL;
+	ring = NULL;
+	ring_size = 0;
+	pcap_unlock();
+}
+
+//==========================================================================
+void gsm_pcap_input(uint8_t inst, uint8_t dir, const uint8_t *data, int len)
+{
+	if ((capturing == 0) || (inst >= GSM_MAX_MODEMS) || (dir > GSM_PCAP_TX)) return;
+	if (pcap_lock() == 0) return;
+	if (ring == NULL) {
+		pcap_unlock();
+		return;
+	}
+
+	pcap_deframer_t *d = &deframer[inst][dir];
+	for (int i=0; i<len; i++) {
+		uint8_t c = data[i];
+		if (c == HDLC_FLAG) {
+			// End of frame, the FCS is not captured
+			if (d->len >= HDLC_MINFRAME) {
+				int orig = d->len - 2;
+				pcap_add(inst, dir, d->buf, (orig > GSM_PCAP_FRAME_MAX) ? GSM_PCAP_FRAME_MAX : orig, orig);
+			}
+			d->len = 0;
+			d->escape = 0;
+			continue;
+		}
+		if (c == HDLC_ESCAPE) {
+			d->escape = 1;
+			continue;
+		}
+		if (d->escape) {
+			c ^= HDLC_TRANS;
+			d->escape = 0;
+		}
+		if (d->len < (GSM_PCAP_FRAME_MAX + 2)) d->buf[d->len] = c;
+		else {
+			// keep the last two bytes (FCS) at the end of the buffer
+			d->buf[GSM_PCAP_FRAME_MAX] = d->buf[GSM_PCAP_FRAME_MAX+1];
+			d->buf[GSM_PCAP_FRAME_MAX+1] = c;
+		}
+		d->len++;
+	}
+	pcap_unlock();
+}
+
+//====================================================================
+int gsm_pcap_export(gsm_pcap_write_cb write, void *arg, uint8_t clear)
+{
+	if (ring == NULL) return -1;
+
+	// Global pcap header
+	uint32_t hdr[6] = {0xa1b2c3d4, 0x00040002, 0, 0, GSM_PCAP_FRAME_MAX + 1, GSM_PCAP_LINKTYPE};
+	if (write(arg, hdr, sizeof(hdr)) != sizeof(hdr)) return -1;
+
+	// Capture is paused during the export, so the exported records are not overwritten
+	uint8_t was_capturing = capturing;
+	capturing = 0;
+
+	static uint8_t frame[GSM_PCAP_FRAME_MAX + 1];
+	int nexp = 0;
+	int err = 0;
+
+	if (pcap_lock() == 0) return -1;
+	int pos = ring_tail;
+	int nrec = ring_records;
+	pcap_unlock();
+
+	for (int n=0; n<nrec; n++) {
+		pcap_rec_t rec;
+		if (pcap_lock() == 0) break;
+		pos = ring_get(pos, &rec, sizeof(pcap_rec_t));
+		frame[0] = rec.dir;
+		pos = ring_get(pos, frame + 1, rec.len);
+		pcap_unlock();
+
+		uint32_t phdr[4] = {rec.sec, rec.usec, rec.len + 1, rec.orig + 1};
+		if ((write(arg, phdr, sizeof(phdr)) != sizeof(phdr)) || (write(arg, frame, rec.len + 1) != (rec.len + 1))) {
+			err = 1;
+			break;
+		}
+		nexp++;
+	}
+
+	if ((clear) && (nexp > 0) && (pcap_lock())) {
+		// Remove the exported records
+		for (int n=0; n<nexp; n++) {
+			pcap_rec_t rec;
+			ring_get(ring_tail, &rec, sizeof(pcap_rec_t));
+			ring_tail = (ring_tail + sizeof(pcap_rec_t) + rec.len) % ring_size;
+			ring_used -= sizeof(pcap_rec_t) + rec.len;
+			ring_records--;
+		}
+		pcap_unlock();
+	}
+	capturing = was_capturing;
+	return (err) ? -1 : nexp;
+}
+
+//---------------------------------------------------------
+static int file_write(void *arg, const void *data, int len)
+{
+	return fwrite(data, 1, len, (FILE *)arg);
+}
+
+//=================================
+int gsm_pcap_save(const char *path)
+{
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) {
+		#if GSM_DEBUG
+		ESP_LOGE(TAG, "Error opening file '%s'", path);
+		#endif
+		return -1;
+	}
+	int res = gsm_pcap_export(file_write, f, 0);
+	fclose(f);
+	return res;
+}
+
+//------------------------------------------------------------
+static int console_write(void *arg, const void *data, int len)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	for (int i=0; i<len; i += PCAP_DUMP_LINE) {
+		printf("GSMPCAP:");
+		for (int b=i; (b<len) && (b<(i+PCAP_DUMP_LINE)); b++) printf("%02x", p[b]);
+		printf("\n");
+	}
+	return len;
+}
+
+//=================
+int gsm_pcap_dump()
+{
+	printf("GSMPCAP-BEGIN\n");
+	int res = gsm_pcap_export(console_write, NULL, 1);
+	printf("GSMPCAP-END\n");
+	return res;
+}
+
+//=============================================
+void gsm_pcap_getStats(gsm_pcap_stats_t *stats)
+{
+	if (pcap_lock() == 0) {
+		memset(stats, 0, sizeof(gsm_pcap_stats_t));
+		return;
+	}
+	memcpy(stats, &pcap_stats, sizeof(gsm_pcap_stats_t));
+	pcap_unlock();
+}
+
+#else
+
+//==========================
+int gsm_pcap_start(int size)
+{
+	return 0;
+}
+
+//==================
+void gsm_pcap_stop()
+{
+}
+
+//==================
+void gsm_pcap_free()
+{
+}
+
+//==========================================================================
+void gsm_pcap_input(uint8_t inst, uint8_t dir, const uint8_t *data, int len)
+{
+}
+
+//====================================================================
+int gsm_pcap_export(gsm_pcap_write_cb write, void *arg, uint8_t clear)
+{
+	return -1;
+}
+
+//=================================
+int gsm_pcap_save(const char *path)
+{
+	return -1;
+}
+
+//=================
+int gsm_pcap_dump()
+{
+	return -1;
+}
+
+//=============================================
+void gsm_pcap_getStats(gsm_pcap_stats_t *stats)
+{
+	memset(stats, 0, sizeof(gsm_pcap_stats_t));
+}
+
+#endif
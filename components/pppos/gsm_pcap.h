@@ -0,0 +1,108 @@
+/*
+ *  PPP frame capture in pcap format
+ *
+ *  Raw HDLC data received from and sent to the modem is deframed (unescaped, FCS removed)
+ *  and the timestamped PPP frames are recorded into a bounded ring buffer.
+ *  When the ring is full the oldest frames are dropped.
+ *  The capture is exported as pcap file (LINKTYPE_PPP_WITH_DIR, PPP in HDLC-like framing
+ *  with direction byte) which can be opened in Wireshark:
+ *    gsm_pcap_export()  through write callback
+ *    gsm_pcap_save()    to file (SPIFFS, FAT on flash or SD card)
+ *    gsm_pcap_dump()    to console as hex lines, convert them with tools/gsm_pcap.py
+ *
+ *  Capture is available if CONFIG_GSM_PCAP is set.
+ *
+*/
+
+
+#ifndef _GSM_PCAP_H_
+#define _GSM_PCAP_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#ifdef CONFIG_GSM_PCAP_SIZE
+#define GSM_PCAP_SIZE		CONFIG_GSM_PCAP_SIZE
+#else
+#define GSM_PCAP_SIZE		32768
+#endif
+#define GSM_PCAP_FRAME_MAX	1600	// longer frames are truncated
+#define GSM_PCAP_LINKTYPE	204		// LINKTYPE_PPP_WITH_DIR
+
+#define GSM_PCAP_RX			0		// frame received from the modem
+#define GSM_PCAP_TX			1		// frame sent to the modem
+
+#ifdef CONFIG_GSM_PCAP
+#define GSM_PCAP(inst, dir, data, len)	gsm_pcap_input((inst), (dir), (data), (len))
+#else
+#define GSM_PCAP(inst, dir, data, len)	((void)0)
+#endif
+
+typedef struct
+{
+	uint32_t	frames;			// captured frames
+	uint32_t	bytes;			// captured frame bytes
+	uint32_t	dropped;		// oldest frames dropped from the full ring
+	uint32_t	truncated;		// frames longer than GSM_PCAP_FRAME_MAX
+}gsm_pcap_stats_t;
+
+// Export write callback, returns the number of bytes written or negative value on error
+typedef int (*gsm_pcap_write_cb)(void *arg, const void *data, int len);
+
+/*
+ * Allocate the capture ring of 'size' bytes (GSM_PCAP_SIZE if 0) and start capturing
+ * The ring is allocated in PSRAM if CONFIG_GSM_BUF_PSRAM is set
+ * Returns 1 on success, 0 on error
+ */
+//===========================
+int gsm_pcap_start(int size);
+
+/*
+ * Stop capturing, the captured frames are kept until exported or gsm_pcap_free() is called
+ */
+//===================
+void gsm_pcap_stop();
+
+/*
+ * Stop capturing and free the capture ring
+ */
+//===================
+void gsm_pcap_free();
+
+/*
+ * Pass raw (HDLC framed) data sent or received by GSM instance 'inst' to the capture
+ * Called by libGSM, 'dir' is GSM_PCAP_RX or GSM_PCAP_TX
+ */
+//===========================================================================
+void gsm_pcap_input(uint8_t inst, uint8_t dir, const uint8_t *data, int len);
+
+/*
+ * Write the captured frames as pcap file through 'write' callback
+ * If 'clear' = 1 the exported frames are removed from the ring
+ * Returns the number of exported frames or -1 on error
+ */
+//=====================================================================
+int gsm_pcap_export(gsm_pcap_write_cb write, void *arg, uint8_t clear);
+
+/*
+ * Save the captured frames to pcap file, the file system must be mounted
+ * Returns the number of saved frames or -1 on error
+ */
+//==================================
+int gsm_pcap_save(const char *path);
+
+/*
+ * Print the pcap file to console as hex lines between "GSMPCAP-BEGIN" and "GSMPCAP-END"
+ * The exported frames are removed from the ring
+ * Returns the number of exported frames or -1 on error
+ */
+//==================
+int gsm_pcap_dump();
+
+/*
+ * Get the capture statistics
+ */
+//==============================================
+void gsm_pcap_getStats(gsm_pcap_stats_t *stats);
+
+#endif
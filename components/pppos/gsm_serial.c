@@ -0,0 +1,378 @@
+/*
+ *  Serial port abstraction, UART recording and replay
+ *
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "libGSM.h"
+#include "gsm_serial.h"
+
+#ifdef CONFIG_GSM_DEBUG
+#define GSM_DEBUG 1
+#else
+#define GSM_DEBUG 0
+#endif
+
+#define RECMUTEX_TIMEOUT	1000 / portTICK_RATE_MS
+#define REC_DUMP_LINE		32		// bytes per console dump line
+
+#if GSM_DEBUG
+static const char *TAG = "[GSM SERIAL]";
+#endif
+
+#ifdef CONFIG_GSM_SERIAL_RECORD
+
+static uint8_t *rec_buf = NULL;
+static int rec_size = 0;
+static int rec_len = 0;
+static uint32_t rec_lost = 0;
+static uint8_t rec_full = 0;
+static int64_t rec_start = 0;
+static volatile uint8_t recording = 0;
+
+static QueueHandle_t rec_mutex = NULL;
+#ifdef CONFIG_GSM_STATIC_ALLOC
+static StaticSemaphore_t rec_mutex_buf;
+#endif
+
+
+//-------------------
+static int rec_lock()
+{
+	if (rec_mutex == NULL) {
+		#ifdef CONFIG_GSM_STATIC_ALLOC
+		rec_mutex = xSemaphoreCreateMutexStatic(&rec_mutex_buf);
+		#else
+		rec_mutex = xSemaphoreCreateMutex();
+		#endif
+		if (rec_mutex == NULL) return 0;
+	}
+	if (xSemaphoreTake(rec_mutex, RECMUTEX_TIMEOUT) != pdTRUE) return 0;
+	return 1;
+}
+
+//----------------------
+static void rec_unlock()
+{
+	xSemaphoreGive(rec_mutex);
+}
+
+//============================
+int gsm_record_start(int size)
+{
+	if (size <= 0) size = GSM_RECORD_SIZE;
+	if (size < (sizeof(gsm_rec_header_t) + sizeof(gsm_rec_event_t))) return 0;
+
+	recording = 0;
+	if (rec_lock() == 0) return 0;
+	if ((rec_buf) && (rec_size != size)) {
+		free(rec_buf);
+		rec_buf = NULL;
+	}
+	if (rec_buf == NULL) rec_buf = gsm_bufAlloc(size);
+	if (rec_buf == NULL) {
+		rec_unlock();
+		#if GSM_DEBUG
+		ESP_LOGE(TAG, "Failed to allocate recording buffer (%d bytes)", size);
+		#endif
+		return 0;
+	}
+	rec_size = size;
+
+	gsm_rec_header_t hdr = { {'G', 'S', 'M', 'R'}, GSM_RECORD_VERSION, {0, 0, 0} };
+	memcpy(rec_buf, &hdr, sizeof(gsm_rec_header_t));
+	rec_len = sizeof(gsm_rec_header_t);
+	rec_lost = 0;
+	rec_full = 0;
+	rec_start = esp_timer_get_time();
+	recording = 1;
+	rec_unlock();
+	return 1;
+}
+
+//====================
+void gsm_record_stop()
+{
+	recording = 0;
+}
+
+//====================
+void gsm_record_free()
+{
+	recording = 0;
+	if (rec_lock() == 0) return;
+	if (rec_buf) free(rec_buf);
+	rec_buf = NULL;
+	rec_size = 0;
+	rec_len = 0;
+	rec_unlock();
+}
+
+//============================================================================
+void gsm_record_input(uint8_t inst, uint8_t dir, const uint8_t *data, int len)
+{
+	if ((recording == 0) || (len <= 0)) return;
+
+	gsm_rec_event_t ev;
+	ev.time = (uint32_t)(esp_timer_get_time() - rec_start);
+	ev.dir = dir;
+	ev.inst = inst;
+
+	if (rec_lock() == 0) return;
+	if (recording) {
+		while (len > 0) {
+			ev.len = (len > 0xFFFF) ? 0xFFFF : len;
+			if ((rec_full) || ((rec_len + sizeof(gsm_rec_event_t) + ev.len) > rec_size)) {
+				// Buffer full, the rest of the session is not recorded
+				rec_lost += len;
+				rec_full = 1;
+				break;
+			}
+			memcpy(rec_buf + rec_len, &ev, sizeof(gsm_rec_event_t));
+			memcpy(rec_buf + rec_len + sizeof(gsm_rec_event_t), data, ev.len);
+			rec_len += sizeof(gsm_rec_event_t) + ev.len;
+			data += ev.len;
+			len -= ev.len;
+		}
+	}
+	rec_unlock();
+}
+
+//======================================================
+const uint8_t *gsm_record_get(int *size, uint32_t *lost)
+{
+	if (rec_lock() == 0) return NULL;
+	const uint8_t *rec = rec_buf;
+	*size = (rec_buf) ? rec_len : 0;
+	if (lost) *lost = rec_lost;
+	rec_unlock();
+	return rec;
+}
+
+//===================================
+int gsm_record_save(const char *path)
+{
+	int size;
+	const uint8_t *rec = gsm_record_get(&size, NULL);
+	if (rec == NULL) return -1;
+
+	FILE *f = fopen(path, "wb");
+	if (f == NULL) {
+		#if GSM_DEBUG
+		ESP_LOGE(TAG, "Error opening file '%s'", path);
+		#endif
+		return -1;
+	}
+	int res = fwrite(rec, 1, size, f);
+	fclose(f);
+	return (res == size) ? size : -1;
+}
+
+//===================
+int gsm_record_dump()
+{
+	int size;
+	uint32_t lost;
+	const uint8_t *rec = gsm_record_get(&size, &lost);
+	if (rec == NULL) return -1;
+
+	printf("GSMREC-BEGIN\n");
+	for (int i=0; i<size; i += REC_DUMP_LINE) {
+		printf("GSMREC:");
+		for (int b=i; (b<size) && (b<(i+REC_DUMP_LINE)); b++) printf("%02x", rec[b]);
+		printf("\n");
+	}
+	if (lost) printf("GSMREC-LOST:%u\n", lost);
+	printf("GSMREC-END\n");
+	return size;
+}
+
+#else
+
+//============================
+int gsm_record_start(int size)
+{
+	return 0;
+}
+
+//====================
+void gsm_record_stop()
+{
+}
+
+//====================
+void gsm_record_free()
+{
+}
+
+//============================================================================
+void gsm_record_input(uint8_t inst, uint8_t dir, const uint8_t *data, int len)
+{
+}
+
+//======================================================
+const uint8_t *gsm_record_get(int *size, uint32_t *lost)
+{
+	*size = 0;
+	if (lost) *lost = 0;
+	return NULL;
+}
+
+//===================================
+int gsm_record_save(const char *path)
+{
+	return -1;
+}
+
+//===================
+int gsm_record_dump()
+{
+	return -1;
+}
+
+#endif
+
+
+// ==== Replay ====
+
+// Find the next data block of the replayed instance in direction 'dir', starting at 'pos'
+// Returns the block position or the recording size if there are no more blocks
+//---------------------------------------------------------------------------------
+static int _replayNext(gsm_replay_t *rp, int pos, uint8_t dir, gsm_rec_event_t *ev)
+{
+	while ((pos + sizeof(gsm_rec_event_t)) <= rp->size) {
+		memcpy(ev, rp->rec + pos, sizeof(gsm_rec_event_t));
+		if ((pos + sizeof(gsm_rec_event_t) + ev->len) > rp->size) break;
+		if ((ev->inst == rp->inst) && (ev->dir == dir)) return pos;
+		pos += sizeof(gsm_rec_event_t) + ev->len;
+	}
+	return rp->size;
+}
+
+//----------------------------------------
+static void _replayStart(gsm_replay_t *rp)
+{
+	if (rp->t_start != 0) return;
+	rp->t_start = esp_timer_get_time();
+	rp->t_base = rp->t_start;
+	rp->ev_base = 0;
+}
+
+//-----------------------------------
+static void _replayDelay(uint32_t ms)
+{
+	TickType_t ticks = ms / portTICK_PERIOD_MS;
+	if (ticks > 0) vTaskDelay(ticks);
+}
+
+// Deliver the recorded received data after the recorded data written before it was written
+// and the recorded time from that write has passed
+//---------------------------------------------------------------------------
+static int _replayRead(void *arg, uint8_t *buf, int len, uint32_t timeout_ms)
+{
+	gsm_replay_t *rp = (gsm_replay_t *)arg;
+	gsm_rec_event_t ev;
+
+	_replayStart(rp);
+	rp->tx_pos = _replayNext(rp, rp->tx_pos, GSM_REC_TX, &ev);
+	rp->rx_pos = _replayNext(rp, rp->rx_pos, GSM_REC_RX, &ev);
+
+	if ((rp->rx_pos < rp->size) && (rp->rx_pos < rp->tx_pos)) {
+		int64_t due = rp->t_base;
+		if (rp->speed > 0) due += (int32_t)(ev.time - rp->ev_base) / rp->speed;
+		int64_t wait = due - esp_timer_get_time();
+		if (wait <= ((int64_t)timeout_ms * 1000)) {
+			if (wait > 0) _replayDelay(wait / 1000);
+			int n = ev.len - rp->rx_off;
+			if (n > len) n = len;
+			memcpy(buf, rp->rec + rp->rx_pos + sizeof(gsm_rec_event_t) + rp->rx_off, n);
+			rp->rx_off += n;
+			if (rp->rx_off >= ev.len) {
+				rp->rx_pos += sizeof(gsm_rec_event_t) + ev.len;
+				rp->rx_off = 0;
+			}
+			rp->rx_bytes += n;
+			rp->t_end = esp_timer_get_time();
+			return n;
+		}
+	}
+	_replayDelay(timeout_ms);
+	return 0;
+}
+
+// Compare the written data with the recorded one, the following received data is timed from now
+//--------------------------------------------------------------
+static int _replayWrite(void *arg, const uint8_t *data, int len)
+{
+	gsm_replay_t *rp = (gsm_replay_t *)arg;
+	gsm_rec_event_t ev;
+	int i = 0;
+
+	_replayStart(rp);
+	while (i < len) {
+		rp->tx_pos = _replayNext(rp, rp->tx_pos, GSM_REC_TX, &ev);
+		if (rp->tx_pos >= rp->size) {
+			// written more than recorded
+			rp->tx_mismatch += len - i;
+			break;
+		}
+		const uint8_t *rec = rp->rec + rp->tx_pos + sizeof(gsm_rec_event_t);
+		while ((i < len) && (rp->tx_off < ev.len)) {
+			if (data[i++] != rec[rp->tx_off++]) rp->tx_mismatch++;
+		}
+		rp->ev_base = ev.time;
+		if (rp->tx_off >= ev.len) {
+			rp->tx_pos += sizeof(gsm_rec_event_t) + ev.len;
+			rp->tx_off = 0;
+		}
+	}
+	rp->tx_bytes += len;
+	rp->t_base = esp_timer_get_time();
+	return len;
+}
+
+const gsm_serial_t gsm_replay_serial = {
+	.read = _replayRead,
+	.write = _replayWrite,
+	.flush = NULL,
+	.errors = NULL
+};
+
+//==========================================================================================
+int gsm_replay_init(gsm_replay_t *rp, const uint8_t *rec, int size, uint8_t inst, int speed)
+{
+	gsm_rec_header_t hdr;
+
+	memset(rp, 0, sizeof(gsm_replay_t));
+	if ((rec == NULL) || (size < sizeof(gsm_rec_header_t))) return 0;
+	memcpy(&hdr, rec, sizeof(gsm_rec_header_t));
+	if ((memcmp(hdr.magic, "GSMR", 4) != 0) || (hdr.version != GSM_RECORD_VERSION)) {
+		#if GSM_DEBUG
+		ESP_LOGE(TAG, "Not a valid recording");
+		#endif
+		return 0;
+	}
+	rp->rec = rec;
+	rp->size = size;
+	rp->inst = inst;
+	rp->speed = (speed < 0) ? 1 : speed;
+	rp->rx_pos = sizeof(gsm_rec_header_t);
+	rp->tx_pos = sizeof(gsm_rec_header_t);
+	return 1;
+}
+
+//===================================
+int gsm_replay_done(gsm_replay_t *rp)
+{
+	gsm_rec_event_t ev;
+	rp->tx_pos = _replayNext(rp, rp->tx_pos, GSM_REC_TX, &ev);
+	rp->rx_pos = _replayNext(rp, rp->rx_pos, GSM_REC_RX, &ev);
+	return ((rp->rx_pos >= rp->size) && (rp->tx_pos >= rp->size));
+}
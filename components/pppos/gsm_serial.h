@@ -0,0 +1,164 @@
+/*
+ *  Serial port abstraction, UART recording and replay
+ *
+ *  libGSM accesses the modem through the UART driver, unless serial port operations
+ *  are set in the instance configuration (gsm_config_t.serial), then all reads and writes
+ *  are done through them and the UART driver is not used.
+ *
+ *  Recording (CONFIG_GSM_SERIAL_RECORD) logs the raw byte stream read from and written
+ *  to the modem, with timestamps, into a memory buffer. The recording can be saved to a file
+ *  or dumped to console, tools/gsm_rec.py converts the dump to a recording file and prints
+ *  its timeline and timings.
+ *
+ *  The replay backend (gsm_replay_serial) feeds a recording back into libGSM at real or
+ *  accelerated speed: received data is delivered with the recorded delays after the data
+ *  which preceded it was written, written data is compared with the recorded one.
+ *  The AT command phase (initialization, SMS, ...) is replayed deterministically,
+ *  PPP negotiation is not, as it depends on random values (LCP magic number).
+ *
+ *  Recording file layout (little endian):
+ *    header:  'G','S','M','R', u8 version, 3 reserved bytes
+ *    records: u32 time (us from the recording start), u16 length, u8 direction, u8 instance, data
+ *
+*/
+
+
+#ifndef _GSM_SERIAL_H_
+#define _GSM_SERIAL_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#ifdef CONFIG_GSM_SERIAL_RECORD_SIZE
+#define GSM_RECORD_SIZE			CONFIG_GSM_SERIAL_RECORD_SIZE
+#else
+#define GSM_RECORD_SIZE			65536
+#endif
+#define GSM_RECORD_VERSION		1
+
+#define GSM_REC_RX				0		// data read from the modem
+#define GSM_REC_TX				1		// data written to the modem
+
+#ifdef CONFIG_GSM_SERIAL_RECORD
+#define GSM_RECORD(inst, dir, data, len)	gsm_record_input((inst), (dir), (data), (len))
+#else
+#define GSM_RECORD(inst, dir, data, len)	((void)0)
+#endif
+
+// Serial port operations, 'arg' is gsm_config_t.serial_arg
+typedef struct
+{
+	// Read up to 'len' bytes, wait up to 'timeout_ms' for data, returns the number of bytes read
+	int		(*read)(void *arg, uint8_t *buf, int len, uint32_t timeout_ms);
+	// Write 'len' bytes, returns the number of bytes written
+	int		(*write)(void *arg, const uint8_t *data, int len);
+	// Discard received data not read yet, can be NULL
+	void	(*flush)(void *arg);
+	// Get and clear the receive errors since the last call, UART FIFO overflows and RX buffer full events; can be NULL
+	void	(*errors)(void *arg, uint32_t *fifo_overflows, uint32_t *buffer_full);
+}gsm_serial_t;
+
+// Recording header
+typedef struct
+{
+	uint8_t		magic[4];		// 'G','S','M','R'
+	uint8_t		version;
+	uint8_t		reserved[3];
+}gsm_rec_header_t;
+
+// Recorded data block header, followed by 'len' data bytes
+typedef struct
+{
+	uint32_t	time;			// microseconds from the recording start
+	uint16_t	len;
+	uint8_t		dir;			// GSM_REC_RX or GSM_REC_TX
+	uint8_t		inst;			// GSM instance index
+}gsm_rec_event_t;
+
+// Replay state, used as gsm_config_t.serial_arg with gsm_replay_serial
+typedef struct
+{
+	const uint8_t	*rec;		// recording
+	int			size;
+	uint8_t		inst;			// instance whose data is replayed
+	int			speed;			// 1 = recorded timing, N = N times faster, 0 = no delays
+	int			rx_pos;			// next received data block
+	int			rx_off;			// bytes already delivered from it
+	int			tx_pos;			// next written data block
+	int			tx_off;			// bytes already compared
+	int64_t		t_base;			// time of the last write
+	uint32_t	ev_base;		// recorded time of the last write
+	int64_t		t_start;		// replay start time
+	int64_t		t_end;			// time of the last delivered data
+	uint32_t	rx_bytes;		// delivered bytes
+	uint32_t	tx_bytes;		// written bytes
+	uint32_t	tx_mismatch;	// written bytes different from the recording
+}gsm_replay_t;
+
+// Replay serial port operations
+extern const gsm_serial_t gsm_replay_serial;
+
+/*
+ * Allocate the recording buffer of 'size' bytes (GSM_RECORD_SIZE if 0) and start recording
+ * The previous recording is discarded, recording stops when the buffer is full
+ * Returns 1 on success, 0 on error
+ */
+//=============================
+int gsm_record_start(int size);
+
+/*
+ * Stop recording, the recording is kept until gsm_record_free() or gsm_record_start() is called
+ */
+//=====================
+void gsm_record_stop();
+
+/*
+ * Stop recording and free the recording buffer
+ */
+//=====================
+void gsm_record_free();
+
+/*
+ * Record the data read from or written to the modem by GSM instance 'inst'
+ * Called by libGSM, 'dir' is GSM_REC_RX or GSM_REC_TX
+ */
+//=============================================================================
+void gsm_record_input(uint8_t inst, uint8_t dir, const uint8_t *data, int len);
+
+/*
+ * Get the recording and its size, recording must be stopped before the data is used
+ * 'lost' (if not NULL) is set to the number of bytes not recorded because the buffer was full
+ * Returns NULL if there is no recording
+ */
+//=======================================================
+const uint8_t *gsm_record_get(int *size, uint32_t *lost);
+
+/*
+ * Save the recording to file, the file system must be mounted
+ * Returns the number of bytes written or -1 on error
+ */
+//====================================
+int gsm_record_save(const char *path);
+
+/*
+ * Print the recording to console as hex lines between "GSMREC-BEGIN" and "GSMREC-END"
+ * Returns the recording size or -1 on error
+ */
+//====================
+int gsm_record_dump();
+
+/*
+ * Prepare the replay of GSM instance 'inst' data from the recording 'rec' of 'size' bytes
+ * The recording must stay valid during the replay
+ * Returns 1 on success, 0 if the recording is not valid
+ */
+//===========================================================================================
+int gsm_replay_init(gsm_replay_t *rp, const uint8_t *rec, int size, uint8_t inst, int speed);
+
+/*
+ * Returns 1 if all recorded data was delivered and all recorded writes were done
+ */
+//====================================
+int gsm_replay_done(gsm_replay_t *rp);
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ *  Binary trace ring for libGSM hot path events
+ *
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "gsm_trace.h"
+
+#ifdef CONFIG_GSM_TRACE
+
+#define GSM_TRACE_MASK		(GSM_TRACE_SIZE - 1)
+#define GSM_TRACE_STACK		2048
+#define GSM_TRACE_CHUNK		16		// records printed at once
+
+#if (GSM_TRACE_SIZE & GSM_TRACE_MASK) != 0
+#error "GSM_TRACE_SIZE must be a power of 2"
+#endif
+
+static gsm_trace_rec_t trace_ring[GSM_TRACE_SIZE];
+static volatile uint32_t trace_head = 0;	// next record to write, incremented atomically by writers
+static uint32_t trace_tail = 0;				// next record to read, used only by the reader
+static uint32_t trace_period = 1000;
+
+#ifdef CONFIG_GSM_STATIC_ALLOC
+static StaticTask_t trace_task_buf;
+static StackType_t trace_task_stack[GSM_TRACE_STACK];
+#endif
+static TaskHandle_t trace_task = NULL;
+
+
+//========================================================================
+void gsm_trace_add(uint8_t id, uint8_t inst, uint16_t arg0, uint32_t arg1)
+{
+	// Claim the record, writers never wait for each other
+	uint32_t n = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+	gsm_trace_rec_t *rec = &trace_ring[n & GSM_TRACE_MASK];
+
+	__atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	rec->ts = (uint32_t)esp_timer_get_time();
+	rec->id = id;
+	rec->inst = inst;
+	rec->arg0 = arg0;
+	rec->arg1 = arg1;
+	// Record is valid when its sequence number is set
+	__atomic_store_n(&rec->seq, n + 1, __ATOMIC_RELEASE);
+}
+
+//================================================================
+int gsm_trace_read(gsm_trace_rec_t *recs, int max, uint32_t *lost)
+{
+	uint32_t head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+	uint32_t nlost = 0;
+	int nrec = 0;
+
+	if ((head - trace_tail) > GSM_TRACE_SIZE) {
+		// Reader was too slow, the oldest records were overwritten
+		nlost = head - trace_tail - GSM_TRACE_SIZE;
+		trace_tail = head - GSM_TRACE_SIZE;
+	}
+	while ((trace_tail != head) && (nrec < max)) {
+		gsm_trace_rec_t *rec = &trace_ring[trace_tail & GSM_TRACE_MASK];
+		memcpy(&recs[nrec], rec, sizeof(gsm_trace_rec_t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		uint32_t seq = recs[nrec].seq;
+		// The record is still being written, read it later
+		if ((seq == 0) || ((int32_t)(seq - (trace_tail + 1)) < 0)) break;
+		// Valid if it was not overwritten by newer record, before or during the copy
+		if ((seq == (trace_tail + 1)) && (__atomic_load_n(&rec->seq, __ATOMIC_RELAXED) == seq)) nrec++;
+		else nlost++;
+		trace_tail++;
+	}
+	if (lost) *lost = nlost;
+	return nrec;
+}
+
+//==================
+int gsm_trace_dump()
+{
+	gsm_trace_rec_t recs[GSM_TRACE_CHUNK];
+	uint32_t lost;
+	int total = 0;
+
+	while (1) {
+		int n = gsm_trace_read(recs, GSM_TRACE_CHUNK, &lost);
+		if (lost) printf("GSMTRC-LOST:%u\n", lost);
+		if (n == 0) break;
+		for (int i=0; i<n; i++) {
+			uint8_t *p = (uint8_t *)&recs[i];
+			printf("GSMTRC:");
+			for (int b=0; b<sizeof(gsm_trace_rec_t); b++) printf("%02x", p[b]);
+			printf("\n");
+		}
+		total += n;
+	}
+	return total;
+}
+
+//----------------------------------
+static void trace_task_fn(void *arg)
+{
+	while (1) {
+		vTaskDelay(trace_period / portTICK_PERIOD_MS);
+		gsm_trace_dump();
+	}
+}
+
+//=======================================================
+int gsm_trace_startTask(int priority, uint32_t period_ms)
+{
+	if (trace_task != NULL) return 1;
+	if (period_ms > 0) trace_period = period_ms;
+
+	#ifdef CONFIG_GSM_STATIC_ALLOC
+	trace_task = xTaskCreateStatic(&trace_task_fn, "gsm_trace", GSM_TRACE_STACK, NULL, priority, trace_task_stack, &trace_task_buf);
+	#else
+	xTaskCreate(&trace_task_fn, "gsm_trace", GSM_TRACE_STACK, NULL, priority, &trace_task);
+	#endif
+	return (trace_task != NULL);
+}
+
+#else
+
+//========================================================================
+void gsm_trace_add(uint8_t id, uint8_t inst, uint16_t arg0, uint32_t arg1)
+{
+}
+
+//================================================================
+int gsm_trace_read(gsm_trace_rec_t *recs, int max, uint32_t *lost)
+{
+	if (lost) *lost = 0;
+	return 0;
+}
+
+//==================
+int gsm_trace_dump()
+{
+	return 0;
+}
+
+//=======================================================
+int gsm_trace_startTask(int priority, uint32_t period_ms)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ *  Binary trace ring for libGSM hot path events
+ *
+ *  Events are recorded as fixed size binary records (timestamp, event id, instance, arguments)
+ *  into a lock-free ring buffer, no string formatting is done when the event is recorded.
+ *  The ring is drained by gsm_trace_read(), dumped to console with gsm_trace_dump()
+ *  or periodically by the low priority task started with gsm_trace_startTask().
+ *  Console dump lines ("GSMTRC:<hex>") are decoded on host with tools/gsm_trace.py
+ *
+ *  Tracing is enabled with CONFIG_GSM_TRACE, otherwise GSM_TRACE() compiles to nothing.
+ *
+*/
+
+
+#ifndef _GSM_TRACE_H_
+#define _GSM_TRACE_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#ifdef CONFIG_GSM_TRACE_SIZE
+#define GSM_TRACE_SIZE		CONFIG_GSM_TRACE_SIZE
+#else
+#define GSM_TRACE_SIZE		256
+#endif
+
+// Event ids, keep in sync with tools/gsm_trace.py
+#define GSM_TRC_UART_RX		1	// arg0: bytes read, arg1: bytes passed to lwIP
+#define GSM_TRC_UART_TX		2	// arg0: bytes written
+#define GSM_TRC_UART_EVENT	3	// arg0: uart_event_type_t (overflow, buffer full, frame error)
+#define GSM_TRC_AT_SEND		4	// arg0: command length, arg1: 4 command characters after "AT"
+#define GSM_TRC_AT_RESP		5	// arg0: result (0 error, 1 ok, 2 alternative ok, 0xFFFF timeout), arg1: latency in us
+#define GSM_TRC_PPP_STATUS	6	// arg0: PPPERR_xxx code
+#define GSM_TRC_STATE		7	// arg0: new GSM_STATE_xxx
+#define GSM_TRC_FCS_ERR		8	// arg0: frames with bad FCS, arg1: frames checked
+#define GSM_TRC_URC			9	// arg0: GSM_URC_xxx class of the unsolicited result code
+#define GSM_TRC_USER		128	// first id available for application events
+
+// Trace record, 16 bytes
+typedef struct
+{
+	uint32_t	seq;		// record sequence number + 1, 0 if the record is being written
+	uint32_t	ts;			// timestamp, low 32 bits of esp_timer time in microseconds
+	uint8_t		id;			// event id
+	uint8_t		inst;		// GSM instance index
+	uint16_t	arg0;
+	uint32_t	arg1;
+}gsm_trace_rec_t;
+
+#ifdef CONFIG_GSM_TRACE
+#define GSM_TRACE(id, inst, arg0, arg1)	gsm_trace_add((id), (inst), (arg0), (arg1))
+#else
+#define GSM_TRACE(id, inst, arg0, arg1)	((void)0)
+#endif
+
+/*
+ * Record the event, safe to call from any task, does not block
+ */
+//=========================================================================
+void gsm_trace_add(uint8_t id, uint8_t inst, uint16_t arg0, uint32_t arg1);
+
+/*
+ * Read up to 'max' records which were not read yet
+ * Records overwritten before they were read are counted in 'lost' (if not NULL)
+ * Only one reader (task) should be used
+ * Returns the number of records read
+ */
+//=================================================================
+int gsm_trace_read(gsm_trace_rec_t *recs, int max, uint32_t *lost);
+
+/*
+ * Print the records which were not read yet to console as "GSMTRC:<hex>" lines
+ * Returns the number of printed records
+ */
+//===================
+int gsm_trace_dump();
+
+/*
+ * Start the low priority task which dumps the trace every 'period_ms' miliseconds
+ * Returns 1 on success, 0 on error
+ */
+//========================================================
+int gsm_trace_startTask(int priority, uint32_t period_ms);
+
+#endif
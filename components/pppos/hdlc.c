@@ -0,0 +1,201 @@
+/*
+ *  HDLC-like framing (RFC 1662) helpers for the PPPoS data path
+ *
+*/
+
+#include <string.h>
+#include "hdlc.h"
+
+
+// True if any byte of the word is zero
+#define HAS_ZERO(v)		(((v) - 0x01010101UL) & ~(v) & 0x80808080UL)
+// True if any byte of the word is the flag or the escape character
+#define HAS_SPECIAL(v)	(HAS_ZERO((v) ^ 0x7E7E7E7EUL) | HAS_ZERO((v) ^ 0x7D7D7D7DUL))
+// True if any byte of the word is a control character (< 0x20)
+#define HAS_CONTROL(v)	(((v) - 0x20202020UL) & ~(v) & 0x80808080UL)
+
+// Slice-by-4 FCS-16 tables, fcs_tab[0] is the standard byte table
+// Built on first use, kept in RAM which is faster than table in flash
+static uint16_t fcs_tab[4][256];
+static uint8_t fcs_tab_ready = 0;
+
+
+//------------------------
+static void fcs_tab_init()
+{
+	for (int i=0; i<256; i++) {
+		uint16_t c = i;
+		for (int b=0; b<8; b++) c = (c & 1) ? ((c >> 1) ^ 0x8408) : (c >> 1);
+		fcs_tab[0][i] = c;
+	}
+	for (int k=1; k<4; k++) {
+		for (int i=0; i<256; i++) {
+			uint16_t c = fcs_tab[k-1][i];
+			fcs_tab[k][i] = (c >> 8) ^ fcs_tab[0][c & 0xFF];
+		}
+	}
+	fcs_tab_ready = 1;
+}
+
+// Update FCS with one 32-bit little endian word (4 data bytes)
+//-------------------------------------------------------
+static inline uint16_t fcs_word(uint16_t fcs, uint32_t w)
+{
+	uint32_t v = fcs ^ w;
+	return fcs_tab[3][v & 0xFF] ^ fcs_tab[2][(v >> 8) & 0xFF] ^ fcs_tab[1][(v >> 16) & 0xFF] ^ fcs_tab[0][v >> 24];
+}
+
+//===============================
+void hdlc_reset(hdlc_state_t *st)
+{
+	st->fcs = HDLC_INITFCS;
+	st->escape = 0;
+	st->len = 0;
+}
+
+//=============================================================
+uint16_t hdlc_fcs16(uint16_t fcs, const uint8_t *data, int len)
+{
+	if (fcs_tab_ready == 0) fcs_tab_init();
+
+	int i = 0;
+	while ((i < len) && (((uintptr_t)(data + i)) & 3)) {
+		fcs = (fcs >> 8) ^ fcs_tab[0][(fcs ^ data[i++]) & 0xFF];
+	}
+	for (; (i + 4) <= len; i += 4) fcs = fcs_word(fcs, *(const uint32_t *)(data + i));
+	while (i < len) {
+		fcs = (fcs >> 8) ^ fcs_tab[0][(fcs ^ data[i++]) & 0xFF];
+	}
+	return fcs;
+}
+
+//=================================================================================================================
+void hdlc_scan(hdlc_state_t *st, const uint8_t *data, int len, uint32_t *frames, uint32_t *errors, uint32_t *bytes)
+{
+	if (fcs_tab_ready == 0) fcs_tab_init();
+
+	uint16_t fcs = st->fcs;
+	uint32_t flen = st->len;
+	uint8_t esc = st->escape;
+	int i = 0;
+
+	while (i < len) {
+		// ** Fast path: aligned words without special characters (ESP32 is little endian)
+		if ((esc == 0) && ((((uintptr_t)(data + i)) & 3) == 0)) {
+			int start = i;
+			while ((i + 4) <= len) {
+				uint32_t w = *(const uint32_t *)(data + i);
+				if (HAS_SPECIAL(w)) break;
+				fcs = fcs_word(fcs, w);
+				i += 4;
+			}
+			flen += i - start;
+			if (i >= len) break;
+		}
+
+		// ** Slow path: one byte
+		uint8_t c = data[i++];
+		if (c == HDLC_FLAG) {
+			if (flen >= HDLC_MINFRAME) {
+				(*frames)++;
+				(*bytes) += flen;
+				if (fcs != HDLC_GOODFCS) (*errors)++;
+			}
+			fcs = HDLC_INITFCS;
+			flen = 0;
+			esc = 0;
+			continue;
+		}
+		if (c == HDLC_ESCAPE) {
+			esc = 1;
+			continue;
+		}
+		if (esc) {
+			c ^= HDLC_TRANS;
+			esc = 0;
+		}
+		fcs = (fcs >> 8) ^ fcs_tab[0][(fcs ^ c) & 0xFF];
+		flen++;
+	}
+
+	st->fcs = fcs;
+	st->len = flen;
+	st->escape = esc;
+}
+
+//========================================================
+void hdlc_rx_init(hdlc_rx_t *rx, uint8_t *frame, int size)
+{
+	hdlc_reset(&rx->st);
+	rx->frame = frame;
+	rx->size = size;
+	rx->overflow = 0;
+}
+
+//==============================================================================================================================================
+void hdlc_deframe(hdlc_rx_t *rx, const uint8_t *data, int len, hdlc_frame_cb cb, void *arg, uint32_t *frames, uint32_t *errors, uint32_t *bytes)
+{
+	if (fcs_tab_ready == 0) fcs_tab_init();
+
+	uint8_t *frame = rx->frame;
+	uint32_t accm = rx->accm;
+	uint16_t fcs = rx->st.fcs;
+	uint32_t flen = rx->st.len;
+	uint8_t esc = rx->st.escape;
+	uint8_t ovf = rx->overflow;
+	int i = 0;
+
+	while (i < len) {
+		// ** Fast path: aligned words without special characters, copied as they are
+		if ((esc == 0) && (ovf == 0) && ((((uintptr_t)(data + i)) & 3) == 0)) {
+			int start = i;
+			int end = len;
+			if ((end - i) > (rx->size - (int)flen)) end = i + (rx->size - flen);
+			while ((i + 4) <= end) {
+				uint32_t w = *(const uint32_t *)(data + i);
+				if (HAS_SPECIAL(w)) break;
+				if ((accm) && (HAS_CONTROL(w))) break;
+				fcs = fcs_word(fcs, w);
+				memcpy(frame + flen + (i - start), &w, 4);
+				i += 4;
+			}
+			flen += i - start;
+			if (i >= len) break;
+		}
+
+		// ** Slow path: one byte
+		uint8_t c = data[i++];
+		if (c == HDLC_FLAG) {
+			if (flen >= HDLC_MINFRAME) {
+				(*frames)++;
+				(*bytes) += flen;
+				if ((fcs != HDLC_GOODFCS) || (ovf)) (*errors)++;
+				else cb(arg, frame, flen - 2);
+			}
+			fcs = HDLC_INITFCS;
+			flen = 0;
+			esc = 0;
+			ovf = 0;
+			continue;
+		}
+		if (c == HDLC_ESCAPE) {
+			esc = 1;
+			continue;
+		}
+		// control characters in ACCM are sent escaped, received ones were inserted by the link
+		if ((c < 0x20) && (accm & (1UL << c))) continue;
+		if (esc) {
+			c ^= HDLC_TRANS;
+			esc = 0;
+		}
+		fcs = (fcs >> 8) ^ fcs_tab[0][(fcs ^ c) & 0xFF];
+		if (flen < rx->size) frame[flen] = c;
+		else ovf = 1;
+		flen++;
+	}
+
+	rx->st.fcs = fcs;
+	rx->st.len = flen;
+	rx->st.escape = esc;
+	rx->overflow = ovf;
+}
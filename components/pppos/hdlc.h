@@ -0,0 +1,82 @@
+/*
+ *  HDLC-like framing (RFC 1662) helpers for the PPPoS data path
+ *
+ *  Follows the received byte stream frame by frame, unescapes the data
+ *  and verifies the FCS-16 of every frame. Runs of bytes without flag
+ *  or escape characters are processed a 32-bit word at a time, with
+ *  slice-by-4 FCS tables.
+ *
+ *  hdlc_deframe() does the same in a single pass which also copies the
+ *  unescaped frames to a buffer and passes the frames with good FCS on,
+ *  so the received data doesn't have to be deframed again by lwIP.
+ *
+*/
+
+
+#ifndef _HDLC_H_
+#define _HDLC_H_
+
+#include <stdint.h>
+
+#define HDLC_FLAG		0x7E
+#define HDLC_ESCAPE		0x7D
+#define HDLC_TRANS		0x20
+#define HDLC_INITFCS	0xFFFF
+#define HDLC_GOODFCS	0xF0B8
+#define HDLC_MINFRAME	4		// address, control and FCS
+
+// Receive state, kept between data blocks
+typedef struct
+{
+	uint16_t	fcs;			// FCS of the frame being received
+	uint8_t		escape;			// last byte was the escape character
+	uint32_t	len;			// unescaped length of the frame being received
+}hdlc_state_t;
+
+// Deframer state, kept between data blocks
+typedef struct
+{
+	hdlc_state_t	st;
+	uint32_t		accm;			// received control characters inserted by the link, bit n = character n, discarded
+	uint8_t			*frame;			// buffer for the unescaped frame
+	int				size;			// frame buffer size
+	uint8_t			overflow;		// the frame being received is longer than the buffer
+}hdlc_rx_t;
+
+// Received frame callback, 'frame' is the unescaped frame without FCS, valid during the call only
+typedef void (*hdlc_frame_cb)(void *arg, uint8_t *frame, int len);
+
+/*
+ * Reset the receive state, next byte is expected to be the frame flag
+ */
+//================================
+void hdlc_reset(hdlc_state_t *st);
+
+/*
+ * Process the received (or sent) data
+ * The number of completed frames and frames with bad FCS is added to 'frames' and 'errors',
+ * the unescaped length of completed frames (including FCS) is added to 'bytes'
+ */
+//==================================================================================================================
+void hdlc_scan(hdlc_state_t *st, const uint8_t *data, int len, uint32_t *frames, uint32_t *errors, uint32_t *bytes);
+
+/*
+ * Set the frame buffer and reset the deframer state
+ */
+//=========================================================
+void hdlc_rx_init(hdlc_rx_t *rx, uint8_t *frame, int size);
+
+/*
+ * Deframe the received data, 'cb' is called for every complete frame with good FCS
+ * Counters are updated as by hdlc_scan(), frames longer than the frame buffer are counted as errors
+ */
+//===============================================================================================================================================
+void hdlc_deframe(hdlc_rx_t *rx, const uint8_t *data, int len, hdlc_frame_cb cb, void *arg, uint32_t *frames, uint32_t *errors, uint32_t *bytes);
+
+/*
+ * Update FCS-16 with unescaped data
+ */
+//==============================================================
+uint16_t hdlc_fcs16(uint16_t fcs, const uint8_t *data, int len);
+
+#endif
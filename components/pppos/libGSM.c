@@ -7,62 +7,137 @@
    CONDITIONS OF ANY KIND, either express or implied.
  */
 #include <string.h>
+#include <time.h>
+#include <sys/time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
 
 #include "driver/uart.h"
 #include "driver/gpio.h"
 #include "tcpip_adapter.h"
 #include "netif/ppp/pppos.h"
 #include "netif/ppp/ppp.h"
+#include "netif/ppp/ppp_impl.h"
 #include "lwip/pppapi.h"
+#include "lwip/tcpip.h"
+#include "lwip/pbuf.h"
+#include "lwip/stats.h"
+#include "lwip/snmp.h"
 
 #include "libGSM.h"
+#include "hdlc.h"
+#include "gsm_trace.h"
+#include "gsm_pcap.h"
+#include "gsm_dns.h"
+#include "gsm_link.h"
 
 
 // === GSM configuration that you can set via 'make menuconfig'. ===
+// Used as default configuration of GSM instances
 #define UART_GPIO_TX CONFIG_GSM_TX
 #define UART_GPIO_RX CONFIG_GSM_RX
 #define UART_BDRATE CONFIG_GSM_BDRATE
+#ifdef CONFIG_GSM_MAX_BDRATE
+#define UART_MAX_BDRATE CONFIG_GSM_MAX_BDRATE
+#else
+#define UART_MAX_BDRATE UART_BDRATE
+#endif
+#ifdef CONFIG_GSM_UART_RX_BUF
+#define UART_RX_BUF CONFIG_GSM_UART_RX_BUF
+#define UART_TX_BUF CONFIG_GSM_UART_TX_BUF
+#else
+#define UART_RX_BUF 0
+#define UART_TX_BUF 0
+#endif
+#ifdef CONFIG_GSM_RTS
+#define UART_GPIO_RTS CONFIG_GSM_RTS
+#define UART_GPIO_CTS CONFIG_GSM_CTS
+#else
+#define UART_GPIO_RTS -1
+#define UART_GPIO_CTS -1
+#endif
+
+#ifdef CONFIG_GSM_TASK_CORE
+#define PPPOS_CLIENT_CORE CONFIG_GSM_TASK_CORE
+#define PPPOS_CLIENT_PRIORITY CONFIG_GSM_TASK_PRIORITY
+#define PPPOS_CLIENT_STACK_SIZE CONFIG_GSM_TASK_STACK_SIZE
+#else
+#define PPPOS_CLIENT_CORE -1
+#define PPPOS_CLIENT_PRIORITY 10
+#define PPPOS_CLIENT_STACK_SIZE 1024*3
+#endif
+
+#ifdef CONFIG_GSM_RECONNECT_MIN
+#define GSM_RECONNECT_FAST CONFIG_GSM_RECONNECT_FAST
+#define GSM_RECONNECT_MIN CONFIG_GSM_RECONNECT_MIN
+#define GSM_RECONNECT_MAX CONFIG_GSM_RECONNECT_MAX
+#define GSM_RECONNECT_JITTER CONFIG_GSM_RECONNECT_JITTER
+#else
+#define GSM_RECONNECT_FAST 1000
+#define GSM_RECONNECT_MIN 3000
+#define GSM_RECONNECT_MAX 300000
+#define GSM_RECONNECT_JITTER 50
+#endif
+#define GSM_INIT_RETRY_MS 1000	// delay before a failed initialization command is retried
+#define GSM_INIT_CMD_RETRIES 3	// retries of a failed command before the whole initialization is restarted
 
 #ifdef CONFIG_GSM_DEBUG
 #define GSM_DEBUG 1
 #else
 #define GSM_DEBUG 0
 #endif
-#define BUF_SIZE (1024)
+#define BUF_SIZE (1024)			// minimal UART read chunk size
+#define UART_MIN_BUF (2048)		// minimal UART driver buffer size
+#define UART_BUF_TIME_MS 100	// auto sized UART buffers hold data received in this time at max baud rate
 #define GSM_OK_Str "OK"
+#define GSM_AT_QUEUE_LEN 8			// queued AT requests per instance
+#define GSM_AT_RESP_SIZE 512		// AT request response buffer, the end of longer responses is kept
+#define GSM_AT_TIMEOUT_MS 1000		// default AT request timeout
+#define GSM_URC_LINE 64				// max length of unsolicited result code line
+#define GSM_URC_DRAIN 16			// max UART reads dispatching URCs before a command, the rest is flushed
 #define PPPOSMUTEX_TIMEOUT 1000 / portTICK_RATE_MS
 
-#define PPPOS_CLIENT_STACK_SIZE 1024*3
-
-
-// shared variables, use mutex to access them
-static uint8_t gsm_status = GSM_STATE_FIRSTINIT;
-static int do_pppos_connect = 1;
-static uint32_t pppos_rx_count;
-static uint32_t pppos_tx_count;
-static uint8_t pppos_task_started = 0;
-static uint8_t gsm_rfOff = 0;
+#define UART_EVENT_QUEUE_SIZE 16
+#ifdef CONFIG_GSM_STATIC_ALLOC
+#define GSM_READ_BUF_SIZE	4096	// UART read buffer, read chunk is limited to this size
+#define GSM_RESP_BUF_SIZE	2048	// AT command response buffer, longer responses are truncated
+#define GSM_SMS_MAX			8		// max number of SMS messages returned by smsRead()
+#define GSM_SMS_TEXT_SIZE	164		// max SMS text length + 1, longer texts are truncated
+#endif
+#define UART_FLOWCTRL_THRESH 100	// RX FIFO level at which RTS is deasserted (FIFO size is 128)
+#define GSM_FRAME_BUF_SIZE	(PPP_MRU + 8)	// received frame buffer, MRU with address, control, protocol and FCS
 
-// local variables
-static QueueHandle_t pppos_mutex = NULL;
-const char *PPP_User = CONFIG_GSM_INTERNET_USER;
-const char *PPP_Pass = CONFIG_GSM_INTERNET_PASSWORD;
-static int uart_num = UART_NUM_1;
 
 static uint8_t tcpip_adapter_initialized = 0;
+static uint32_t gsm_allocs = 0;		// heap allocations made by libGSM, see gsm_GetAllocCount()
 
-// The PPP control block
-static ppp_pcb *ppp = NULL;
-
-// The PPP IP interface
-struct netif ppp_netif;
+// GSM instances, the first created instance is the default one
+static struct gsm_ctx *gsm_instances[GSM_MAX_MODEMS] = { NULL };
+static int gsm_num_instances = 0;
+static portMUX_TYPE gsm_create_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t gsm_creating = 0;		// an instance is being created, use gsm_create_mux to access
 
 static const char *TAG = "[PPPOS CLIENT]";
 
+// Initialization command indexes
+#define GSM_CMD_AT			0
+#define GSM_CMD_RESET		1
+#define GSM_CMD_ECHOOFF		2
+#define GSM_CMD_RFON		3
+#define GSM_CMD_SMSIND		4
+#define GSM_CMD_PIN			5
+#define GSM_CMD_REG			6
+#define GSM_CMD_APN			7
+#define GSM_CMD_CONNECT		8
+#define GSM_CMD_NUM			9
+
 typedef struct
 {
 	char		*cmd;
@@ -83,10 +158,11 @@ static GSM_Cmd cmd_AT =
 	.skip = 0,
 };
 
-static GSM_Cmd cmd_NoSMSInd =
+// New message indications: +CMTI is sent for every received SMS, buffered by the modem while in data mode
+static GSM_Cmd cmd_SMSInd =
 {
-	.cmd = "AT+CNMI=0,0,0,0,0\r\n",
-	.cmdSize = sizeof("AT+CNMI=0,0,0,0,0\r\n")-1,
+	.cmd = "AT+CNMI=2,1,0,0,0\r\n",
+	.cmdSize = sizeof("AT+CNMI=2,1,0,0,0\r\n")-1,
 	.cmdResponseOnOk = GSM_OK_Str,
 	.timeoutMs = 1000,
 	.delayMs = 0,
@@ -135,11 +211,11 @@ static GSM_Cmd cmd_Pin =
 
 static GSM_Cmd cmd_Reg =
 {
-	.cmd = "AT+CREG?\r\n",
-	.cmdSize = sizeof("AT+CREG?\r\n")-1,
-	.cmdResponseOnOk = "CREG: 0,1",
+	.cmd = "AT+CREG=2\r\n",		// registration changes with location are reported as URC
+	.cmdSize = sizeof("AT+CREG=2\r\n")-1,
+	.cmdResponseOnOk = GSM_OK_Str,
 	.timeoutMs = 3000,
-	.delayMs = 10000,
+	.delayMs = 0,
 	.skip = 0,
 };
 
@@ -165,13 +241,15 @@ static GSM_Cmd cmd_Connect =
 	.skip = 0,
 };
 
-static GSM_Cmd *GSM_Init[] =
+// Default initialization sequence, each GSM instance works on its own copy
+// Must be in the same order as GSM_CMD_xxx indexes
+static const GSM_Cmd *GSM_Init[] =
 {
 		&cmd_AT,
 		&cmd_Reset,
 		&cmd_EchoOff,
 		&cmd_RFOn,
-		&cmd_NoSMSInd,
+		&cmd_SMSInd,
 		&cmd_Pin,
 		&cmd_Reg,
 		&cmd_APN,
@@ -180,137 +258,388 @@ static GSM_Cmd *GSM_Init[] =
 
 #define GSM_InitCmdsSize  (sizeof(GSM_Init)/sizeof(GSM_Cmd *))
 
+// Modem profile, model specific commands, timeouts and capabilities
+typedef struct
+{
+	const char	*name;
+	const char	*match;				// string identifying the model in AT+CGMM or ATI response
+	const char	*init;				// model specific setup command, sent after the model is detected
+	const char	*dial;				// command used to enter data mode
+	uint16_t	cfun_timeout;		// AT+CFUN=1 response timeout
+	uint16_t	cfun_delay;			// delay after RF is turned on
+	uint16_t	reg_timeout;		// max time from RF on to network registration
+	uint16_t	connect_timeout;	// CONNECT response timeout
+	uint16_t	connect_delay;		// delay after CONNECT, before PPP is started
+	uint8_t		caps;				// GSM_CAP_xxx
+}gsm_profile_t;
+
+// Must be in the same order as GSM_MODEM_xxx constants
+// Generic profile uses the conservative values of the default command table
+static const gsm_profile_t gsm_profiles[] =
+{
+	{ "Generic",	NULL,		NULL,				"AT+CGDATA=\"PPP\",1\r\n",	10000,	1000,	60000,	30000,	1000,	0 },
+	{ "SIM800",		"SIM800",	NULL,				"AT+CGDATA=\"PPP\",1\r\n",	10000,	500,	30000,	10000,	200,	GSM_CAP_CMUX | GSM_CAP_FLOWCTRL },
+	{ "Neoway M590","M590",		NULL,				"ATD*99***1#\r\n",			10000,	1000,	30000,	20000,	500,	0 },
+	{ "Telit GL865","GL865",	"AT#SELINT=2\r\n",	"AT+CGDATA=\"PPP\",1\r\n",	10000,	500,	30000,	15000,	500,	GSM_CAP_CMUX | GSM_CAP_FLOWCTRL },
+	{ "SIM7000",	"SIM7000",	NULL,				"ATD*99#\r\n",				10000,	500,	65000,	15000,	200,	GSM_CAP_CMUX | GSM_CAP_PSM | GSM_CAP_FLOWCTRL | GSM_CAP_EPS },
+};
+
+#define GSM_ProfilesSize  (sizeof(gsm_profiles)/sizeof(gsm_profile_t))
+
+// Baud rates tried in negotiation, highest first
+static const uint32_t gsm_baud_rates[] = { 921600, 460800, 230400, 115200 };
+
+#define GSM_BaudRatesSize  (sizeof(gsm_baud_rates)/sizeof(uint32_t))
+#define GSM_BAUD_CHECKS	3	// number of AT round trips used to verify the baud rate
+
+#ifdef CONFIG_GSM_WARM_START
+#define GSM_WARM_MAGIC	0x47534D57
+
+// Verified modem state, kept in RTC memory over deep sleep
+typedef struct
+{
+	uint32_t	magic;
+	uint32_t	apn_hash;		// hash of the APN configured in PDP context 1
+	uint8_t		rf_on;			// RF was on (AT+CFUN=1)
+	uint8_t		registered;		// modem was registered to the network
+	char		oper[32];		// operator name reported by AT+COPS?
+	uint32_t	connect_ms;		// last init to CONNECT time
+}gsm_warm_state_t;
+
+RTC_DATA_ATTR static gsm_warm_state_t warm_state[GSM_MAX_MODEMS];
+#endif
+
+// Queued AT request
+typedef struct
+{
+	char		cmd[GSM_AT_CMD_MAX];
+	char		ok[24];				// expected final response
+	uint32_t	timeout_ms;
+	int64_t		t_submit;			// submit time, us
+	gsm_at_cb	cb;
+	void		*arg;
+}gsm_at_req_t;
+
+// URC subscriber
+typedef struct
+{
+	uint32_t	mask;				// GSM_URC_MASK() of the subscribed classes
+	gsm_urc_cb	cb;
+	void		*arg;
+}gsm_urc_sub_t;
+
+// gsm_atCommand() completion
+typedef struct
+{
+	TaskHandle_t	task;				// waiting task
+	int				result;
+	char			*resp;
+	int				size;
+}gsm_at_wait_t;
+
+// Received frames passed to lwIP from one data block
+typedef struct
+{
+	gsm_handle		h;
+	uint32_t		msgs;
+	uint32_t		bytes;
+	uint32_t		drops;			// frames dropped for lack of pbufs
+}gsm_rx_batch_t;
+
+// GSM instance context
+struct gsm_ctx
+{
+	// shared variables, use mutex to access them
+	uint8_t			gsm_status;
+	int				do_pppos_connect;
+	uint32_t		pppos_rx_count;
+	uint32_t		pppos_tx_count;
+	uint8_t			pppos_task_started;
+	uint8_t			gsm_rfOff;
+	uint8_t			time_set;
+
+	// local variables
+	int				index;
+	gsm_config_t	cfg;
+	QueueHandle_t	mutex;
+	ppp_pcb			*ppp;					// The PPP control block
+	struct netif	netif;					// The PPP IP interface
+	GSM_Cmd			cmd[GSM_CMD_NUM];		// instance's copy of the command table
+	GSM_Cmd			*init[GSM_CMD_NUM];		// initialization sequence
+	uint8_t			ninit;
+	char			apn_cmd[GSM_APN_MAX+24];
+	char			task_name[20];
+	char			tag[20];
+	uint32_t		init_start_tick;
+	uint32_t		connect_time_ms;
+	uint8_t			warm_started;
+	const gsm_profile_t	*profile;			// modem profile, NULL until the modem is detected
+	uint32_t		baud_rate;				// UART baud rate currently used
+	uint8_t			flow_ctrl;				// RTS/CTS flow control is enabled
+	int				rx_buf_size;			// UART driver buffer sizes
+	int				tx_buf_size;
+	int				read_size;				// UART read chunk size
+	QueueHandle_t	uart_queue;				// UART driver event queue
+	gsm_uart_stats_t	uart_stats;			// UART and PPP frame error counters, use mutex to access
+	hdlc_rx_t		rx_hdlc;				// deframer of the received PPP frames
+	hdlc_state_t	tx_hdlc;				// state of the PPP frame being sent
+	uint32_t		rx_chkerr;				// dropped frames not counted in lwIP statistics yet, use mutex to access
+	uint32_t		rx_memerr;
+	uint32_t		local_ip;				// PPP interface IPv4 address, 0 if not connected
+	gsm_status_cb	status_cb;				// link status change callback
+	void			*status_cb_arg;
+	gsm_metrics_t	metrics;				// connection lifecycle metrics, use mutex to access
+	uint32_t		link_up_tick;			// time the PPP link went up, 0 if down
+	uint32_t		rate_tick;				// start of the current throughput sample
+	uint32_t		rate_rx;				// bytes received/sent in the current throughput sample
+	uint32_t		rate_tx;
+	TaskHandle_t	task;					// PPPoS task, static task is not deleted, it waits to be restarted
+	QueueHandle_t	at_mutex;				// recursive, serializes AT command exchanges of all tasks
+	QueueHandle_t	at_queue;				// queued AT requests, gsm_at_req_t
+	char			at_resp[GSM_AT_RESP_SIZE];	// response of the executed AT request
+	char			urc_line[GSM_URC_LINE];	// line being received in command mode, checked for URC
+	int				urc_len;
+	uint8_t			urc_pass;				// the line being received is not URC, pass it to the response
+	gsm_urc_sub_t	urc_subs[GSM_URC_SUBS];	// URC subscribers, use mutex to access
+	gsm_reg_t		reg[GSM_REG_TYPES];		// network registration state by GSM_REG_xxx type, use mutex to access
+	int64_t			rf_on_time;				// RF on time in the current initialization, start of the registration
+	uint32_t		retries;				// failed connection attempts since the link was up, use mutex to access
+	uint8_t			link_lost;				// established link was lost, the next attempt is fast, use mutex to access
+	uint32_t		lost_tick;				// time the link was lost, 0 if not lost, use mutex to access
+	#ifdef CONFIG_GSM_STATIC_ALLOC
+	StaticSemaphore_t	mutex_buf;
+	StaticSemaphore_t	at_mutex_buf;
+	StaticQueue_t	at_queue_buf;
+	uint8_t			at_queue_storage[GSM_AT_QUEUE_LEN * sizeof(gsm_at_req_t)];
+	StaticTask_t	task_buf;
+	StackType_t		task_stack[PPPOS_CLIENT_STACK_SIZE];
+	char			read_buf[GSM_READ_BUF_SIZE];
+	uint8_t			frame_buf[GSM_FRAME_BUF_SIZE];
+	char			resp_buf[GSM_RESP_BUF_SIZE];
+	SMS_Msg			sms[GSM_SMS_MAX];		// messages returned by smsRead(), valid until the next call
+	char			sms_text[GSM_SMS_MAX][GSM_SMS_TEXT_SIZE];
+	#endif
+};
+
+#ifdef CONFIG_GSM_STATIC_ALLOC
+static struct gsm_ctx gsm_ctx_pool[GSM_MAX_MODEMS];
+#endif
+
 
 // PPP status callback
 //--------------------------------------------------------------
 static void ppp_status_cb(ppp_pcb *pcb, int err_code, void *ctx)
 {
 	struct netif *pppif = ppp_netif(pcb);
-	LWIP_UNUSED_ARG(ctx);
+	gsm_handle h = (gsm_handle)ctx;
 
 	switch(err_code) {
 		case PPPERR_NONE: {
 			#if GSM_DEBUG
-			ESP_LOGI(TAG,"status_cb: Connected");
+			ESP_LOGI(h->tag,"status_cb: Connected");
 			#if PPP_IPV4_SUPPORT
-			ESP_LOGI(TAG,"   ipaddr    = %s", ipaddr_ntoa(&pppif->ip_addr));
-			ESP_LOGI(TAG,"   gateway   = %s", ipaddr_ntoa(&pppif->gw));
-			ESP_LOGI(TAG,"   netmask   = %s", ipaddr_ntoa(&pppif->netmask));
+			ESP_LOGI(h->tag,"   ipaddr    = %s", ipaddr_ntoa(&pppif->ip_addr));
+			ESP_LOGI(h->tag,"   gateway   = %s", ipaddr_ntoa(&pppif->gw));
+			ESP_LOGI(h->tag,"   netmask   = %s", ipaddr_ntoa(&pppif->netmask));
 			#endif
 
 			#if PPP_IPV6_SUPPORT
-			ESP_LOGI(TAG,"   ip6addr   = %s", ip6addr_ntoa(netif_ip6_addr(pppif, 0)));
+			ESP_LOGI(h->tag,"   ip6addr   = %s", ip6addr_ntoa(netif_ip6_addr(pppif, 0)));
 			#endif
 			#endif
-			xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-			gsm_status = GSM_STATE_CONNECTED;
-			xSemaphoreGive(pppos_mutex);
+			xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+			h->gsm_status = GSM_STATE_CONNECTED;
+			GSM_TRACE(GSM_TRC_STATE, h->index, GSM_STATE_CONNECTED, 0);
+			h->local_ip = ip4_addr_get_u32(netif_ip4_addr(pppif));
+			xSemaphoreGive(h->mutex);
 			break;
 		}
 		case PPPERR_PARAM: {
 			#if GSM_DEBUG
-			ESP_LOGE(TAG,"status_cb: Invalid parameter");
+			ESP_LOGE(h->tag,"status_cb: Invalid parameter");
 			#endif
 			break;
 		}
 		case PPPERR_OPEN: {
 			#if GSM_DEBUG
-			ESP_LOGE(TAG,"status_cb: Unable to open PPP session");
+			ESP_LOGE(h->tag,"status_cb: Unable to open PPP session");
 			#endif
 			break;
 		}
 		case PPPERR_DEVICE: {
 			#if GSM_DEBUG
-			ESP_LOGE(TAG,"status_cb: Invalid I/O device for PPP");
+			ESP_LOGE(h->tag,"status_cb: Invalid I/O device for PPP");
 			#endif
 			break;
 		}
 		case PPPERR_ALLOC: {
 			#if GSM_DEBUG
-			ESP_LOGE(TAG,"status_cb: Unable to allocate resources");
+			ESP_LOGE(h->tag,"status_cb: Unable to allocate resources");
 			#endif
 			break;
 		}
 		case PPPERR_USER: {
 			/* ppp_free(); -- can be called here */
 			#if GSM_DEBUG
-			ESP_LOGW(TAG,"status_cb: User interrupt (disconnected)");
+			ESP_LOGW(h->tag,"status_cb: User interrupt (disconnected)");
 			#endif
-			xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-			gsm_status = GSM_STATE_DISCONNECTED;
-			xSemaphoreGive(pppos_mutex);
+			xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+			h->gsm_status = GSM_STATE_DISCONNECTED;
+			GSM_TRACE(GSM_TRC_STATE, h->index, GSM_STATE_DISCONNECTED, 0);
+			xSemaphoreGive(h->mutex);
 			break;
 		}
 		case PPPERR_CONNECT: {
 			#if GSM_DEBUG
-			ESP_LOGE(TAG,"status_cb: Connection lost");
+			ESP_LOGE(h->tag,"status_cb: Connection lost");
 			#endif
-			xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-			gsm_status = GSM_STATE_DISCONNECTED;
-			xSemaphoreGive(pppos_mutex);
 			break;
 		}
 		case PPPERR_AUTHFAIL: {
 			#if GSM_DEBUG
-			ESP_LOGE(TAG,"status_cb: Failed authentication challenge");
+			ESP_LOGE(h->tag,"status_cb: Failed authentication challenge");
 			#endif
 			break;
 		}
 		case PPPERR_PROTOCOL: {
 			#if GSM_DEBUG
-			ESP_LOGE(TAG,"status_cb: Failed to meet protocol");
+			ESP_LOGE(h->tag,"status_cb: Failed to meet protocol");
 			#endif
 			break;
 		}
 		case PPPERR_PEERDEAD: {
 			#if GSM_DEBUG
-			ESP_LOGE(TAG,"status_cb: Connection timeout");
+			ESP_LOGE(h->tag,"status_cb: Connection timeout");
 			#endif
 			break;
 		}
 		case PPPERR_IDLETIMEOUT: {
 			#if GSM_DEBUG
-			ESP_LOGE(TAG,"status_cb: Idle Timeout");
+			ESP_LOGE(h->tag,"status_cb: Idle Timeout");
 			#endif
 			break;
 		}
 		case PPPERR_CONNECTTIME: {
 			#if GSM_DEBUG
-			ESP_LOGE(TAG,"status_cb: Max connect time reached");
+			ESP_LOGE(h->tag,"status_cb: Max connect time reached");
 			#endif
 			break;
 		}
 		case PPPERR_LOOPBACK: {
 			#if GSM_DEBUG
-			ESP_LOGE(TAG,"status_cb: Loopback detected");
+			ESP_LOGE(h->tag,"status_cb: Loopback detected");
 			#endif
 			break;
 		}
 		default: {
 			#if GSM_DEBUG
-			ESP_LOGE(TAG,"status_cb: Unknown error code %d", err_code);
+			ESP_LOGE(h->tag,"status_cb: Unknown error code %d", err_code);
 			#endif
 			break;
 		}
 	}
+
+	GSM_TRACE(GSM_TRC_PPP_STATUS, h->index, err_code, 0);
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	uint32_t now = xTaskGetTickCount();
+	if (err_code == PPPERR_NONE) {
+		h->metrics.connects++;
+		gsm_hist_add(&h->metrics.connect_time, (now - h->init_start_tick) * portTICK_PERIOD_MS);
+		h->link_up_tick = now;
+		if (h->lost_tick) gsm_hist_add(&h->metrics.recover_time, (now - h->lost_tick) * portTICK_PERIOD_MS);
+		h->lost_tick = 0;
+		h->retries = 0;
+	}
+	else {
+		// Any error code means the PPP link is down (LCP echo timeout, protocol or authentication failure...),
+		// the task reconnects; on user close it is already set
+		if (err_code != PPPERR_USER) {
+			h->gsm_status = GSM_STATE_DISCONNECTED;
+			GSM_TRACE(GSM_TRC_STATE, h->index, GSM_STATE_DISCONNECTED, 0);
+		}
+		h->local_ip = 0;
+		h->metrics.disconnects[(err_code < GSM_METRICS_ERR_NUM) ? err_code : GSM_METRICS_ERR_NUM-1]++;
+		if (h->link_up_tick) {
+			gsm_hist_add(&h->metrics.session_time, (now - h->link_up_tick) * portTICK_PERIOD_MS);
+			if (err_code != PPPERR_USER) {
+				h->link_lost = 1;
+				h->lost_tick = now;
+			}
+		}
+		h->link_up_tick = 0;
+	}
+	xSemaphoreGive(h->mutex);
+	if (h->status_cb) h->status_cb(h, (err_code == PPPERR_NONE) ? GSM_STATE_CONNECTED : GSM_STATE_DISCONNECTED, h->status_cb_arg);
+}
+
+// Read from the modem through the UART driver or the configured serial port operations
+//------------------------------------------------------------------------
+static int _serRead(gsm_handle h, char *buf, int len, uint32_t timeout_ms)
+{
+	int res;
+	if (h->cfg.serial) res = h->cfg.serial->read(h->cfg.serial_arg, (uint8_t*)buf, len, timeout_ms);
+	else res = uart_read_bytes(h->cfg.uart_num, (uint8_t*)buf, len, timeout_ms / portTICK_RATE_MS);
+	if (res > 0) GSM_RECORD(h->index, GSM_REC_RX, (uint8_t*)buf, res);
+	return res;
+}
+
+// Write to the modem, waits up to 'wait_ms' for the UART transmission to finish
+//-----------------------------------------------------------------------------
+static int _serWrite(gsm_handle h, const char *data, int len, uint32_t wait_ms)
+{
+	int res;
+	if (h->cfg.serial) res = h->cfg.serial->write(h->cfg.serial_arg, (const uint8_t*)data, len);
+	else {
+		res = uart_write_bytes(h->cfg.uart_num, data, len);
+		if (wait_ms) uart_wait_tx_done(h->cfg.uart_num, wait_ms / portTICK_RATE_MS);
+	}
+	if (res > 0) GSM_RECORD(h->index, GSM_REC_TX, (const uint8_t*)data, res);
+	return res;
+}
+
+// Discard the received data not read yet
+//---------------------------------
+static void _serFlush(gsm_handle h)
+{
+	if (h->cfg.serial) {
+		if (h->cfg.serial->flush) h->cfg.serial->flush(h->cfg.serial_arg);
+	}
+	else uart_flush(h->cfg.uart_num);
 }
 
 // === Handle sending data to GSM modem ===
 //------------------------------------------------------------------------------
 static u32_t ppp_output_callback(ppp_pcb *pcb, u8_t *data, u32_t len, void *ctx)
 {
-	uint32_t ret = uart_write_bytes(uart_num, (const char*)data, len);
-    uart_wait_tx_done(uart_num, 10 / portTICK_RATE_MS);
+	gsm_handle h = (gsm_handle)ctx;
+	int64_t t_start = esp_timer_get_time();
+	uint32_t ret = _serWrite(h, (const char*)data, len, 10);
+    GSM_TRACE(GSM_TRC_UART_TX, h->index, ret, 0);
+	uint32_t frames = 0;
+	uint32_t errors = 0;
+	uint32_t bytes = 0;
     if (ret > 0) {
-		xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-    	pppos_rx_count += ret;
-		xSemaphoreGive(pppos_mutex);
+		GSM_PCAP(h->index, GSM_PCAP_TX, data, ret);
+		// count the sent frames to get the framing overhead
+		hdlc_scan(&h->tx_hdlc, data, ret, &frames, &errors, &bytes);
     }
+	uint32_t t_out = (uint32_t)(esp_timer_get_time() - t_start);
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	h->pppos_rx_count += ret;
+	h->rate_tx += ret;
+	h->uart_stats.tx_bytes += ret;
+	h->uart_stats.tx_frames += frames;
+	h->uart_stats.tx_frame_bytes += bytes;
+	h->uart_stats.output_calls++;
+	h->uart_stats.output_us += t_out;
+	xSemaphoreGive(h->mutex);
     return ret;
 }
 
+#if GSM_DEBUG
 //---------------------------------------------------------
-static void infoCommand(char *cmd, int cmdSize, char *info)
+static void infoCommand(gsm_handle h, char *cmd, int cmdSize, char *info)
 {
 	char buf[cmdSize+2];
 	memset(buf, 0, cmdSize+2);
@@ -320,46 +649,222 @@ static void infoCommand(char *cmd, int cmdSize, char *info)
 		else buf[i] = cmd[i];
 		if (buf[i] == '\0') break;
 	}
-	ESP_LOGI(TAG,"%s [%s]", info, buf);
+	ESP_LOGI(h->tag,"%s [%s]", info, buf);
+}
+#endif
+
+// Update the registration state from +CREG/+CGREG/+CEREG line
+// Returns 1 if the line was parsed
+//---------------------------------------------------
+static int _regUpdate(gsm_handle h, const char *line)
+{
+	gsm_reg_t reg;
+	if (gsm_parseReg(line, &reg) == 0) return 0;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	memcpy(&h->reg[reg.type], &reg, sizeof(gsm_reg_t));
+	xSemaphoreGive(h->mutex);
+	#if GSM_DEBUG
+	ESP_LOGI(h->tag,"Registration (%d): stat=%d, lac=%04X, ci=%08X, act=%d", reg.type, reg.stat, reg.lac, reg.ci, reg.act);
+	#endif
+	return 1;
+}
+
+// Pass the unsolicited line to the subscribers
+//---------------------------------------------------------------
+static void _urcDispatch(gsm_handle h, int urc, const char *line)
+{
+	gsm_urc_sub_t subs[GSM_URC_SUBS];
+
+	GSM_TRACE(GSM_TRC_URC, h->index, urc, 0);
+	#if GSM_DEBUG
+	ESP_LOGI(h->tag,"URC: [%s]", line);
+	#endif
+	// The library tracks the registration itself
+	if (urc == GSM_URC_REG) _regUpdate(h, line);
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	memcpy(subs, h->urc_subs, sizeof(subs));
+	xSemaphoreGive(h->mutex);
+
+	for (int i=0; i<GSM_URC_SUBS; i++) {
+		if ((subs[i].cb) && (subs[i].mask & GSM_URC_MASK(urc))) subs[i].cb(h, urc, line, subs[i].arg);
+	}
+}
+
+// Dispatch unsolicited lines in the data received in command mode and remove them from the data
+// 'len' bytes received are at 'buf' + GSM_URC_LINE, the remaining data is placed at 'buf'
+// (it can be preceded by the line held from the previous call)
+// Returns the length of the remaining data
+//----------------------------------------------------------------------
+static int _urcFilter(gsm_handle h, char *buf, int len, const char *cmd)
+{
+	char *in = buf + GSM_URC_LINE;
+	int out = 0;
+
+	for (int i=0; i<len; i++) {
+		char c = in[i];
+		if (h->urc_pass) {
+			buf[out++] = c;
+			if (c == '\n') h->urc_pass = 0;
+			continue;
+		}
+		if ((c == '\r') || (c == '\n')) {
+			if (h->urc_len > 0) {
+				h->urc_line[h->urc_len] = '\0';
+				int urc = gsm_parseURC(h->urc_line, cmd);
+				if (urc != GSM_URC_NONE) {
+					_urcDispatch(h, urc, h->urc_line);
+					h->urc_len = 0;
+					continue;
+				}
+				memcpy(buf + out, h->urc_line, h->urc_len);
+				out += h->urc_len;
+				h->urc_len = 0;
+			}
+			buf[out++] = c;
+			continue;
+		}
+		if (h->urc_len >= (GSM_URC_LINE-1)) {
+			// too long for URC
+			memcpy(buf + out, h->urc_line, h->urc_len);
+			out += h->urc_len;
+			h->urc_len = 0;
+			h->urc_pass = 1;
+			buf[out++] = c;
+			continue;
+		}
+		h->urc_line[h->urc_len++] = c;
+	}
+
+	// Incomplete line which can't be URC (prompt "> ") is not held
+	if ((h->urc_len > 0) && (gsm_isURCPrefix(h->urc_line, h->urc_len) == 0)) {
+		memcpy(buf + out, h->urc_line, h->urc_len);
+		out += h->urc_len;
+		h->urc_len = 0;
+		h->urc_pass = 1;
+	}
+	return out;
+}
+
+// Dispatch unsolicited lines received while no command was waiting, discard the other data
+//---------------------------------
+static void _urcDrain(gsm_handle h)
+{
+	char buf[GSM_URC_LINE + 128];
+	int len;
+
+	xSemaphoreTakeRecursive(h->at_mutex, portMAX_DELAY);
+	for (int n=0; n<GSM_URC_DRAIN; n++) {
+		len = _serRead(h, buf + GSM_URC_LINE, 128, 0);
+		if (len <= 0) break;
+		_urcFilter(h, buf, len, NULL);
+	}
+	_serFlush(h);
+	// the next command's response starts on a new line
+	h->urc_len = 0;
+	h->urc_pass = 0;
+	xSemaphoreGiveRecursive(h->at_mutex);
+}
+
+// Receive and dispatch unsolicited lines for up to 'timeout_ms'
+//-----------------------------------------------------
+static void _urcWait(gsm_handle h, uint32_t timeout_ms)
+{
+	char buf[GSM_URC_LINE + 128];
+
+	xSemaphoreTakeRecursive(h->at_mutex, portMAX_DELAY);
+	int len = _serRead(h, buf + GSM_URC_LINE, 128, timeout_ms);
+	if (len > 0) _urcFilter(h, buf, len, NULL);
+	xSemaphoreGiveRecursive(h->at_mutex);
+}
+
+// Record AT command latency and result, 'res' is -1 on timeout, 0 on unexpected response
+//------------------------------------------------------------
+static void _atMetrics(gsm_handle h, int64_t t_start, int res)
+{
+	uint32_t us = (uint32_t)(esp_timer_get_time() - t_start);
+	uint32_t ms = us / 1000;
+	GSM_TRACE(GSM_TRC_AT_RESP, h->index, (res < 0) ? 0xFFFF : res, us);
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	h->metrics.at_commands++;
+	if (res < 0) h->metrics.at_timeouts++;
+	else {
+		if (res == 0) h->metrics.at_errors++;
+		gsm_hist_add(&h->metrics.at_latency, ms);
+	}
+	xSemaphoreGive(h->mutex);
+}
+
+// Count 'n' heap allocations made by libGSM, buffers, FreeRTOS objects or tasks
+//-----------------------------------
+static void _allocCount(uint32_t n)
+{
+	__atomic_fetch_add(&gsm_allocs, n, __ATOMIC_RELAXED);
 }
 
-//----------------------------------------------------------------------------------------------------------------------
-static int atCmd_waitResponse(char * cmd, char *resp, char * resp1, int cmdSize, int timeout, char **response, int size)
+//--------------------------------------------------------------------------------------------------------------------------------
+static int _atCmdResponse(gsm_handle h, char * cmd, char *resp, char * resp1, int cmdSize, int timeout, char **response, int size)
 {
 	char sresp[256] = {'\0'};
-	char data[256] = {'\0'};
-    int len, res = 1, idx = 0, tot = 0, timeoutCnt = 0;
+	char data[GSM_URC_LINE + 256] = {'\0'};
+    int len, n, res = 1, idx = 0, tot = 0, timeoutCnt = 0;
+    int64_t t_start = 0;
 
 	// ** Send command to GSM
 	vTaskDelay(100 / portTICK_PERIOD_MS);
-	uart_flush(uart_num);
+	_urcDrain(h);
 
 	if (cmd != NULL) {
 		if (cmdSize == -1) cmdSize = strlen(cmd);
 		#if GSM_DEBUG
-		infoCommand(cmd, cmdSize, "AT COMMAND:");
+		infoCommand(h, cmd, cmdSize, "AT COMMAND:");
+		#endif
+		_serWrite(h, (const char*)cmd, cmdSize, 100);
+		t_start = esp_timer_get_time();
+		#ifdef CONFIG_GSM_TRACE
+		// Command is identified by 4 characters after "AT"
+		uint32_t cmd_id = 0;
+		for (int i=2; (i<6) && (i<cmdSize); i++) cmd_id |= (uint8_t)cmd[i] << ((i-2) * 8);
+		GSM_TRACE(GSM_TRC_AT_SEND, h->index, cmdSize, cmd_id);
 		#endif
-		uart_write_bytes(uart_num, (const char*)cmd, cmdSize);
-		uart_wait_tx_done(uart_num, 100 / portTICK_RATE_MS);
 	}
 
 	if (response != NULL) {
-		// Read GSM response into buffer
+		// Read GSM response into buffer until the final result code,
+		// 100 ms without data ends the response without it, 'timeout' ms without any response
 		char *pbuf = *response;
-		len = uart_read_bytes(uart_num, (uint8_t*)data, 256, timeout / portTICK_RATE_MS);
-		while (len > 0) {
+		while (1) {
+			n = _serRead(h, data + GSM_URC_LINE, 256, 10);
+			if (n <= 0) {
+				timeoutCnt += 10;
+				if (timeoutCnt > ((tot > 0) ? 100 : timeout)) break;
+				continue;
+			}
+			timeoutCnt = 0;
+			len = _urcFilter(h, data, n, cmd);
+			#ifdef CONFIG_GSM_STATIC_ALLOC
+			// Fixed size buffer, the rest of the response is read but not stored
+			if ((tot+len) >= size) len = size - tot - 1;
+			#else
 			if ((tot+len) >= size) {
 				char *ptemp = realloc(pbuf, size+512);
-				if (ptemp == NULL) return 0;
+				_allocCount(1);
+				if (ptemp == NULL) {
+					*response = pbuf;
+					return 0;
+				}
 				size += 512;
 				pbuf = ptemp;
 			}
+			#endif
 			memcpy(pbuf+tot, data, len);
 			tot += len;
-			response[tot] = '\0';
-			len = uart_read_bytes(uart_num, (uint8_t*)data, 256, 100 / portTICK_RATE_MS);
+			pbuf[tot] = '\0';
+			if (gsm_isFinalResult(pbuf, tot)) break;
 		}
 		*response = pbuf;
+		if (cmd != NULL) _atMetrics(h, t_start, (tot > 0) ? 1 : -1);
 		return tot;
 	}
 
@@ -367,10 +872,11 @@ static int atCmd_waitResponse(char * cmd, char *resp, char * resp1, int cmdSize,
 	idx = 0;
 	while(1)
 	{
-		memset(data, 0, 256);
-		len = 0;
-		len = uart_read_bytes(uart_num, (uint8_t*)data, 256, 10 / portTICK_RATE_MS);
-		if (len > 0) {
+		memset(data, 0, sizeof(data));
+		// unsolicited lines are not part of the response, they don't end it either
+		n = _serRead(h, data + GSM_URC_LINE, 256, 10);
+		if (n > 0) {
+			len = _urcFilter(h, data, n, cmd);
 			for (int i=0; i<len;i++) {
 				if (idx < 256) {
 					if ((data[i] >= 0x20) && (data[i] < 0x80)) sresp[idx++] = data[i];
@@ -384,7 +890,7 @@ static int atCmd_waitResponse(char * cmd, char *resp, char * resp1, int cmdSize,
 				// Check the response
 				if (strstr(sresp, resp) != NULL) {
 					#if GSM_DEBUG
-					ESP_LOGI(TAG,"AT RESPONSE: [%s]", sresp);
+					ESP_LOGI(h->tag,"AT RESPONSE: [%s]", sresp);
 					#endif
 					break;
 				}
@@ -392,7 +898,7 @@ static int atCmd_waitResponse(char * cmd, char *resp, char * resp1, int cmdSize,
 					if (resp1 != NULL) {
 						if (strstr(sresp, resp1) != NULL) {
 							#if GSM_DEBUG
-							ESP_LOGI(TAG,"AT RESPONSE (1): [%s]", sresp);
+							ESP_LOGI(h->tag,"AT RESPONSE (1): [%s]", sresp);
 							#endif
 							res = 2;
 							break;
@@ -400,7 +906,7 @@ static int atCmd_waitResponse(char * cmd, char *resp, char * resp1, int cmdSize,
 					}
 					// no match
 					#if GSM_DEBUG
-					ESP_LOGI(TAG,"AT BAD RESPONSE: [%s]", sresp);
+					ESP_LOGI(h->tag,"AT BAD RESPONSE: [%s]", sresp);
 					#endif
 					res = 0;
 					break;
@@ -412,697 +918,1938 @@ static int atCmd_waitResponse(char * cmd, char *resp, char * resp1, int cmdSize,
 		if (timeoutCnt > timeout) {
 			// timeout
 			#if GSM_DEBUG
-			ESP_LOGE(TAG,"AT: TIMEOUT");
+			ESP_LOGE(h->tag,"AT: TIMEOUT");
 			#endif
-			res = 0;
+			res = -1;
+			break;
+		}
+	}
+
+	if (cmd != NULL) _atMetrics(h, t_start, res);
+	return (res < 0) ? 0 : res;
+}
+
+// Send AT command and wait for the response, the exchange is not interrupted by other tasks' commands
+//------------------------------------------------------------------------------------------------------------------------------------
+static int atCmd_waitResponse(gsm_handle h, char * cmd, char *resp, char * resp1, int cmdSize, int timeout, char **response, int size)
+{
+	xSemaphoreTakeRecursive(h->at_mutex, portMAX_DELAY);
+	int res = _atCmdResponse(h, cmd, resp, resp1, cmdSize, timeout, response, size);
+	xSemaphoreGiveRecursive(h->at_mutex);
+	return res;
+}
+
+// Execute queued AT request, the response is collected in h->at_resp
+// Returns GSM_AT_OK, GSM_AT_ERROR or GSM_AT_TIMEOUT
+//----------------------------------------------------------
+static int _atRequest(gsm_handle h, const gsm_at_req_t *req)
+{
+	char data[GSM_URC_LINE + 128];
+	int len, tot = 0, res = GSM_AT_TIMEOUT;
+	char *resp = h->at_resp;
+
+	xSemaphoreTakeRecursive(h->at_mutex, portMAX_DELAY);
+	// Requests are sent back to back, without the delay used before the initialization commands
+	_urcDrain(h);
+	#if GSM_DEBUG
+	infoCommand(h, (char *)req->cmd, strlen(req->cmd), "AT REQUEST:");
+	#endif
+	_serWrite(h, req->cmd, strlen(req->cmd), 100);
+	int64_t t_start = esp_timer_get_time();
+	GSM_TRACE(GSM_TRC_AT_SEND, h->index, strlen(req->cmd), 0);
+
+	resp[0] = '\0';
+	while ((esp_timer_get_time() - t_start) < ((int64_t)req->timeout_ms * 1000)) {
+		int n = _serRead(h, data + GSM_URC_LINE, 128, 10);
+		if (n <= 0) continue;
+		len = _urcFilter(h, data, n, req->cmd);
+		if ((tot + len) >= GSM_AT_RESP_SIZE) {
+			// keep the end of the response, the final result code is expected there
+			memmove(resp, resp + tot - (GSM_AT_RESP_SIZE / 4), GSM_AT_RESP_SIZE / 4);
+			tot = GSM_AT_RESP_SIZE / 4;
+		}
+		memcpy(resp + tot, data, len);
+		tot += len;
+		resp[tot] = '\0';
+		if (strstr(resp, req->ok) != NULL) {
+			res = GSM_AT_OK;
+			break;
+		}
+		if (strstr(resp, "ERROR") != NULL) {
+			res = GSM_AT_ERROR;
 			break;
 		}
 	}
+	xSemaphoreGiveRecursive(h->at_mutex);
 
+	#if GSM_DEBUG
+	if (res == GSM_AT_TIMEOUT) ESP_LOGE(h->tag,"AT REQUEST: TIMEOUT");
+	else ESP_LOGI(h->tag,"AT REQUEST RESPONSE: [%s]", resp);
+	#endif
+	_atMetrics(h, t_start, res);
 	return res;
 }
 
+#define GSM_AT_EXPIRE	0	// complete the requests waiting longer than their timeout
+#define GSM_AT_EXEC		1	// execute all queued requests
+#define GSM_AT_CANCEL	2	// complete all queued requests without executing them
+
+// Handle the queued AT requests, called from the PPPoS task
+//--------------------------------------------
+static void _atService(gsm_handle h, int mode)
+{
+	gsm_at_req_t req;
+
+	while (xQueuePeek(h->at_queue, &req, 0) == pdTRUE) {
+		int64_t t_wait = esp_timer_get_time() - req.t_submit;
+		if ((mode == GSM_AT_EXPIRE) && (t_wait < ((int64_t)req.timeout_ms * 1000))) break;
+		xQueueReceive(h->at_queue, &req, 0);
+
+		int res = GSM_AT_NOTREADY;
+		h->at_resp[0] = '\0';
+		if (mode == GSM_AT_EXEC) res = _atRequest(h, &req);
+
+		xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+		if (mode == GSM_AT_EXEC) gsm_hist_add(&h->metrics.at_queue_time, (uint32_t)(t_wait / 1000));
+		else h->metrics.at_expired++;
+		xSemaphoreGive(h->mutex);
+
+		if (req.cb) req.cb(h, res, h->at_resp, req.arg);
+	}
+}
+
 //------------------------------------
-static void _disconnect(uint8_t rfOff)
+static void _disconnect(gsm_handle h, uint8_t rfOff)
 {
-	int res = atCmd_waitResponse("AT\r\n", GSM_OK_Str, NULL, 4, 1000, NULL, 0);
+	int res = atCmd_waitResponse(h, "AT\r\n", GSM_OK_Str, NULL, 4, 1000, NULL, 0);
 	if (res == 1) {
 		if (rfOff) {
-			cmd_Reg.timeoutMs = 10000;
-			res = atCmd_waitResponse("AT+CFUN=4\r\n", GSM_OK_Str, NULL, 11, 10000, NULL, 0); // disable RF function
+			res = atCmd_waitResponse(h, "AT+CFUN=4\r\n", GSM_OK_Str, NULL, 11, 10000, NULL, 0); // disable RF function
+			#ifdef CONFIG_GSM_WARM_START
+			warm_state[h->index].rf_on = 0;
+			warm_state[h->index].registered = 0;
+			warm_state[h->index].magic = 0;	// next start is cold
+			#endif
 		}
 		return;
 	}
 
 	#if GSM_DEBUG
-	ESP_LOGI(TAG,"ONLINE, DISCONNECTING...");
+	ESP_LOGI(h->tag,"ONLINE, DISCONNECTING...");
 	#endif
 	vTaskDelay(1000 / portTICK_PERIOD_MS);
-	uart_flush(uart_num);
-	uart_write_bytes(uart_num, "+++", 3);
-    uart_wait_tx_done(uart_num, 10 / portTICK_RATE_MS);
+	_serFlush(h);
+	_serWrite(h, "+++", 3, 10);
 	vTaskDelay(1100 / portTICK_PERIOD_MS);
 
 	int n = 0;
-	res = atCmd_waitResponse("ATH\r\n", GSM_OK_Str, "NO CARRIER", 5, 3000, NULL, 0);
+	res = atCmd_waitResponse(h, "ATH\r\n", GSM_OK_Str, "NO CARRIER", 5, 3000, NULL, 0);
 	while (res == 0) {
 		n++;
 		if (n > 10) {
 			#if GSM_DEBUG
-			ESP_LOGI(TAG,"STILL CONNECTED.");
+			ESP_LOGI(h->tag,"STILL CONNECTED.");
 			#endif
 			n = 0;
 			vTaskDelay(1000 / portTICK_PERIOD_MS);
-			uart_flush(uart_num);
-			uart_write_bytes(uart_num, "+++", 3);
-		    uart_wait_tx_done(uart_num, 10 / portTICK_RATE_MS);
+			_serFlush(h);
+			_serWrite(h, "+++", 3, 10);
 			vTaskDelay(1000 / portTICK_PERIOD_MS);
 		}
 		vTaskDelay(100 / portTICK_PERIOD_MS);
-		res = atCmd_waitResponse("ATH\r\n", GSM_OK_Str, "NO CARRIER", 5, 3000, NULL, 0);
+		res = atCmd_waitResponse(h, "ATH\r\n", GSM_OK_Str, "NO CARRIER", 5, 3000, NULL, 0);
 	}
 	vTaskDelay(100 / portTICK_PERIOD_MS);
 	if (rfOff) {
-		cmd_Reg.timeoutMs = 10000;
-		res = atCmd_waitResponse("AT+CFUN=4\r\n", GSM_OK_Str, NULL, 11, 3000, NULL, 0);
+		res = atCmd_waitResponse(h, "AT+CFUN=4\r\n", GSM_OK_Str, NULL, 11, 3000, NULL, 0);
+		#ifdef CONFIG_GSM_WARM_START
+		warm_state[h->index].rf_on = 0;
+		warm_state[h->index].registered = 0;
+		warm_state[h->index].magic = 0;	// next start is cold
+		#endif
 	}
 	#if GSM_DEBUG
-	ESP_LOGI(TAG,"DISCONNECTED.");
+	ESP_LOGI(h->tag,"DISCONNECTED.");
 	#endif
 }
 
-//----------------------------
-static void enableAllInitCmd()
+// Get the buffer for AT command response, in static mode the instance's fixed buffer is used
+//----------------------------------------------
+static char *_respAlloc(gsm_handle h, int *size)
 {
-	for (int idx = 0; idx < GSM_InitCmdsSize; idx++) {
-		GSM_Init[idx]->skip = 0;
-	}
+	#ifdef CONFIG_GSM_STATIC_ALLOC
+	*size = sizeof(h->resp_buf);
+	h->resp_buf[0] = '\0';
+	return h->resp_buf;
+	#else
+	char *buf = malloc(*size);
+	_allocCount(1);
+	if (buf) buf[0] = '\0';
+	return buf;
+	#endif
 }
 
-/*
- * PPPoS TASK
- * Handles GSM initialization, disconnects and GSM modem responses
- */
-//-----------------------------
-static void pppos_client_task()
+//------------------------------
+static void _respFree(char *buf)
 {
-	xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-	pppos_task_started = 1;
-	xSemaphoreGive(pppos_mutex);
+	#ifndef CONFIG_GSM_STATIC_ALLOC
+	free(buf);
+	#endif
+}
 
-    // Allocate receive buffer
-    char* data = (char*) malloc(BUF_SIZE);
-    if (data == NULL) {
-		#if GSM_DEBUG
-		ESP_LOGE(TAG,"Failed to allocate data buffer.");
-		#endif
-    	goto exit;
-    }
+#ifdef CONFIG_GSM_NETWORK_TIME
+// Enable automatic time update from the network (NITZ)
+// Telit/u-blox use AT+CTZU, SIMCom uses AT+CLTS, errors are ignored
+//-------------------------------
+static void _enableNetworkTime(gsm_handle h)
+{
+	atCmd_waitResponse(h, "AT+CTZU=1\r\n", GSM_OK_Str, NULL, -1, 1000, NULL, 0);
+	atCmd_waitResponse(h, "AT+CLTS=1\r\n", GSM_OK_Str, NULL, -1, 1000, NULL, 0);
+}
 
-    if (gpio_set_direction(UART_GPIO_TX, GPIO_MODE_OUTPUT)) goto exit;
-	if (gpio_set_direction(UART_GPIO_RX, GPIO_MODE_INPUT)) goto exit;
-	if (gpio_set_pull_mode(UART_GPIO_RX, GPIO_PULLUP_ONLY)) goto exit;
+// Get the network time from modem's clock and set the system time
+// Modem returns local time and time zone in quarters of an hour: +CCLK: "yy/MM/dd,hh:mm:ss±zz"
+//----------------------------
+static void _getNetworkTime(gsm_handle h)
+{
+	struct tm tm;
+	int tz = 0;
+	int size = 64;
+	char *rbuffer = _respAlloc(h, &size);
+	if (rbuffer == NULL) return;
 
-	char PPP_ApnATReq[sizeof(CONFIG_GSM_APN)+24];
-	
-	uart_config_t uart_config = {
-			.baud_rate = UART_BDRATE,
-			.data_bits = UART_DATA_8_BITS,
-			.parity = UART_PARITY_DISABLE,
-			.stop_bits = UART_STOP_BITS_1,
-			.flow_ctrl = UART_HW_FLOWCTRL_DISABLE
-	};
+	int res = atCmd_waitResponse(h, "AT+CCLK?\r\n", NULL, NULL, -1, 1000, &rbuffer, size);
+	char *pclk = (res > 0) ? strstr(rbuffer, "+CCLK: \"") : NULL;
+	// Without network time the modem clock runs from its default date
+	res = ((pclk != NULL) && (gsm_parseTime(pclk+8, &tm, &tz)) && (tm.tm_year >= 117));
+	_respFree(rbuffer);
+	if (res == 0) {
+		#if GSM_DEBUG
+		ESP_LOGW(h->tag,"Network time not available");
+		#endif
+		return;
+	}
 
-	//Configure UART1 parameters
-	if (uart_param_config(uart_num, &uart_config)) goto exit;
-	//Set UART1 pins(TX, RX, RTS, CTS)
-	if (uart_set_pin(uart_num, UART_GPIO_TX, UART_GPIO_RX, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE)) goto exit;
-	if (uart_driver_install(uart_num, BUF_SIZE * 2, BUF_SIZE * 2, 0, NULL, 0)) goto exit;
+	struct timeval tv;
+	tv.tv_sec = mktime(&tm) - (tz * 15 * 60);	// convert to UTC
+	tv.tv_usec = 0;
+	settimeofday(&tv, NULL);
 
-	// Set APN from config
-	sprintf(PPP_ApnATReq, "AT+CGDCONT=1,\"IP\",\"%s\"\r\n", CONFIG_GSM_APN);
-	cmd_APN.cmd = PPP_ApnATReq;
-	cmd_APN.cmdSize = strlen(PPP_ApnATReq);
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	h->time_set = 1;
+	xSemaphoreGive(h->mutex);
+	#if GSM_DEBUG
+	ESP_LOGI(h->tag,"Time set from network: %02d/%02d/%02d %02d:%02d:%02d, tz=%d",
+			tm.tm_year-100, tm.tm_mon+1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, tz/4);
+	#endif
+}
+#endif
 
-	_disconnect(1); // Disconnect if connected
+#ifdef CONFIG_GSM_WARM_START
+//-------------------------------------
+static uint32_t _hash(const char *str)
+{
+	uint32_t h = 2166136261u;	// FNV-1a
+	while (*str) {
+		h ^= (uint8_t)*str++;
+		h *= 16777619u;
+	}
+	return h;
+}
 
-	xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-    pppos_tx_count = 0;
-    pppos_rx_count = 0;
-	gsm_status = GSM_STATE_FIRSTINIT;
-	xSemaphoreGive(pppos_mutex);
+// Get the operator name from AT+COPS? response
+//-----------------------------------------------------------
+static void _getOperator(const char *resp, char *oper, int size)
+{
+	oper[0] = '\0';
+	char *pstart = strstr(resp, "+COPS: ");
+	if (pstart == NULL) return;
+	pstart = strchr(pstart, '"');
+	if (pstart == NULL) return;
+	pstart++;
+	char *pend = strchr(pstart, '"');
+	if ((pend == NULL) || ((pend - pstart) >= size)) return;
+	memcpy(oper, pstart, pend - pstart);
+	oper[pend - pstart] = '\0';
+}
 
-	enableAllInitCmd();
+// Record the verified modem state after successful initialization
+//-----------------------------
+static void _saveWarmState(gsm_handle h)
+{
+	int size = 64;
+	char *rbuffer = _respAlloc(h, &size);
+
+	warm_state[h->index].oper[0] = '\0';
+	if (rbuffer != NULL) {
+		int res = atCmd_waitResponse(h, "AT+COPS?\r\n", NULL, NULL, -1, 2000, &rbuffer, size);
+		if (res > 0) _getOperator(rbuffer, warm_state[h->index].oper, sizeof(warm_state[h->index].oper));
+		_respFree(rbuffer);
+	}
+	warm_state[h->index].apn_hash = _hash(h->cfg.apn);
+	warm_state[h->index].rf_on = 1;
+	warm_state[h->index].registered = 1;
+	warm_state[h->index].magic = GSM_WARM_MAGIC;
+}
 
-	while(1)
-	{
-		#if GSM_DEBUG
-		ESP_LOGI(TAG,"GSM initialization start");
-		#endif
-		vTaskDelay(500 / portTICK_PERIOD_MS);
+/*
+ * Verify the modem state recorded before deep sleep with a single probe command
+ * and mark the initialization commands which are not needed as skipped
+ * Returns 1 if the modem is in command mode and the state is valid
+ */
+//--------------------------
+static int _warmStart(gsm_handle h)
+{
+	if (warm_state[h->index].magic != GSM_WARM_MAGIC) return 0;
+	warm_state[h->index].magic = 0;	// invalid until verified again
 
-		int gsmCmdIter = 0;
-		int nfail = 0;
-		// * GSM Initialization loop
-		while(gsmCmdIter < GSM_InitCmdsSize)
-		{
-			if (GSM_Init[gsmCmdIter]->skip) {
-				#if GSM_DEBUG
-				infoCommand(GSM_Init[gsmCmdIter]->cmd, GSM_Init[gsmCmdIter]->cmdSize, "Skip command:");
-				#endif
-				gsmCmdIter++;
-				continue;
-			}
-			if (atCmd_waitResponse(GSM_Init[gsmCmdIter]->cmd,
-					GSM_Init[gsmCmdIter]->cmdResponseOnOk, NULL,
-					GSM_Init[gsmCmdIter]->cmdSize,
-					GSM_Init[gsmCmdIter]->timeoutMs, NULL, 0) == 0)
-			{
-				// * No response or not as expected, start from first initialization command
-				#if GSM_DEBUG
-				ESP_LOGW(TAG,"Wrong response, restarting...");
-				#endif
+	// Modem must respond in command mode
+	if (atCmd_waitResponse(h, "AT\r\n", GSM_OK_Str, NULL, 4, 300, NULL, 0) != 1) return 0;
 
-				nfail++;
-				if (nfail > 20) goto exit;
+	int size = 256;
+	char *rbuffer = _respAlloc(h, &size);
+	if (rbuffer == NULL) return 0;
 
-				vTaskDelay(3000 / portTICK_PERIOD_MS);
-				gsmCmdIter = 0;
-				continue;
-			}
+	int res = atCmd_waitResponse(h, "AT+CFUN?;+CREG?;+CGDCONT?;+COPS?\r\n", NULL, NULL, -1, 2000, &rbuffer, size);
+	if ((res <= 0) || (strstr(rbuffer, "OK") == NULL)) {
+		_respFree(rbuffer);
+		return 0;
+	}
 
-			if (GSM_Init[gsmCmdIter]->delayMs > 0) vTaskDelay(GSM_Init[gsmCmdIter]->delayMs / portTICK_PERIOD_MS);
-			GSM_Init[gsmCmdIter]->skip = 1;
-			if (GSM_Init[gsmCmdIter] == &cmd_Reg) GSM_Init[gsmCmdIter]->delayMs = 0;
-			// Next command
-			gsmCmdIter++;
-		}
+	char pdp_type[8];
+	char apn[GSM_APN_MAX];
+	char oper[32];
+	_getOperator(rbuffer, oper, sizeof(oper));
+
+	uint8_t echo_off = (strstr(rbuffer, "AT+CFUN?") == NULL);
+	uint8_t rf_on = (strstr(rbuffer, "+CFUN: 1") != NULL);
+	char *preg = strstr(rbuffer, "+CREG:");
+	uint8_t registered = ((preg != NULL) && (_regUpdate(h, preg)) && (GSM_REG_REGISTERED(h->reg[GSM_REG_CS].stat)));
+	// the dial command uses PDP context 1
+	uint8_t apn_set = ((gsm_parsePDPContext(rbuffer, 1, pdp_type, sizeof(pdp_type), apn, sizeof(apn))) &&
+			(strcmp(pdp_type, "IP") == 0) && (strcmp(apn, h->cfg.apn) == 0) && (warm_state[h->index].apn_hash == _hash(h->cfg.apn)));
+	uint8_t same_oper = ((oper[0] != '\0') && (strcmp(oper, warm_state[h->index].oper) == 0));
+	_respFree(rbuffer);
+
+	// Skip only the steps whose result was verified
+	if (echo_off) {
+		h->cmd[GSM_CMD_AT].skip = 1;
+		h->cmd[GSM_CMD_RESET].skip = 1;
+		h->cmd[GSM_CMD_ECHOOFF].skip = 1;
+		h->cmd[GSM_CMD_SMSIND].skip = 1;
+	}
+	if (rf_on && warm_state[h->index].rf_on) h->cmd[GSM_CMD_RFON].skip = 1;
+	if (rf_on && registered && same_oper) {
+		h->cmd[GSM_CMD_PIN].skip = 1;
+		h->cmd[GSM_CMD_REG].skip = 1;
+	}
+	if (apn_set) h->cmd[GSM_CMD_APN].skip = 1;
+	// The state is still valid, APN command which records it may be skipped
+	if ((h->cmd[GSM_CMD_RFON].skip) && (h->cmd[GSM_CMD_REG].skip) && (apn_set)) warm_state[h->index].magic = GSM_WARM_MAGIC;
 
-		#if GSM_DEBUG
-		ESP_LOGI(TAG,"GSM initialized.");
-		#endif
+	#if GSM_DEBUG
+	ESP_LOGI(h->tag,"Warm start: echo off=%d, RF on=%d, registered=%d (%s), APN set=%d", echo_off, rf_on, registered, oper, apn_set);
+	#endif
+	return 1;
+}
+#endif
 
-		xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-		if (gsm_status == GSM_STATE_FIRSTINIT) {
-			xSemaphoreGive(pppos_mutex);
-			// ** After first successful initialization create PPP control block
-			ppp = pppapi_pppos_create(&ppp_netif,
-					ppp_output_callback, ppp_status_cb, NULL);
+// Apply the modem profile to the instance's command table
+//-------------------------------------------------------------------
+static void _applyProfile(gsm_handle h, const gsm_profile_t *profile)
+{
+	h->profile = profile;
+	h->cmd[GSM_CMD_RFON].timeoutMs = profile->cfun_timeout;
+	h->cmd[GSM_CMD_RFON].delayMs = profile->cfun_delay;
+	h->cmd[GSM_CMD_CONNECT].cmd = (char *)profile->dial;
+	h->cmd[GSM_CMD_CONNECT].cmdSize = strlen(profile->dial);
+	h->cmd[GSM_CMD_CONNECT].timeoutMs = profile->connect_timeout;
+	h->cmd[GSM_CMD_CONNECT].delayMs = profile->connect_delay;
+
+	if (profile->init) atCmd_waitResponse(h, (char *)profile->init, GSM_OK_Str, NULL, -1, 1000, NULL, 0);
+	#if GSM_DEBUG
+	ESP_LOGI(h->tag,"Modem profile: %s", profile->name);
+	#endif
+}
 
-			if (ppp == NULL) {
-				#if GSM_DEBUG
-				ESP_LOGE(TAG, "Error initializing PPPoS");
-				#endif
-				break; // end task
+// Detect the modem model from AT+CGMM or ATI response and select its profile
+//------------------------------------
+static void _detectModem(gsm_handle h)
+{
+	const gsm_profile_t *profile = &gsm_profiles[GSM_MODEM_GENERIC];
+
+	if ((h->cfg.modem > GSM_MODEM_AUTO) && (h->cfg.modem < GSM_ProfilesSize)) profile = &gsm_profiles[h->cfg.modem];
+	else {
+		int size = 128;
+		char *rbuffer = _respAlloc(h, &size);
+		char *cmd[2] = {"AT+CGMM\r\n", "ATI\r\n"};
+		for (int n=0; (n<2) && (rbuffer != NULL); n++) {
+			rbuffer[0] = '\0';
+			if (atCmd_waitResponse(h, cmd[n], NULL, NULL, -1, 1000, &rbuffer, size) <= 0) continue;
+			if (strstr(rbuffer, GSM_OK_Str) == NULL) continue;
+			for (int i=GSM_MODEM_GENERIC+1; i<GSM_ProfilesSize; i++) {
+				if (strstr(rbuffer, gsm_profiles[i].match)) {
+					profile = &gsm_profiles[i];
+					break;
+				}
 			}
+			if (profile != &gsm_profiles[GSM_MODEM_GENERIC]) break;
 		}
-		else xSemaphoreGive(pppos_mutex);
-
-		pppapi_set_default(ppp);
-		pppapi_set_auth(ppp, PPPAUTHTYPE_PAP, PPP_User, PPP_Pass);
-		//pppapi_set_auth(ppp, PPPAUTHTYPE_NONE, PPP_User, PPP_Pass);
+		_respFree(rbuffer);
+	}
+	_applyProfile(h, profile);
+}
 
-		xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-		gsm_status = GSM_STATE_IDLE;
-		xSemaphoreGive(pppos_mutex);
-		pppapi_connect(ppp, 0);
+// Get UART driver buffer size, if 'size' is 0 it is derived from the baud rate
+//-----------------------------------------------
+static int _bufSize(int size, uint32_t baud_rate)
+{
+	if (size <= 0) {
+		size = ((baud_rate / 10) * UART_BUF_TIME_MS) / 1000;
+		size = (size + 511) & ~511;
+	}
+	return (size < UART_MIN_BUF) ? UART_MIN_BUF : size;
+}
 
-		// *** LOOP: Handle GSM modem responses & disconnects ***
-		while(1) {
-			// === Check if disconnect requested ===
-			xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-			if (do_pppos_connect <= 0) {
-				int end_task = do_pppos_connect;
-				do_pppos_connect = 1;
-				xSemaphoreGive(pppos_mutex);
-				#if GSM_DEBUG
-				printf("\r\n");
-				ESP_LOGI(TAG, "Disconnect requested.");
-				#endif
+// Set UART baud rate and verify the communication with AT round trips
+// Returns the average round trip time in ms or 0 if the modem does not respond
+//---------------------------------------------------------
+static uint32_t _checkBaudRate(gsm_handle h, uint32_t rate)
+{
+	if (h->cfg.serial == NULL) uart_set_baudrate(h->cfg.uart_num, rate);
+	_serFlush(h);
 
-				pppapi_close(ppp, 0);
+	uint32_t t_start = xTaskGetTickCount();
+	for (int i=0; i<GSM_BAUD_CHECKS; i++) {
+		if (atCmd_waitResponse(h, "AT\r\n", GSM_OK_Str, NULL, 4, 500, NULL, 0) != 1) return 0;
+	}
+	uint32_t rtt = ((xTaskGetTickCount() - t_start) * portTICK_PERIOD_MS) / GSM_BAUD_CHECKS;
+	return (rtt > 0) ? rtt : 1;
+}
+
+// Find the baud rate used by the modem, it may still use the negotiated rate after ESP32 restart
+//--------------------------------------
+static void _probeBaudRate(gsm_handle h)
+{
+	if (_checkBaudRate(h, h->baud_rate)) return;
+
+	for (int i=0; i<GSM_BaudRatesSize; i++) {
+		if ((gsm_baud_rates[i] == h->baud_rate) || (gsm_baud_rates[i] > h->cfg.max_baud_rate)) continue;
+		if (_checkBaudRate(h, gsm_baud_rates[i])) {
+			#if GSM_DEBUG
+			ESP_LOGI(h->tag,"Modem responds at %u baud", gsm_baud_rates[i]);
+			#endif
+			h->baud_rate = gsm_baud_rates[i];
+			return;
+		}
+	}
+	// not found, the modem may be in data mode, continue with the current rate
+	if (h->cfg.serial == NULL) uart_set_baudrate(h->cfg.uart_num, h->baud_rate);
+}
+
+// Switch to the highest baud rate supported by the modem, up to configured maximum
+// Each rate is verified with AT round trips, on failure the modem is returned to the previous rate
+//------------------------------------------
+static void _negotiateBaudRate(gsm_handle h)
+{
+	char buf[32];
+	uint32_t safe_rate = h->baud_rate;
+	uint32_t rtt = _checkBaudRate(h, safe_rate);
+	#if GSM_DEBUG
+	ESP_LOGI(h->tag,"Baud rate %u: AT round trip %u ms", safe_rate, rtt);
+	#endif
+	if (rtt == 0) return;
+
+	for (int i=0; i<GSM_BaudRatesSize; i++) {
+		uint32_t rate = gsm_baud_rates[i];
+		if ((rate > h->cfg.max_baud_rate) || (rate <= safe_rate)) continue;
+
+		sprintf(buf, "AT+IPR=%u\r\n", rate);
+		if (atCmd_waitResponse(h, buf, GSM_OK_Str, NULL, -1, 1000, NULL, 0) != 1) continue; // rate not supported
+		vTaskDelay(100 / portTICK_PERIOD_MS);
+
+		rtt = _checkBaudRate(h, rate);
+		if (rtt) {
+			#if GSM_DEBUG
+			ESP_LOGI(h->tag,"Baud rate %u: AT round trip %u ms", rate, rtt);
+			#endif
+			h->baud_rate = rate;
+			return;
+		}
+
+		// No response at the new rate, switch the modem back
+		#if GSM_DEBUG
+		ESP_LOGW(h->tag,"Baud rate %u: no response, falling back to %u", rate, safe_rate);
+		#endif
+		sprintf(buf, "AT+IPR=%u\r\n", safe_rate);
+		atCmd_waitResponse(h, buf, GSM_OK_Str, NULL, -1, 1000, NULL, 0);
+		vTaskDelay(100 / portTICK_PERIOD_MS);
+		if (_checkBaudRate(h, safe_rate) == 0) {
+			_probeBaudRate(h);
+			return;
+		}
+	}
+}
+
+// Enable RTS/CTS flow control on both sides, disable it on UART if the modem does not accept it
+//---------------------------------------
+static void _setFlowControl(gsm_handle h)
+{
+	int res = atCmd_waitResponse(h, "AT+IFC=2,2\r\n", GSM_OK_Str, NULL, -1, 1000, NULL, 0);
+	h->flow_ctrl = (res == 1);
+	if (h->cfg.serial == NULL) uart_set_hw_flow_ctrl(h->cfg.uart_num, (h->flow_ctrl) ? UART_HW_FLOWCTRL_CTS_RTS : UART_HW_FLOWCTRL_DISABLE, UART_FLOWCTRL_THRESH);
+	#if GSM_DEBUG
+	ESP_LOGI(h->tag,"RTS/CTS flow control %s", (h->flow_ctrl) ? "enabled" : "not supported");
+	#endif
+}
+
+// Count UART driver error events
+//-----------------------------------
+static void _uartEvents(gsm_handle h)
+{
+	uart_event_t event;
+
+	if (h->cfg.serial) {
+		// serial port operations report the errors as counts
+		uint32_t fifo_overflows = 0, buffer_full = 0;
+		if (h->cfg.serial->errors) h->cfg.serial->errors(h->cfg.serial_arg, &fifo_overflows, &buffer_full);
+		if ((fifo_overflows == 0) && (buffer_full == 0)) return;
+		xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+		h->uart_stats.fifo_overflows += fifo_overflows;
+		h->uart_stats.buffer_full += buffer_full;
+		xSemaphoreGive(h->mutex);
+		if (fifo_overflows) GSM_TRACE(GSM_TRC_UART_EVENT, h->index, UART_FIFO_OVF, 0);
+		if (buffer_full) GSM_TRACE(GSM_TRC_UART_EVENT, h->index, UART_BUFFER_FULL, 0);
+		return;
+	}
+	if (h->uart_queue == NULL) return;
+	while (xQueueReceive(h->uart_queue, &event, 0)) {
+		xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+		switch (event.type) {
+			case UART_FIFO_OVF:
+				h->uart_stats.fifo_overflows++;
+				GSM_TRACE(GSM_TRC_UART_EVENT, h->index, event.type, 0);
+				break;
+			case UART_BUFFER_FULL:
+				h->uart_stats.buffer_full++;
+				GSM_TRACE(GSM_TRC_UART_EVENT, h->index, event.type, 0);
+				break;
+			case UART_FRAME_ERR:
+			case UART_PARITY_ERR:
+				h->uart_stats.frame_errors++;
+				GSM_TRACE(GSM_TRC_UART_EVENT, h->index, event.type, 0);
+				break;
+			default:
+				break;
+		}
+		xSemaphoreGive(h->mutex);
+	}
+}
+
+// Pass the received frame to PPP, runs in lwIP tcpip thread
+// The PPP control block is passed in front of the frame, as lwIP does it for frames deframed in interrupt
+//------------------------------
+static void _pppInput(void *arg)
+{
+	struct pbuf *p = (struct pbuf *)arg;
+	ppp_pcb *ppp;
+
+	memcpy(&ppp, p->payload, sizeof(ppp_pcb *));
+	pbuf_header(p, -(s16_t)sizeof(ppp_pcb *));
+	// frames received while the link is not open are dropped, as in pppos_input()
+	if (((pppos_pcb *)ppp->link_ctx_cb)->open == 0) {
+		pbuf_free(p);
+		return;
+	}
+	ppp_input(ppp, p);
+}
+
+// Frame with good FCS received, pass its protocol and information fields to lwIP
+//------------------------------------------------------
+static void _rxFrame(void *arg, uint8_t *frame, int len)
+{
+	gsm_rx_batch_t *b = (gsm_rx_batch_t *)arg;
+	int off = 0;
+
+	// address and control fields can be omitted (ACFC)
+	if ((len >= 2) && (frame[0] == PPP_ALLSTATIONS) && (frame[1] == PPP_UI)) off = 2;
+	if (off >= len) return;
+	// protocol field can be compressed to its odd low byte (PFC), ppp_input() expects two bytes
+	int pfc = frame[off] & 1;
+	int hlen = sizeof(ppp_pcb *) + pfc;
+
+	struct pbuf *p = pbuf_alloc(PBUF_RAW, hlen + len - off, PBUF_POOL);
+	if (p == NULL) {
+		b->drops++;
+		return;
+	}
+	pbuf_take_at(p, &b->h->ppp, sizeof(ppp_pcb *), 0);
+	if (pfc) pbuf_put_at(p, sizeof(ppp_pcb *), 0);
+	pbuf_take_at(p, frame + off, len - off, hlen);
+	// wait for room in tcpip thread mailbox, data not read meanwhile stays in UART buffer
+	if (tcpip_callback_with_block(_pppInput, p, 1) != ERR_OK) {
+		pbuf_free(p);
+		b->drops++;
+		return;
+	}
+	b->msgs++;
+	b->bytes += len - off + pfc;
+}
+
+// Count the frames dropped by the receive path in lwIP statistics, as pppos_input() does, runs in tcpip thread
+//-------------------------------
+static void _pppDrops(void *arg)
+{
+	gsm_handle h = (gsm_handle)arg;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	uint32_t chkerr = h->rx_chkerr;
+	uint32_t memerr = h->rx_memerr;
+	h->rx_chkerr = 0;
+	h->rx_memerr = 0;
+	xSemaphoreGive(h->mutex);
+	if ((h->ppp == NULL) || ((chkerr + memerr) == 0)) return;
+
+	for (uint32_t i=0; i<chkerr; i++) LINK_STATS_INC(link.chkerr);
+	for (uint32_t i=0; i<memerr; i++) LINK_STATS_INC(link.memerr);
+	for (uint32_t i=0; i<(chkerr + memerr); i++) {
+		LINK_STATS_INC(link.drop);
+		MIB2_STATS_NETIF_INC(ppp_netif(h->ppp), ifindiscards);
+	}
+	#if VJ_SUPPORT
+	// a frame was lost, VJ decompressor must toss the packets until the next uncompressed one (RFC 1144)
+	vj_uncompress_err(&h->ppp->vj_comp);
+	#endif
+}
+
+// Get the receive ACCM negotiated by LCP, the control characters the peer sends escaped
+//-----------------------------------
+static uint32_t _rxAccm(gsm_handle h)
+{
+	pppos_pcb *pppos = (pppos_pcb *)h->ppp->link_ctx_cb;
+	return pppos->in_accm[0] | (pppos->in_accm[1] << 8) | (pppos->in_accm[2] << 16) | ((uint32_t)pppos->in_accm[3] << 24);
+}
+
+// Update throughput averages every GSM_RATE_PERIOD_MS, called with mutex taken
+//-----------------------------------
+static void _updateRate(gsm_handle h)
+{
+	uint32_t now = xTaskGetTickCount();
+	uint32_t ms = (now - h->rate_tick) * portTICK_PERIOD_MS;
+	if (ms < GSM_RATE_PERIOD_MS) return;
+
+	if (h->rate_tick != 0) {
+		uint32_t rx = (uint32_t)(((uint64_t)h->rate_rx * 1000) / ms);
+		uint32_t tx = (uint32_t)(((uint64_t)h->rate_tx * 1000) / ms);
+		h->metrics.rx_rate = gsm_ewma_update(h->metrics.rx_rate, rx);
+		h->metrics.tx_rate = gsm_ewma_update(h->metrics.tx_rate, tx);
+		if (rx > h->metrics.rx_rate_max) h->metrics.rx_rate_max = rx;
+		if (tx > h->metrics.tx_rate_max) h->metrics.tx_rate_max = tx;
+	}
+	h->rate_tick = now;
+	h->rate_rx = 0;
+	h->rate_tx = 0;
+}
+
+// Pass the data received from GSM to lwIP
+// The data is deframed here in a single pass, which also checks the FCS and counts the frames damaged
+// on serial line, every frame with good FCS is sent to lwIP tcpip thread as a separate message.
+// Dropped frames are also counted in lwIP link statistics, lwIP's own deframing is not used.
+// The frame not completed at the end of data is kept by the deframer.
+//----------------------------------------------------
+static void _rxData(gsm_handle h, char *data, int len)
+{
+	_uartEvents(h);
+	if (len <= 0) return;
+	int64_t t_start = esp_timer_get_time();
+	gsm_rx_batch_t batch = { h, 0, 0, 0 };
+	uint32_t frames = 0;
+	uint32_t errors = 0;
+	uint32_t bytes = 0;
+
+	GSM_PCAP(h->index, GSM_PCAP_RX, (uint8_t *)data, len);
+	h->rx_hdlc.accm = _rxAccm(h);
+	hdlc_deframe(&h->rx_hdlc, (uint8_t *)data, len, _rxFrame, &batch, &frames, &errors, &bytes);
+	if (errors) GSM_TRACE(GSM_TRC_FCS_ERR, h->index, errors, frames);
+	uint32_t t_cpu = (uint32_t)(esp_timer_get_time() - t_start);
+	GSM_TRACE(GSM_TRC_UART_RX, h->index, len, batch.bytes);
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	h->pppos_tx_count += len;
+	h->uart_stats.rx_bytes += len;
+	h->rate_rx += len;
+	_updateRate(h);
+	h->uart_stats.frames += frames;
+	h->uart_stats.fcs_errors += errors;
+	h->uart_stats.rx_frame_bytes += bytes;
+	h->uart_stats.input_msgs += batch.msgs;
+	h->uart_stats.input_bytes += batch.bytes;
+	h->uart_stats.input_us += t_cpu;
+	h->rx_chkerr += errors;
+	h->rx_memerr += batch.drops;
+	xSemaphoreGive(h->mutex);
+	// not waiting for the mailbox, the counts are posted with the next dropped frame if it is full
+	if ((errors) || (batch.drops)) tcpip_callback_with_block(_pppDrops, h, 0);
+}
+
+//----------------------------
+static void enableAllInitCmd(gsm_handle h)
+{
+	for (int idx = 0; idx < h->ninit; idx++) {
+		h->init[idx]->skip = 0;
+	}
+}
+
+// Get the current registration state and wait for registration (home or roaming)
+// The state changes are received as +CREG/+CEREG URCs, the wait ends as soon as the modem is registered
+// Returns 1 if registered, 0 if not registered in profile's registration timeout
+//----------------------------------------
+static int _waitRegistration(gsm_handle h)
+{
+	const gsm_profile_t *profile = (h->profile) ? h->profile : &gsm_profiles[GSM_MODEM_GENERIC];
+	int64_t t_start = (h->rf_on_time) ? h->rf_on_time : esp_timer_get_time();
+	h->rf_on_time = 0;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	memset(h->reg, 0, sizeof(h->reg));
+	xSemaphoreGive(h->mutex);
+
+	// LTE registration is reported with +CEREG, generic modem may support it, 2G modems don't
+	uint8_t eps = ((profile == &gsm_profiles[GSM_MODEM_GENERIC]) || (profile->caps & GSM_CAP_EPS));
+	if ((eps) && (atCmd_waitResponse(h, "AT+CEREG=2\r\n", GSM_OK_Str, NULL, -1, 1000, NULL, 0) != 1)) eps = 0;
+
+	// URCs report the changes only, get the current state
+	int size = 128;
+	char *rbuffer = _respAlloc(h, &size);
+	if (rbuffer != NULL) {
+		if (atCmd_waitResponse(h, "AT+CREG?\r\n", NULL, NULL, -1, 1000, &rbuffer, size) > 0) {
+			if (strstr(rbuffer, "+CREG:")) _regUpdate(h, strstr(rbuffer, "+CREG:"));
+		}
+		rbuffer[0] = '\0';
+		if ((eps) && (atCmd_waitResponse(h, "AT+CEREG?\r\n", NULL, NULL, -1, 1000, &rbuffer, size) > 0)) {
+			if (strstr(rbuffer, "+CEREG:")) _regUpdate(h, strstr(rbuffer, "+CEREG:"));
+		}
+		_respFree(rbuffer);
+	}
+
+	while (1) {
+		xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+		uint8_t registered = (GSM_REG_REGISTERED(h->reg[GSM_REG_CS].stat) || GSM_REG_REGISTERED(h->reg[GSM_REG_EPS].stat));
+		xSemaphoreGive(h->mutex);
+		uint32_t ms = (uint32_t)((esp_timer_get_time() - t_start) / 1000);
+
+		if (registered) {
+			xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+			gsm_hist_add(&h->metrics.reg_time, ms);
+			xSemaphoreGive(h->mutex);
+			#if GSM_DEBUG
+			ESP_LOGI(h->tag,"Registered after %u ms", ms);
+			#endif
+			return 1;
+		}
+		if (ms >= profile->reg_timeout) break;
+
+		// Application requests can be executed while waiting
+		_atService(h, GSM_AT_EXEC);
+		_urcWait(h, 50);
+	}
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	h->metrics.reg_timeouts++;
+	xSemaphoreGive(h->mutex);
+	#if GSM_DEBUG
+	ESP_LOGW(h->tag,"Not registered in %u ms", profile->reg_timeout);
+	#endif
+	return 0;
+}
+
+// Get the delay before the next connection attempt after the PPP link was lost or failed to come up,
+// or before the initialization is restarted after repeated command failures
+// The first attempt after the established link was lost is fast, the delay after failed attempts
+// is doubled up to the max delay and reduced by random jitter, so many devices don't retry in sync
+//-------------------------------------------
+static uint32_t _reconnectDelay(gsm_handle h)
+{
+	uint32_t delay;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	h->metrics.reconnects++;
+	if (h->link_lost) {
+		h->link_lost = 0;
+		h->retries = 0;
+		delay = h->cfg.reconnect_fast_ms;
+	}
+	else {
+		delay = h->cfg.reconnect_min_ms;
+		for (int i=0; (i<h->retries) && (delay < h->cfg.reconnect_max_ms); i++) delay *= 2;
+		if (delay > h->cfg.reconnect_max_ms) delay = h->cfg.reconnect_max_ms;
+		h->retries++;
+	}
+	xSemaphoreGive(h->mutex);
+
+	uint32_t jitter = (uint32_t)(((uint64_t)delay * h->cfg.reconnect_jitter) / 100);
+	if (jitter) delay -= esp_random() % (jitter + 1);
+	return delay;
+}
+
+// Wait for 'ms' milliseconds, unsolicited results are dispatched and expired AT requests completed while waiting
+//-------------------------------------------------
+static void _serviceWait(gsm_handle h, uint32_t ms)
+{
+	int64_t t_end = esp_timer_get_time() + ((int64_t)ms * 1000);
+	while (esp_timer_get_time() < t_end) {
+		_atService(h, GSM_AT_EXPIRE);
+		int64_t left = (t_end - esp_timer_get_time()) / 1000;
+		if (left <= 0) break;
+		_urcWait(h, (left < 100) ? left : 100);
+	}
+}
+
+// Wait before the next connection attempt
+//--------------------------------------
+static void _reconnectWait(gsm_handle h)
+{
+	uint32_t delay = _reconnectDelay(h);
+	#if GSM_DEBUG
+	ESP_LOGI(h->tag,"Next connection attempt in %u ms", delay);
+	#endif
+	_serviceWait(h, delay);
+}
+
+// Configure UART pins and install the UART driver
+//--------------------------------
+static int _uartInit(gsm_handle h)
+{
+	if (gpio_set_direction(h->cfg.tx_pin, GPIO_MODE_OUTPUT)) return 0;
+	if (gpio_set_direction(h->cfg.rx_pin, GPIO_MODE_INPUT)) return 0;
+	if (gpio_set_pull_mode(h->cfg.rx_pin, GPIO_PULLUP_ONLY)) return 0;
+
+	uart_config_t uart_config = {
+			.baud_rate = h->baud_rate,
+			.data_bits = UART_DATA_8_BITS,
+			.parity = UART_PARITY_DISABLE,
+			.stop_bits = UART_STOP_BITS_1,
+			.flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+			.rx_flow_ctrl_thresh = UART_FLOWCTRL_THRESH
+	};
+
+	//Configure UART1 parameters
+	if (uart_param_config(h->cfg.uart_num, &uart_config)) return 0;
+	//Set UART1 pins(TX, RX, RTS, CTS)
+	// RTS/CTS pins are set if used, flow control is enabled after the modem accepts it
+	int rts_pin = ((h->cfg.rts_pin >= 0) && (h->cfg.cts_pin >= 0)) ? h->cfg.rts_pin : UART_PIN_NO_CHANGE;
+	int cts_pin = ((h->cfg.rts_pin >= 0) && (h->cfg.cts_pin >= 0)) ? h->cfg.cts_pin : UART_PIN_NO_CHANGE;
+	if (uart_set_pin(h->cfg.uart_num, h->cfg.tx_pin, h->cfg.rx_pin, rts_pin, cts_pin)) return 0;
+	if (uart_driver_install(h->cfg.uart_num, h->rx_buf_size, h->tx_buf_size, UART_EVENT_QUEUE_SIZE, &h->uart_queue, 0)) return 0;
+	return 1;
+}
+
+/*
+ * PPPoS TASK
+ * Handles GSM initialization, disconnects and GSM modem responses
+ */
+//-----------------------------------------
+static void pppos_client_task(void *arg)
+{
+	gsm_handle h = (gsm_handle)arg;
+	char* data = NULL;
+	uint8_t *frame = NULL;
+
+	#ifdef CONFIG_GSM_STATIC_ALLOC
+start:
+	#endif
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	h->pppos_task_started = 1;
+	xSemaphoreGive(h->mutex);
+
+	// UART buffers can't be resized after the driver is installed, use the max rate which can be negotiated
+	uint32_t max_rate = (h->cfg.max_baud_rate > h->cfg.baud_rate) ? h->cfg.max_baud_rate : h->cfg.baud_rate;
+	h->rx_buf_size = _bufSize(h->cfg.uart_rx_buf, max_rate);
+	h->tx_buf_size = _bufSize(h->cfg.uart_tx_buf, max_rate);
+	h->read_size = h->rx_buf_size / 2;
+	#if GSM_DEBUG
+	ESP_LOGI(h->tag,"UART buffers: rx=%d, tx=%d, read chunk=%d", h->rx_buf_size, h->tx_buf_size, h->read_size);
+	#endif
+
+	#ifdef CONFIG_GSM_STATIC_ALLOC
+	if (h->read_size > GSM_READ_BUF_SIZE) h->read_size = GSM_READ_BUF_SIZE;
+	data = h->read_buf;
+	frame = h->frame_buf;
+	#else
+    // Allocate receive and frame buffers, they are used for every received byte, keep them in internal RAM
+    data = (char*) heap_caps_malloc(h->read_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    frame = (uint8_t*) heap_caps_malloc(GSM_FRAME_BUF_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+	_allocCount(2);
+	#endif
+    if ((data == NULL) || (frame == NULL)) {
+		#if GSM_DEBUG
+		ESP_LOGE(h->tag,"Failed to allocate data buffer.");
+		#endif
+    	goto exit;
+    }
+
+	h->baud_rate = h->cfg.baud_rate;
+	if ((h->cfg.serial == NULL) && (_uartInit(h) == 0)) goto exit;
+
+	// Set APN from config
+	snprintf(h->apn_cmd, sizeof(h->apn_cmd), "AT+CGDCONT=1,\"IP\",\"%s\"\r\n", h->cfg.apn);
+	h->cmd[GSM_CMD_APN].cmd = h->apn_cmd;
+	h->cmd[GSM_CMD_APN].cmdSize = strlen(h->apn_cmd);
+
+	h->init_start_tick = xTaskGetTickCount();
+	enableAllInitCmd(h);
+	#if GSM_DEBUG
+	ESP_LOGI(h->tag,"Task running on core %d, priority %d, stack %d", xPortGetCoreID(), h->cfg.task_priority, h->cfg.task_stack);
+	#endif
+
+	// The modem may still use the rate negotiated before restart
+	if (h->cfg.max_baud_rate > h->baud_rate) _probeBaudRate(h);
+
+	#ifdef CONFIG_GSM_WARM_START
+	h->warm_started = _warmStart(h);
+	if (h->warm_started == 0) _disconnect(h, 1); // Disconnect if connected
+	#else
+	_disconnect(h, 1); // Disconnect if connected
+	#endif
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+    h->pppos_tx_count = 0;
+    h->pppos_rx_count = 0;
+	h->gsm_status = GSM_STATE_FIRSTINIT;
+	GSM_TRACE(GSM_TRC_STATE, h->index, GSM_STATE_FIRSTINIT, 0);
+	xSemaphoreGive(h->mutex);
+
+	while(1)
+	{
+		#if GSM_DEBUG
+		ESP_LOGI(h->tag,"GSM initialization start");
+		#endif
+		vTaskDelay(500 / portTICK_PERIOD_MS);
+
+		int gsmCmdIter = 0;
+		int cmd_fail = 0;
+		// * GSM Initialization loop
+		while(gsmCmdIter < h->ninit)
+		{
+			// Queued requests are executed once the modem responds to commands
+			_atService(h, (h->profile != NULL) ? GSM_AT_EXEC : GSM_AT_EXPIRE);
+
+			// Modem responds to basic commands, select the profile before model dependent commands are sent
+			if (h->init[gsmCmdIter] == &h->cmd[GSM_CMD_RFON]) {
+				if (h->profile == NULL) {
+					_detectModem(h);
+					if (h->cfg.max_baud_rate > h->baud_rate) _negotiateBaudRate(h);
+				}
+				// flow control setting can be lost on modem reset, set it on every initialization
+				if ((h->cfg.rts_pin >= 0) && (h->cfg.cts_pin >= 0)) _setFlowControl(h);
+			}
+
+			if (h->init[gsmCmdIter]->skip) {
+				#if GSM_DEBUG
+				infoCommand(h, h->init[gsmCmdIter]->cmd, h->init[gsmCmdIter]->cmdSize, "Skip command:");
+				#endif
+				gsmCmdIter++;
+				continue;
+			}
+			int res = atCmd_waitResponse(h, h->init[gsmCmdIter]->cmd,
+					h->init[gsmCmdIter]->cmdResponseOnOk, NULL,
+					h->init[gsmCmdIter]->cmdSize,
+					h->init[gsmCmdIter]->timeoutMs, NULL, 0);
+			if (h->init[gsmCmdIter] == &h->cmd[GSM_CMD_RFON]) h->rf_on_time = esp_timer_get_time();
+			// Registration URCs are enabled, wait until the modem is registered
+			if ((res) && (h->init[gsmCmdIter] == &h->cmd[GSM_CMD_REG])) res = _waitRegistration(h);
+			if (res == 0)
+			{
+				// * No response or not as expected, start from first initialization command
+				#if GSM_DEBUG
+				ESP_LOGW(h->tag,"Wrong response, restarting...");
+				#endif
+
+				cmd_fail++;
+				xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+				h->metrics.init_failures++;
+				xSemaphoreGive(h->mutex);
+				if (h->warm_started) {
+					// Recorded state is not valid, do the full initialization
+					h->warm_started = 0;
+					#ifdef CONFIG_GSM_WARM_START
+					warm_state[h->index].magic = 0;
+					#endif
+					enableAllInitCmd(h);
+				}
+				// The modem may have changed the baud rate (reset), find it
+				if (h->cfg.max_baud_rate > h->cfg.baud_rate) _probeBaudRate(h);
+
+				if (cmd_fail <= GSM_INIT_CMD_RETRIES) {
+					// Modem is not ready yet, retry the command soon (the commands already executed are skipped)
+					_serviceWait(h, GSM_INIT_RETRY_MS);
+				}
+				else {
+					// Modem or network is not available, back off and restart the whole initialization
+					cmd_fail = 0;
+					enableAllInitCmd(h);
+					_reconnectWait(h);
+				}
+				gsmCmdIter = 0;
+				continue;
+			}
+			cmd_fail = 0;
+
+			if (h->init[gsmCmdIter]->delayMs > 0) vTaskDelay(h->init[gsmCmdIter]->delayMs / portTICK_PERIOD_MS);
+			h->init[gsmCmdIter]->skip = 1;
+			#ifdef CONFIG_GSM_NETWORK_TIME
+			// Network time must be enabled before RF is turned on and is available after registration
+			if (h->init[gsmCmdIter] == &h->cmd[GSM_CMD_ECHOOFF]) _enableNetworkTime(h);
+			if ((h->init[gsmCmdIter] == &h->cmd[GSM_CMD_REG]) && (h->time_set == 0)) _getNetworkTime(h);
+			#endif
+			if (h->init[gsmCmdIter] == &h->cmd[GSM_CMD_APN]) {
+				#ifdef CONFIG_GSM_WARM_START
+				_saveWarmState(h);	// modem is registered and configured, record the state before going online
+				#endif
+			}
+			if (h->init[gsmCmdIter] == &h->cmd[GSM_CMD_CONNECT]) {
+				h->connect_time_ms = (xTaskGetTickCount() - h->init_start_tick) * portTICK_PERIOD_MS;
+				xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+				gsm_hist_add(&h->metrics.init_time, h->connect_time_ms);
+				xSemaphoreGive(h->mutex);
+				#if GSM_DEBUG
+				ESP_LOGI(h->tag,"CONNECT after %u ms (%s start)", h->connect_time_ms, (h->warm_started) ? "warm" : "cold");
+				#endif
+				#ifdef CONFIG_GSM_WARM_START
+				warm_state[h->index].connect_ms = h->connect_time_ms;
+				#endif
+			}
+			// Next command
+			gsmCmdIter++;
+		}
+
+		#if GSM_DEBUG
+		ESP_LOGI(h->tag,"GSM initialized.");
+		#endif
+
+		xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+		if (h->gsm_status == GSM_STATE_FIRSTINIT) {
+			xSemaphoreGive(h->mutex);
+			// ** After first successful initialization create PPP control block
+			h->ppp = pppapi_pppos_create(&h->netif,
+					ppp_output_callback, ppp_status_cb, h);
+
+			if (h->ppp == NULL) {
+				#if GSM_DEBUG
+				ESP_LOGE(h->tag, "Error initializing PPPoS");
+				#endif
+				break; // end task
+			}
+		}
+		else xSemaphoreGive(h->mutex);
+
+		if (h->cfg.set_default) pppapi_set_default(h->ppp);
+		pppapi_set_auth(h->ppp, PPPAUTHTYPE_PAP, h->cfg.user, h->cfg.pass);
+		//pppapi_set_auth(h->ppp, PPPAUTHTYPE_NONE, h->cfg.user, h->cfg.pass);
+
+		xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+		h->gsm_status = GSM_STATE_IDLE;
+		GSM_TRACE(GSM_TRC_STATE, h->index, GSM_STATE_IDLE, 0);
+		xSemaphoreGive(h->mutex);
+		hdlc_rx_init(&h->rx_hdlc, frame, GSM_FRAME_BUF_SIZE);
+		hdlc_reset(&h->tx_hdlc);
+		pppapi_connect(h->ppp, 0);
+
+		// *** LOOP: Handle GSM modem responses & disconnects ***
+		while(1) {
+			// === Check if disconnect requested ===
+			xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+			if (h->do_pppos_connect <= 0) {
+				int end_task = h->do_pppos_connect;
+				h->do_pppos_connect = 1;
+				xSemaphoreGive(h->mutex);
+				#if GSM_DEBUG
+				printf("\r\n");
+				ESP_LOGI(h->tag, "Disconnect requested.");
+				#endif
+
+				pppapi_close(h->ppp, 0);
 				int gstat = 1;
-				while (gsm_status != GSM_STATE_DISCONNECTED) {
+				while (h->gsm_status != GSM_STATE_DISCONNECTED) {
 					// Handle data received from GSM
-					memset(data, 0, BUF_SIZE);
-					int len = uart_read_bytes(uart_num, (uint8_t*)data, BUF_SIZE, 30 / portTICK_RATE_MS);
-					if (len > 0)	{
-						pppos_input_tcpip(ppp, (u8_t*)data, len);
-						xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-					    pppos_tx_count += len;
-						xSemaphoreGive(pppos_mutex);
-					}
-					xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-					gstat = gsm_status;
-					xSemaphoreGive(pppos_mutex);
+					int len = _serRead(h, data, h->read_size, 30);
+					_rxData(h, data, len);
+					xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+					gstat = h->gsm_status;
+					xSemaphoreGive(h->mutex);
 				}
 				vTaskDelay(1000 / portTICK_PERIOD_MS);
 
-				xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-				uint8_t rfoff = gsm_rfOff;
-				xSemaphoreGive(pppos_mutex);
-				_disconnect(rfoff); // Disconnect GSM if still connected
+				xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+				uint8_t rfoff = h->gsm_rfOff;
+				xSemaphoreGive(h->mutex);
+				_disconnect(h, rfoff); // Disconnect GSM if still connected
 
 				#if GSM_DEBUG
-				ESP_LOGI(TAG, "Disconnected.");
+				ESP_LOGI(h->tag, "Disconnected.");
 				#endif
 
 				gsmCmdIter = 0;
-				enableAllInitCmd();
-				xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-				gsm_status = GSM_STATE_IDLE;
-				do_pppos_connect = 0;
-				xSemaphoreGive(pppos_mutex);
+				enableAllInitCmd(h);
+				h->warm_started = 0;
+				xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+				h->gsm_status = GSM_STATE_IDLE;
+				GSM_TRACE(GSM_TRC_STATE, h->index, GSM_STATE_IDLE, 0);
+				h->do_pppos_connect = 0;
+				xSemaphoreGive(h->mutex);
 
 				if (end_task < 0) goto exit;
 
 				// === Wait for reconnect request ===
 				gstat = 0;
 				while (gstat == 0) {
+					_atService(h, GSM_AT_EXEC);
+					_urcDrain(h);
 					vTaskDelay(100 / portTICK_PERIOD_MS);
-					xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-					gstat = do_pppos_connect;
-					xSemaphoreGive(pppos_mutex);
+					xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+					gstat = h->do_pppos_connect;
+					xSemaphoreGive(h->mutex);
 				}
 				#if GSM_DEBUG
 				printf("\r\n");
-				ESP_LOGI(TAG, "Reconnect requested.");
+				ESP_LOGI(h->tag, "Reconnect requested.");
 				#endif
+				xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+				h->retries = 0;
+				h->link_lost = 0;
+				h->lost_tick = 0;
+				xSemaphoreGive(h->mutex);
+				h->init_start_tick = xTaskGetTickCount();
 				break;
 			}
 
 			// === Check if disconnected ===
-			if (gsm_status == GSM_STATE_DISCONNECTED) {
-				xSemaphoreGive(pppos_mutex);
+			if (h->gsm_status == GSM_STATE_DISCONNECTED) {
+				xSemaphoreGive(h->mutex);
 				#if GSM_DEBUG
 				printf("\r\n");
-				ESP_LOGE(TAG, "Disconnected, trying again...");
+				ESP_LOGE(h->tag, "Disconnected, trying again...");
 				#endif
-				pppapi_close(ppp, 0);
+				pppapi_close(h->ppp, 0);
 
-				enableAllInitCmd();
+				enableAllInitCmd(h);
+				h->warm_started = 0;
 				gsmCmdIter = 0;
-				gsm_status = GSM_STATE_IDLE;
-				vTaskDelay(10000 / portTICK_PERIOD_MS);
+				h->gsm_status = GSM_STATE_IDLE;
+				GSM_TRACE(GSM_TRC_STATE, h->index, GSM_STATE_IDLE, 0);
+				_reconnectWait(h);
+				h->init_start_tick = xTaskGetTickCount();
 				break;
 			}
-			else xSemaphoreGive(pppos_mutex);
+			else xSemaphoreGive(h->mutex);
 
 			// === Handle data received from GSM ===
-			memset(data, 0, BUF_SIZE);
-			int len = uart_read_bytes(uart_num, (uint8_t*)data, BUF_SIZE, 30 / portTICK_RATE_MS);
-			if (len > 0)	{
-				pppos_input_tcpip(ppp, (u8_t*)data, len);
-				xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-			    pppos_tx_count += len;
-				xSemaphoreGive(pppos_mutex);
-			}
+			int len = _serRead(h, data, h->read_size, 30);
+			_rxData(h, data, len);
 
+			// AT requests can't be executed in data mode
+			_atService(h, GSM_AT_EXPIRE);
 		}  // Handle GSM modem responses & disconnects loop
 	}  // main task loop
 
 exit:
-	if (data) free(data);  // free data buffer
-	if (ppp) ppp_free(ppp);
-
-	xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-	pppos_task_started = 0;
-	gsm_status = GSM_STATE_FIRSTINIT;
-	xSemaphoreGive(pppos_mutex);
+	#ifndef CONFIG_GSM_STATIC_ALLOC
+	if (data) free(data);  // free data buffers
+	data = NULL;
+	if (frame) free(frame);
+	frame = NULL;
+	#endif
+	if (h->ppp) ppp_free(h->ppp);
+	h->ppp = NULL;
+	if (h->cfg.serial == NULL) uart_driver_delete(h->cfg.uart_num);
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	h->pppos_task_started = 0;
+	h->gsm_status = GSM_STATE_FIRSTINIT;
+	GSM_TRACE(GSM_TRC_STATE, h->index, GSM_STATE_FIRSTINIT, 0);
+	xSemaphoreGive(h->mutex);
+	// No new requests are accepted, complete the queued ones
+	_atService(h, GSM_AT_CANCEL);
 	#if GSM_DEBUG
-	ESP_LOGE(TAG, "PPPoS TASK TERMINATED");
+	ESP_LOGE(h->tag, "PPPoS TASK TERMINATED");
 	#endif
+	#ifdef CONFIG_GSM_STATIC_ALLOC
+	// The task's memory can't be reused until the deleted task is cleaned up by the idle task,
+	// static task is not deleted but waits to be restarted by ppposInit()
+	ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	goto start;
+	#else
+	h->task = NULL;
 	vTaskDelete(NULL);
+	#endif
 }
 
-//=============
-int ppposInit()
+//============================================
+void gsm_defaultConfig(gsm_config_t *cfg)
 {
-	if (pppos_mutex != NULL) xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-	do_pppos_connect = 1;
+	memset(cfg, 0, sizeof(gsm_config_t));
+	cfg->uart_num = UART_NUM_1;
+	cfg->tx_pin = UART_GPIO_TX;
+	cfg->rx_pin = UART_GPIO_RX;
+	cfg->baud_rate = UART_BDRATE;
+	cfg->max_baud_rate = UART_MAX_BDRATE;
+	cfg->rts_pin = UART_GPIO_RTS;
+	cfg->uart_rx_buf = UART_RX_BUF;
+	cfg->uart_tx_buf = UART_TX_BUF;
+	cfg->cts_pin = UART_GPIO_CTS;
+	cfg->task_core = PPPOS_CLIENT_CORE;
+	cfg->task_priority = PPPOS_CLIENT_PRIORITY;
+	cfg->task_stack = PPPOS_CLIENT_STACK_SIZE;
+	strncpy(cfg->apn, CONFIG_GSM_APN, GSM_APN_MAX-1);
+	strncpy(cfg->user, CONFIG_GSM_INTERNET_USER, sizeof(cfg->user)-1);
+	strncpy(cfg->pass, CONFIG_GSM_INTERNET_PASSWORD, sizeof(cfg->pass)-1);
+	cfg->set_default = 1;
+	cfg->reconnect_fast_ms = GSM_RECONNECT_FAST;
+	cfg->reconnect_min_ms = GSM_RECONNECT_MIN;
+	cfg->reconnect_max_ms = GSM_RECONNECT_MAX;
+	cfg->reconnect_jitter = GSM_RECONNECT_JITTER;
+	#if defined(CONFIG_GSM_MODEM_SIM800)
+	cfg->modem = GSM_MODEM_SIM800;
+	#elif defined(CONFIG_GSM_MODEM_M590)
+	cfg->modem = GSM_MODEM_M590;
+	#elif defined(CONFIG_GSM_MODEM_GL865)
+	cfg->modem = GSM_MODEM_GL865;
+	#elif defined(CONFIG_GSM_MODEM_SIM7000)
+	cfg->modem = GSM_MODEM_SIM7000;
+	#elif defined(CONFIG_GSM_MODEM_GENERIC)
+	cfg->modem = GSM_MODEM_GENERIC;
+	#else
+	cfg->modem = GSM_MODEM_AUTO;
+	#endif
+}
+
+// Instances are created one at a time, the creation can't be done in a critical section
+//---------------------------
+static void _createLock(void)
+{
+	while (1) {
+		portENTER_CRITICAL(&gsm_create_mux);
+		uint8_t busy = gsm_creating;
+		gsm_creating = 1;
+		portEXIT_CRITICAL(&gsm_create_mux);
+		if (busy == 0) return;
+		vTaskDelay(1);
+	}
+}
+
+//-----------------------------
+static void _createUnlock(void)
+{
+	portENTER_CRITICAL(&gsm_create_mux);
+	gsm_creating = 0;
+	portEXIT_CRITICAL(&gsm_create_mux);
+}
+
+// Create the instance, must be called with the creation lock taken
+//-------------------------------------------------
+static gsm_handle _create(const gsm_config_t *cfg)
+{
+	if (gsm_num_instances >= GSM_MAX_MODEMS) {
+		#if GSM_DEBUG
+		ESP_LOGE(TAG, "Max number of GSM instances (%d) already created", GSM_MAX_MODEMS);
+		#endif
+		return NULL;
+	}
+
+	// Modules shared by all instances
+	if ((gsm_dns_init() == 0) || (gsm_link_init() == 0)) return NULL;
+
+	#ifdef CONFIG_GSM_STATIC_ALLOC
+	gsm_handle h = &gsm_ctx_pool[gsm_num_instances];
+	memset(h, 0, sizeof(struct gsm_ctx));
+	h->mutex = xSemaphoreCreateMutexStatic(&h->mutex_buf);
+	h->at_mutex = xSemaphoreCreateRecursiveMutexStatic(&h->at_mutex_buf);
+	h->at_queue = xQueueCreateStatic(GSM_AT_QUEUE_LEN, sizeof(gsm_at_req_t), h->at_queue_storage, &h->at_queue_buf);
+	#else
+	gsm_handle h = calloc(1, sizeof(struct gsm_ctx));
+	_allocCount(1);
+	if (h == NULL) return NULL;
+
+	h->mutex = xSemaphoreCreateMutex();
+	h->at_mutex = xSemaphoreCreateRecursiveMutex();
+	h->at_queue = xQueueCreate(GSM_AT_QUEUE_LEN, sizeof(gsm_at_req_t));
+	_allocCount(3);
+	if ((h->mutex == NULL) || (h->at_mutex == NULL) || (h->at_queue == NULL)) {
+		if (h->mutex) vSemaphoreDelete(h->mutex);
+		if (h->at_mutex) vSemaphoreDelete(h->at_mutex);
+		if (h->at_queue) vQueueDelete(h->at_queue);
+		free(h);
+		return NULL;
+	}
+	#endif
+
+	memcpy(&h->cfg, cfg, sizeof(gsm_config_t));
+	h->cfg.apn[GSM_APN_MAX-1] = '\0';
+	#ifdef CONFIG_GSM_STATIC_ALLOC
+	h->cfg.task_stack = PPPOS_CLIENT_STACK_SIZE;	// size of the reserved stack
+	#else
+	if (h->cfg.task_stack < PPPOS_CLIENT_STACK_SIZE) h->cfg.task_stack = PPPOS_CLIENT_STACK_SIZE;
+	#endif
+	if (h->cfg.task_priority <= 0) h->cfg.task_priority = PPPOS_CLIENT_PRIORITY;
+	if ((h->cfg.task_core < 0) || (h->cfg.task_core >= portNUM_PROCESSORS)) h->cfg.task_core = -1;
+	if (h->cfg.reconnect_min_ms == 0) h->cfg.reconnect_min_ms = GSM_RECONNECT_MIN;
+	if (h->cfg.reconnect_max_ms == 0) h->cfg.reconnect_max_ms = GSM_RECONNECT_MAX;
+	if (h->cfg.reconnect_max_ms < h->cfg.reconnect_min_ms) h->cfg.reconnect_max_ms = h->cfg.reconnect_min_ms;
+	if (h->cfg.reconnect_jitter > 100) h->cfg.reconnect_jitter = 100;
+	h->index = gsm_num_instances;
+	h->gsm_status = GSM_STATE_FIRSTINIT;
+	GSM_TRACE(GSM_TRC_STATE, h->index, GSM_STATE_FIRSTINIT, 0);
+	h->do_pppos_connect = 1;
+
+	// Each instance works on its own copy of the initialization commands
+	for (int i=0; i<GSM_CMD_NUM; i++) {
+		memcpy(&h->cmd[i], GSM_Init[i], sizeof(GSM_Cmd));
+		h->init[i] = &h->cmd[i];
+	}
+	h->ninit = GSM_InitCmdsSize;
+
+	if (h->index == 0) {
+		strcpy(h->task_name, "pppos_client_task");
+		strcpy(h->tag, TAG);
+	}
+	else {
+		sprintf(h->task_name, "pppos_client_%d", h->index);
+		sprintf(h->tag, "[PPPOS CLIENT %d]", h->index);
+	}
+
+	gsm_instances[gsm_num_instances++] = h;
+	return h;
+}
+
+//================================================
+gsm_handle gsmCreate(const gsm_config_t *cfg)
+{
+	_createLock();
+	gsm_handle h = _create(cfg);
+	_createUnlock();
+	return h;
+}
+
+// Get the GSM instance, NULL selects the default instance which is created on first use
+// Concurrent first calls from different tasks create it only once
+//-------------------------------------------
+static gsm_handle _getHandle(gsm_handle gsm)
+{
+	if (gsm != NULL) return gsm;
+	if (gsm_instances[0] != NULL) return gsm_instances[0];
+
+	_createLock();
+	gsm_handle h = gsm_instances[0];
+	if (h == NULL) {
+		gsm_config_t cfg;
+		gsm_defaultConfig(&cfg);
+		h = _create(&cfg);
+	}
+	_createUnlock();
+	return h;
+}
+
+//============================
+int ppposInit(gsm_handle gsm)
+{
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return 0;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	h->do_pppos_connect = 1;
 	int gstat = 0;
-	int task_s = pppos_task_started;
-	if (pppos_mutex != NULL) xSemaphoreGive(pppos_mutex);
+	int task_s = h->pppos_task_started;
+	xSemaphoreGive(h->mutex);
 
 	if (task_s == 0) {
-		if (pppos_mutex == NULL) pppos_mutex = xSemaphoreCreateMutex();
-		if (pppos_mutex == NULL) return 0;
-
 		if (tcpip_adapter_initialized == 0) {
 			tcpip_adapter_init();
 			tcpip_adapter_initialized = 1;
 		}
-		xTaskCreate(&pppos_client_task, "pppos_client_task", PPPOS_CLIENT_STACK_SIZE, NULL, 10, NULL);
+		// The UART driver interrupt is allocated on the core the task runs on
+		BaseType_t core = (h->cfg.task_core < 0) ? tskNO_AFFINITY : h->cfg.task_core;
+		#ifdef CONFIG_GSM_STATIC_ALLOC
+		if (h->task != NULL) xTaskNotifyGive(h->task);
+		else {
+			h->task = xTaskCreateStaticPinnedToCore(&pppos_client_task, h->task_name, h->cfg.task_stack, h,
+					h->cfg.task_priority, h->task_stack, &h->task_buf, core);
+			if (h->task == NULL) {
+				#if GSM_DEBUG
+				ESP_LOGE(h->tag,"Failed to create task");
+				#endif
+				return 0;
+			}
+		}
+		#else
+		_allocCount(1);
+		if (xTaskCreatePinnedToCore(&pppos_client_task, h->task_name, h->cfg.task_stack, h, h->cfg.task_priority, &h->task, core) != pdPASS) {
+			#if GSM_DEBUG
+			ESP_LOGE(h->tag,"Failed to create task");
+			#endif
+			return 0;
+		}
+		#endif
 		while (task_s == 0) {
 			vTaskDelay(10 / portTICK_RATE_MS);
-			xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-			task_s = pppos_task_started;
-			xSemaphoreGive(pppos_mutex);
+			xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+			task_s = h->pppos_task_started;
+			xSemaphoreGive(h->mutex);
 		}
 	}
 
 	while (gstat != 1) {
 		vTaskDelay(10 / portTICK_RATE_MS);
-		xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-		gstat = gsm_status;
-		task_s = pppos_task_started;
-		xSemaphoreGive(pppos_mutex);
+		xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+		gstat = h->gsm_status;
+		task_s = h->pppos_task_started;
+		xSemaphoreGive(h->mutex);
 		if (task_s == 0) return 0;
 	}
 
 	return 1;
 }
 
-//===================================================
-void ppposDisconnect(uint8_t end_task, uint8_t rfoff)
+//===================================================================
+void ppposDisconnect(gsm_handle gsm, uint8_t end_task, uint8_t rfoff)
 {
-	xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-	int gstat = gsm_status;
-	xSemaphoreGive(pppos_mutex);
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	int gstat = h->gsm_status;
+	xSemaphoreGive(h->mutex);
 
 	if (gstat == GSM_STATE_IDLE) return;
 
 	gstat = 0;
 
 	vTaskDelay(2000 / portTICK_RATE_MS);
-	xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-	if (end_task) do_pppos_connect = -1;
-	else do_pppos_connect = 0;
-	gsm_rfOff = rfoff;
-	xSemaphoreGive(pppos_mutex);
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	if (end_task) h->do_pppos_connect = -1;
+	else h->do_pppos_connect = 0;
+	h->gsm_rfOff = rfoff;
+	xSemaphoreGive(h->mutex);
 
 	while (gstat == 0) {
-		xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-		gstat = do_pppos_connect;
-		xSemaphoreGive(pppos_mutex);
+		xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+		gstat = h->do_pppos_connect;
+		xSemaphoreGive(h->mutex);
 		vTaskDelay(10 / portTICK_RATE_MS);
 	}
 	while (gstat != 0) {
 		vTaskDelay(100 / portTICK_RATE_MS);
-		xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-		gstat = do_pppos_connect;
-		xSemaphoreGive(pppos_mutex);
+		xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+		gstat = h->do_pppos_connect;
+		xSemaphoreGive(h->mutex);
 	}
 }
 
-//===================
-int ppposStatus()
+//=============================
+int ppposStatus(gsm_handle gsm)
 {
-	xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-	int gstat = gsm_status;
-	xSemaphoreGive(pppos_mutex);
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return GSM_STATE_FIRSTINIT;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	int gstat = h->gsm_status;
+	xSemaphoreGive(h->mutex);
 
 	return gstat;
 }
 
-//========================================================
-void getRxTxCount(uint32_t *rx, uint32_t *tx, uint8_t rst)
+//=========================================================================
+void gsm_GetUartStats(gsm_handle gsm, gsm_uart_stats_t *stats, uint8_t rst)
+{
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) {
+		memset(stats, 0, sizeof(gsm_uart_stats_t));
+		return;
+	}
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	memcpy(stats, &h->uart_stats, sizeof(gsm_uart_stats_t));
+	stats->flow_ctrl = h->flow_ctrl;
+	if (rst) memset(&h->uart_stats, 0, sizeof(gsm_uart_stats_t));
+	xSemaphoreGive(h->mutex);
+}
+
+//===========================================
+uint32_t gsm_GetTaskStackFree(gsm_handle gsm)
+{
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return 0;
+
+	uint32_t stack_free = 0;
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	if ((h->pppos_task_started) && (h->task != NULL)) stack_free = uxTaskGetStackHighWaterMark(h->task);
+	xSemaphoreGive(h->mutex);
+	return stack_free;
+}
+
+//=============================
+void *gsm_bufAlloc(size_t size)
 {
-	xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-	*rx = pppos_rx_count;
-	*tx = pppos_tx_count;
+	void *buf = NULL;
+	#ifdef CONFIG_GSM_BUF_PSRAM
+	buf = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+	#endif
+	if (buf == NULL) buf = malloc(size);
+	_allocCount(1);
+	return buf;
+}
+
+//=====================================
+uint32_t gsm_GetAllocCount(uint8_t rst)
+{
+	if (rst) return __atomic_exchange_n(&gsm_allocs, 0, __ATOMIC_RELAXED);
+	return __atomic_load_n(&gsm_allocs, __ATOMIC_RELAXED);
+}
+
+//===========================================================================
+void gsm_GetMetrics(gsm_handle gsm, gsm_metrics_t *metrics, uint8_t rst)
+{
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) {
+		memset(metrics, 0, sizeof(gsm_metrics_t));
+		return;
+	}
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	memcpy(metrics, &h->metrics, sizeof(gsm_metrics_t));
+	if (rst) memset(&h->metrics, 0, sizeof(gsm_metrics_t));
+	xSemaphoreGive(h->mutex);
+}
+
+//======================================
+uint32_t gsm_GetBaudRate(gsm_handle gsm)
+{
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return 0;
+	return h->baud_rate;
+}
+
+//=======================================
+const char *gsm_ModemName(gsm_handle gsm)
+{
+	gsm_handle h = _getHandle(gsm);
+	if ((h == NULL) || (h->profile == NULL)) return "unknown";
+	return h->profile->name;
+}
+
+//===================================
+uint8_t gsm_ModemCaps(gsm_handle gsm)
+{
+	gsm_handle h = _getHandle(gsm);
+	if ((h == NULL) || (h->profile == NULL)) return 0;
+	return h->profile->caps;
+}
+
+//====================================================================
+void gsmSetStatusCallback(gsm_handle gsm, gsm_status_cb cb, void *arg)
+{
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	h->status_cb = cb;
+	h->status_cb_arg = arg;
+	xSemaphoreGive(h->mutex);
+}
+
+//================================
+uint32_t gsm_GetIP(gsm_handle gsm)
+{
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return 0;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	uint32_t ip = h->local_ip;
+	xSemaphoreGive(h->mutex);
+
+	return ip;
+}
+
+//================================
+int gsm_SetDefault(gsm_handle gsm)
+{
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return 0;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	int gstat = h->gsm_status;
+	xSemaphoreGive(h->mutex);
+
+	if ((gstat != GSM_STATE_CONNECTED) || (h->ppp == NULL)) return 0;
+	pppapi_set_default(h->ppp);
+	return 1;
+}
+
+//=====================================
+int gsm_TimeFromNetwork(gsm_handle gsm)
+{
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return 0;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	int tset = h->time_set;
+	xSemaphoreGive(h->mutex);
+
+	return tset;
+}
+
+//======================================================
+uint32_t gsm_ConnectTime(gsm_handle gsm, uint8_t *warm)
+{
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return 0;
+
+	if (warm) *warm = h->warm_started;
+	return h->connect_time_ms;
+}
+
+//========================================================================
+void getRxTxCount(gsm_handle gsm, uint32_t *rx, uint32_t *tx, uint8_t rst)
+{
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	*rx = h->pppos_rx_count;
+	*tx = h->pppos_tx_count;
 	if (rst) {
-		pppos_rx_count = 0;
-		pppos_tx_count = 0;
+		h->pppos_rx_count = 0;
+		h->pppos_tx_count = 0;
 	}
-	xSemaphoreGive(pppos_mutex);
+	xSemaphoreGive(h->mutex);
+}
+
+//==================================
+void resetRxTxCount(gsm_handle gsm)
+{
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	h->pppos_rx_count = 0;
+	h->pppos_tx_count = 0;
+	xSemaphoreGive(h->mutex);
 }
 
-//===================
-void resetRxTxCount()
+//=====================================================
+int gsm_GetRegistration(gsm_handle gsm, gsm_reg_t *reg)
 {
-	xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-	pppos_rx_count = 0;
-	pppos_tx_count = 0;
-	xSemaphoreGive(pppos_mutex);
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return 0;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	int type = (GSM_REG_REGISTERED(h->reg[GSM_REG_EPS].stat)) ? GSM_REG_EPS : GSM_REG_CS;
+	memcpy(reg, &h->reg[type], sizeof(gsm_reg_t));
+	xSemaphoreGive(h->mutex);
+	return GSM_REG_REGISTERED(reg->stat);
 }
 
-//=============
-int gsm_RFOff()
+//===========================
+int gsm_RFOff(gsm_handle gsm)
 {
-	xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-	int gstat = gsm_status;
-	xSemaphoreGive(pppos_mutex);
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return 0;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	int gstat = h->gsm_status;
+	xSemaphoreGive(h->mutex);
 
 	if (gstat != GSM_STATE_IDLE) return 0;
 
 	uint8_t f = 1;
-	char buf[64] = {'\0'};
-	char *pbuf = buf;
-	int res = atCmd_waitResponse("AT+CFUN?\r\n", NULL, NULL, -1, 2000, &pbuf, 63);
+	int size = 64;
+	char *rbuffer = _respAlloc(h, &size);
+	if (rbuffer == NULL) return 0;
+	int res = atCmd_waitResponse(h, "AT+CFUN?\r\n", NULL, NULL, -1, 2000, &rbuffer, size);
 	if (res > 0) {
-		if (strstr(buf, "+CFUN: 4")) f = 0;
+		if (strstr(rbuffer, "+CFUN: 4")) f = 0;
 	}
+	_respFree(rbuffer);
 
 	if (f) {
-		cmd_Reg.timeoutMs = 500;
-		return atCmd_waitResponse("AT+CFUN=4\r\n", GSM_OK_Str, NULL, 11, 10000, NULL, 0); // disable RF function
+		return atCmd_waitResponse(h, "AT+CFUN=4\r\n", GSM_OK_Str, NULL, 11, 10000, NULL, 0); // disable RF function
 	}
 	return 1;
 }
 
-//============
-int gsm_RFOn()
+//==========================
+int gsm_RFOn(gsm_handle gsm)
 {
-	xSemaphoreTake(pppos_mutex, PPPOSMUTEX_TIMEOUT);
-	int gstat = gsm_status;
-	xSemaphoreGive(pppos_mutex);
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return 0;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	int gstat = h->gsm_status;
+	xSemaphoreGive(h->mutex);
 
 	if (gstat != GSM_STATE_IDLE) return 0;
 
 	uint8_t f = 1;
-	char buf[64] = {'\0'};
-	char *pbuf = buf;
-	int res = atCmd_waitResponse("AT+CFUN?\r\n", NULL, NULL, -1, 2000, &pbuf, 63);
+	int size = 64;
+	char *rbuffer = _respAlloc(h, &size);
+	if (rbuffer == NULL) return 0;
+	int res = atCmd_waitResponse(h, "AT+CFUN?\r\n", NULL, NULL, -1, 2000, &rbuffer, size);
 	if (res > 0) {
-		if (strstr(buf, "+CFUN: 1")) f = 0;
+		if (strstr(rbuffer, "+CFUN: 1")) f = 0;
 	}
+	_respFree(rbuffer);
 
 	if (f) {
-		cmd_Reg.timeoutMs = 0;
-		return atCmd_waitResponse("AT+CFUN=1\r\n", GSM_OK_Str, NULL, 11, 10000, NULL, 0); // disable RF function
+		return atCmd_waitResponse(h, "AT+CFUN=1\r\n", GSM_OK_Str, NULL, 11, 10000, NULL, 0); // enable RF function
 	}
 	return 1;
 }
 
+//=============================================================================================================
+int gsm_atSubmit(gsm_handle gsm, const char *cmd, const char *ok, uint32_t timeout_ms, gsm_at_cb cb, void *arg)
+{
+	gsm_handle h = _getHandle(gsm);
+	if ((h == NULL) || (cmd == NULL)) return 0;
+
+	gsm_at_req_t req;
+	int len = strlen(cmd);
+	int crlf = ((len >= 2) && (cmd[len-2] == '\r') && (cmd[len-1] == '\n')) ? 0 : 2;
+	if ((len + crlf) >= GSM_AT_CMD_MAX) return 0;
+	memcpy(req.cmd, cmd, len);
+	if (crlf) memcpy(req.cmd + len, "\r\n", 2);
+	req.cmd[len + crlf] = '\0';
+	strncpy(req.ok, (ok) ? ok : GSM_OK_Str, sizeof(req.ok)-1);
+	req.ok[sizeof(req.ok)-1] = '\0';
+	req.timeout_ms = (timeout_ms) ? timeout_ms : GSM_AT_TIMEOUT_MS;
+	req.cb = cb;
+	req.arg = arg;
+	req.t_submit = esp_timer_get_time();
+
+	// Queued under mutex, so the request is either rejected or completed by the task when it ends
+	int res = 0;
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	if ((h->pppos_task_started) && (xQueueSend(h->at_queue, &req, 0) == pdTRUE)) {
+		h->metrics.at_requests++;
+		res = 1;
+	}
+	xSemaphoreGive(h->mutex);
+	return res;
+}
+
+// gsm_atCommand() request completion, wakes up the waiting task
+//--------------------------------------------------------------------------------
+static void _atWaitDone(gsm_handle h, int result, const char *response, void *arg)
+{
+	gsm_at_wait_t *w = (gsm_at_wait_t *)arg;
+	w->result = result;
+	if ((w->resp) && (w->size > 0)) {
+		strncpy(w->resp, response, w->size-1);
+		w->resp[w->size-1] = '\0';
+	}
+	xTaskNotifyGive(w->task);
+}
+
+//===========================================================================================================
+int gsm_atCommand(gsm_handle gsm, const char *cmd, const char *ok, uint32_t timeout_ms, char *resp, int size)
+{
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return GSM_AT_NOTREADY;
+	if ((resp) && (size > 0)) resp[0] = '\0';
+	// The PPPoS task would wait for itself
+	if (xTaskGetCurrentTaskHandle() == h->task) return GSM_AT_NOTREADY;
+
+	gsm_at_wait_t w = { xTaskGetCurrentTaskHandle(), GSM_AT_NOTREADY, resp, size };
+	if (gsm_atSubmit(h, cmd, ok, timeout_ms, _atWaitDone, &w) == 0) return GSM_AT_NOTREADY;
+
+	// Every queued request is completed, executed, expired or canceled when the task ends
+	ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	return w.result;
+}
+
+//===========================================================================
+int gsm_urcSubscribe(gsm_handle gsm, uint32_t mask, gsm_urc_cb cb, void *arg)
+{
+	gsm_handle h = _getHandle(gsm);
+	if ((h == NULL) || (cb == NULL)) return 0;
+
+	int res = 0;
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	for (int i=0; i<GSM_URC_SUBS; i++) {
+		if (h->urc_subs[i].cb == NULL) {
+			h->urc_subs[i].mask = mask;
+			h->urc_subs[i].cb = cb;
+			h->urc_subs[i].arg = arg;
+			res = 1;
+			break;
+		}
+	}
+	xSemaphoreGive(h->mutex);
+	return res;
+}
+
+//===============================================================
+void gsm_urcUnsubscribe(gsm_handle gsm, gsm_urc_cb cb, void *arg)
+{
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return;
+
+	xSemaphoreTake(h->mutex, PPPOSMUTEX_TIMEOUT);
+	for (int i=0; i<GSM_URC_SUBS; i++) {
+		if ((h->urc_subs[i].cb == cb) && (h->urc_subs[i].arg == arg)) memset(&h->urc_subs[i], 0, sizeof(gsm_urc_sub_t));
+	}
+	xSemaphoreGive(h->mutex);
+}
+
 //--------------------
-static int sms_ready()
+static int sms_ready(gsm_handle h)
 {
-	if (ppposStatus() != GSM_STATE_IDLE) return 0;
+	if (ppposStatus(h) != GSM_STATE_IDLE) return 0;
 
-	int res = atCmd_waitResponse("AT+CFUN?\r\n", "+CFUN: 1", NULL, -1, 1000, NULL, 0);
+	int res = atCmd_waitResponse(h, "AT+CFUN?\r\n", "+CFUN: 1", NULL, -1, 1000, NULL, 0);
 	if (res != 1) return 0;
 
-	res = atCmd_waitResponse("AT+CMGF=1\r\n", GSM_OK_Str, NULL, -1, 1000, NULL, 0);
+	res = atCmd_waitResponse(h, "AT+CMGF=1\r\n", GSM_OK_Str, NULL, -1, 1000, NULL, 0);
 	if (res != 1) return 0;
 	return 1;
 }
 
-//==================================
-int smsSend(char *smsnum, char *msg)
+//--------------------------------------------------------
+static int _smsSend(gsm_handle h, char *smsnum, char *msg)
 {
-	if (sms_ready() == 0) return 0;
+	if (sms_ready(h) == 0) return 0;
 
 	char buf[64];
 	int len = strlen(msg);
 
 	sprintf(buf, "AT+CMGS=\"%s\"\r\n", smsnum);
-	int res = atCmd_waitResponse(buf, "> ", NULL, -1, 1000, NULL, 0);
+	int res = atCmd_waitResponse(h, buf, "> ", NULL, -1, 1000, NULL, 0);
 	if (res != 1) {
-		res = atCmd_waitResponse("\x1B", GSM_OK_Str, NULL, 1, 1000, NULL, 0);
+		res = atCmd_waitResponse(h, "\x1B", GSM_OK_Str, NULL, 1, 1000, NULL, 0);
 		return 0;
 	}
 
-	char *msgbuf = malloc(len+2);
-	if (msgbuf == NULL) return 0;
-
-	sprintf(msgbuf, "%s\x1A", msg);
-	res = atCmd_waitResponse(msgbuf, "+CMGS: ", "ERROR", len+1, 40000, NULL, 0);
+	// Send the text, the message is sent to the network after Ctrl-Z is received
+	#if GSM_DEBUG
+	infoCommand(h, msg, len, "SMS TEXT:");
+	#endif
+	_serWrite(h, (const char*)msg, len, 0);
+	res = atCmd_waitResponse(h, "\x1A", "+CMGS: ", "ERROR", 1, 40000, NULL, 0);
 	if (res != 1) {
-		res = atCmd_waitResponse("\x1B", GSM_OK_Str, NULL, 1, 1000, NULL, 0);
+		res = atCmd_waitResponse(h, "\x1B", GSM_OK_Str, NULL, 1, 1000, NULL, 0);
 		res = 0;
 	}
-
-	free(msgbuf);
 	return res;
 }
 
-// Get number of messages in buffer
-//------------------------------
-static int numSMS(char *rbuffer)
+//================================================
+int smsSend(gsm_handle gsm, char *smsnum, char *msg)
 {
-	if (strlen(rbuffer) == 0) return 0;
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return 0;
 
-	char *msgidx = rbuffer;
-	int nmsg = 0;
-	while (1) {
-		msgidx = strstr(msgidx, "+CMGL: ");
-		if (msgidx == NULL) break;
-		nmsg++;
-		msgidx += 7;
-	}
-	return nmsg;
-}
-
-// Parse message at index idx to message structure
-//-----------------------------------------------------
-static int getSMS(char *rbuffer, int idx, SMS_Msg *msg)
-{
-	// Find requested message pointer
-	char *msgidx = rbuffer;
-	int nmsg = 0;
-	while (1) {
-		msgidx = strstr(msgidx, "+CMGL: ");
-		if (msgidx == NULL) break;
-		nmsg++;
-		msgidx += 7;
-		if (nmsg == idx) break;
-	}
-	if (nmsg != idx) return 0;
-
-	// Clear message structure
-	memset(msg, 0, sizeof(SMS_Msg));
-
-	// Get message info
-	char *pend = strstr(msgidx, "\r\n");
-	if (pend == NULL) return 0;
-
-	int len = pend-msgidx;
-	char hdr[len+4];
-	char buf[32];
-
-	memset(hdr, 0, len+4);
-	memcpy(hdr, msgidx, len);
-	hdr[len] = '\0';
-
-	// Get message body
-	msgidx = pend + 2;
-	pend = strstr(msgidx, "\r\n");
-	if (pend == NULL) return 0;
-
-	// Allocate message body buffer and copy the data
-	len = pend-msgidx;
-	char *msgdata = calloc(len+2, 1);
-	memcpy(msgdata, msgidx, len);
-	msg->msg = msgdata;
-
-	// Parse message info
-	msgidx = hdr;
-	pend = strstr(hdr, ",\"");
-	int i = 1;
-	while (pend != NULL) {
-		len = pend-msgidx;
-		if ((len < 32) && (len > 0)) {
-			memset(buf, 0, 32);
-			strncpy(buf, msgidx, len);
-			buf[len] = '\0';
-			if (buf[len-1] == '"') buf[len-1] = '\0';
-
-			if (i == 1) msg->idx = (int)strtol(buf, NULL, 0);	// message index
-			else if (i == 2) strcpy(msg->stat, buf);			// message status
-			else if (i == 3) strcpy(msg->from, buf);			// phone number of message sender
-			else if (i == 5) strcpy(msg->time, buf);			// the time when the message was sent
-		}
-		i++;
-		msgidx = pend + 2;
-		pend = strstr(msgidx, ",\"");
-		if (pend == NULL) pend = strstr(msgidx, "\"");
-	}
-	if (strlen(msg->time) >= 20) {
-		// Convert message time to time structure
-		int hh,mm,ss,yy,mn,dd, tz;
-		struct tm tm;
-		sscanf(msg->time, "%u/%u/%u,%u:%u:%u%d", &yy, &mn, &dd, &hh, &mm, &ss, &tz);
-		tm.tm_hour = hh;
-		tm.tm_min = mm;
-		tm.tm_sec = ss;
-		tm.tm_year = yy+100;
-		tm.tm_mon = mn;
-		tm.tm_mday = dd;
-		msg->time_value = mktime(&tm);	// Linux time
-		msg->tz = tz/4;					// time zone info
-	}
-	return nmsg;
+	// The text is sent between two commands, keep the AT commands of other tasks out
+	xSemaphoreTakeRecursive(h->at_mutex, portMAX_DELAY);
+	int res = _smsSend(h, smsnum, msg);
+	xSemaphoreGiveRecursive(h->at_mutex);
+	return res;
 }
 
-//===========================================
-void smsRead(SMS_Messages *SMSmesg, int sort)
+//===========================================================
+void smsRead(gsm_handle gsm, SMS_Messages *SMSmesg, int sort)
 {
 	SMSmesg->messages = NULL;
 	SMSmesg->nmsg = 0;
 
-	if (sms_ready() == 0) return;
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return;
+
+	if (sms_ready(h) == 0) return;
 
 	int size = 512;
-	char *rbuffer = malloc(size);
+	char *rbuffer = _respAlloc(h, &size);
 	if (rbuffer == NULL) return;
 
-	int res = atCmd_waitResponse("AT+CMGL=\"ALL\"\r\n", NULL, NULL, -1, 2000, &rbuffer, size);
+	int res = atCmd_waitResponse(h, "AT+CMGL=\"ALL\"\r\n", NULL, NULL, -1, 2000, &rbuffer, size);
 	if (res <= 0) {
-		free(rbuffer);
+		_respFree(rbuffer);
 		return;
 	}
 
-	int nmsg = numSMS(rbuffer);
+	int nmsg = gsm_parseSMSCount(rbuffer);
 	if (nmsg > 0) {
+		#ifdef CONFIG_GSM_STATIC_ALLOC
+		if (nmsg > GSM_SMS_MAX) nmsg = GSM_SMS_MAX;
+		SMS_Msg *messages = h->sms;
+		#else
 		// Allocate buffer for nmsg messages
 		SMS_Msg *messages = calloc(nmsg, sizeof(SMS_Msg));
+		_allocCount(1);
 		if (messages == NULL) {
-			free(rbuffer);
+			_respFree(rbuffer);
 			return;
 		}
+		#endif
+		// Parse all messages in a single pass over the response
 		SMS_Msg msg;
+		char *text = NULL;
+		int text_size = 0;
+		const char *presp = rbuffer;
 		for (int i=0; i<nmsg; i++) {
-			if (getSMS(rbuffer, i+1, &msg) > 0) {
-				memcpy(messages + (i * sizeof(SMS_Msg)), &msg, sizeof(SMS_Msg));
+			#ifdef CONFIG_GSM_STATIC_ALLOC
+			text = h->sms_text[SMSmesg->nmsg];
+			text_size = GSM_SMS_TEXT_SIZE;
+			#endif
+			res = gsm_parseSMS(&presp, &msg, text, text_size);
+			if (res < 0) break;
+			if (res > 0) {
+				if (text == NULL) _allocCount(1);	// text allocated by the parser
+				memcpy(&messages[SMSmesg->nmsg], &msg, sizeof(SMS_Msg));
 				SMSmesg->nmsg++;
 			}
 		}
-		if ((SMSmesg->nmsg) && (sort != 0)) {
-			SMS_Msg *smessages = calloc(SMSmesg->nmsg, sizeof(SMS_Msg));
-			uint8_t mm[SMSmesg->nmsg];
-			memset(mm, 1, SMSmesg->nmsg);
-			if (sort > 0) {
-				for (int idx = 0; idx < SMSmesg->nmsg; idx++) {
-					// find minimal time
-					time_t tm = 0x7FFFFFFF;
-					for (int i=0; i<SMSmesg->nmsg; i++) {
-						if (mm[i]) {
-							if ((messages + (i * sizeof(SMS_Msg)))->time_value < tm) tm = (messages + (i * sizeof(SMS_Msg)))->time_value;
-						}
-					}
-					// Copy the message
-					for (int i=0; i<SMSmesg->nmsg; i++) {
-						if (mm[i]) {
-							if ((messages + (i * sizeof(SMS_Msg)))->time_value == tm) {
-								memcpy(smessages + (idx * sizeof(SMS_Msg)), messages + (i * sizeof(SMS_Msg)), sizeof(SMS_Msg));
-								mm[i] = 0; // mark as processed
-								break;
-							}
-						}
-					}
+		if ((SMSmesg->nmsg > 1) && (sort != 0)) {
+			// Sort by message time (insertion sort, in place)
+			for (int i=1; i<SMSmesg->nmsg; i++) {
+				memcpy(&msg, &messages[i], sizeof(SMS_Msg));
+				int j = i - 1;
+				while ((j >= 0) && (((sort > 0) && (messages[j].time_value > msg.time_value)) ||
+						((sort < 0) && (messages[j].time_value < msg.time_value)))) {
+					memcpy(&messages[j+1], &messages[j], sizeof(SMS_Msg));
+					j--;
 				}
+				memcpy(&messages[j+1], &msg, sizeof(SMS_Msg));
 			}
-			else {
-				for (int idx = 0; idx < SMSmesg->nmsg; idx++) {
-					// find maximal time
-					time_t tm = 0;
-					for (int i=0; i<SMSmesg->nmsg; i++) {
-						if (mm[i]) {
-							if ((messages + (i * sizeof(SMS_Msg)))->time_value > tm) tm = (messages + (i * sizeof(SMS_Msg)))->time_value;
-						}
-					}
-					// Copy the message
-					for (int i=0; i<SMSmesg->nmsg; i++) {
-						if (mm[i]) {
-							if ((messages + (i * sizeof(SMS_Msg)))->time_value == tm) {
-								memcpy(smessages + (idx * sizeof(SMS_Msg)), messages + (i * sizeof(SMS_Msg)), sizeof(SMS_Msg));
-								mm[i] = 0; // mark as processed
-								break;
-							}
-						}
-					}
-				}
-			}
-			SMSmesg->messages = smessages;
-			free(messages);
-		}
-		else {
-			if (SMSmesg->nmsg) SMSmesg->messages = messages;
-			else free(messages);
 		}
+		if (SMSmesg->nmsg) SMSmesg->messages = messages;
+		#ifndef CONFIG_GSM_STATIC_ALLOC
+		else free(messages);
+		#endif
+	}
+	_respFree(rbuffer);
+}
+
+//=================================
+void smsFree(SMS_Messages *SMSmesg)
+{
+	#ifndef CONFIG_GSM_STATIC_ALLOC
+	for (int i=0; i<SMSmesg->nmsg; i++) {
+		if (SMSmesg->messages[i].msg) free(SMSmesg->messages[i].msg);
 	}
-	free(rbuffer);
+	if (SMSmesg->messages) free(SMSmesg->messages);
+	#endif
+	SMSmesg->messages = NULL;
+	SMSmesg->nmsg = 0;
 }
 
-//====================
-int smsDelete(int idx)
+//==================================
+int smsDelete(gsm_handle gsm, int idx)
 {
-	if (sms_ready() == 0) return 0;
+	gsm_handle h = _getHandle(gsm);
+	if (h == NULL) return 0;
+	if (sms_ready(h) == 0) return 0;
 
 	char buf[64];
 	sprintf(buf,"AT+CMGD=%d\r\n", idx);
 
-	return atCmd_waitResponse(buf, GSM_OK_Str, NULL, -1, 5000, NULL, 0);
+	return atCmd_waitResponse(h, buf, GSM_OK_Str, NULL, -1, 5000, NULL, 0);
 }
 
@@ -7,28 +7,132 @@
 #ifndef _LIBGSM_H_
 #define _LIBGSM_H_
 
+#include <stdint.h>
+#include <time.h>
+#include "sdkconfig.h"
+#include "driver/uart.h"
+#include "gsm_metrics.h"
+#include "gsm_serial.h"
+#include "gsm_parse.h"
+
 #define GSM_STATE_DISCONNECTED	0
 #define GSM_STATE_CONNECTED		1
 #define GSM_STATE_IDLE			89
 #define GSM_STATE_FIRSTINIT		98
 
+#ifdef CONFIG_GSM_MAX_MODEMS
+#define GSM_MAX_MODEMS			CONFIG_GSM_MAX_MODEMS
+#else
+#define GSM_MAX_MODEMS			1
+#endif
+#define GSM_APN_MAX				64
+
+// Modem models with known profiles
+#define GSM_MODEM_AUTO			-1	// detect from AT+CGMM/ATI response
+#define GSM_MODEM_GENERIC		0
+#define GSM_MODEM_SIM800		1
+#define GSM_MODEM_M590			2
+#define GSM_MODEM_GL865			3
+#define GSM_MODEM_SIM7000		4
+
+// Modem capabilities
+#define GSM_CAP_CMUX			0x01	// multiplexer (AT+CMUX)
+#define GSM_CAP_PSM				0x02	// power saving mode (AT+CPSMS)
+#define GSM_CAP_FLOWCTRL		0x04	// RTS/CTS flow control (AT+IFC)
+#define GSM_CAP_EPS				0x08	// LTE registration status (AT+CEREG)
+
+// GSM instance handle, NULL can be used for the default instance
+typedef struct gsm_ctx *gsm_handle;
+
+// AT request results
+#define GSM_AT_OK				1	// expected final response received
+#define GSM_AT_ERROR			0	// ERROR (or other unexpected) final response received
+#define GSM_AT_TIMEOUT			-1	// no final response in time
+#define GSM_AT_NOTREADY			-2	// not executed, the modem was not in command mode or the task ended
+#define GSM_AT_CMD_MAX			128	// max AT request command length, including "\r\n"
+#define GSM_URC_SUBS			4	// max URC subscribers per instance
 
+// UART and PPP frame error counters
 typedef struct
 {
-	int		idx;
-	char	*msg;
-	char	stat[32];
-	char	from[32];
-	char	time[32];
-	time_t	time_value;
-	int		tz;
-}SMS_Msg;
+	uint32_t	fifo_overflows;		// UART hw FIFO overflows (data lost)
+	uint32_t	buffer_full;		// UART driver ring buffer full events
+	uint32_t	frame_errors;		// UART framing and parity errors
+	uint32_t	frames;				// received PPP frames
+	uint32_t	fcs_errors;			// received PPP frames with bad FCS, also counted in lwIP link statistics (chkerr, drop)
+	uint32_t	input_msgs;			// received frames sent to lwIP tcpip thread, one message per frame
+	uint32_t	input_bytes;		// bytes passed to lwIP
+	uint32_t	input_us;			// CPU time spent in the receive path in microseconds
+	uint32_t	rx_bytes;			// bytes received from the modem in data mode
+	uint32_t	rx_frame_bytes;		// unescaped bytes of received PPP frames, rx_bytes - rx_frame_bytes is framing overhead
+	uint32_t	tx_bytes;			// bytes sent to the modem in data mode
+	uint32_t	tx_frames;			// sent PPP frames
+	uint32_t	tx_frame_bytes;		// unescaped bytes of sent PPP frames, tx_bytes - tx_frame_bytes is framing overhead
+	uint32_t	output_calls;		// PPP output callback calls (UART writes)
+	uint32_t	output_us;			// time spent in PPP output callback in microseconds, including waiting for UART
+	uint8_t		flow_ctrl;			// RTS/CTS flow control is enabled
+}gsm_uart_stats_t;
 
+// Link status callback, 'status' is GSM_STATE_CONNECTED or GSM_STATE_DISCONNECTED
+typedef void (*gsm_status_cb)(gsm_handle gsm, int status, void *arg);
+
+// AT request completion callback, 'result' is GSM_AT_xxx
+// 'response' is the received response text (only its end is kept for long responses),
+// it is valid only during the callback
+typedef void (*gsm_at_cb)(gsm_handle gsm, int result, const char *response, void *arg);
+
+// Unsolicited result code callback, 'urc' is GSM_URC_xxx class, 'line' is the received line without line end
+typedef void (*gsm_urc_cb)(gsm_handle gsm, int urc, const char *line, void *arg);
+
+// GSM instance configuration
 typedef struct
 {
-	int		nmsg;
-	SMS_Msg	*messages;
-}SMS_Messages;
+	uart_port_t	uart_num;			// UART used for the modem
+	int			tx_pin;				// UART TX gpio
+	int			rx_pin;				// UART RX gpio
+	int			baud_rate;			// UART baud rate used to start communication with the modem
+	int			max_baud_rate;		// highest baud rate negotiated with AT+IPR, no negotiation if <= baud_rate
+	int			rts_pin;			// UART RTS gpio, -1 if flow control is not used
+	int			cts_pin;			// UART CTS gpio, -1 if flow control is not used
+	int			uart_rx_buf;		// UART driver RX buffer size, 0 to derive it from the baud rate
+	int			uart_tx_buf;		// UART driver TX buffer size, 0 to derive it from the baud rate
+	char		apn[GSM_APN_MAX];	// Internet APN
+	char		user[32];			// PPP user name
+	char		pass[32];			// PPP password
+	uint8_t		set_default;		// use the PPP interface as the default lwIP interface
+	int8_t		modem;				// modem model, GSM_MODEM_xxx
+	int			task_core;			// core the PPPoS task (and UART interrupt) runs on, -1 for no affinity
+	int			task_priority;		// PPPoS task priority
+	int			task_stack;			// PPPoS task stack size
+	const gsm_serial_t *serial;		// serial port operations used instead of the UART driver (replay), NULL for UART
+	void		*serial_arg;		// argument passed to serial port operations
+	uint32_t	reconnect_fast_ms;	// delay of the first connection attempt after the link was lost
+	uint32_t	reconnect_min_ms;	// delay after the first failed attempt, doubled after every next one, 0 for default
+	uint32_t	reconnect_max_ms;	// max delay between connection attempts, 0 for default
+	uint8_t		reconnect_jitter;	// random part of the delay in percent
+}gsm_config_t;
+
+/*
+ * Fill the GSM instance configuration with the values set in 'menuconfig'
+ */
+//========================================
+void gsm_defaultConfig(gsm_config_t *cfg);
+
+/*
+ * Create GSM instance (modem on its own UART) with the given configuration
+ * Up to GSM_MAX_MODEMS instances can be created, each one runs its own PPPoS task
+ * The first created instance is the default one, used when NULL handle is passed;
+ * if no instance is created, the default instance is created from 'menuconfig' values
+ *
+ * Returns the instance handle or NULL on error
+ */
+//============================================
+gsm_handle gsmCreate(const gsm_config_t *cfg);
+
+/*
+ * All functions below take the GSM instance handle as the first argument,
+ * NULL selects the default instance
+ */
 
 /*
  * Create GSM/PPPoS task if not already created
@@ -36,8 +140,8 @@ typedef struct
  * Handle all PPPoS requests
  * Disconnect/Reconnect from/to Internet on user request
  */
-//==============
-int ppposInit();
+//===========================
+int ppposInit(gsm_handle gsm);
 
 /*
  * Disconnect from Internet
@@ -45,21 +149,21 @@ int ppposInit();
  * If 'rfoff' = 1, turns off GSM RF section to preserve power
  * If already disconnected, this function does nothing
  */
-//====================================================
-void ppposDisconnect(uint8_t end_task, uint8_t rfoff);
+//====================================================================
+void ppposDisconnect(gsm_handle gsm, uint8_t end_task, uint8_t rfoff);
 
 /*
  * Get transmitted and received bytes count
  * If 'rst' = 1, resets the counters
  */
-//=========================================================
-void getRxTxCount(uint32_t *rx, uint32_t *tx, uint8_t rst);
+//=========================================================================
+void getRxTxCount(gsm_handle gsm, uint32_t *rx, uint32_t *tx, uint8_t rst);
 
 /*
  * Resets transmitted and received bytes counters
  */
-//====================
-void resetRxTxCount();
+//===================================
+void resetRxTxCount(gsm_handle gsm);
 
 /*
  * Get GSM/Task status
@@ -70,20 +174,181 @@ void resetRxTxCount();
  * GSM_STATE_IDLE			(89)	Disconnected from Internet, Task idle, waiting for reconnect request
  * GSM_STATE_FIRSTINIT		(98)	Task started, initializing PPPoS
  */
-//================
-int ppposStatus();
+//==============================
+int ppposStatus(gsm_handle gsm);
+
+/*
+ * Allocate large, not time critical buffer
+ * The buffer is allocated in PSRAM if CONFIG_GSM_BUF_PSRAM is set and PSRAM is available,
+ * otherwise in internal RAM. Free it with free()
+ * The allocation is counted by gsm_GetAllocCount()
+ */
+//==============================
+void *gsm_bufAlloc(size_t size);
+
+/*
+ * Get the number of heap allocations made by libGSM: instances, PPPoS task, its receive buffers,
+ * AT response, DNS, SMS, capture and recording buffers and buffers from gsm_bufAlloc()
+ * If 'rst' = 1 the counter is reset
+ * ESP-IDF UART driver and lwIP PPP control block are not counted.
+ * With CONFIG_GSM_STATIC_ALLOC no allocation is made after gsmCreate(),
+ * connecting, disconnecting and AT commands keep the count at 0
+ */
+//=====================================
+uint32_t gsm_GetAllocCount(uint8_t rst);
+
+/*
+ * Get UART overrun and PPP frame error counters and PPP input statistics
+ * Overruns and bad frames cause TCP retransmissions, they should not occur if flow control is used
+ * If 'rst' = 1, resets the counters
+ */
+//==========================================================================
+void gsm_GetUartStats(gsm_handle gsm, gsm_uart_stats_t *stats, uint8_t rst);
+
+/*
+ * Get the PPPoS task stack never used so far (high water mark) in bytes, 0 if the task is not running
+ * Used to size GSM_TASK_STACK_SIZE for the chosen task profile
+ */
+//============================================
+uint32_t gsm_GetTaskStackFree(gsm_handle gsm);
+
+/*
+ * Get connection lifecycle metrics: AT command latency, initialization, connect and session time histograms,
+ * disconnects by PPPERR_xxx code and throughput averages
+ * Use gsm_metrics_toJSON() or gsm_metrics_pack() to dump them
+ * If 'rst' = 1, resets the metrics
+ */
+//=======================================================================
+void gsm_GetMetrics(gsm_handle gsm, gsm_metrics_t *metrics, uint8_t rst);
+
+/*
+ * Get the UART baud rate used by the instance
+ * Can be higher than configured if the rate was negotiated with the modem
+ */
+//=======================================
+uint32_t gsm_GetBaudRate(gsm_handle gsm);
+
+/*
+ * Get the name of the modem profile used by the instance
+ * The profile is selected during GSM initialization
+ */
+//========================================
+const char *gsm_ModemName(gsm_handle gsm);
+
+/*
+ * Get the capabilities of the modem used by the instance (GSM_CAP_xxx)
+ */
+//====================================
+uint8_t gsm_ModemCaps(gsm_handle gsm);
+
+/*
+ * Set the callback called when the PPP link goes up or down
+ * The callback is executed in lwIP tcpip thread, it must return quickly
+ * and must not call pppapi or blocking socket functions
+ */
+//=====================================================================
+void gsmSetStatusCallback(gsm_handle gsm, gsm_status_cb cb, void *arg);
+
+/*
+ * Get the IPv4 address (network byte order) of the instance's PPP interface
+ * Returns 0 if not connected
+ */
+//=================================
+uint32_t gsm_GetIP(gsm_handle gsm);
+
+/*
+ * Make the instance's PPP interface the default lwIP interface
+ * Returns 1 on success, 0 if the instance is not connected
+ */
+//=================================
+int gsm_SetDefault(gsm_handle gsm);
+
+/*
+ * Check if the system time was set from the network time (NITZ) reported by the modem
+ * Network time is read during GSM initialization if CONFIG_GSM_NETWORK_TIME is set
+ *
+ * Result:
+ *   1 if the time was set, 0 if not (SNTP should be used)
+ */
+//======================================
+int gsm_TimeFromNetwork(gsm_handle gsm);
+
+/*
+ * Get the time in ms from the start of GSM initialization to CONNECT response
+ * If 'warm' is not NULL, it is set to 1 if the initialization was shortened
+ * using the modem state recorded before deep sleep (CONFIG_GSM_WARM_START)
+ */
+//=====================================================
+uint32_t gsm_ConnectTime(gsm_handle gsm, uint8_t *warm);
+
+/*
+ * Get the network registration state (LTE state if registered on LTE, otherwise the +CREG state)
+ * The state is updated from +CREG/+CEREG unsolicited result codes in command mode,
+ * it is not updated while connected to Internet
+ *
+ * Result:
+ *   1 if registered to home network or roaming, 0 if not
+ */
+//======================================================
+int gsm_GetRegistration(gsm_handle gsm, gsm_reg_t *reg);
 
 /*
  * Turn GSM RF Off
  */
-//==============
-int gsm_RFOff();
+//============================
+int gsm_RFOff(gsm_handle gsm);
 
 /*
  * Turn GSM RF On
  */
-//=============
-int gsm_RFOn();
+//===========================
+int gsm_RFOn(gsm_handle gsm);
+
+/*
+ * Submit AT command request to the instance's request queue
+ * The requests are executed one after another by the PPPoS task while the modem is in command mode:
+ * during initialization after the modem is detected and while disconnected from Internet.
+ * Requests waiting longer than their timeout (while connected) are completed with GSM_AT_NOTREADY.
+ *
+ * Params:
+ *       cmd:	AT command, "\r\n" is added if not present
+ *        ok:	expected final response, NULL for "OK"; "ERROR" response completes the request with GSM_AT_ERROR
+ *   timeout_ms:	response timeout, also the max time the request waits in the queue; 0 for 1000 ms
+ *        cb:	completion callback, executed in the PPPoS task, it must return quickly; can be NULL
+ *
+ * Returns 1 if the request was queued, 0 if the task is not running, the queue is full or the command too long
+ */
+//==============================================================================================================
+int gsm_atSubmit(gsm_handle gsm, const char *cmd, const char *ok, uint32_t timeout_ms, gsm_at_cb cb, void *arg);
+
+/*
+ * Submit AT command request and wait for its completion
+ * The response is copied to 'resp' buffer of 'size' bytes if not NULL
+ * Must not be called from the callbacks (PPPoS task or lwIP tcpip thread),
+ * uses the calling task's notification
+ *
+ * Returns GSM_AT_xxx result
+ */
+//============================================================================================================
+int gsm_atCommand(gsm_handle gsm, const char *cmd, const char *ok, uint32_t timeout_ms, char *resp, int size);
+
+/*
+ * Subscribe to unsolicited result codes of the classes in 'mask' (GSM_URC_MASK(GSM_URC_xxx), GSM_URC_ALL)
+ * URCs are recognized in command mode, mixed with command responses or while the modem is idle
+ * (off line, checked every 100 ms); in data mode they are not seen
+ * The callback is executed in the task exchanging AT commands with the modem (PPPoS task or the task
+ * calling SMS and RF functions), it must return quickly and must not call blocking GSM functions
+ *
+ * Returns 1 on success, 0 if GSM_URC_SUBS subscribers are already registered
+ */
+//============================================================================
+int gsm_urcSubscribe(gsm_handle gsm, uint32_t mask, gsm_urc_cb cb, void *arg);
+
+/*
+ * Remove the subscription registered with the same callback and argument
+ */
+//================================================================
+void gsm_urcUnsubscribe(gsm_handle gsm, gsm_urc_cb cb, void *arg);
 
 /*
  * Send SMS
@@ -92,19 +357,29 @@ int gsm_RFOn();
  *   smsnum:	Pointer to phone number in international format (+<counry_code><gsm number>)
  *      msg:	Pointer to message text
  */
-//==================================
-int smsSend(char *smsnum, char *msg);
+//=================================================
+int smsSend(gsm_handle gsm, char *smsnum, char *msg);
 
 /*
  * Read all SMS messages to 'SMS_Messages' structure
+ * Messages are sorted by time, ascending if 'sort' > 0, descending if 'sort' < 0
+ * Free the messages with smsFree()
+ * With CONFIG_GSM_STATIC_ALLOC the messages are kept in instance's buffers
+ * and are valid until the next smsRead() call
  */
-//============================================
-void smsRead(SMS_Messages *SMSmesg, int sort);
+//==========================================================
+void smsRead(gsm_handle gsm, SMS_Messages *SMSmesg, int sort);
+
+/*
+ * Free the messages returned by smsRead()
+ */
+//=====================================
+void smsFree(SMS_Messages *SMSmesg);
 
 /*
  * Delete the message at GSM message index 'idx'
  */
-int smsDelete(int idx);
+int smsDelete(gsm_handle gsm, int idx);
 
 
 #endif
@@ -0,0 +1,460 @@
+/*
+ *  Streaming HTTP response reader
+ *
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "http_stream.h"
+
+#ifdef CONFIG_GSM_HTTP_COMPRESSION
+#include "rom/miniz.h"
+#include "esp_heap_caps.h"
+
+#define GZIP_FHCRC		0x02
+#define GZIP_FEXTRA		0x04
+#define GZIP_FNAME		0x08
+#define GZIP_FCOMMENT	0x10
+
+// Streaming inflate context
+// Decoded data is written into the 32KB wrapping dictionary buffer (the maximal deflate window)
+// and passed from there to the user callback, so no other output buffer is needed.
+// The dictionary can't be smaller: gzip and raw deflate streams don't declare their window and servers
+// compress with 32KB, tinfl would output wrong data for the references beyond a smaller buffer
+typedef struct
+{
+	http_data_cb		cb;
+	void				*arg;
+	http_response_t		*resp;
+	tinfl_decompressor	inf;
+	uint8_t				dict[TINFL_LZ_DICT_SIZE];
+	size_t				dict_ofs;
+	uint8_t				gzip;
+	uint8_t				hdr_stage;		// gzip header parsing stage
+	uint8_t				hdr_flags;		// gzip header flags
+	uint16_t			hdr_cnt;		// bytes left in the current gzip header stage
+	uint8_t				first;			// zlib header detection not done yet
+	uint8_t				zhdr[2];		// first two bytes of 'deflate' body, used for zlib header detection
+	uint8_t				zhdr_len;
+	uint8_t				done;			// end of the deflate stream reached
+	uint8_t				trailer[8];		// gzip trailer, CRC32 and ISIZE
+	uint8_t				trailer_len;
+	uint32_t			crc;			// CRC32 of the decoded data
+	mz_uint32			flags;
+}inflate_ctx_t;
+#endif
+
+
+typedef struct
+{
+	http_read_func	read;
+	void			*ctx;
+	char			*buf;
+	int				pos;
+	int				len;
+	uint32_t		wire;
+}http_stream_t;
+
+
+// Move unread data to the buffer start and read more data after it
+//------------------------------------------
+static int stream_fill(http_stream_t *s)
+{
+	if (s->pos > 0) {
+		if (s->len > s->pos) memmove(s->buf, s->buf + s->pos, s->len - s->pos);
+		s->len -= s->pos;
+		s->pos = 0;
+	}
+	if (s->len >= HTTP_STREAM_BUF_SIZE) return HTTP_ERR_HEADER;
+
+	int r = s->read(s->ctx, s->buf + s->len, HTTP_STREAM_BUF_SIZE - s->len);
+	if (r > 0) {
+		s->len += r;
+		s->wire += r;
+	}
+	return r;
+}
+
+// Get the next CRLF terminated line, the line is terminated with '\0'
+// Returns pointer to the line in the stream buffer or NULL on error
+//--------------------------------------------
+static char *stream_getline(http_stream_t *s)
+{
+	while (1) {
+		char *eol = memchr(s->buf + s->pos, '\n', s->len - s->pos);
+		if (eol != NULL) {
+			char *line = s->buf + s->pos;
+			s->pos = (eol - s->buf) + 1;
+			*eol = '\0';
+			if ((eol > line) && (*(eol-1) == '\r')) *(eol-1) = '\0';
+			return line;
+		}
+		if (stream_fill(s) <= 0) return NULL;
+	}
+}
+
+// Deliver 'n' body bytes to the callback, 'n' < 0 means until the connection is closed
+//---------------------------------------------------------------------------------------------
+static int stream_deliver(http_stream_t *s, int n, http_response_t *resp, http_data_cb cb, void *arg)
+{
+	while (n != 0) {
+		if (s->pos >= s->len) {
+			// Buffer is empty, read directly into it, but not past the end of the body
+			s->pos = 0;
+			s->len = 0;
+			int rlen = HTTP_STREAM_BUF_SIZE;
+			if ((n > 0) && (n < rlen)) rlen = n;
+			int r = s->read(s->ctx, s->buf, rlen);
+			if (r <= 0) {
+				if ((n < 0) && (r == 0)) return 0;	// closed by server, end of body
+				return HTTP_ERR_READ;
+			}
+			s->len = r;
+			s->wire += r;
+		}
+		int take = s->len - s->pos;
+		if ((n > 0) && (take > n)) take = n;
+		if (cb) {
+			int res = cb(arg, s->buf + s->pos, take);
+			if (res != 0) return (res == HTTP_ERR_INFLATE) ? res : HTTP_ERR_ABORT;
+		}
+		resp->body_bytes += take;
+		s->pos += take;
+		if (n > 0) n -= take;
+	}
+	return 0;
+}
+
+// Parse the status line
+//-------------------------------------------------------------
+static int parse_status(http_response_t *resp, const char *line)
+{
+	if (strncmp(line, "HTTP/", 5) != 0) return HTTP_ERR_HEADER;
+	const char *p = strchr(line, ' ');
+	if (p == NULL) return HTTP_ERR_HEADER;
+	resp->status = (int)strtol(p+1, NULL, 10);
+	return 0;
+}
+
+// Parse the header line, only the lines needed for the body framing are used
+// The lines are parsed as they are read, so the framing does not depend on the stored header size
+//------------------------------------------------------------
+static void parse_line(http_response_t *resp, const char *line)
+{
+	const char *p;
+
+	if (strncasecmp(line, "Content-Length:", 15) == 0) {
+		resp->content_length = (int)strtol(line+15, NULL, 10);
+	}
+	else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+		p = line+18;
+		while (*p == ' ') p++;
+		if (strncasecmp(p, "chunked", 7) == 0) resp->chunked = 1;
+	}
+	else if (strncasecmp(line, "Content-Encoding:", 17) == 0) {
+		p = line+17;
+		while (*p == ' ') p++;
+		if (strncasecmp(p, "gzip", 4) == 0) resp->encoding = HTTP_ENC_GZIP;
+		else if (strncasecmp(p, "deflate", 7) == 0) resp->encoding = HTTP_ENC_DEFLATE;
+	}
+}
+
+#ifdef CONFIG_GSM_HTTP_COMPRESSION
+// The inflate context is large (32KB dictionary), place it in PSRAM if enabled
+//------------------------------------
+static inflate_ctx_t *inflate_alloc()
+{
+	inflate_ctx_t *z = NULL;
+	#ifdef CONFIG_GSM_BUF_PSRAM
+	z = heap_caps_malloc(sizeof(inflate_ctx_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+	#endif
+	if (z == NULL) z = malloc(sizeof(inflate_ctx_t));
+	return z;
+}
+
+// Skip the gzip header (RFC 1952), which can be split between several data blocks
+// Returns 1 when the whole header is processed
+//--------------------------------------------------------------------------
+static int gzip_header(inflate_ctx_t *z, const uint8_t **data, int *len)
+{
+	while (*len > 0) {
+		uint8_t c = **data;
+		switch (z->hdr_stage) {
+			case 0:	// fixed 10-byte header, magic and deflate compression method are checked
+				if ((z->hdr_cnt == 10) && (c != 0x1F)) return -1;
+				if ((z->hdr_cnt == 9) && (c != 0x8B)) return -1;
+				if ((z->hdr_cnt == 8) && (c != 8)) return -1;
+				if (z->hdr_cnt == 7) z->hdr_flags = c;
+				z->hdr_cnt--;
+				if (z->hdr_cnt == 0) {
+					z->hdr_stage = 1;
+					z->hdr_cnt = 2;
+				}
+				break;
+			case 1:	// extra field length
+				if ((z->hdr_flags & GZIP_FEXTRA) == 0) {
+					z->hdr_stage = 3;
+					continue;
+				}
+				if (z->hdr_cnt == 2) z->hdr_cnt = 0x100 | c;
+				else {
+					z->hdr_cnt = (z->hdr_cnt & 0xFF) | (c << 8);
+					z->hdr_stage = (z->hdr_cnt > 0) ? 2 : 3;
+				}
+				break;
+			case 2:	// extra field
+				if (--z->hdr_cnt == 0) z->hdr_stage = 3;
+				break;
+			case 3:	// file name
+				if ((z->hdr_flags & GZIP_FNAME) == 0) {
+					z->hdr_stage = 4;
+					continue;
+				}
+				if (c == 0) z->hdr_stage = 4;
+				break;
+			case 4:	// comment
+				if ((z->hdr_flags & GZIP_FCOMMENT) == 0) {
+					z->hdr_stage = 5;
+					z->hdr_cnt = 2;
+					continue;
+				}
+				if (c == 0) {
+					z->hdr_stage = 5;
+					z->hdr_cnt = 2;
+				}
+				break;
+			case 5:	// header crc
+				if ((z->hdr_flags & GZIP_FHCRC) == 0) {
+					z->hdr_stage = 6;
+					continue;
+				}
+				if (--z->hdr_cnt == 0) z->hdr_stage = 6;
+				break;
+			default:
+				return 1;
+		}
+		(*data)++;
+		(*len)--;
+	}
+	return (z->hdr_stage >= 6) ? 1 : 0;
+}
+
+// Update CRC32 (IEEE 802.3, as used by gzip) of the decoded data, 4-bit table
+//-----------------------------------------------------------------------
+static uint32_t gzip_crc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+	static const uint32_t crc_tab[16] = {
+		0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+		0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+	};
+
+	crc = ~crc;
+	while (len--) {
+		crc ^= *data++;
+		crc = (crc >> 4) ^ crc_tab[crc & 0x0F];
+		crc = (crc >> 4) ^ crc_tab[crc & 0x0F];
+	}
+	return ~crc;
+}
+
+// Inflate the block of deflate data and pass the decoded data to the user callback
+// Data after the end of the deflate stream is the gzip trailer
+//-----------------------------------------------------------------------
+static int inflate_block(inflate_ctx_t *z, const uint8_t *pdata, int len)
+{
+	while ((len > 0) && (z->done == 0)) {
+		size_t in_size = len;
+		size_t out_size = TINFL_LZ_DICT_SIZE - z->dict_ofs;
+		tinfl_status status = tinfl_decompress(&z->inf, pdata, &in_size, z->dict, z->dict + z->dict_ofs, &out_size, z->flags);
+		pdata += in_size;
+		len -= in_size;
+		if (out_size > 0) {
+			if (z->gzip) z->crc = gzip_crc32(z->crc, z->dict + z->dict_ofs, out_size);
+			if (z->cb) {
+				if (z->cb(z->arg, (const char *)(z->dict + z->dict_ofs), out_size) != 0) return HTTP_ERR_ABORT;
+			}
+			z->resp->decoded_bytes += out_size;
+			z->dict_ofs = (z->dict_ofs + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+		}
+		if (status < TINFL_STATUS_DONE) return HTTP_ERR_INFLATE;
+		if (status == TINFL_STATUS_DONE) z->done = 1;
+		else if ((status == TINFL_STATUS_NEEDS_MORE_INPUT) && (in_size == 0) && (out_size == 0)) break;
+	}
+
+	if ((z->done) && (z->gzip)) {
+		while ((len > 0) && (z->trailer_len < sizeof(z->trailer))) {
+			z->trailer[z->trailer_len++] = *pdata++;
+			len--;
+		}
+	}
+	return 0;
+}
+
+// Inflate the received body data and pass the decoded data to the user callback
+//--------------------------------------------------------------
+static int inflate_data(void *arg, const char *data, int len)
+{
+	inflate_ctx_t *z = (inflate_ctx_t *)arg;
+	const uint8_t *pdata = (const uint8_t *)data;
+
+	if (z->gzip) {
+		int res = gzip_header(z, &pdata, &len);
+		if (res < 0) return HTTP_ERR_INFLATE;
+		if (res == 0) return 0;
+	}
+	else if (z->first) {
+		// 'deflate' should be zlib wrapped, but some servers send raw deflate data
+		// The first two bytes are needed for detection, they can be received in separate blocks
+		while ((len > 0) && (z->zhdr_len < 2)) {
+			z->zhdr[z->zhdr_len++] = *pdata++;
+			len--;
+		}
+		if (z->zhdr_len < 2) return 0;
+		z->first = 0;
+		if (((z->zhdr[0] & 0x0F) == 8) && ((z->zhdr[0] >> 4) <= 7) && ((((z->zhdr[0] << 8) | z->zhdr[1]) % 31) == 0)) {
+			z->flags |= TINFL_FLAG_PARSE_ZLIB_HEADER;
+		}
+		int res = inflate_block(z, z->zhdr, 2);
+		if (res != 0) return res;
+	}
+	return inflate_block(z, pdata, len);
+}
+
+// Check that the compressed stream is complete, gzip trailer must match the decoded data
+//--------------------------------------
+static int inflate_end(inflate_ctx_t *z)
+{
+	if (z->done == 0) return HTTP_ERR_INFLATE;
+	if (z->gzip) {
+		if (z->trailer_len < sizeof(z->trailer)) return HTTP_ERR_INFLATE;
+		uint32_t crc = z->trailer[0] | (z->trailer[1] << 8) | (z->trailer[2] << 16) | ((uint32_t)z->trailer[3] << 24);
+		uint32_t isize = z->trailer[4] | (z->trailer[5] << 8) | (z->trailer[6] << 16) | ((uint32_t)z->trailer[7] << 24);
+		if ((crc != z->crc) || (isize != z->resp->decoded_bytes)) return HTTP_ERR_INFLATE;
+	}
+	return 0;
+}
+#endif
+
+//==========================================================================================================
+int http_read_response(http_read_func rd, void *rd_ctx, http_response_t *resp, http_data_cb cb, void *cb_arg)
+{
+	http_stream_t s;
+	int res = 0;
+	#ifdef CONFIG_GSM_HTTP_COMPRESSION
+	inflate_ctx_t *z = NULL;
+	#endif
+
+	memset(resp, 0, sizeof(http_response_t));
+	resp->content_length = -1;
+
+	memset(&s, 0, sizeof(http_stream_t));
+	s.read = rd;
+	s.ctx = rd_ctx;
+	s.buf = malloc(HTTP_STREAM_BUF_SIZE+1);
+	if (s.buf == NULL) return HTTP_ERR_NOMEM;
+
+	// ** Read and parse the header, a copy of the lines which fit is stored in 'resp->header'
+	int hlen = 0;
+	int nlines = 0;
+	while (1) {
+		char *line = stream_getline(&s);
+		if (line == NULL) {
+			res = HTTP_ERR_HEADER;
+			goto exit;
+		}
+		if (*line == '\0') break;	// end of header
+		if (nlines++ == 0) {
+			res = parse_status(resp, line);
+			if (res != 0) goto exit;
+		}
+		else parse_line(resp, line);
+
+		int llen = strlen(line);
+		if ((hlen + llen + 3) < HTTP_HEADER_MAX) {
+			if (hlen > 0) {
+				memcpy(resp->header+hlen, "\r\n", 2);
+				hlen += 2;
+			}
+			memcpy(resp->header+hlen, line, llen);
+			hlen += llen;
+			resp->header[hlen] = '\0';
+		}
+	}
+
+	#ifdef CONFIG_GSM_HTTP_COMPRESSION
+	if (resp->encoding != HTTP_ENC_NONE) {
+		// ** Insert the inflate stage between the body reader and the user callback
+		z = inflate_alloc();
+		if (z == NULL) {
+			res = HTTP_ERR_NOMEM;
+			goto exit;
+		}
+		tinfl_init(&z->inf);
+		z->cb = cb;
+		z->arg = cb_arg;
+		z->resp = resp;
+		z->dict_ofs = 0;
+		z->gzip = (resp->encoding == HTTP_ENC_GZIP);
+		z->hdr_stage = 0;
+		z->hdr_flags = 0;
+		z->hdr_cnt = 10;
+		z->first = 1;
+		z->zhdr_len = 0;
+		z->done = 0;
+		z->trailer_len = 0;
+		z->crc = 0;
+		z->flags = TINFL_FLAG_HAS_MORE_INPUT;
+		cb = inflate_data;
+		cb_arg = z;
+	}
+	#endif
+
+	// ** Read the body
+	if (((resp->status >= 100) && (resp->status < 200)) || (resp->status == 204) || (resp->status == 304)) {
+		// no body
+	}
+	else if (resp->chunked) {
+		while (1) {
+			char *line = stream_getline(&s);
+			if ((line == NULL) || (!isxdigit((int)*line))) {
+				res = HTTP_ERR_CHUNK;
+				break;
+			}
+			int chunk_size = (int)strtol(line, NULL, 16);
+			if (chunk_size == 0) {
+				// last chunk, skip trailers
+				while (((line = stream_getline(&s)) != NULL) && (*line != '\0'));
+				if (line == NULL) res = HTTP_ERR_CHUNK;
+				break;
+			}
+			res = stream_deliver(&s, chunk_size, resp, cb, cb_arg);
+			if (res != 0) break;
+			line = stream_getline(&s);
+			if ((line == NULL) || (*line != '\0')) {
+				res = HTTP_ERR_CHUNK;
+				break;
+			}
+		}
+	}
+	else if (resp->content_length >= 0) {
+		if (resp->content_length > 0) res = stream_deliver(&s, resp->content_length, resp, cb, cb_arg);
+	}
+	else res = stream_deliver(&s, -1, resp, cb, cb_arg);
+
+	#ifdef CONFIG_GSM_HTTP_COMPRESSION
+	// The body must end with the end of the compressed stream
+	if ((res == 0) && (z) && (resp->body_bytes > 0)) res = inflate_end(z);
+	#endif
+
+exit:
+	resp->wire_bytes = s.wire;
+	if (resp->encoding == HTTP_ENC_NONE) resp->decoded_bytes = resp->body_bytes;
+	#ifdef CONFIG_GSM_HTTP_COMPRESSION
+	if (z) free(z);
+	#endif
+	free(s.buf);
+	return res;
+}
@@ -0,0 +1,72 @@
+/*
+ *  Streaming HTTP response reader
+ *
+ *  Parses the response header and delivers the body to a callback
+ *  as it arrives, handling 'Transfer-Encoding: chunked' and 'Content-Length'.
+ *  The end of the body is detected from the framing, not from a receive timeout.
+ *
+*/
+
+
+#ifndef _HTTP_STREAM_H_
+#define _HTTP_STREAM_H_
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#define HTTP_STREAM_BUF_SIZE	1460	// stream buffer size, one TCP segment
+#define HTTP_HEADER_MAX			512		// max header size stored in 'http_response_t', longer headers are parsed but truncated
+
+#define HTTP_ERR_READ		-1		// read error or connection closed before the end of the body
+#define HTTP_ERR_HEADER		-2		// invalid or too long response header
+#define HTTP_ERR_CHUNK		-3		// invalid chunk framing
+#define HTTP_ERR_ABORT		-4		// data callback requested abort
+#define HTTP_ERR_NOMEM		-5		// cannot allocate the stream buffer
+#define HTTP_ERR_INFLATE	-6		// error decompressing the body
+
+#define HTTP_ENC_NONE		0		// body is not compressed
+#define HTTP_ENC_GZIP		1		// 'Content-Encoding: gzip'
+#define HTTP_ENC_DEFLATE	2		// 'Content-Encoding: deflate'
+
+#ifdef CONFIG_GSM_HTTP_COMPRESSION
+#define HTTP_ACCEPT_ENCODING "Accept-Encoding: gzip, deflate\r\n"
+#else
+#define HTTP_ACCEPT_ENCODING ""
+#endif
+
+/*
+ * Read function used to get the data from the connection
+ * Returns number of bytes read, 0 if the connection is closed or <0 on error
+ */
+typedef int (*http_read_func)(void *ctx, char *buf, int len);
+
+/*
+ * Body data callback
+ * Return 0 to continue, any other value aborts the transfer
+ */
+typedef int (*http_data_cb)(void *arg, const char *data, int len);
+
+typedef struct
+{
+	int			status;					// HTTP status code
+	int			content_length;			// Content-Length, -1 if not present
+	uint8_t		chunked;				// 1 if chunked transfer encoding is used
+	uint8_t		encoding;				// content encoding, HTTP_ENC_xxx
+	char		header[HTTP_HEADER_MAX];	// response header for display (lines that don't fit are not stored)
+	uint32_t	wire_bytes;				// bytes read from the connection
+	uint32_t	body_bytes;				// body bytes received, before decompression
+	uint32_t	decoded_bytes;			// body bytes delivered to the callback
+}http_response_t;
+
+/*
+ * Read the HTTP response from the connection
+ * The header is stored in 'resp', the body is passed to 'cb' in large blocks
+ * If CONFIG_GSM_HTTP_COMPRESSION is set, gzip or deflate encoded body is inflated
+ * on the fly and 'cb' receives the decoded data
+ *
+ * Returns 0 on success or one of HTTP_ERR_xxx codes
+ */
+//==========================================================================================================
+int http_read_response(http_read_func rd, void *rd_ctx, http_response_t *resp, http_data_cb cb, void *cb_arg);
+
+#endif
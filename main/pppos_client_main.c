@@ -11,6 +11,7 @@
 
 
 #include <string.h>
+#include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -46,12 +47,18 @@
 #include "cJSON.h"
 
 #include "libGSM.h"
+#include "gsm_dns.h"
+#include "gsm_link.h"
+#include "gsm_trace.h"
+#include "gsm_pcap.h"
+#include "http_stream.h"
 
 
 #define EXAMPLE_TASK_PAUSE	300		// pause between task runs in seconds
 #define TASK_SEMAPHORE_WAIT 140000	// time to wait for mutex in miliseconds
 
 QueueHandle_t http_mutex;
+static uint32_t heap_after_init = 0;	// free heap after GSM initialization, used to check the heap usage
 
 static const char *TIME_TAG = "[SNTP]";
 static const char *HTTP_TAG = "[HTTP]";
@@ -71,15 +78,19 @@ static const char *SMS_TAG = "[SMS]";
 #define SSL_WEB_PORT "443"
 #define SSL_WEB_URL "https://www.howsmyssl.com/a/check"
 
-static const char *REQUEST = "GET " WEB_URL " HTTP/1.1\n"
-    "Host: "WEB_SERVER"\n"
-    "User-Agent: esp-idf/1.0 esp32\n"
-    "\n";
+#define HTTP_RECV_TIMEOUT 20000	// socket receive timeout in miliseconds, not used to detect the end of the body
 
-static const char *SSL_REQUEST = "GET " SSL_WEB_URL " HTTP/1.1\n"
-    "Host: "SSL_WEB_SERVER"\n"
-    "User-Agent: esp-idf/1.0 esp32\n"
-    "\n";
+static const char *REQUEST = "GET " WEB_URL " HTTP/1.1\r\n"
+    "Host: "WEB_SERVER"\r\n"
+    "User-Agent: esp-idf/1.0 esp32\r\n"
+    HTTP_ACCEPT_ENCODING
+    "\r\n";
+
+static const char *SSL_REQUEST = "GET " SSL_WEB_URL " HTTP/1.1\r\n"
+    "Host: "SSL_WEB_SERVER"\r\n"
+    "User-Agent: esp-idf/1.0 esp32\r\n"
+    HTTP_ACCEPT_ENCODING
+    "\r\n";
 
 /* Root cert for howsmyssl.com, taken from server_root_cert.pem
 
@@ -95,6 +106,125 @@ extern const uint8_t server_root_cert_pem_start[] asm("_binary_server_root_cert_
 extern const uint8_t server_root_cert_pem_end[]   asm("_binary_server_root_cert_pem_end");
 
 
+// Buffer used to collect the response body
+typedef struct
+{
+	char	*buf;
+	int		size;
+	int		len;
+}body_buffer_t;
+
+// Collect the body data, data which does not fit into the buffer is only counted
+//------------------------------------------------------------
+static int body_collect(void *arg, const char *data, int len)
+{
+	body_buffer_t *body = (body_buffer_t *)arg;
+
+	if ((body->len + len) >= body->size) len = body->size - body->len - 1;
+	if (len > 0) {
+		memcpy(body->buf + body->len, data, len);
+		body->len += len;
+	}
+	body->buf[body->len] = '\0';
+	return 0;
+}
+
+// Print the transfer byte accounting: PPP link bytes, body bytes on the wire and decoded body bytes
+//---------------------------------------------------------------------------------------------
+static void print_transfer_info(const char *tag, http_response_t *resp, uint32_t link_rx, uint32_t link_tx)
+{
+	uint32_t rx, tx;
+	getRxTxCount(NULL, &rx, &tx, 0);
+	ESP_LOGI(tag, "Link bytes: %u out, %u in; body: %u on wire, %u decoded (encoding %d)",
+			rx - link_rx, tx - link_tx, resp->body_bytes, resp->decoded_bytes, resp->encoding);
+	if ((resp->encoding != HTTP_ENC_NONE) && (resp->decoded_bytes > 0)) {
+		// incompressible body can be larger on the wire, the saving is negative
+		int saved = 100 - (int)(((uint64_t)resp->body_bytes * 100) / resp->decoded_bytes);
+		ESP_LOGI(tag, "Compression saved %d bytes (%d%%)",
+				(int)(resp->decoded_bytes - resp->body_bytes), saved);
+	}
+
+	gsm_uart_stats_t ustats;
+	gsm_GetUartStats(NULL, &ustats, 0);
+	ESP_LOGI(tag, "UART: %u overruns, %u buffer full, flow control %s; PPP: %u frames, %u FCS errors",
+			ustats.fifo_overflows, ustats.buffer_full, (ustats.flow_ctrl) ? "on" : "off", ustats.frames, ustats.fcs_errors);
+	ESP_LOGI(tag, "Heap: %u free (%d since init), %u minimum free",
+			esp_get_free_heap_size(), (int)(esp_get_free_heap_size() - heap_after_init), esp_get_minimum_free_heap_size());
+	ESP_LOGI(tag, "PPPoS task: %u stack bytes never used", gsm_GetTaskStackFree(NULL));
+	if ((ustats.input_bytes > 0) && (ustats.frames > 0)) {
+		uint32_t mpk = (uint32_t)(((uint64_t)ustats.input_msgs * 102400) / ustats.input_bytes);	// messages/KB * 100
+		ESP_LOGI(tag, "PPP input: %u.%02u messages/KB, %u us CPU/frame",
+				mpk / 100, mpk % 100, ustats.input_us / ustats.frames);
+	}
+	if ((ustats.rx_bytes > 0) && (ustats.tx_bytes > 0) && (ustats.output_calls > 0)) {
+		// HDLC framing overhead: flags and escaped bytes
+		ESP_LOGI(tag, "PPP framing overhead: in %u%%, out %u%% (%u frames); output %u us/call, %u ns/byte",
+				((ustats.rx_bytes - ustats.rx_frame_bytes) * 100) / ustats.rx_bytes,
+				((ustats.tx_bytes - ustats.tx_frame_bytes) * 100) / ustats.tx_bytes, ustats.tx_frames,
+				ustats.output_us / ustats.output_calls, (uint32_t)(((uint64_t)ustats.output_us * 1000) / ustats.tx_bytes));
+	}
+}
+
+// Print DNS cache statistics
+//----------------------------------------
+static void print_dns_info(const char *tag)
+{
+	gsm_dns_stats_t stats;
+	gsm_dns_getStats(&stats, 0);
+	uint32_t total = stats.hits + stats.misses;
+	ESP_LOGI(tag, "DNS cache: %u hits, %u misses (hit rate %u%%), %u prefetched, %u ms saved",
+			stats.hits, stats.misses, (total) ? ((stats.hits * 100) / total) : 0, stats.prefetches, stats.saved_ms);
+}
+
+// Print GSM connection metrics summary and JSON snapshot
+//--------------------------------------------
+static void print_gsm_metrics(const char *tag)
+{
+	gsm_metrics_t m;
+	gsm_GetMetrics(NULL, &m, 0);
+	ESP_LOGI(tag, "GSM: AT p50 %u ms, p90 %u ms (%u timeouts); connect p50 %u ms; %u connects; rate in %u B/s, out %u B/s",
+			gsm_hist_percentile(&m.at_latency, 50), gsm_hist_percentile(&m.at_latency, 90), m.at_timeouts,
+			gsm_hist_percentile(&m.connect_time, 50), m.connects, m.rx_rate, m.tx_rate);
+	gsm_reg_t reg;
+	if (gsm_GetRegistration(NULL, &reg)) {
+		ESP_LOGI(tag, "GSM: registered (%s), area %04X, cell %08X, act %d; registration p50 %u ms (%u timeouts)",
+				(reg.stat == GSM_REG_ROAMING) ? "roaming" : "home", reg.lac, reg.ci, reg.act,
+				gsm_hist_percentile(&m.reg_time, 50), m.reg_timeouts);
+	}
+
+	char *json = gsm_bufAlloc(GSM_METRICS_JSON_MAX);
+	if (json == NULL) return;
+	if (gsm_metrics_toJSON(&m, json, GSM_METRICS_JSON_MAX) > 0) ESP_LOGI(tag, "GSM metrics: %s", json);
+	free(json);
+}
+
+// Log unsolicited result codes reported by the modem
+//---------------------------------------------------------------------------
+static void gsm_urc_log(gsm_handle gsm, int urc, const char *line, void *arg)
+{
+	ESP_LOGW("PPPoS EXAMPLE", "Modem reported: %s", line);
+}
+
+// Read data from socket
+//-------------------------------------------------------
+static int socket_read(void *ctx, char *buf, int len)
+{
+	return read(*(int *)ctx, buf, len);
+}
+
+// Read data from SSL connection
+//------------------------------------------------------
+static int ssl_read(void *ctx, char *buf, int len)
+{
+	int ret;
+	do {
+		ret = mbedtls_ssl_read((mbedtls_ssl_context *)ctx, (unsigned char *)buf, len);
+	} while ((ret == MBEDTLS_ERR_SSL_WANT_READ) || (ret == MBEDTLS_ERR_SSL_WANT_WRITE));
+
+	if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) ret = 0;
+	return ret;
+}
+
 //-----------------------------------
 static void parse_object(cJSON *item)
 {
@@ -139,11 +269,20 @@ static void https_get_task(void *pvParameters)
 	}
 
 	char buf[512];
-    char *buffer;
-    int ret, flags, len, rlen=0, totlen=0;
-
-	buffer = malloc(8192);
-	if (!buffer) {
+    int ret, flags, len;
+    int link = -1;
+    uint32_t t_start = 0;
+    uint32_t link_rx = 0, link_tx = 0;
+    gsm_link_stats_t link_stats;
+    struct sockaddr_in server;
+    http_response_t resp;
+    body_buffer_t body;
+
+    memset(&resp, 0, sizeof(http_response_t));
+	body.size = CONFIG_GSM_HTTPS_BUF_SIZE;
+	body.len = 0;
+	body.buf = gsm_bufAlloc(body.size);
+	if (!body.buf) {
 		xSemaphoreGive(http_mutex);
 		ESP_LOGE(HTTPS_TAG, "*** ERROR allocating receive buffer ***");
 		while (1) {
@@ -159,6 +298,7 @@ static void https_get_task(void *pvParameters)
     mbedtls_net_context server_fd;
 
     mbedtls_ssl_init(&ssl);
+    mbedtls_net_init(&server_fd);
     mbedtls_x509_crt_init(&cacert);
     mbedtls_ctr_drbg_init(&ctr_drbg);
     ESP_LOGI(HTTPS_TAG, "Seeding the random number generator");
@@ -239,22 +379,40 @@ static void https_get_task(void *pvParameters)
 		}
 start:
         // ** We must be connected to Internet
-        if (ppposInit() == 0) goto finished;
+        if (ppposInit(NULL) == 0) goto finished;
 
         ESP_LOGI(HTTPS_TAG, "===== HTTPS GET REQUEST =========================================\n");
 
+        memset(&resp, 0, sizeof(http_response_t));
+        body.len = 0;
+        body.buf[0] = '\0';
+        getRxTxCount(NULL, &link_rx, &link_tx, 0);
+
         mbedtls_net_init(&server_fd);
+        link = -1;
 
         ESP_LOGI(HTTPS_TAG, "Connecting to %s:%s...", SSL_WEB_SERVER, SSL_WEB_PORT);
 
-        if ((ret = mbedtls_net_connect(&server_fd, SSL_WEB_SERVER,
-                                      SSL_WEB_PORT, MBEDTLS_NET_PROTO_TCP)) != 0)
-        {
-            ESP_LOGE(HTTPS_TAG, "mbedtls_net_connect returned -%x", -ret);
+        // Resolve the server address using DNS cache
+        memset(&server, 0, sizeof(server));
+        server.sin_family = AF_INET;
+        server.sin_port = htons(atoi(SSL_WEB_PORT));
+        if (gsm_dns_resolve(SSL_WEB_SERVER, &server.sin_addr) == 0) {
+            ESP_LOGE(HTTPS_TAG, "DNS lookup failed");
+            ret = 0;
+            goto exit;
+        }
+
+        // ** Connect over one of the PPP links registered in link manager, TLS runs on the connected socket
+        t_start = xTaskGetTickCount();
+        server_fd.fd = gsm_link_connect(&server, &link);
+        if (server_fd.fd < 0) {
+            ESP_LOGE(HTTPS_TAG, "socket connect failed errno=%d", errno);
+            ret = 0;
             goto exit;
         }
 
-        ESP_LOGI(HTTPS_TAG, "Connected.");
+        ESP_LOGI(HTTPS_TAG, "Connected over link %d.", link);
 
         mbedtls_ssl_set_bio(&ssl, &server_fd, mbedtls_net_send, mbedtls_net_recv, NULL);
 
@@ -298,63 +456,35 @@ start:
         ESP_LOGI(HTTPS_TAG, "%d bytes written", len);
         ESP_LOGI(HTTPS_TAG, "Reading HTTP response...");
 
-		rlen = 0;
-		totlen = 0;
-        do
-        {
-            len = sizeof(buf) - 1;
-            bzero(buf, sizeof(buf));
-            ret = mbedtls_ssl_read(&ssl, (unsigned char *)buf, len);
-
-            if(ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
-                continue;
-
-            if(ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
-                ret = 0;
-                break;
-            }
-
-            if(ret < 0)
-            {
-                ESP_LOGE(HTTPS_TAG, "mbedtls_ssl_read returned -0x%x", -ret);
-                break;
-            }
-
-            if(ret == 0)
-            {
-                ESP_LOGI(HTTPS_TAG, "connection closed");
-                break;
-            }
-
-            len = ret;
-            //ESP_LOGI(HTTPS_TAG, "%d bytes read", len);
-			totlen += len;
-			if ((rlen + len) < 8192) {
-				memcpy(buffer+rlen, buf, len);
-				rlen += len;
-			}
-        } while(1);
+        ret = http_read_response(ssl_read, &ssl, &resp, body_collect, &body);
+        if (ret != 0) ESP_LOGE(HTTPS_TAG, "http_read_response returned %d", ret);
+        ret = 0;
 
         mbedtls_ssl_close_notify(&ssl);
 
     exit:
         mbedtls_ssl_session_reset(&ssl);
         mbedtls_net_free(&server_fd);
+        if (link >= 0) {
+            gsm_link_done(link, resp.wire_bytes, (xTaskGetTickCount() - t_start) * portTICK_PERIOD_MS);
+            if (gsm_link_getStats(link, &link_stats)) {
+                ESP_LOGI(HTTPS_TAG, "Link %d: %u connections, rtt=%u ms, %u B/s, utilisation %u%%",
+                		link, link_stats.connections, link_stats.rtt_ms, link_stats.throughput, link_stats.utilisation);
+            }
+            link = -1;
+        }
 
-        ESP_LOGI(HTTPS_TAG, "%d bytes read, %d in buffer", totlen, rlen);
+        ESP_LOGI(HTTPS_TAG, "%u bytes read, %u body bytes, %d in buffer", resp.wire_bytes, resp.body_bytes, body.len);
         if(ret != 0)
         {
             mbedtls_strerror(ret, buf, 100);
             ESP_LOGE(HTTPS_TAG, "Last error was: -0x%x - %s", -ret, buf);
         }
 
-        buffer[rlen] = '\0';
-        char *json_ptr = strstr(buffer, "{\"given_cipher_suites\":");
-        char *hdr_end_ptr = strstr(buffer, "\r\n\r\n");
-		if (hdr_end_ptr) {
-			*hdr_end_ptr = '\0';
-			printf("Header:\r\n-------\r\n%s\r\n-------\r\n", buffer);
-		}
+		if (resp.status) printf("Header:\r\n-------\r\n%s\r\n-------\r\n", resp.header);
+		print_transfer_info(HTTPS_TAG, &resp, link_rx, link_tx);
+		print_dns_info(HTTPS_TAG);
+        char *json_ptr = strstr(body.buf, "{\"given_cipher_suites\":");
 		if (json_ptr) {
 			ESP_LOGI(HTTPS_TAG, "JSON data received.");
 			cJSON *root = cJSON_Parse(json_ptr);
@@ -366,7 +496,7 @@ start:
 		}
 
 		// We can disconnect from Internet now and turn off RF to save power
-		ppposDisconnect(0, 1);
+		ppposDisconnect(NULL, 0, 1);
 
 finished:
         ESP_LOGI(HTTPS_TAG, "Waiting %d sec...", EXAMPLE_TASK_PAUSE);
@@ -389,19 +519,18 @@ static void http_get_task(void *pvParameters)
 		}
 	}
 
-	const struct addrinfo hints = {
-        .ai_family = AF_INET,
-        .ai_socktype = SOCK_STREAM,
-    };
-    struct addrinfo *res;
-    struct in_addr *addr;
-    int s, r;
-    char recv_buf[128];
-    char *buffer;
-    int rlen=0, totlen=0;
-
-	buffer = malloc(2048);
-	if (!buffer) {
+    struct sockaddr_in server;
+    int s, r, link;
+    uint32_t t_start;
+    gsm_link_stats_t link_stats;
+    uint32_t link_rx, link_tx;
+    http_response_t resp;
+    body_buffer_t body;
+
+	body.size = CONFIG_GSM_HTTP_BUF_SIZE;
+	body.len = 0;
+	body.buf = gsm_bufAlloc(body.size);
+	if (!body.buf) {
 		ESP_LOGE(HTTPS_TAG, "*** ERROR allocating receive buffer ***");
 		xSemaphoreGive(http_mutex);
 		while (1) {
@@ -419,14 +548,18 @@ static void http_get_task(void *pvParameters)
 		}
 start:
         // ** We must be connected to Internet
-        if (ppposInit() == 0) goto finished;
+        if (ppposInit(NULL) == 0) goto finished;
+        // ** Refresh DNS cache entries which are about to expire
+        gsm_dns_prefetch();
 
 		ESP_LOGI(HTTP_TAG, "===== HTTP GET REQUEST =========================================\n");
+		getRxTxCount(NULL, &link_rx, &link_tx, 0);
 
-        int err = getaddrinfo(WEB_SERVER, "80", &hints, &res);
-
-        if(err != 0 || res == NULL) {
-            ESP_LOGE(HTTP_TAG, "DNS lookup failed err=%d res=%p", err, res);
+        memset(&server, 0, sizeof(server));
+        server.sin_family = AF_INET;
+        server.sin_port = htons(WEB_PORT);
+        if (gsm_dns_resolve(WEB_SERVER, &server.sin_addr) == 0) {
+            ESP_LOGE(HTTP_TAG, "DNS lookup failed");
             xSemaphoreGive(http_mutex);
             vTaskDelay(1000 / portTICK_PERIOD_MS);
             continue;
@@ -435,34 +568,24 @@ start:
         /* Code to print the resolved IP.
 
            Note: inet_ntoa is non-reentrant, look at ipaddr_ntoa_r for "real" code */
-        addr = &((struct sockaddr_in *)res->ai_addr)->sin_addr;
-        ESP_LOGI(HTTP_TAG, "DNS lookup succeeded. IP=%s", inet_ntoa(*addr));
+        ESP_LOGI(HTTP_TAG, "DNS lookup succeeded. IP=%s", inet_ntoa(server.sin_addr));
 
-        s = socket(res->ai_family, res->ai_socktype, 0);
+        // ** Connect over one of the PPP links registered in link manager
+        t_start = xTaskGetTickCount();
+        s = gsm_link_connect(&server, &link);
         if(s < 0) {
-            ESP_LOGE(HTTP_TAG, "... Failed to allocate socket.");
-            freeaddrinfo(res);
-            xSemaphoreGive(http_mutex);
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
-            continue;
-        }
-        ESP_LOGI(HTTP_TAG, "... allocated socket\r\n");
-
-        if(connect(s, res->ai_addr, res->ai_addrlen) != 0) {
             ESP_LOGE(HTTP_TAG, "... socket connect failed errno=%d", errno);
-            close(s);
-            freeaddrinfo(res);
             xSemaphoreGive(http_mutex);
             vTaskDelay(4000 / portTICK_PERIOD_MS);
             continue;
         }
 
-        ESP_LOGI(HTTP_TAG, "... connected");
-        freeaddrinfo(res);
+        ESP_LOGI(HTTP_TAG, "... connected over link %d", link);
 
         if (write(s, REQUEST, strlen(REQUEST)) < 0) {
             ESP_LOGE(HTTP_TAG, "... socket send failed");
             close(s);
+            gsm_link_done(link, 0, 0);
             xSemaphoreGive(http_mutex);
             vTaskDelay(4000 / portTICK_PERIOD_MS);
             continue;
@@ -470,36 +593,40 @@ start:
         ESP_LOGI(HTTP_TAG, "... socket send success");
         ESP_LOGI(HTTP_TAG, "... reading HTTP response...");
 
-        /* Read HTTP response */
-		int opt = 500;
-		int first_block = 1;
-		rlen = 0;
-		totlen = 0;
-        do {
-            bzero(recv_buf, sizeof(recv_buf));
-            r = read(s, recv_buf, sizeof(recv_buf)-1);
-			totlen += r;
-			if ((rlen + r) < 2048) {
-				memcpy(buffer+rlen, recv_buf, r);
-				rlen += r;
-			}
-			if (first_block) {
-				lwip_setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &opt, sizeof(int));
-			}
-        } while(r > 0);
-
-        buffer[rlen] = '\0';
-        char *hdr_end_ptr = strstr(buffer, "\r\n\r\n");
-		if (hdr_end_ptr) {
-			*hdr_end_ptr = '\0';
-			printf("Header:\r\n-------\r\n%s\r\n-------\r\n", buffer);
-			printf("Data:\r\n-----\r\n%s\r\n-----\r\n", hdr_end_ptr+4);
+        /* Read HTTP response, the end of the body is detected from the response framing */
+		int opt = HTTP_RECV_TIMEOUT;
+		lwip_setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &opt, sizeof(int));
+		body.len = 0;
+		body.buf[0] = '\0';
+		r = http_read_response(socket_read, &s, &resp, body_collect, &body);
+
+		if (resp.status) {
+			printf("Header:\r\n-------\r\n%s\r\n-------\r\n", resp.header);
+			printf("Data:\r\n-----\r\n%s\r\n-----\r\n", body.buf);
 		}
-        ESP_LOGI(HTTP_TAG, "... done reading from socket. %d bytes read, %d in buffer, errno=%d\r\n", totlen, rlen, errno);
+        ESP_LOGI(HTTP_TAG, "... done reading from socket. %u bytes read, %u body bytes, %d in buffer, result=%d\r\n", resp.wire_bytes, resp.body_bytes, body.len, r);
         close(s);
+        gsm_link_done(link, resp.wire_bytes, (xTaskGetTickCount() - t_start) * portTICK_PERIOD_MS);
+        if (gsm_link_getStats(link, &link_stats)) {
+            ESP_LOGI(HTTP_TAG, "Link %d: %u connections, rtt=%u ms, %u B/s, utilisation %u%%",
+            		link, link_stats.connections, link_stats.rtt_ms, link_stats.throughput, link_stats.utilisation);
+        }
+		print_transfer_info(HTTP_TAG, &resp, link_rx, link_tx);
+		print_dns_info(HTTP_TAG);
+		print_gsm_metrics(HTTP_TAG);
+		#ifdef CONFIG_GSM_PCAP
+		// Dump the captured PPP frames, convert them with tools/gsm_pcap.py
+		gsm_pcap_dump();
+		#endif
+		#ifdef CONFIG_GSM_SERIAL_RECORD
+		// Dump the UART recording of the session, convert it with tools/gsm_rec.py
+		gsm_record_stop();
+		gsm_record_dump();
+		gsm_record_start(0);
+		#endif
 
         // We can disconnect from Internet now and turn off RF to save power
-		ppposDisconnect(0, 1);
+		ppposDisconnect(NULL, 0, 1);
 
 finished:
         ESP_LOGI(HTTP_TAG, "Waiting %d sec...", EXAMPLE_TASK_PAUSE);
@@ -537,13 +664,20 @@ start:
 		ESP_LOGI(SMS_TAG, "===== SMS TEST =================================================\n");
 
 		// ** For SMS operations we have to off line **
-		ppposDisconnect(0, 0);
-		gsm_RFOn();  // Turn on RF if it was turned off
+		ppposDisconnect(NULL, 0, 0);
+		gsm_RFOn(NULL);  // Turn on RF if it was turned off
 		vTaskDelay(2000 / portTICK_RATE_MS);
 
+		// ** Any AT command can be sent through the request queue while off line
+		char csq[64];
+		if (gsm_atCommand(NULL, "AT+CSQ", NULL, 1000, csq, sizeof(csq)) == GSM_AT_OK) {
+			char *p = strstr(csq, "+CSQ:");
+			if (p) ESP_LOGI(SMS_TAG, "Signal quality: %.*s", (int)strcspn(p, "\r\n"), p);
+		}
+
 		#ifdef CONFIG_GSM_SEND_SMS
 		if (clock() > sms_time) {
-			if (smsSend(CONFIG_GSM_SMS_NUMBER, "Hi from ESP32 via GSM\rThis is the test message.") == 1) {
+			if (smsSend(NULL, CONFIG_GSM_SMS_NUMBER, "Hi from ESP32 via GSM\rThis is the test message.") == 1) {
 				printf("SMS sent successfully\r\n");
 			}
 			else {
@@ -553,12 +687,12 @@ start:
 		}
 		#endif
 
-		smsRead(&messages, -1);
+		smsRead(NULL, &messages, -1);
 		if (messages.nmsg) {
 			printf("\r\nReceived messages: %d\r\n", messages.nmsg);
 			SMS_Msg *msg;
 			for (int i=0; i<messages.nmsg; i++) {
-				msg = messages.messages + (i * sizeof(SMS_Msg));
+				msg = &messages.messages[i];
 				struct tm * timeinfo;
 				timeinfo = localtime (&msg->time_value );
 				printf("-------------------------------------------\r\n");
@@ -574,29 +708,27 @@ start:
 					timeinfo = localtime( &rawtime );
 					strftime(buffer,80,"%x %H:%M:%S", timeinfo);
 					sprintf(buf, "Hi, %s\rMy time is now\r%s", msg->from, buffer);
-					if (smsSend(CONFIG_GSM_SMS_NUMBER, buf) == 1) {
+					if (smsSend(NULL, CONFIG_GSM_SMS_NUMBER, buf) == 1) {
 						printf("Response sent successfully\r\n");
 					}
 					else {
 						printf("Response send failed\r\n");
 					}
 				}
-				// Free allocated message text buffer
-				if (msg->msg) free(msg->msg);
 				if ((i+1) == messages.nmsg) {
 					printf("Delete message at index %d\r\n", msg->idx);
-					if (smsDelete(msg->idx) == 0) printf("Delete ERROR\r\n");
+					if (smsDelete(NULL, msg->idx) == 0) printf("Delete ERROR\r\n");
 					else printf("Delete OK\r\n");
 				}
 			}
-			free(messages.messages);
+			smsFree(&messages);
 		}
 		else printf("\r\nNo messages\r\n");
 
 		// ** We can turn off GSM RF to save power
-		gsm_RFOff();
+		gsm_RFOff(NULL);
 		// ** We can now go back on line, or stay off line **
-        //ppposInit();
+        //ppposInit(NULL);
 
         ESP_LOGI(SMS_TAG, "Waiting %d sec...", EXAMPLE_TASK_PAUSE);
         ESP_LOGI(SMS_TAG, "================================================================\n\n");
@@ -615,12 +747,34 @@ void app_main()
 {
 	http_mutex = xSemaphoreCreateMutex();
 
-	if (ppposInit() == 0) {
+	#ifdef CONFIG_GSM_TRACE
+	// Dump the GSM event trace to console every 5 seconds, decode it with tools/gsm_trace.py
+	gsm_trace_startTask(1, 5000);
+	#endif
+	#ifdef CONFIG_GSM_PCAP
+	gsm_pcap_start(0);
+	#endif
+	#ifdef CONFIG_GSM_SERIAL_RECORD
+	gsm_record_start(0);
+	#endif
+	// The first created instance is the default one, used with NULL handle
+	gsm_config_t gsm_cfg;
+	gsm_defaultConfig(&gsm_cfg);
+	gsm_handle gsm = gsmCreate(&gsm_cfg);
+
+	// Log incoming SMS and power supply warnings
+	gsm_urcSubscribe(NULL, GSM_URC_MASK(GSM_URC_SMS) | GSM_URC_MASK(GSM_URC_POWER), gsm_urc_log, NULL);
+
+	if (ppposInit(NULL) == 0) {
 		ESP_LOGE("PPPoS EXAMPLE", "ERROR: GSM not initialized, HALTED");
 		while (1) {
 			vTaskDelay(1000 / portTICK_RATE_MS);
 		}
 	}
+	heap_after_init = esp_get_free_heap_size();
+
+	// Register the GSM link in link manager, more modems created with gsmCreate() can be added
+	gsm_link_add(gsm, 1);
 
 	// Get time from NTP server
 	time_t now = 0;
@@ -631,7 +785,11 @@ void app_main()
 	time(&now);
 	localtime_r(&now, &timeinfo);
 
-	while (1) {
+	if (gsm_TimeFromNetwork(NULL)) {
+		// ** Time was already set from the network time reported by the modem, SNTP is not needed
+		ESP_LOGI(TIME_TAG, "TIME SET FROM NETWORK TO %s", asctime(&timeinfo));
+	}
+	else while (1) {
 		printf("\r\n");
 		ESP_LOGI(TIME_TAG,"OBTAINING TIME");
 	    ESP_LOGI(TIME_TAG, "Initializing SNTP");
@@ -647,13 +805,13 @@ void app_main()
 			vTaskDelay(2000 / portTICK_PERIOD_MS);
 			time(&now);
 			localtime_r(&now, &timeinfo);
-			if (ppposStatus() != GSM_STATE_CONNECTED) break;
+			if (ppposStatus(NULL) != GSM_STATE_CONNECTED) break;
 		}
-		if (ppposStatus() != GSM_STATE_CONNECTED) {
+		if (ppposStatus(NULL) != GSM_STATE_CONNECTED) {
 			sntp_stop();
 			ESP_LOGE(TIME_TAG, "Disconnected, waiting for reconnect");
 			retry = 0;
-			while (ppposStatus() != GSM_STATE_CONNECTED) {
+			while (ppposStatus(NULL) != GSM_STATE_CONNECTED) {
 				vTaskDelay(100 / portTICK_RATE_MS);
 			}
 			continue;
@@ -670,6 +828,8 @@ void app_main()
 		break;
 	}
 
+	ESP_LOGI(TIME_TAG, "Boot to first request: %u ms", (uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS));
+
 	// Create tasks
     xTaskCreate(&http_get_task, "http_get_task", 4096, NULL, 5, NULL);
     xTaskCreate(&https_get_task, "https_get_task", 16384, NULL, 4, NULL);
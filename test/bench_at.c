@@ -0,0 +1,386 @@
+/*
+ *  Host benchmark of the AT command path
+ *
+ *  The response parsers (components/pppos/gsm_parse.c) are run over the modem output from
+ *  the checked-in recording data/sim800_init.rec and a set of unsolicited result codes,
+ *  AT+CMGL dumps are parsed as smsRead() does. Then libGSM initializes the simulated modem
+ *  without line rate limit and latency, reads the SMS list and executes AT commands through
+ *  the PPPoS task (response matching and URC filtering in _atCmdResponse()).
+ *
+ *  Reported are ns per byte of modem output and heap allocations per operation. The wall time
+ *  of the libGSM operations is dominated by the fixed delays in the command sequence, the CPU
+ *  time is the time used by the process (all threads, including the simulated modem).
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_timer.h"
+#include "libGSM.h"
+#include "gsm_parse.h"
+#include "gsm_serial.h"
+#include "host_port.h"
+#include "sim_modem.h"
+
+#define REC_FILE		"data/sim800_init.rec"
+#define BENCH_NS		200000000LL		// every parser is run for at least this time
+#define MAX_LINES		256
+#define LINE_MAX		128
+#define SMS_COUNT		30				// messages in the AT+CMGL dump
+#define SMS_READS		5
+#define AT_COMMANDS		20
+
+typedef struct
+{
+	char		line[LINE_MAX];
+	const char	*cmd;			// command waiting for the response, NULL if none
+}bench_line_t;
+
+typedef uint32_t (*bench_fn)();
+
+static bench_line_t lines[MAX_LINES];
+static int nlines;
+static int lines_bytes;
+static char cmds[MAX_LINES][LINE_MAX];
+static int ncmds;
+static char cmgl[SMS_COUNT * 128 + 64];
+static int cmgl_len;
+
+// Unsolicited result codes as reported by SIM800 and LTE modems
+static const char *urc_lines[] = {
+	"RING",
+	"NO CARRIER",
+	"+CMTI: \"SM\",5",
+	"+CREG: 1,\"1A2B\",\"00C3\"",
+	"+CREG: 5,\"1A2C\",\"4F21\"",
+	"+CGREG: 1,\"1A2B\",\"00C3\"",
+	"+CEREG: 5,\"00A1\",\"01A2B3C4\",7",
+	"*PSUTTZ: 2026,10,18,12,30,45,\"+8\",0",
+	"DST: 0",
+	"+CTZV: +8,0",
+	"+PDP: DEACT",
+	"UNDER-VOLTAGE WARNNING",
+	"+CPIN: NOT READY",
+	"Call Ready",
+	"SMS Ready",
+};
+
+// Time stamps of the +CCLK responses and SMS
+static const char *time_strs[] = {
+	"26/10/18,12:30:45+08",
+	"26/10/17,09:15:02+08",
+	"26/01/01,00:00:00-16",
+	"25/12/31,23:59:59+00",
+	"26/10/18,12:30:45",
+};
+
+#define URC_LINES	(sizeof(urc_lines)/sizeof(char *))
+#define TIME_STRS	(sizeof(time_strs)/sizeof(char *))
+
+
+//---------------------
+static int64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t)ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+}
+
+//--------------------------------------------------------------
+static void add_line(const char *line, int len, const char *cmd)
+{
+	if ((len <= 0) || (nlines >= MAX_LINES)) return;
+	if (len >= LINE_MAX) len = LINE_MAX - 1;
+	memcpy(lines[nlines].line, line, len);
+	lines[nlines].line[len] = '\0';
+	lines[nlines].cmd = cmd;
+	lines_bytes += len;
+	nlines++;
+}
+
+// Split the modem output of the recording into lines, with the command written before them
+//-------------------------------------
+static int load_lines(const char *path)
+{
+	static uint8_t rec[65536];
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) return 0;
+	int size = fread(rec, 1, sizeof(rec), f);
+	fclose(f);
+
+	const char *cmd = NULL;
+	int pos = sizeof(gsm_rec_header_t);
+	while ((pos + (int)sizeof(gsm_rec_event_t)) <= size) {
+		gsm_rec_event_t ev;
+		memcpy(&ev, rec + pos, sizeof(gsm_rec_event_t));
+		const char *data = (const char *)rec + pos + sizeof(gsm_rec_event_t);
+		pos += sizeof(gsm_rec_event_t) + ev.len;
+		if (pos > size) break;
+
+		if (ev.dir == GSM_REC_TX) {
+			if (ncmds >= MAX_LINES) continue;
+			int len = (ev.len < LINE_MAX) ? ev.len : LINE_MAX - 1;
+			memcpy(cmds[ncmds], data, len);
+			cmds[ncmds][len] = '\0';
+			cmd = cmds[ncmds++];
+			continue;
+		}
+		// lines end with CR LF, the echo with CR only
+		int start = 0;
+		for (int i=0; i<ev.len; i++) {
+			if ((data[i] == '\r') || (data[i] == '\n')) {
+				add_line(data + start, i - start, cmd);
+				start = i + 1;
+			}
+		}
+		add_line(data + start, ev.len - start, cmd);
+	}
+	for (int i=0; i<URC_LINES; i++) add_line(urc_lines[i], strlen(urc_lines[i]), NULL);
+	return nlines;
+}
+
+// AT+CMGL="ALL" response of SMS_COUNT messages, without the final OK
+//---------------------
+static void make_cmgl()
+{
+	static const char *stat[] = { "REC READ", "REC UNREAD", "STO SENT", "STO UNSENT" };
+	int len = 0;
+	for (int i=0; i<SMS_COUNT; i++) {
+		len += sprintf(cmgl + len, "%s+CMGL: %d,\"%s\",\"+3859%08d\",\"\",\"26/10/%02d,%02d:%02d:%02d+08\"\r\n"
+				"Message %d, the text of a typical SMS notification\r\n",
+				(i == 0) ? "\r\n" : "", i + 1, stat[i % 4], 11234567 + (i * 7919), 1 + (i % 28), i % 24, (i * 7) % 60, (i * 13) % 60, i + 1);
+	}
+	cmgl_len = len;
+}
+
+// ==== Parser passes, every pass returns a value depending on the result, so it is not optimized away ====
+
+//------------------------
+static uint32_t pass_urc()
+{
+	uint32_t res = 0;
+	for (int i=0; i<nlines; i++) res += gsm_parseURC(lines[i].line, lines[i].cmd);
+	return res;
+}
+
+//-------------------------------
+static uint32_t pass_urc_prefix()
+{
+	uint32_t res = 0;
+	for (int i=0; i<nlines; i++) res += gsm_isURCPrefix(lines[i].line, strlen(lines[i].line));
+	return res;
+}
+
+//------------------------
+static uint32_t pass_reg()
+{
+	uint32_t res = 0;
+	gsm_reg_t reg;
+	for (int i=0; i<nlines; i++) {
+		if (gsm_parseReg(lines[i].line, &reg)) res += reg.stat + reg.ci;
+	}
+	return res;
+}
+
+//-------------------------
+static uint32_t pass_time()
+{
+	uint32_t res = 0;
+	struct tm tm;
+	int tz;
+	for (int i=0; i<TIME_STRS; i++) {
+		if (gsm_parseTime(time_strs[i], &tm, &tz)) res += tm.tm_sec + tz;
+	}
+	return res;
+}
+
+// As smsRead(), every message text is allocated
+//-------------------------
+static uint32_t pass_cmgl()
+{
+	SMS_Msg msg[SMS_COUNT];
+	uint32_t res = 0;
+	const char *p = cmgl;
+	int nmsg = gsm_parseSMSCount(cmgl);
+	for (int i=0; (i<nmsg) && (i<SMS_COUNT); i++) {
+		if (gsm_parseSMS(&p, &msg[i], NULL, 0) <= 0) break;
+		res += msg[i].idx;
+		free(msg[i].msg);
+	}
+	return res;
+}
+
+// As smsRead() with CONFIG_GSM_STATIC_ALLOC, the texts are copied to fixed buffers
+// The remaining allocations are made by the host mktime() (glibc), not by the parser
+//--------------------------------
+static uint32_t pass_cmgl_static()
+{
+	static char text[SMS_COUNT][160];
+	SMS_Msg msg[SMS_COUNT];
+	uint32_t res = 0;
+	const char *p = cmgl;
+	int nmsg = gsm_parseSMSCount(cmgl);
+	for (int i=0; (i<nmsg) && (i<SMS_COUNT); i++) {
+		if (gsm_parseSMS(&p, &msg[i], text[i], sizeof(text[i])) <= 0) break;
+		res += msg[i].idx;
+	}
+	return res;
+}
+
+//---------------------------------------------------------
+static void bench(const char *name, bench_fn fn, int bytes)
+{
+	static volatile uint32_t sink;
+	host_alloc_stats_t as;
+	int64_t n = 0;
+	int64_t t;
+
+	host_alloc_stats(&as, 1);
+	host_alloc_count(1);
+	int64_t t0 = now_ns();
+	do {
+		for (int i=0; i<16; i++) sink += fn();
+		n += 16;
+		t = now_ns();
+	} while ((t - t0) < BENCH_NS);
+	host_alloc_count(0);
+	host_alloc_stats(&as, 1);
+
+	double ns = (double)(t - t0) / n;
+	printf("  %-22s %8.2f ns/byte %10.1f ns/op %7.2f allocs/op  (%d bytes/op)\n",
+			name, ns / bytes, ns, (double)as.allocs / n, bytes);
+}
+
+//-----------------------
+static void bench_parse()
+{
+	int urc_bytes = 0;
+	int reg_bytes = 0;
+	int time_bytes = 0;
+	gsm_reg_t reg;
+
+	for (int i=0; i<nlines; i++) {
+		if (gsm_parseReg(lines[i].line, &reg)) reg_bytes += strlen(lines[i].line);
+	}
+	for (int i=0; i<TIME_STRS; i++) time_bytes += strlen(time_strs[i]);
+	urc_bytes = lines_bytes;
+
+	printf("Parsers (%d lines, %d bytes of modem output):\n", nlines, lines_bytes);
+	bench("gsm_parseURC", pass_urc, urc_bytes);
+	bench("gsm_isURCPrefix", pass_urc_prefix, urc_bytes);
+	bench("gsm_parseReg", pass_reg, reg_bytes);
+	bench("gsm_parseTime", pass_time, time_bytes);
+	bench("CMGL dump", pass_cmgl, cmgl_len);
+	bench("CMGL dump, static", pass_cmgl_static, cmgl_len);
+}
+
+// Print the wall time, process CPU time per byte exchanged with the modem and allocations per operation
+//---------------------------------------------------------------------------------------------------------------------------------
+static void report(const char *name, int ops, int64_t wall_us, int64_t cpu_us, const sim_stats_t *st, const host_alloc_stats_t *as)
+{
+	uint64_t bytes = st->rx_bytes + st->tx_bytes;
+	printf("  %-22s %8.1f ms/op %8.2f us CPU/op %8.1f ns CPU/byte %7.1f allocs/op  (%llu bytes/op)\n",
+			name, (double)wall_us / 1000 / ops, (double)cpu_us / ops, (bytes) ? (double)cpu_us * 1000 / bytes : 0,
+			(double)as->allocs / ops, (unsigned long long)(bytes / ops));
+}
+
+//---------------------
+static void bench_sim()
+{
+	sim_config_t scfg;
+	sim_stats_t st;
+	host_alloc_stats_t as;
+	int64_t t0, cpu0;
+
+	sim_default_config(&scfg);
+	scfg.sms_list = cmgl;
+	sim_modem_t *sim = sim_create(&scfg);
+	if (sim == NULL) return;
+
+	gsm_config_t cfg;
+	gsm_defaultConfig(&cfg);
+	cfg.max_baud_rate = cfg.baud_rate;
+	cfg.rts_pin = -1;
+	cfg.cts_pin = -1;
+	cfg.serial = &sim_serial;
+	cfg.serial_arg = sim;
+	gsm_handle gsm = gsmCreate(&cfg);
+	if (gsm == NULL) return;
+
+	printf("libGSM against the simulated modem, no line rate limit and latency:\n");
+
+	// Initialization and connection
+	host_alloc_stats(&as, 1);
+	host_alloc_count(1);
+	t0 = esp_timer_get_time();
+	cpu0 = host_process_cpu_us();
+	int res = ppposInit(gsm);
+	int64_t cpu = host_process_cpu_us() - cpu0;
+	int64_t wall = esp_timer_get_time() - t0;
+	host_alloc_count(0);
+	host_alloc_stats(&as, 1);
+	sim_get_stats(sim, &st, 1);
+	if (res != 1) {
+		printf("  Not connected\n");
+		return;
+	}
+	report("init and connect", 1, wall, cpu, &st, &as);
+
+	// SMS are read in command mode
+	ppposDisconnect(gsm, 0, 0);
+	sim_get_stats(sim, &st, 1);
+
+	SMS_Messages msgs;
+	host_alloc_stats(&as, 1);
+	host_alloc_count(1);
+	t0 = esp_timer_get_time();
+	cpu0 = host_process_cpu_us();
+	int nmsg = 0;
+	for (int i=0; i<SMS_READS; i++) {
+		smsRead(gsm, &msgs, 1);
+		nmsg += msgs.nmsg;
+		smsFree(&msgs);
+	}
+	cpu = host_process_cpu_us() - cpu0;
+	wall = esp_timer_get_time() - t0;
+	host_alloc_count(0);
+	host_alloc_stats(&as, 1);
+	sim_get_stats(sim, &st, 1);
+	report("smsRead", SMS_READS, wall, cpu, &st, &as);
+	if (nmsg != (SMS_READS * SMS_COUNT)) printf("  %d messages read, expected %d\n", nmsg, SMS_READS * SMS_COUNT);
+
+	// AT commands through the PPPoS task
+	char resp[128];
+	int ok = 0;
+	host_alloc_stats(&as, 1);
+	host_alloc_count(1);
+	t0 = esp_timer_get_time();
+	cpu0 = host_process_cpu_us();
+	for (int i=0; i<AT_COMMANDS; i++) {
+		if (gsm_atCommand(gsm, "AT+CREG?", NULL, 1000, resp, sizeof(resp)) == 1) ok++;
+	}
+	cpu = host_process_cpu_us() - cpu0;
+	wall = esp_timer_get_time() - t0;
+	host_alloc_count(0);
+	host_alloc_stats(&as, 1);
+	sim_get_stats(sim, &st, 1);
+	report("gsm_atCommand", AT_COMMANDS, wall, cpu, &st, &as);
+	if (ok != AT_COMMANDS) printf("  %d of %d commands failed\n", AT_COMMANDS - ok, AT_COMMANDS);
+	// the PPPoS task is left idle
+}
+
+//========
+int main()
+{
+	if (load_lines(REC_FILE) == 0) {
+		printf("Can't read '%s'\n", REC_FILE);
+		return 1;
+	}
+	make_cmgl();
+	bench_parse();
+	bench_sim();
+	return 0;
+}
@@ -0,0 +1,411 @@
+/*
+ *  Host benchmark of the HDLC framing kernel (components/pppos/hdlc.c)
+ *
+ *  The PPP frames of the checked-in capture data/ppp_session.pcap are HDLC framed as sent
+ *  on the serial line (LCP with all control characters escaped, other frames with ACCM 0)
+ *  and the stream is deframed in blocks of the UART read size by:
+ *    reference     byte-at-a-time loop of lwIP's pppos_input(): ACCM test, unescape,
+ *                  FCS table lookup and copy to the pbuf chain for every byte
+ *    hdlc_deframe  word-at-a-time scan, slice-by-4 FCS and copy of the runs without
+ *                  special characters
+ *  FCS-16 of the unescaped frames is computed by the byte-wise table of lwIP (PPP_FCS())
+ *  and by hdlc_fcs16().
+ *
+ *  Both deframers must deliver the same frames. Reported are MB/s and cycles per byte of
+ *  the serial data (unescaped frame data for FCS). Cycles are TSC cycles on x86, elsewhere
+ *  they are not reported.
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#include "hdlc.h"
+
+#define CAPTURE_FILE	"data/ppp_session.pcap"
+#define MAX_FRAMES		1024
+#define FRAME_MAX		1604		// pcap snap length of the capture, with the direction byte
+#define READ_SIZE		1024		// UART read block of libGSM
+#define BENCH_NS		500000000LL	// every kernel is run for at least this time
+#define REF_PBUF_SIZE	1536		// PBUF_POOL_BUFSIZE, pbuf chain segment of pppos_input()
+#define REF_PBUFS		4
+
+#define PPP_LCP			0xC021
+
+typedef struct
+{
+	uint8_t		data[FRAME_MAX];
+	int			len;
+}frame_t;
+
+// Delivered frames, compared between the deframers
+typedef struct
+{
+	uint32_t	frames;
+	uint32_t	bytes;			// information field bytes
+	uint32_t	sum;
+}deliver_t;
+
+// lwIP pppos_input() receive state
+typedef struct
+{
+	int			state;
+	uint8_t		escaped;
+	uint16_t	fcs;
+	uint16_t	protocol;
+	uint32_t	accm[8];		// in_accm, 0x7D and 0x7E are always set
+	uint8_t		pbuf[REF_PBUFS][REF_PBUF_SIZE];
+	int			pbuf_len[REF_PBUFS];
+	int			tail;
+	uint32_t	errors;
+}ref_rx_t;
+
+enum { PDIDLE, PDSTART, PDADDRESS, PDCONTROL, PDPROTOCOL1, PDPROTOCOL2, PDDATA };
+
+typedef void (*bench_fn)(const uint8_t *data, int len);
+
+static frame_t frames[MAX_FRAMES];
+static int nframes;
+static uint8_t *stream;
+static int stream_len;
+static int frame_bytes;
+static uint16_t fcstab[256];
+
+static ref_rx_t ref_rx;
+static hdlc_rx_t hdlc_rx;
+static uint8_t hdlc_buf[FRAME_MAX + 2];
+static deliver_t delivered;
+static volatile uint32_t sink;
+
+
+//---------------------
+static int64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t)ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+}
+
+//----------------------
+static uint64_t cycles()
+{
+	#if HAVE_TSC
+	return __rdtsc();
+	#else
+	return 0;
+	#endif
+}
+
+// FCS table of lwIP (fcstab[] of pppos.c)
+//-----------------------
+static void make_fcstab()
+{
+	for (int b=0; b<256; b++) {
+		uint16_t v = b;
+		for (int i=0; i<8; i++) v = (v & 1) ? ((v >> 1) ^ 0x8408) : (v >> 1);
+		fcstab[b] = v;
+	}
+}
+
+// Load the frames of the pcap capture (LINKTYPE_PPP_WITH_DIR)
+//--------------------------------------
+static int load_frames(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) return 0;
+
+	uint32_t hdr[6];
+	if ((fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) || (hdr[0] != 0xa1b2c3d4) || (hdr[5] != 204)) {
+		fclose(f);
+		return 0;
+	}
+	uint32_t phdr[4];
+	while ((nframes < MAX_FRAMES) && (fread(phdr, 1, sizeof(phdr), f) == sizeof(phdr))) {
+		uint8_t buf[FRAME_MAX];
+		if ((phdr[2] < 5) || (phdr[2] > FRAME_MAX) || (fread(buf, 1, phdr[2], f) != phdr[2])) break;
+		// without the direction byte
+		memcpy(frames[nframes].data, buf + 1, phdr[2] - 1);
+		frames[nframes].len = phdr[2] - 1;
+		frame_bytes += frames[nframes].len + 2;
+		nframes++;
+	}
+	fclose(f);
+	return nframes;
+}
+
+// Frame the captured frames as they are sent on the serial line, frames share the flag
+//-----------------------
+static void make_stream()
+{
+	stream = malloc((frame_bytes * 2) + nframes + 1);
+	int n = 0;
+	stream[n++] = HDLC_FLAG;
+	for (int i=0; i<nframes; i++) {
+		const uint8_t *fr = frames[i].data;
+		int len = frames[i].len;
+		uint32_t accm = (((fr[2] << 8) | fr[3]) == PPP_LCP) ? 0xFFFFFFFF : 0;
+		uint16_t fcs = hdlc_fcs16(HDLC_INITFCS, fr, len) ^ 0xFFFF;
+		for (int j=0; j<len+2; j++) {
+			uint8_t c = (j < len) ? fr[j] : ((j == len) ? (fcs & 0xFF) : (fcs >> 8));
+			if ((c == HDLC_FLAG) || (c == HDLC_ESCAPE) || ((c < 0x20) && (accm & (1UL << c)))) {
+				stream[n++] = HDLC_ESCAPE;
+				c ^= HDLC_TRANS;
+			}
+			stream[n++] = c;
+		}
+		stream[n++] = HDLC_FLAG;
+	}
+	stream_len = n;
+}
+
+//-----------------------------------------------
+static void deliver(const uint8_t *data, int len)
+{
+	delivered.frames++;
+	delivered.bytes += len;
+	for (int i=0; i<len; i++) delivered.sum = (delivered.sum * 31) + data[i];
+}
+
+// ==== Reference: lwIP pppos_input() ====
+
+//--------------------
+static void ref_init()
+{
+	memset(ref_rx.accm, 0, sizeof(ref_rx.accm));
+	ref_rx.accm[3] = 0x60000000;	// 0x7D, 0x7E
+	ref_rx.state = PDIDLE;
+	ref_rx.escaped = 0;
+	ref_rx.tail = -1;
+	ref_rx.errors = 0;
+}
+
+// Received frame with good FCS, the pbuf chain is passed on, the FCS is trimmed off
+//------------------------------
+static void ref_frame(int check)
+{
+	if (check == 0) {
+		sink += ref_rx.protocol + ref_rx.pbuf_len[0];
+		return;
+	}
+	// information field of the chain as one block
+	static uint8_t info[REF_PBUFS * REF_PBUF_SIZE];
+	int len = 0;
+	for (int i=0; i<=ref_rx.tail; i++) {
+		memcpy(info + len, ref_rx.pbuf[i], ref_rx.pbuf_len[i]);
+		len += ref_rx.pbuf_len[i];
+	}
+	deliver(info, len - 2);
+}
+
+// Byte-at-a-time receive loop of pppos_input()
+//-------------------------------------------------------
+static void ref_input(const uint8_t *s, int l, int check)
+{
+	while (l-- > 0) {
+		uint8_t cur_char = *s++;
+		if (ref_rx.accm[cur_char >> 5] & (1UL << (cur_char & 0x1F))) {
+			if (cur_char == HDLC_ESCAPE) ref_rx.escaped = 1;
+			else if (cur_char == HDLC_FLAG) {
+				if (ref_rx.state <= PDADDRESS) {
+					// ignore
+				}
+				else if ((ref_rx.state < PDDATA) || (ref_rx.fcs != HDLC_GOODFCS)) ref_rx.errors++;
+				else ref_frame(check);
+				ref_rx.fcs = HDLC_INITFCS;
+				ref_rx.state = PDADDRESS;
+				ref_rx.escaped = 0;
+				ref_rx.tail = -1;
+			}
+			// other characters in ACCM are discarded
+		}
+		else {
+			if (ref_rx.escaped) {
+				ref_rx.escaped = 0;
+				cur_char ^= HDLC_TRANS;
+			}
+			switch (ref_rx.state) {
+				case PDIDLE:
+					if (cur_char != 0xFF) break;
+					// fall through
+				case PDSTART:
+					ref_rx.fcs = HDLC_INITFCS;
+					// fall through
+				case PDADDRESS:
+					if (cur_char == 0xFF) {
+						ref_rx.state = PDCONTROL;
+						break;
+					}
+					// fall through, address and control fields compressed
+				case PDCONTROL:
+					if (cur_char == 0x03) {
+						ref_rx.state = PDPROTOCOL1;
+						break;
+					}
+					// fall through
+				case PDPROTOCOL1:
+					if (cur_char & 1) {
+						ref_rx.protocol = cur_char;
+						ref_rx.state = PDDATA;
+					}
+					else {
+						ref_rx.protocol = cur_char << 8;
+						ref_rx.state = PDPROTOCOL2;
+					}
+					break;
+				case PDPROTOCOL2:
+					ref_rx.protocol |= cur_char;
+					ref_rx.state = PDDATA;
+					break;
+				case PDDATA:
+					// next pbuf of the chain when the current one is full
+					if ((ref_rx.tail < 0) || (ref_rx.pbuf_len[ref_rx.tail] == REF_PBUF_SIZE)) {
+						if (ref_rx.tail == (REF_PBUFS - 1)) {
+							ref_rx.errors++;
+							ref_rx.state = PDSTART;
+							break;
+						}
+						ref_rx.tail++;
+						ref_rx.pbuf_len[ref_rx.tail] = 0;
+					}
+					ref_rx.pbuf[ref_rx.tail][ref_rx.pbuf_len[ref_rx.tail]++] = cur_char;
+					break;
+			}
+			ref_rx.fcs = (ref_rx.fcs >> 8) ^ fcstab[(ref_rx.fcs ^ cur_char) & 0xFF];
+		}
+	}
+}
+
+// ==== hdlc_deframe() ====
+
+//-----------------------------------------------------
+static void hdlc_cb(void *arg, uint8_t *frame, int len)
+{
+	if (arg) deliver(frame + 4, len - 4);	// without address, control and protocol
+	else sink += frame[3] + len;
+}
+
+// ==== Benchmarked passes over the stream in UART read blocks ====
+
+//------------------------------------------------
+static void pass_ref(const uint8_t *data, int len)
+{
+	for (int off=0; off<len; off+=READ_SIZE) ref_input(data + off, (len - off < READ_SIZE) ? len - off : READ_SIZE, 0);
+}
+
+//-------------------------------------------------
+static void pass_hdlc(const uint8_t *data, int len)
+{
+	uint32_t fr = 0, err = 0, bytes = 0;
+	for (int off=0; off<len; off+=READ_SIZE) {
+		hdlc_deframe(&hdlc_rx, data + off, (len - off < READ_SIZE) ? len - off : READ_SIZE, hdlc_cb, NULL, &fr, &err, &bytes);
+	}
+	sink += fr + err;
+}
+
+//----------------------------------------------------
+static void pass_ref_fcs(const uint8_t *data, int len)
+{
+	uint32_t res = 0;
+	for (int i=0; i<nframes; i++) {
+		uint16_t fcs = HDLC_INITFCS;
+		const uint8_t *p = frames[i].data;
+		for (int j=0; j<frames[i].len; j++) fcs = (fcs >> 8) ^ fcstab[(fcs ^ p[j]) & 0xFF];
+		res += fcs;
+	}
+	sink += res;
+}
+
+//-----------------------------------------------------
+static void pass_hdlc_fcs(const uint8_t *data, int len)
+{
+	uint32_t res = 0;
+	for (int i=0; i<nframes; i++) res += hdlc_fcs16(HDLC_INITFCS, frames[i].data, frames[i].len);
+	sink += res;
+}
+
+// Run the pass for BENCH_NS, returns ns per byte, 'cpb' is set to cycles per byte
+//------------------------------------------------------
+static double bench(bench_fn fn, int bytes, double *cpb)
+{
+	int64_t n = 0;
+	int64_t t;
+	int64_t t0 = now_ns();
+	uint64_t c0 = cycles();
+	do {
+		fn(stream, stream_len);
+		n++;
+		t = now_ns();
+	} while ((t - t0) < BENCH_NS);
+	uint64_t c = cycles() - c0;
+
+	double total = (double)bytes * n;
+	*cpb = c / total;
+	return (t - t0) / total;
+}
+
+//----------------------------------------------------------------------------------------
+static void report(const char *name, double ns_ref, double cpb_ref, double ns, double cpb)
+{
+	printf("  %-14s %9.1f MB/s %7.2f c/B   %9.1f MB/s %7.2f c/B   %5.2fx\n",
+			name, 1000 / ns_ref, cpb_ref, 1000 / ns, cpb, ns_ref / ns);
+}
+
+//========
+int main()
+{
+	double ns_ref, ns, cpb_ref, cpb;
+
+	make_fcstab();
+	if (load_frames(CAPTURE_FILE) == 0) {
+		printf("Error loading '%s'\n", CAPTURE_FILE);
+		return 1;
+	}
+	make_stream();
+
+	// Both deframers must deliver the same frames
+	deliver_t ref_res;
+	memset(&delivered, 0, sizeof(delivered));
+	ref_init();
+	for (int off=0; off<stream_len; off+=READ_SIZE) ref_input(stream + off, (stream_len - off < READ_SIZE) ? stream_len - off : READ_SIZE, 1);
+	ref_res = delivered;
+	uint32_t ref_errors = ref_rx.errors;
+
+	uint32_t fr = 0, err = 0, bytes = 0;
+	memset(&delivered, 0, sizeof(delivered));
+	hdlc_rx_init(&hdlc_rx, hdlc_buf, sizeof(hdlc_buf));
+	for (int off=0; off<stream_len; off+=READ_SIZE) {
+		hdlc_deframe(&hdlc_rx, stream + off, (stream_len - off < READ_SIZE) ? stream_len - off : READ_SIZE, hdlc_cb, &delivered, &fr, &err, &bytes);
+	}
+	if ((ref_res.frames != nframes) || (ref_errors) || (err) || (memcmp(&ref_res, &delivered, sizeof(deliver_t)) != 0)) {
+		printf("Deframers don't match: reference %u frames, %u errors, hdlc_deframe %u frames, %u errors\n",
+				ref_res.frames, ref_errors, delivered.frames, err);
+		return 1;
+	}
+
+	printf("Capture '%s': %d frames, %d bytes with FCS, %d bytes on the line (%.2f%% escaped), read blocks of %d bytes\n",
+			CAPTURE_FILE, nframes, frame_bytes, stream_len, (double)(stream_len - nframes - 1 - frame_bytes) * 100 / frame_bytes, READ_SIZE);
+	printf("  %-14s %22s   %22s   %6s\n", "", "lwIP byte-at-a-time", "hdlc.c", "speedup");
+
+	ref_init();
+	ns_ref = bench(pass_ref, stream_len, &cpb_ref);
+	hdlc_rx_init(&hdlc_rx, hdlc_buf, sizeof(hdlc_buf));
+	ns = bench(pass_hdlc, stream_len, &cpb);
+	report("deframe", ns_ref, cpb_ref, ns, cpb);
+
+	int fcs_bytes = frame_bytes - (2 * nframes);
+	ns_ref = bench(pass_ref_fcs, fcs_bytes, &cpb_ref);
+	ns = bench(pass_hdlc_fcs, fcs_bytes, &cpb);
+	report("FCS-16", ns_ref, cpb_ref, ns, cpb);
+	if (HAVE_TSC == 0) printf("  (no cycle counter, c/B not measured)\n");
+
+	free(stream);
+	return 0;
+}
@@ -0,0 +1,232 @@
+/*
+ *  Host benchmark of the PPPoS data path
+ *
+ *  GSM instances connect through their own simulated modems. The modems send PPP frames
+ *  of the simulated peer, the host PPP stand-in sends every received frame back (host_ppp_echo()),
+ *  so each frame passes the libGSM receive path (_rxData(), deframing, tcpip thread) and the
+ *  output path (ppp_output_callback()) once.
+ *
+ *  Two modems: the throughput of one and of both modems running concurrently is measured at
+ *  several serial line rates. Reported are the payload received back per second, the line use,
+ *  frames lost and CPU time per KB: the time used by the process (all threads, including the
+ *  simulated modems) and the receive and output path time measured by libGSM (gsm_GetUartStats(),
+ *  the output time includes waiting for the UART).
+ *
+ *  Line emulation: one modem at several line rates and network latencies. Bulk transfer
+ *  (large frames, window sized to the bandwidth-delay product) gives the goodput in each
+ *  direction, its share of the line rate, the HDLC framing overhead of the received and sent
+ *  data and CPU time per KB; request/response (small frames, one at a time) gives the round trip.
+ *
+ *  The peer is the simulated modem, not pppd: lwIP is not part of this tree, so there is no host
+ *  PPP/TCP stack to negotiate a link and run TCP transfers with. The numbers cover the libGSM
+ *  data path, LCP/IPCP and TCP behaviour are not measured.
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_timer.h"
+#include "libGSM.h"
+#include "host_port.h"
+#include "sim_modem.h"
+
+#define MODEMS			2
+#define PAYLOAD			1500		// information field of the peer's frames, bulk transfer
+#define RR_PAYLOAD		64			// request/response frames
+#define WINDOW			4			// peer's frames not received back yet, two modems
+#define WARMUP_MS		500
+#define RUN_MS			2000
+#define DRAIN_MS		500			// after the frames in flight are received back
+
+typedef struct
+{
+	sim_stats_t			st[MODEMS];
+	gsm_uart_stats_t	ust[MODEMS];	// receive and output path time during the run
+	gsm_uart_stats_t	all[MODEMS];	// from the start to the last frame received back, all frames complete
+	double				secs;
+	int64_t				cpu_us;		// process CPU time
+}result_t;
+
+static sim_modem_t *sims[MODEMS];
+static gsm_handle gsms[MODEMS];
+
+static const uint32_t line_rates[] = { 115200, 921600, 0 };
+static const uint32_t emu_rates[] = { 115200, 460800, 921600 };
+static const uint32_t emu_latency_ms[] = { 0, 50, 150 };
+
+#define LINE_RATES		(sizeof(line_rates)/sizeof(uint32_t))
+#define EMU_RATES		(sizeof(emu_rates)/sizeof(uint32_t))
+#define EMU_LATENCIES	(sizeof(emu_latency_ms)/sizeof(uint32_t))
+
+
+// Create the modems and connect
+//-------------------------
+static int connect_modems()
+{
+	sim_config_t scfg;
+	gsm_config_t cfg;
+
+	for (int i=0; i<MODEMS; i++) {
+		sim_default_config(&scfg);
+		sims[i] = sim_create(&scfg);
+		if (sims[i] == NULL) return 0;
+
+		gsm_defaultConfig(&cfg);
+		cfg.uart_num = i + 1;
+		cfg.max_baud_rate = cfg.baud_rate;
+		cfg.rts_pin = -1;
+		cfg.cts_pin = -1;
+		cfg.set_default = (i == 0);
+		cfg.serial = &sim_serial;
+		cfg.serial_arg = sims[i];
+		gsms[i] = gsmCreate(&cfg);
+		if (gsms[i] == NULL) return 0;
+	}
+	for (int i=0; i<MODEMS; i++) {
+		if (ppposInit(gsms[i]) != 1) return 0;
+	}
+	return 1;
+}
+
+// Frame time on the line in microseconds, 0 for no limit
+//-------------------------------------------------------
+static uint32_t frame_us(int payload, uint32_t baud_rate)
+{
+	// address, control, protocol, FCS and flag, without escapes
+	return (baud_rate) ? (uint32_t)((uint64_t)(payload + 7) * 10000000 / baud_rate) : 0;
+}
+
+// Run the peer's traffic on 'nmodems' modems for RUN_MS, the results are collected after the warm-up
+//---------------------------------------------------------------------------------------------------------------
+static void measure(int nmodems, uint32_t baud_rate, uint32_t latency_us, int payload, int window, result_t *res)
+{
+	gsm_uart_stats_t ust;
+
+	for (int i=0; i<nmodems; i++) {
+		gsm_GetUartStats(gsms[i], &ust, 1);
+		sim_set_line(sims[i], baud_rate, latency_us);
+		sim_data_start(sims[i], payload, window, 0);
+	}
+	usleep(WARMUP_MS * 1000);
+
+	for (int i=0; i<nmodems; i++) {
+		sim_get_stats(sims[i], &res->st[i], 1);
+		gsm_GetUartStats(gsms[i], &res->ust[i], 0);
+	}
+	int64_t t0 = esp_timer_get_time();
+	int64_t cpu0 = host_process_cpu_us();
+	usleep(RUN_MS * 1000);
+	for (int i=0; i<nmodems; i++) {
+		sim_get_stats(sims[i], &res->st[i], 0);
+		gsm_GetUartStats(gsms[i], &ust, 0);
+		res->ust[i].input_us = ust.input_us - res->ust[i].input_us;
+		res->ust[i].output_us = ust.output_us - res->ust[i].output_us;
+	}
+	res->cpu_us = host_process_cpu_us() - cpu0;
+	res->secs = (double)(esp_timer_get_time() - t0) / 1000000;
+
+	// the frames in flight must not be counted in the next run
+	for (int i=0; i<nmodems; i++) sim_data_stop(sims[i]);
+	uint64_t drain_us = ((uint64_t)window * 2 * frame_us(payload, baud_rate)) + (2 * latency_us);
+	usleep(drain_us + (DRAIN_MS * 1000));
+	for (int i=0; i<nmodems; i++) gsm_GetUartStats(gsms[i], &res->all[i], 0);
+}
+
+// Throughput of 'nmodems' modems at 'baud_rate' (0 for no limit)
+//----------------------------------------------
+static void run(int nmodems, uint32_t baud_rate)
+{
+	result_t res;
+	measure(nmodems, baud_rate, 0, PAYLOAD, WINDOW, &res);
+
+	uint64_t payload = 0;
+	uint64_t wire = 0;
+	uint32_t lost = 0;
+	uint64_t rx_us = 0;
+	uint64_t tx_us = 0;
+	for (int i=0; i<nmodems; i++) {
+		payload += res.st[i].payload_echoed;
+		wire += res.st[i].wire_sent;
+		lost += res.st[i].frames_lost;
+		rx_us += res.ust[i].input_us;
+		tx_us += res.ust[i].output_us;
+	}
+	double secs = res.secs;
+	double kb = (double)payload / 1024;
+	char rate[16];
+	char use[16];
+	if (baud_rate) {
+		sprintf(rate, "%u", baud_rate);
+		// the peer's frames on the line, of the line capacity
+		sprintf(use, "%.1f%%", (double)wire * 100 / secs / nmodems / (baud_rate / 10));
+	}
+	else {
+		sprintf(rate, "no limit");
+		sprintf(use, "-");
+	}
+	printf("  %-9s %6d %12.1f %12.1f %8s %6u %10.1f %10.1f %10.1f\n",
+			rate, nmodems, kb / secs / nmodems, kb / secs, use, lost,
+			(kb > 0) ? res.cpu_us / kb : 0, (kb > 0) ? rx_us / kb : 0, (kb > 0) ? tx_us / kb : 0);
+}
+
+//---------------------------------------------------------------
+static double overhead(uint32_t wire_bytes, uint32_t frame_bytes)
+{
+	return (frame_bytes) ? ((double)wire_bytes - frame_bytes) * 100 / frame_bytes : 0;
+}
+
+// Bulk transfer and request/response on one modem at 'baud_rate' with 'latency_ms' network delay
+//-----------------------------------------------------------
+static void run_line(uint32_t baud_rate, uint32_t latency_ms)
+{
+	result_t bulk;
+	result_t rr;
+
+	// enough frames in flight to keep the line busy for the round trip
+	uint32_t ft = frame_us(PAYLOAD, baud_rate);
+	int window = (((2 * latency_ms * 1000) + (2 * ft)) / ft) + 2;
+	measure(1, baud_rate, latency_ms * 1000, PAYLOAD, window, &bulk);
+	measure(1, baud_rate, latency_ms * 1000, RR_PAYLOAD, 1, &rr);
+
+	const sim_stats_t *st = &bulk.st[0];
+	const gsm_uart_stats_t *ust = &bulk.ust[0];
+	const gsm_uart_stats_t *all = &bulk.all[0];
+	double kb = (double)st->payload_echoed / 1024;
+	double goodput = (double)st->payload_echoed / bulk.secs;
+	uint32_t rtt_avg = (rr.st[0].frames_echoed) ? rr.st[0].rtt_sum_us / rr.st[0].frames_echoed : 0;
+
+	printf("  %9u %5u %6d %9.1f %7.1f%% %4u %6.2f%% %6.2f%% %8.1f %8.1f %8.2f %7.2f %7.2f\n",
+			baud_rate, latency_ms, window, goodput / 1024, goodput * 100 / (baud_rate / 10), st->frames_lost,
+			overhead(all->rx_bytes, all->rx_frame_bytes), overhead(all->tx_bytes, all->tx_frame_bytes),
+			(kb > 0) ? ust->input_us / kb : 0, (kb > 0) ? ust->output_us / kb : 0,
+			(double)rtt_avg / 1000, (double)rr.st[0].rtt_min_us / 1000, (double)rr.st[0].rtt_max_us / 1000);
+}
+
+//========
+int main()
+{
+	if (connect_modems() == 0) {
+		printf("Not connected\n");
+		return 1;
+	}
+	host_ppp_echo(1);
+
+	printf("Two modems, %d byte frames, window %d, %d ms per run:\n", PAYLOAD, WINDOW, RUN_MS);
+	printf("  line rate  modems   KB/s/modem  aggreg KB/s line use   lost  CPU us/KB   rx us/KB   tx us/KB\n");
+	for (int r=0; r<LINE_RATES; r++) {
+		run(1, line_rates[r]);
+		run(MODEMS, line_rates[r]);
+	}
+
+	printf("\nLine emulation, one modem, bulk %d byte frames, request/response %d byte frames, %d ms per run:\n",
+			PAYLOAD, RR_PAYLOAD, RUN_MS);
+	printf("  line rate  lat ms window  KB/s dir line use lost  rx ovh  tx ovh rx us/KB tx us/KB  RTT avg     min     max ms\n");
+	for (int r=0; r<EMU_RATES; r++) {
+		for (int l=0; l<EMU_LATENCIES; l++) run_line(emu_rates[r], emu_latency_ms[l]);
+	}
+	// the PPPoS tasks are left running
+	return 0;
+}
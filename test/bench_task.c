@@ -0,0 +1,173 @@
+/*
+ *  Host benchmark of the PPPoS task profiles: core affinity, priority and stack size
+ *
+ *  One modem at 921600 baud, the peer's frames are sent back from the tcpip thread (host_ppp_echo()).
+ *  An application task (priority 5, as the example's HTTP task) keeps its core busy, as TLS
+ *  work does. For each profile of the PPPoS task (gsm_config_t task_core, task_priority, task_stack)
+ *  and of the tcpip thread core, the bulk transfer goodput, frames lost, request/response round trip
+ *  and the PPPoS task stack never used (gsm_GetTaskStackFree()) are reported.
+ *
+ *  Host port: the priority is the thread's nice value (19 - priority), not strict preemption;
+ *  the core is the host CPU, on a host with one CPU all profiles share it as on one ESP32 core.
+ *  The stack used is the one of the host code (x86-64, glibc), on the target use the example's log.
+ *  The task profile is fixed when the instance is created, every profile runs in its own process.
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "libGSM.h"
+#include "host_port.h"
+#include "sim_modem.h"
+
+#define BAUD_RATE		921600
+#define PAYLOAD			1500		// bulk transfer
+#define WINDOW			8
+#define RR_PAYLOAD		64			// request/response
+#define WARMUP_MS		500
+#define RUN_MS			2000
+#define DRAIN_MS		200			// no data received for
+#define LOAD_PRIORITY	5
+#define LOAD_BUSY_MS	9			// the load task is busy, then sleeps for one tick
+#define NO_LOAD			-2
+
+typedef struct
+{
+	const char	*name;
+	int			core;			// PPPoS task core, -1 for no affinity
+	int			priority;		// PPPoS task priority
+	int			stack;			// PPPoS task stack size
+	int			tcpip_core;		// tcpip thread core, -1 for no affinity
+	int			load_core;		// application load task core, -1 for no affinity, NO_LOAD
+}profile_t;
+
+static const profile_t profiles[] = {
+	{ "default, no load",		-1, 10, 3072, -1, NO_LOAD },
+	{ "default",				-1, 10, 3072, -1, -1 },
+	{ "below load",				-1,  3, 3072, -1, -1 },
+	{ "above tcpip",			-1, 20, 3072, -1, -1 },
+	{ "all on core 0",			 0, 10, 3072,  0,  0 },
+	{ "PPPoS, tcpip core 1",	 1, 10, 3072,  1,  0 },
+	{ "PPPoS core 1",			 1, 10, 3072,  0,  0 },
+	{ "default, 6 KB stack",	-1, 10, 6144, -1, -1 },
+};
+
+#define PROFILES		(sizeof(profiles)/sizeof(profile_t))
+
+
+// Application work keeping its core busy
+//------------------------------
+static void load_task(void *arg)
+{
+	volatile uint32_t x = 0;
+	while (1) {
+		int64_t end = esp_timer_get_time() + (LOAD_BUSY_MS * 1000);
+		while (esp_timer_get_time() < end) x++;
+		vTaskDelay(1);
+	}
+}
+
+// Run the peer's traffic for RUN_MS, the statistics are collected after the warm-up
+//-------------------------------------------------------------------------------
+static double measure(sim_modem_t *sim, int payload, int window, sim_stats_t *st)
+{
+	sim_data_start(sim, payload, window, 0);
+	usleep(WARMUP_MS * 1000);
+	sim_get_stats(sim, st, 1);
+	int64_t t0 = esp_timer_get_time();
+	usleep(RUN_MS * 1000);
+	sim_get_stats(sim, st, 0);
+	double secs = (double)(esp_timer_get_time() - t0) / 1000000;
+	sim_data_stop(sim);
+
+	// the frames in flight must not be counted in the next run
+	sim_stats_t drain;
+	uint64_t rx_bytes = st->rx_bytes;
+	while (1) {
+		usleep(DRAIN_MS * 1000);
+		sim_get_stats(sim, &drain, 0);
+		if (drain.rx_bytes == rx_bytes) break;
+		rx_bytes = drain.rx_bytes;
+	}
+	return secs;
+}
+
+// Connect with profile 'p' and measure
+//----------------------------------------
+static int run_profile(const profile_t *p)
+{
+	sim_config_t scfg;
+	sim_default_config(&scfg);
+	scfg.baud_rate = BAUD_RATE;
+	sim_modem_t *sim = sim_create(&scfg);
+	if (sim == NULL) return 1;
+
+	gsm_config_t cfg;
+	gsm_defaultConfig(&cfg);
+	cfg.max_baud_rate = cfg.baud_rate;
+	cfg.rts_pin = -1;
+	cfg.cts_pin = -1;
+	cfg.task_core = p->core;
+	cfg.task_priority = p->priority;
+	cfg.task_stack = p->stack;
+	cfg.serial = &sim_serial;
+	cfg.serial_arg = sim;
+	host_tcpip_core(p->tcpip_core);
+	gsm_handle gsm = gsmCreate(&cfg);
+	if ((gsm == NULL) || (ppposInit(gsm) != 1)) {
+		printf("  %-22s not connected\n", p->name);
+		return 1;
+	}
+	host_ppp_echo(1);
+	if (p->load_core != NO_LOAD) {
+		BaseType_t core = (p->load_core < 0) ? tskNO_AFFINITY : p->load_core;
+		if (xTaskCreatePinnedToCore(&load_task, "load", 4096, NULL, LOAD_PRIORITY, NULL, core) != pdPASS) return 1;
+	}
+
+	sim_stats_t bulk, rr;
+	double secs = measure(sim, PAYLOAD, WINDOW, &bulk);
+	measure(sim, RR_PAYLOAD, 1, &rr);
+	uint32_t rtt_avg = (rr.frames_echoed) ? rr.rtt_sum_us / rr.frames_echoed : 0;
+
+	char core[8], tcpip_core[8], load_core[8];
+	sprintf(core, (p->core < 0) ? "-" : "%d", p->core);
+	sprintf(tcpip_core, (p->tcpip_core < 0) ? "-" : "%d", p->tcpip_core);
+	if (p->load_core == NO_LOAD) strcpy(load_core, "none");
+	else sprintf(load_core, (p->load_core < 0) ? "-" : "%d", p->load_core);
+	printf("  %-22s %4s %4d %6d %5s %5s %9.1f %5u %8.2f %8.2f %7u\n",
+			p->name, core, p->priority, p->stack, tcpip_core, load_core,
+			(double)bulk.payload_echoed / 1024 / secs, bulk.frames_lost,
+			(double)rtt_avg / 1000, (double)rr.rtt_max_us / 1000, gsm_GetTaskStackFree(gsm));
+	fflush(stdout);
+	// the PPPoS and load tasks are left running, the process ends
+	return 0;
+}
+
+//========
+int main()
+{
+	printf("PPPoS task profiles, %u baud, bulk %d byte frames window %d, request/response %d byte frames, %d ms per run\n",
+			BAUD_RATE, PAYLOAD, WINDOW, RR_PAYLOAD, RUN_MS);
+	printf("  load task priority %d busy %d ms of %d ms; tcpip thread priority 18; host CPUs: %ld\n",
+			LOAD_PRIORITY, LOAD_BUSY_MS, LOAD_BUSY_MS + 1, sysconf(_SC_NPROCESSORS_ONLN));
+	printf("  profile                core prio  stack tcpip  load  KB/s dir  lost  RTT avg      max stack free\n");
+	fflush(stdout);
+
+	int res = 0;
+	for (int i=0; i<PROFILES; i++) {
+		pid_t pid = fork();
+		if (pid < 0) return 1;
+		if (pid == 0) _exit(run_profile(&profiles[i]));
+		int status;
+		waitpid(pid, &status, 0);
+		if ((!WIFEXITED(status)) || (WEXITSTATUS(status) != 0)) res = 1;
+	}
+	return res;
+}
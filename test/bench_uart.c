@@ -0,0 +1,147 @@
+/*
+ *  Host stress run of the UART buffers without flow control
+ *
+ *  The simulated modem emulates the UART driver RX buffer of the size libGSM configures
+ *  (gsm_config_t.uart_rx_buf) and does not wait for the host: data arriving when the buffer
+ *  is full is lost. The load of a busy ESP32 is added in data mode: every STRESS_PERIOD_MS the
+ *  UART interrupt is disabled for ISR_OFF_US (data beyond the 128-byte hardware FIFO is lost)
+ *  and the PPPoS task is preempted for STALL_MS before its next read.
+ *
+ *  The peer sends large frames without a window limit, every frame is sent back (host_ppp_echo()),
+ *  so both directions are busy. For each RX and TX buffer size at each line rate the UART
+ *  FIFO overflow and buffer full events counted by libGSM (gsm_GetUartStats()), the bytes lost,
+ *  the frames with bad FCS, the payload received back and the output path time are reported.
+ *  The TX buffer loses no data, writes wait for room; its size shows in the output path time.
+ *
+ *  The buffer sizes are fixed when the PPPoS task starts, every RX/TX combination runs
+ *  in its own process with its own modem and GSM instance.
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "esp_timer.h"
+#include "libGSM.h"
+#include "host_port.h"
+#include "sim_modem.h"
+
+#define PAYLOAD				1500
+#define WARMUP_MS			500
+#define RUN_MS				3000
+#define DRAIN_MS			200		// no data received for
+#define STRESS_PERIOD_MS	500
+#define ISR_OFF_US			2000	// e.g. flash write with the UART interrupt handler not in IRAM
+#define STALL_MS			50		// e.g. higher priority task or WiFi
+
+static const uint32_t line_rates[] = { 115200, 460800, 921600 };
+// auto sizes (100 ms at the line rate) of the three rates and a larger one
+static const int rx_sizes[] = { 2048, 4608, 9216, 16384 };
+static const int tx_sizes[] = { 2048, 9216 };
+
+#define LINE_RATES		(sizeof(line_rates)/sizeof(uint32_t))
+#define RX_SIZES		(sizeof(rx_sizes)/sizeof(int))
+#define TX_SIZES		(sizeof(tx_sizes)/sizeof(int))
+
+
+// Auto buffer size at 'baud_rate', as libGSM derives it
+//--------------------------------------
+static int auto_size(uint32_t baud_rate)
+{
+	int size = ((baud_rate / 10) * 100) / 1000;
+	size = (size + 511) & ~511;
+	return (size < 2048) ? 2048 : size;
+}
+
+// Run all line rates with 'rx_buf' and 'tx_buf' UART buffers
+//------------------------------------------
+static int run_sizes(int rx_buf, int tx_buf)
+{
+	sim_config_t scfg;
+	sim_default_config(&scfg);
+	scfg.uart_rx_buf = rx_buf;
+	scfg.tx_buf = tx_buf;
+	sim_modem_t *sim = sim_create(&scfg);
+	if (sim == NULL) return 1;
+
+	gsm_config_t cfg;
+	gsm_defaultConfig(&cfg);
+	cfg.max_baud_rate = cfg.baud_rate;
+	cfg.rts_pin = -1;
+	cfg.cts_pin = -1;
+	cfg.uart_rx_buf = rx_buf;
+	cfg.uart_tx_buf = tx_buf;
+	cfg.serial = &sim_serial;
+	cfg.serial_arg = sim;
+	gsm_handle gsm = gsmCreate(&cfg);
+	if ((gsm == NULL) || (ppposInit(gsm) != 1)) {
+		printf("  %6d %6d  not connected\n", rx_buf, tx_buf);
+		return 1;
+	}
+	host_ppp_echo(1);
+	sim_set_stress(sim, STRESS_PERIOD_MS, ISR_OFF_US, STALL_MS * 1000);
+
+	for (int r=0; r<LINE_RATES; r++) {
+		sim_stats_t st;
+		gsm_uart_stats_t ust;
+
+		sim_set_line(sim, line_rates[r], 0);
+		sim_data_start(sim, PAYLOAD, 0, 0);
+		usleep(WARMUP_MS * 1000);
+		sim_get_stats(sim, &st, 1);
+		gsm_GetUartStats(gsm, &ust, 1);
+		int64_t t0 = esp_timer_get_time();
+		usleep(RUN_MS * 1000);
+		double secs = (double)(esp_timer_get_time() - t0) / 1000000;
+		sim_get_stats(sim, &st, 0);
+		gsm_GetUartStats(gsm, &ust, 0);
+		uint64_t echoed = st.payload_echoed;
+		uint32_t lost = st.frames_lost;
+		uint64_t rx_lost = st.rx_lost;
+		sim_data_stop(sim);
+
+		// the frames queued at this rate are received before the next one
+		uint64_t rx_bytes;
+		do {
+			rx_bytes = st.rx_bytes;
+			usleep(DRAIN_MS * 1000);
+			sim_get_stats(sim, &st, 0);
+		} while (st.rx_bytes != rx_bytes);
+
+		double kb = (double)echoed / 1024;
+		printf("  %9u %6d%c %6d%c %9.1f %5u %6u %6u %9llu %5u %8.1f\n",
+				line_rates[r], rx_buf, (rx_buf == auto_size(line_rates[r])) ? '*' : ' ',
+				tx_buf, (tx_buf == auto_size(line_rates[r])) ? '*' : ' ',
+				kb / secs, lost, ust.fifo_overflows, ust.buffer_full,
+				(unsigned long long)rx_lost, ust.fcs_errors, (kb > 0) ? ust.output_us / kb : 0);
+		fflush(stdout);
+	}
+	// the PPPoS task is left running, the process ends
+	return 0;
+}
+
+//========
+int main()
+{
+	printf("No flow control, %d byte frames both directions, %d ms per run; every %d ms: interrupt off %d us, PPPoS task preempted %d ms\n",
+			PAYLOAD, RUN_MS, STRESS_PERIOD_MS, ISR_OFF_US, STALL_MS);
+	printf("  (* auto size at the line rate)\n");
+	printf("  line rate  RX buf  TX buf  KB/s back  lost  FIFO  full  bytes lost  FCS  tx us/KB\n");
+	fflush(stdout);
+
+	int res = 0;
+	for (int i=0; i<RX_SIZES; i++) {
+		for (int j=0; j<TX_SIZES; j++) {
+			pid_t pid = fork();
+			if (pid < 0) return 1;
+			if (pid == 0) _exit(run_sizes(rx_sizes[i], tx_sizes[j]));
+			int status;
+			waitpid(pid, &status, 0);
+			if ((!WIFEXITED(status)) || (WEXITSTATUS(status) != 0)) res = 1;
+		}
+	}
+	return res;
+}
@@ -0,0 +1,961 @@
+/*
+ *  Host port of the ESP-IDF functions used by libGSM
+ *
+ *  FreeRTOS on POSIX threads, the tick is one millisecond; lwIP tcpip thread, pbufs and PPP API
+ *  stand-ins; ESP-IDF log, timer and random functions. Linux/glibc only.
+ *
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "tcpip_adapter.h"
+#include "lwip/tcpip.h"
+#include "lwip/pbuf.h"
+#include "lwip/stats.h"
+#include "netif/ppp/ppp.h"
+
+#include "hdlc.h"
+#include "host_port.h"
+
+#define HOST_Q_QUEUE		0
+#define HOST_Q_MUTEX		1
+#define HOST_Q_RECURSIVE	2
+
+#define TCPIP_MBOX_SIZE		32		// tcpip thread message box size
+#define HOST_PPP_MAX		8		// max PPP interfaces
+#define PPP_MAXIDLEFLAG		100		// start the frame with a flag if the line was idle longer, ms
+#define TCPIP_PRIORITY		18		// ESP-IDF tcpip thread priority (ESP_TASK_TCPIP_PRIO)
+#define HOST_NICE_MAX		19		// nice value of priority 0, one nice level per priority
+#define HOST_STACK_PAINT	65536	// task stack bytes painted at the start, more than the host code uses
+#define HOST_STACK_FILL		0xA5
+
+struct host_queue
+{
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;			// signalled on every change
+	int				kind;			// HOST_Q_xxx
+	uint8_t			*items;
+	UBaseType_t		item_size;
+	UBaseType_t		length;
+	UBaseType_t		count;			// queued items, 1 if the mutex is free
+	UBaseType_t		head;
+	pthread_t		owner;			// recursive mutex owner
+	int				depth;
+	int				is_static;		// in caller's buffer, not freed
+};
+
+struct host_task
+{
+	pthread_t		thread;
+	TaskFunction_t	fn;
+	void			*arg;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+	uint32_t		notify;
+	char			name[16];
+	int				is_static;
+	int				priority;
+	BaseType_t		core;
+	uint32_t		stack;			// requested stack size
+	uint8_t			*stack_top;		// stack at the task start
+	uint8_t			*stack_low;		// end of the painted stack
+};
+
+_Static_assert(sizeof(struct host_queue) <= sizeof(StaticQueue_t), "StaticQueue_t too small");
+_Static_assert(sizeof(struct host_task) <= sizeof(StaticTask_t), "StaticTask_t too small");
+
+typedef struct
+{
+	tcpip_callback_fn	fn;
+	void				*ctx;
+}tcpip_msg_t;
+
+// pppapi call executed in tcpip thread, the caller waits for its completion
+typedef struct
+{
+	tcpip_callback_fn	fn;
+	void				*ctx;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	int					done;
+}api_call_t;
+
+static __thread struct host_task *current_task = NULL;
+static struct timespec t_boot;
+static int log_level = ESP_LOG_WARN;
+
+static QueueHandle_t tcpip_mbox = NULL;
+static pthread_once_t tcpip_once = PTHREAD_ONCE_INIT;
+static BaseType_t tcpip_core = tskNO_AFFINITY;
+
+static pthread_mutex_t ppp_lock = PTHREAD_MUTEX_INITIALIZER;
+static ppp_pcb *ppp_list[HOST_PPP_MAX] = { NULL };
+static volatile int ppp_echo = 0;
+
+static volatile int alloc_on = 0;
+static host_alloc_stats_t alloc_stats;
+
+struct stats_ lwip_stats;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+
+//--------------------------------------------------
+__attribute__((constructor)) static void _hostInit()
+{
+	clock_gettime(CLOCK_MONOTONIC, &t_boot);
+	const char *lvl = getenv("HOST_LOG");
+	if (lvl) log_level = atoi(lvl);
+}
+
+// ==== ESP-IDF ====
+
+//==============================
+int64_t esp_timer_get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t)(ts.tv_sec - t_boot.tv_sec) * 1000000) + ((ts.tv_nsec - t_boot.tv_nsec) / 1000);
+}
+
+//=======================
+uint32_t esp_random(void)
+{
+	return ((uint32_t)random() << 16) ^ (uint32_t)random();
+}
+
+//=============================================================
+void host_log(int level, const char *tag, const char *fmt, ...)
+{
+	static const char lvl_char[] = "?EWIDV";
+	if (level > log_level) return;
+
+	char line[512];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(line, sizeof(line), fmt, args);
+	va_end(args);
+	fprintf(stderr, "%c (%u) %s: %s\n", lvl_char[(level < 6) ? level : 0],
+			(uint32_t)(esp_timer_get_time() / 1000), tag, line);
+}
+
+//==========================
+int64_t host_thread_cpu_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ((int64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+//===========================
+int64_t host_process_cpu_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ((int64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+// ==== Heap allocation counting ====
+
+//----------------------------------
+static void _allocCount(size_t size)
+{
+	if (alloc_on == 0) return;
+	__atomic_fetch_add(&alloc_stats.allocs, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&alloc_stats.bytes, size, __ATOMIC_RELAXED);
+}
+
+//=======================
+void *malloc(size_t size)
+{
+	_allocCount(size);
+	return __libc_malloc(size);
+}
+
+//=================================
+void *calloc(size_t n, size_t size)
+{
+	_allocCount(n * size);
+	return __libc_calloc(n, size);
+}
+
+//===================================
+void *realloc(void *ptr, size_t size)
+{
+	_allocCount(size);
+	return __libc_realloc(ptr, size);
+}
+
+//==================
+void free(void *ptr)
+{
+	if ((alloc_on) && (ptr)) __atomic_fetch_add(&alloc_stats.frees, 1, __ATOMIC_RELAXED);
+	__libc_free(ptr);
+}
+
+//===========================
+void host_alloc_count(int on)
+{
+	alloc_on = on;
+}
+
+//=======================================================
+void host_alloc_stats(host_alloc_stats_t *stats, int rst)
+{
+	stats->allocs = __atomic_load_n(&alloc_stats.allocs, __ATOMIC_RELAXED);
+	stats->frees = __atomic_load_n(&alloc_stats.frees, __ATOMIC_RELAXED);
+	stats->bytes = __atomic_load_n(&alloc_stats.bytes, __ATOMIC_RELAXED);
+	if (rst) {
+		__atomic_store_n(&alloc_stats.allocs, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&alloc_stats.frees, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&alloc_stats.bytes, 0, __ATOMIC_RELAXED);
+	}
+}
+
+// ==== FreeRTOS ====
+
+// Absolute monotonic time 'ticks' ms from now
+//----------------------------------------------------------
+static void _deadline(struct timespec *ts, TickType_t ticks)
+{
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	ts->tv_sec += ticks / 1000;
+	ts->tv_nsec += (long)(ticks % 1000) * 1000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+// Wait for the condition to be signalled until the deadline, the lock must be held
+// Returns 0 on timeout, portMAX_DELAY waits forever
+//-----------------------------------------------------------------------------------------------------------
+static int _condWait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t wait, const struct timespec *dl)
+{
+	if (wait == 0) return 0;
+	if (wait == portMAX_DELAY) {
+		pthread_cond_wait(cond, lock);
+		return 1;
+	}
+	return (pthread_cond_timedwait(cond, lock, dl) != ETIMEDOUT);
+}
+
+//-----------------------------------------
+static void _condInit(pthread_cond_t *cond)
+{
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+//---------------------------------------------------------------------------------------------------------------
+static void _queueInit(struct host_queue *q, int kind, UBaseType_t length, UBaseType_t item_size, uint8_t *items)
+{
+	pthread_mutex_init(&q->lock, NULL);
+	_condInit(&q->cond);
+	q->kind = kind;
+	q->items = items;
+	q->length = length;
+	q->item_size = item_size;
+}
+
+//------------------------------------------------------------------------------------
+static QueueHandle_t _queueCreate(int kind, UBaseType_t length, UBaseType_t item_size)
+{
+	struct host_queue *q = calloc(1, sizeof(struct host_queue));
+	if (q == NULL) return NULL;
+	uint8_t *items = NULL;
+	if (item_size) {
+		items = malloc(length * item_size);
+		if (items == NULL) {
+			free(q);
+			return NULL;
+		}
+	}
+	_queueInit(q, kind, length, item_size, items);
+	return q;
+}
+
+// Queue in the caller's buffer, 'items' is the storage of 'length' items
+//---------------------------------------------------------------------------------------------------------------------
+static QueueHandle_t _queueCreateStatic(int kind, UBaseType_t length, UBaseType_t item_size, uint8_t *items, void *buf)
+{
+	struct host_queue *q = (struct host_queue *)buf;
+	memset(q, 0, sizeof(struct host_queue));
+	_queueInit(q, kind, length, item_size, items);
+	q->is_static = 1;
+	return q;
+}
+
+//===================================================================
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+	return _queueCreate(HOST_Q_QUEUE, length, item_size);
+}
+
+//===============================================================================================================
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *buf)
+{
+	return _queueCreateStatic(HOST_Q_QUEUE, length, item_size, storage, buf);
+}
+
+//====================================
+void vQueueDelete(QueueHandle_t queue)
+{
+	pthread_mutex_destroy(&queue->lock);
+	pthread_cond_destroy(&queue->cond);
+	if (queue->is_static) return;
+	free(queue->items);
+	free(queue);
+}
+
+//===========================================================================
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+	struct timespec dl;
+	_deadline(&dl, wait);
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count >= queue->length) {
+		if ((_condWait(&queue->cond, &queue->lock, wait, &dl) == 0) && (queue->count >= queue->length)) {
+			pthread_mutex_unlock(&queue->lock);
+			return pdFALSE;
+		}
+	}
+	UBaseType_t tail = (queue->head + queue->count) % queue->length;
+	if (queue->item_size) memcpy(queue->items + (tail * queue->item_size), item, queue->item_size);
+	queue->count++;
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->lock);
+	return pdTRUE;
+}
+
+// Wait until an item is available, returns 0 on timeout, the lock is held on return
+//-------------------------------------------------------------
+static int _queueWaitItem(QueueHandle_t queue, TickType_t wait)
+{
+	struct timespec dl;
+	_deadline(&dl, wait);
+	pthread_mutex_lock(&queue->lock);
+	while (queue->count == 0) {
+		if ((_condWait(&queue->cond, &queue->lock, wait, &dl) == 0) && (queue->count == 0)) return 0;
+	}
+	return 1;
+}
+
+//========================================================================
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+	if (_queueWaitItem(queue, wait) == 0) {
+		pthread_mutex_unlock(&queue->lock);
+		return pdFALSE;
+	}
+	if (queue->item_size) memcpy(item, queue->items + (queue->head * queue->item_size), queue->item_size);
+	queue->head = (queue->head + 1) % queue->length;
+	queue->count--;
+	pthread_cond_broadcast(&queue->cond);
+	pthread_mutex_unlock(&queue->lock);
+	return pdTRUE;
+}
+
+//=====================================================================
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t wait)
+{
+	if (_queueWaitItem(queue, wait) == 0) {
+		pthread_mutex_unlock(&queue->lock);
+		return pdFALSE;
+	}
+	if (queue->item_size) memcpy(item, queue->items + (queue->head * queue->item_size), queue->item_size);
+	pthread_mutex_unlock(&queue->lock);
+	return pdTRUE;
+}
+
+//===========================================
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+	QueueHandle_t q = _queueCreate(HOST_Q_MUTEX, 1, 0);
+	if (q) q->count = 1;
+	return q;
+}
+
+//====================================================
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+	return _queueCreate(HOST_Q_RECURSIVE, 1, 0);
+}
+
+//===================================================================
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buf)
+{
+	QueueHandle_t q = _queueCreateStatic(HOST_Q_MUTEX, 1, 0, NULL, buf);
+	q->count = 1;
+	return q;
+}
+
+//============================================================================
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(StaticSemaphore_t *buf)
+{
+	return _queueCreateStatic(HOST_Q_RECURSIVE, 1, 0, NULL, buf);
+}
+
+//===============================================================
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+	return xQueueReceive(sem, NULL, wait);
+}
+
+//==============================================
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+	return xQueueSend(sem, NULL, 0);
+}
+
+//========================================================================
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t wait)
+{
+	struct timespec dl;
+	_deadline(&dl, wait);
+	pthread_mutex_lock(&sem->lock);
+	if ((sem->depth > 0) && (pthread_equal(sem->owner, pthread_self()))) {
+		sem->depth++;
+		pthread_mutex_unlock(&sem->lock);
+		return pdTRUE;
+	}
+	while (sem->depth > 0) {
+		if ((_condWait(&sem->cond, &sem->lock, wait, &dl) == 0) && (sem->depth > 0)) {
+			pthread_mutex_unlock(&sem->lock);
+			return pdFALSE;
+		}
+	}
+	sem->owner = pthread_self();
+	sem->depth = 1;
+	pthread_mutex_unlock(&sem->lock);
+	return pdTRUE;
+}
+
+//=======================================================
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem)
+{
+	pthread_mutex_lock(&sem->lock);
+	if ((sem->depth == 0) || (pthread_equal(sem->owner, pthread_self()) == 0)) {
+		pthread_mutex_unlock(&sem->lock);
+		return pdFALSE;
+	}
+	sem->depth--;
+	if (sem->depth == 0) pthread_cond_broadcast(&sem->cond);
+	pthread_mutex_unlock(&sem->lock);
+	return pdTRUE;
+}
+
+// Task structure of threads not created by xTaskCreate (main)
+//-------------------------------------
+static struct host_task *_currentTask()
+{
+	if (current_task == NULL) {
+		current_task = calloc(1, sizeof(struct host_task));
+		if (current_task == NULL) abort();
+		pthread_mutex_init(&current_task->lock, NULL);
+		_condInit(&current_task->cond);
+		current_task->thread = pthread_self();
+		strcpy(current_task->name, "main");
+	}
+	return current_task;
+}
+
+// Run the calling thread with the task 'priority' on 'core'
+// Higher priority is a lower nice value; lowering it needs privileges, then the nice value is not changed
+//-------------------------------------------------------
+static void _threadProfile(int priority, BaseType_t core)
+{
+	int nice = HOST_NICE_MAX - priority;
+	if (nice < 0) nice = 0;
+	setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), nice);
+	if ((core != tskNO_AFFINITY) && (core >= 0) && (core < sysconf(_SC_NPROCESSORS_ONLN))) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(core, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+	}
+}
+
+//--------------------------------
+static void *_taskStart(void *arg)
+{
+	current_task = (struct host_task *)arg;
+	_threadProfile(current_task->priority, current_task->core);
+
+	// Paint the stack below this frame (and the frame of memset), the lowest changed byte is the high water mark
+	uint8_t *top = __builtin_frame_address(0);
+	memset(top - HOST_STACK_PAINT, HOST_STACK_FILL, HOST_STACK_PAINT - 1024);
+	current_task->stack_top = top;
+	current_task->stack_low = top - HOST_STACK_PAINT;
+
+	current_task->fn(current_task->arg);
+	// FreeRTOS tasks must not return
+	fprintf(stderr, "Task '%s' returned\n", current_task->name);
+	abort();
+	return NULL;
+}
+
+// Start the thread of task 't'
+//---------------------------------------------------------------------------------------------------------
+static int _taskCreate(struct host_task *t, TaskFunction_t fn, const char *name, void *arg, uint32_t stack,
+		UBaseType_t priority, BaseType_t core)
+{
+	pthread_mutex_init(&t->lock, NULL);
+	_condInit(&t->cond);
+	t->fn = fn;
+	t->arg = arg;
+	t->stack = stack;
+	t->priority = priority;
+	t->core = core;
+	strncpy(t->name, name, sizeof(t->name)-1);
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	int res = pthread_create(&t->thread, &attr, _taskStart, t);
+	pthread_attr_destroy(&attr);
+	return (res == 0);
+}
+
+//================================================================================================
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+		UBaseType_t priority, TaskHandle_t *task, BaseType_t core)
+{
+	struct host_task *t = calloc(1, sizeof(struct host_task));
+	if (t == NULL) return pdFAIL;
+	if (task) *task = t;
+	if (_taskCreate(t, fn, name, arg, stack, priority, core) == 0) {
+		if (task) *task = NULL;
+		free(t);
+		return pdFAIL;
+	}
+	return pdPASS;
+}
+
+//========================================================================================================
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+		UBaseType_t priority, StackType_t *stack_buf, StaticTask_t *task_buf, BaseType_t core)
+{
+	struct host_task *t = (struct host_task *)task_buf;
+	memset(t, 0, sizeof(struct host_task));
+	t->is_static = 1;
+	if (_taskCreate(t, fn, name, arg, stack, priority, core) == 0) return NULL;
+	return t;
+}
+
+//=================================
+void vTaskDelete(TaskHandle_t task)
+{
+	if ((task != NULL) && (task != current_task)) {
+		fprintf(stderr, "vTaskDelete: only the calling task can be deleted\n");
+		abort();
+	}
+	struct host_task *t = _currentTask();
+	if (t->is_static) {
+		fprintf(stderr, "vTaskDelete: static task '%s' can't be deleted\n", t->name);
+		abort();
+	}
+	pthread_mutex_destroy(&t->lock);
+	pthread_cond_destroy(&t->cond);
+	free(t);
+	current_task = NULL;
+	pthread_exit(NULL);
+}
+
+//===============================
+void vTaskDelay(TickType_t ticks)
+{
+	if (ticks == 0) {
+		sched_yield();
+		return;
+	}
+	struct timespec ts = { ticks / 1000, (long)(ticks % 1000) * 1000000 };
+	while (nanosleep(&ts, &ts) != 0);
+}
+
+//================================
+TickType_t xTaskGetTickCount(void)
+{
+	return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+//==========================================
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+	return _currentTask();
+}
+
+//==========================================================
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+	struct host_task *t = _currentTask();
+	struct timespec dl;
+	_deadline(&dl, wait);
+	pthread_mutex_lock(&t->lock);
+	while (t->notify == 0) {
+		if ((_condWait(&t->cond, &t->lock, wait, &dl) == 0) && (t->notify == 0)) break;
+	}
+	uint32_t val = t->notify;
+	if (val) t->notify = (clear) ? 0 : val - 1;
+	pthread_mutex_unlock(&t->lock);
+	return val;
+}
+
+//===========================================
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+	pthread_mutex_lock(&task->lock);
+	task->notify++;
+	pthread_cond_broadcast(&task->cond);
+	pthread_mutex_unlock(&task->lock);
+	return pdPASS;
+}
+
+//=============================
+BaseType_t xPortGetCoreID(void)
+{
+	int cpu = sched_getcpu();
+	return (cpu < 0) ? 0 : cpu;
+}
+
+//========================================================
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+	struct host_task *t = (task) ? task : _currentTask();
+	if (t->stack_low == NULL) return 0;
+	const volatile uint8_t *p = t->stack_low;
+	while ((p < t->stack_top) && (*p == HOST_STACK_FILL)) p++;
+	uint32_t used = t->stack_top - p;
+	return (used < t->stack) ? t->stack - used : 0;
+}
+
+// ==== lwIP ====
+
+//----------------------------------
+static void *_tcpipThread(void *arg)
+{
+	tcpip_msg_t msg;
+	_threadProfile(TCPIP_PRIORITY, tcpip_core);
+	while (1) {
+		if (xQueueReceive(tcpip_mbox, &msg, portMAX_DELAY) == pdTRUE) msg.fn(msg.ctx);
+	}
+	return NULL;
+}
+
+//-----------------------
+static void _tcpipStart()
+{
+	pthread_t thread;
+	tcpip_mbox = xQueueCreate(TCPIP_MBOX_SIZE, sizeof(tcpip_msg_t));
+	if ((tcpip_mbox == NULL) || (pthread_create(&thread, NULL, _tcpipThread, NULL) != 0)) abort();
+	pthread_detach(thread);
+}
+
+//===========================
+void tcpip_adapter_init(void)
+{
+	pthread_once(&tcpip_once, _tcpipStart);
+}
+
+//============================
+void host_tcpip_core(int core)
+{
+	tcpip_core = (core < 0) ? tskNO_AFFINITY : core;
+}
+
+//================================================================================
+err_t tcpip_callback_with_block(tcpip_callback_fn function, void *ctx, u8_t block)
+{
+	tcpip_msg_t msg = { function, ctx };
+	pthread_once(&tcpip_once, _tcpipStart);
+	if (xQueueSend(tcpip_mbox, &msg, (block) ? portMAX_DELAY : 0) != pdTRUE) return ERR_MEM;
+	return ERR_OK;
+}
+
+//--------------------------------
+static void _apiCallRun(void *arg)
+{
+	api_call_t *call = (api_call_t *)arg;
+	call->fn(call->ctx);
+	pthread_mutex_lock(&call->lock);
+	call->done = 1;
+	pthread_cond_signal(&call->cond);
+	pthread_mutex_unlock(&call->lock);
+}
+
+// Execute the function in tcpip thread and wait for it, as pppapi does
+//---------------------------------------------------
+static void _apiCall(tcpip_callback_fn fn, void *ctx)
+{
+	api_call_t call;
+	call.fn = fn;
+	call.ctx = ctx;
+	call.done = 0;
+	pthread_mutex_init(&call.lock, NULL);
+	pthread_cond_init(&call.cond, NULL);
+	tcpip_callback_with_block(_apiCallRun, &call, 1);
+	pthread_mutex_lock(&call.lock);
+	while (call.done == 0) pthread_cond_wait(&call.cond, &call.lock);
+	pthread_mutex_unlock(&call.lock);
+	pthread_mutex_destroy(&call.lock);
+	pthread_cond_destroy(&call.cond);
+}
+
+//=====================================================================
+struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
+{
+	struct pbuf *p = malloc(sizeof(struct pbuf) + length);
+	if (p == NULL) return NULL;
+	p->next = NULL;
+	p->payload = (u8_t *)(p + 1);
+	p->tot_len = length;
+	p->len = length;
+	return p;
+}
+
+//============================
+u8_t pbuf_free(struct pbuf *p)
+{
+	if (p == NULL) return 0;
+	free(p);
+	return 1;
+}
+
+//=================================================
+u8_t pbuf_header(struct pbuf *p, s16_t header_size)
+{
+	u8_t *payload = (u8_t *)p->payload - header_size;
+	if ((payload < (u8_t *)(p + 1)) || (header_size < -(s16_t)p->len)) return 1;
+	p->payload = payload;
+	p->len += header_size;
+	p->tot_len += header_size;
+	return 0;
+}
+
+//===========================================================================
+err_t pbuf_take_at(struct pbuf *p, const void *data, u16_t len, u16_t offset)
+{
+	if ((offset + len) > p->len) return ERR_MEM;
+	memcpy((u8_t *)p->payload + offset, data, len);
+	return ERR_OK;
+}
+
+//=======================================================
+void pbuf_put_at(struct pbuf *p, u16_t offset, u8_t data)
+{
+	if (offset < p->len) ((u8_t *)p->payload)[offset] = data;
+}
+
+//======================================
+char *ipaddr_ntoa(const ip_addr_t *addr)
+{
+	static char str[16];
+	const u8_t *b = (const u8_t *)&addr->addr;
+	sprintf(str, "%u.%u.%u.%u", b[0], b[1], b[2], b[3]);
+	return str;
+}
+
+//=========================================
+const ip_addr_t *dns_getserver(u8_t numdns)
+{
+	static const ip_addr_t none = { 0 };
+	return &none;
+}
+
+// ==== PPP ====
+
+//---------------------------------------------------------------
+static void _setAddr(ip_addr_t *addr, int a, int b, int c, int d)
+{
+	u8_t *p = (u8_t *)&addr->addr;
+	p[0] = a;
+	p[1] = b;
+	p[2] = c;
+	p[3] = d;
+}
+
+// Link is up, the addresses are "negotiated"
+//---------------------------
+static void _pppUp(void *arg)
+{
+	ppp_pcb *pcb = (ppp_pcb *)arg;
+	if (pcb->pppos.open == 0) return;
+	int idx = 0;
+	pthread_mutex_lock(&ppp_lock);
+	for (int i=0; i<HOST_PPP_MAX; i++) {
+		if (ppp_list[i] == pcb) idx = i;
+	}
+	pthread_mutex_unlock(&ppp_lock);
+	_setAddr(&pcb->netif->ip_addr, 10, 64, 0, 2 + idx);
+	_setAddr(&pcb->netif->gw, 10, 64, 0, 1);
+	_setAddr(&pcb->netif->netmask, 255, 255, 255, 255);
+	pcb->link_status_cb(pcb, PPPERR_NONE, pcb->ctx_cb);
+}
+
+//--------------------------------
+static void _pppConnect(void *arg)
+{
+	ppp_pcb *pcb = (ppp_pcb *)arg;
+	pcb->pppos.open = 1;
+	// after LCP negotiation with ACCM 0 only the flag and escape characters are escaped
+	memset(pcb->pppos.in_accm, 0, sizeof(pcb->pppos.in_accm));
+	pcb->pppos.in_accm[15] = 0x60;
+	pcb->last_xmit = 0;
+	tcpip_callback_with_block(_pppUp, pcb, 0);
+}
+
+//------------------------------
+static void _pppClose(void *arg)
+{
+	ppp_pcb *pcb = (ppp_pcb *)arg;
+	if (pcb->pppos.open == 0) return;
+	pcb->pppos.open = 0;
+	memset(pcb->netif, 0, sizeof(struct netif));
+	pcb->link_status_cb(pcb, PPPERR_USER, pcb->ctx_cb);
+}
+
+//=============================================================================
+ppp_pcb *pppapi_pppos_create(struct netif *pppif, pppos_output_cb_fn output_cb,
+		ppp_link_status_cb_fn link_status_cb, void *ctx_cb)
+{
+	ppp_pcb *pcb = calloc(1, sizeof(ppp_pcb));
+	if (pcb == NULL) return NULL;
+	pcb->netif = pppif;
+	pcb->link_ctx_cb = &pcb->pppos;
+	pcb->link_status_cb = link_status_cb;
+	pcb->ctx_cb = ctx_cb;
+	pcb->pppos.ppp = pcb;
+	pcb->pppos.output_cb = output_cb;
+	memset(pcb->pppos.in_accm, 0xFF, 4);
+
+	pthread_mutex_lock(&ppp_lock);
+	for (int i=0; i<HOST_PPP_MAX; i++) {
+		if (ppp_list[i] == NULL) {
+			ppp_list[i] = pcb;
+			pthread_mutex_unlock(&ppp_lock);
+			return pcb;
+		}
+	}
+	pthread_mutex_unlock(&ppp_lock);
+	free(pcb);
+	return NULL;
+}
+
+//====================================
+err_t pppapi_set_default(ppp_pcb *pcb)
+{
+	return ERR_OK;
+}
+
+//=====================================================================================
+void pppapi_set_auth(ppp_pcb *pcb, u8_t authtype, const char *user, const char *passwd)
+{
+}
+
+//===============================================
+err_t pppapi_connect(ppp_pcb *pcb, u16_t holdoff)
+{
+	_apiCall(_pppConnect, pcb);
+	return ERR_OK;
+}
+
+//==============================================
+err_t pppapi_close(ppp_pcb *pcb, u8_t nocarrier)
+{
+	_apiCall(_pppClose, pcb);
+	return ERR_OK;
+}
+
+//==========================
+err_t ppp_free(ppp_pcb *pcb)
+{
+	pthread_mutex_lock(&ppp_lock);
+	for (int i=0; i<HOST_PPP_MAX; i++) {
+		if (ppp_list[i] == pcb) ppp_list[i] = NULL;
+	}
+	pthread_mutex_unlock(&ppp_lock);
+	free(pcb);
+	return ERR_OK;
+}
+
+// Send the frame (protocol and information) back, with address and control fields and FCS
+//-----------------------------------------------------------
+static void _pppEcho(ppp_pcb *pcb, const u8_t *data, int len)
+{
+	uint8_t frame[PPP_MRU + 8];
+	uint8_t out[(PPP_MRU + 8) * 2 + 2];
+	if (len > PPP_MRU + 2) return;
+
+	frame[0] = PPP_ALLSTATIONS;
+	frame[1] = PPP_UI;
+	memcpy(frame + 2, data, len);
+	len += 2;
+	uint16_t fcs = hdlc_fcs16(HDLC_INITFCS, frame, len) ^ 0xFFFF;
+	frame[len++] = fcs & 0xFF;
+	frame[len++] = fcs >> 8;
+
+	int n = 0;
+	uint32_t now = xTaskGetTickCount();
+	if ((pcb->last_xmit == 0) || ((now - pcb->last_xmit) >= PPP_MAXIDLEFLAG)) out[n++] = HDLC_FLAG;
+	for (int i=0; i<len; i++) {
+		if ((frame[i] == HDLC_FLAG) || (frame[i] == HDLC_ESCAPE)) {
+			out[n++] = HDLC_ESCAPE;
+			out[n++] = frame[i] ^ HDLC_TRANS;
+		}
+		else out[n++] = frame[i];
+	}
+	out[n++] = HDLC_FLAG;
+	pcb->last_xmit = now;
+	pcb->out_frames++;
+	pcb->out_bytes += n;
+	pcb->pppos.output_cb(pcb, out, n, pcb->ctx_cb);
+}
+
+//===========================================
+void ppp_input(ppp_pcb *pcb, struct pbuf *pb)
+{
+	pcb->in_frames++;
+	pcb->in_bytes += pb->tot_len;
+	if ((ppp_echo) && (pcb->pppos.open)) _pppEcho(pcb, pb->payload, pb->len);
+	pbuf_free(pb);
+}
+
+//========================
+void host_ppp_echo(int on)
+{
+	ppp_echo = on;
+}
+
+//============================
+ppp_pcb *host_ppp_get(int idx)
+{
+	if ((idx < 0) || (idx >= HOST_PPP_MAX)) return NULL;
+	pthread_mutex_lock(&ppp_lock);
+	ppp_pcb *pcb = ppp_list[idx];
+	pthread_mutex_unlock(&ppp_lock);
+	return pcb;
+}
@@ -0,0 +1,70 @@
+/*
+ *  Host port of the ESP-IDF functions used by libGSM, for the host tests and benchmarks
+ *
+ *  FreeRTOS tasks, queues and semaphores run on POSIX threads, lwIP tcpip thread,
+ *  pbufs and the PPP API are emulated (see stubs/lwip/host_lwip.h and stubs/netif/ppp/ppp.h).
+ *  The PPP peer is not negotiated with, the link is up as soon as it is connected.
+ *
+*/
+
+#ifndef _HOST_PORT_H_
+#define _HOST_PORT_H_
+
+#include <stdint.h>
+#include "netif/ppp/ppp.h"
+
+// Allocation counters, counted only while enabled with host_alloc_count(1)
+typedef struct
+{
+	uint64_t	allocs;			// malloc, calloc and realloc calls
+	uint64_t	frees;
+	uint64_t	bytes;			// requested bytes
+}host_alloc_stats_t;
+
+/*
+ * Send the frames passed to ppp_input() back to the modem, HDLC framed, through the PPP output callback
+ * The echo is sent from the tcpip thread, as lwIP sends its frames
+ */
+//=========================
+void host_ppp_echo(int on);
+
+/*
+ * Get the PPP control block of the 'idx'-th connected PPP interface, NULL if there is none
+ */
+//=============================
+ppp_pcb *host_ppp_get(int idx);
+
+/*
+ * Set the core of the tcpip thread (-1 for no affinity) before it is started by tcpip_adapter_init()
+ * Tasks and the tcpip thread (priority 18, as in ESP-IDF) run with the nice value 19 - priority,
+ * pinned to the host CPU of the core if the host has it. The task stack high water mark
+ * (uxTaskGetStackHighWaterMark()) is the stack used by the host code of the task.
+ */
+//=============================
+void host_tcpip_core(int core);
+
+/*
+ * Start or stop counting heap allocations of all threads
+ */
+//============================
+void host_alloc_count(int on);
+
+/*
+ * Get the allocation counters, reset them if 'rst' = 1
+ */
+//========================================================
+void host_alloc_stats(host_alloc_stats_t *stats, int rst);
+
+/*
+ * Get the CPU time used by the calling thread in microseconds
+ */
+//===========================
+int64_t host_thread_cpu_us();
+
+/*
+ * Get the CPU time used by the process in microseconds
+ */
+//============================
+int64_t host_process_cpu_us();
+
+#endif
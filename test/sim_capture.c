@@ -0,0 +1,332 @@
+/*
+ *  Capture of a simulated PPP session for the HDLC benchmark
+ *
+ *    build/sim_capture <file>
+ *
+ *  The frames of a typical PPPoS client session are built as the modem's peer and lwIP
+ *  send them: LCP and PAP/IPCP negotiation, DNS lookup, TCP connection to an HTTPS server,
+ *  TLS handshake and download (encrypted records, ACK every second segment), LCP echo,
+ *  connection close and LCP terminate. The frames are HDLC framed (LCP with all control
+ *  characters escaped, other frames with the negotiated ACCM 0), passed to the PPP frame
+ *  capture (gsm_pcap.c) and saved to <file> in pcap format, as gsm_pcap_save() does on the device.
+ *  Captures of a real modem (gsm_pcap_save(), tools/gsm_pcap.py) can be used the same way.
+ *
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "hdlc.h"
+#include "gsm_pcap.h"
+
+#define DOWNLOAD_SEGMENTS	120		// TCP segments of the download
+#define MSS					1460
+
+#define PPP_LCP				0xC021
+#define PPP_PAP				0xC023
+#define PPP_IPCP			0x8021
+#define PPP_IP				0x0021
+
+static const uint8_t local_ip[4] = { 10, 64, 12, 201 };
+static const uint8_t dns_ip[4] = { 8, 8, 8, 8 };
+static const uint8_t server_ip[4] = { 93, 184, 216, 34 };
+
+static uint32_t rnd = 0x2545F491;
+static uint16_t ip_id = 0x3A10;
+static uint32_t local_seq = 0x6B8B4567;
+static uint32_t server_seq = 0x327B23C6;
+static int nframes;
+
+
+//---------------------
+static uint8_t _rand8()
+{
+	rnd = (rnd * 1103515245) + 12345;
+	return rnd >> 16;
+}
+
+//-------------------------------------------------------------
+static uint32_t _sum16(uint32_t sum, const uint8_t *p, int len)
+{
+	for (int i=0; i<(len-1); i+=2) sum += (p[i] << 8) | p[i+1];
+	if (len & 1) sum += p[len-1] << 8;
+	return sum;
+}
+
+//---------------------------------
+static uint16_t _fold(uint32_t sum)
+{
+	while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+	return ~sum;
+}
+
+// HDLC frame the PPP frame (address, control, protocol, information) and pass it to the capture
+//--------------------------------------------------------------------------
+static void _send(uint8_t dir, uint16_t proto, const uint8_t *info, int len)
+{
+	static uint8_t frame[MSS + 64];
+	static uint8_t wire[(MSS + 64) * 2 + 2];
+	uint32_t accm = (proto == PPP_LCP) ? 0xFFFFFFFF : 0;
+
+	int flen = 0;
+	frame[flen++] = 0xFF;
+	frame[flen++] = 0x03;
+	frame[flen++] = proto >> 8;
+	frame[flen++] = proto & 0xFF;
+	memcpy(frame + flen, info, len);
+	flen += len;
+	uint16_t fcs = hdlc_fcs16(HDLC_INITFCS, frame, flen) ^ 0xFFFF;
+	frame[flen++] = fcs & 0xFF;
+	frame[flen++] = fcs >> 8;
+
+	int n = 0;
+	wire[n++] = HDLC_FLAG;
+	for (int i=0; i<flen; i++) {
+		uint8_t c = frame[i];
+		if ((c == HDLC_FLAG) || (c == HDLC_ESCAPE) || ((c < 0x20) && (accm & (1UL << c)))) {
+			wire[n++] = HDLC_ESCAPE;
+			c ^= HDLC_TRANS;
+		}
+		wire[n++] = c;
+	}
+	wire[n++] = HDLC_FLAG;
+	gsm_pcap_input(0, dir, wire, n);
+	nframes++;
+}
+
+// LCP, PAP or IPCP packet with the options
+//--------------------------------------------------------------------------------------------------------
+static void _control(uint8_t dir, uint16_t proto, uint8_t code, uint8_t id, const uint8_t *opts, int olen)
+{
+	uint8_t pkt[64];
+	pkt[0] = code;
+	pkt[1] = id;
+	pkt[2] = (olen + 4) >> 8;
+	pkt[3] = (olen + 4) & 0xFF;
+	if (olen) memcpy(pkt + 4, opts, olen);
+	_send(dir, proto, pkt, olen + 4);
+}
+
+// IPv4 packet, the header and the transport checksum are calculated
+//-----------------------------------------------------------------------------------------------------------------------
+static void _ip(uint8_t dir, uint8_t proto, const uint8_t *src, const uint8_t *dst, uint8_t *l4, int l4len, int csum_off)
+{
+	static uint8_t pkt[MSS + 64];
+	uint8_t *h = pkt;
+	int len = 20 + l4len;
+
+	memset(h, 0, 20);
+	h[0] = 0x45;
+	h[2] = len >> 8;
+	h[3] = len & 0xFF;
+	h[4] = ip_id >> 8;
+	h[5] = ip_id & 0xFF;
+	ip_id++;
+	h[6] = 0x40;
+	h[8] = (dir == GSM_PCAP_TX) ? 64 : 52;
+	h[9] = proto;
+	memcpy(h + 12, src, 4);
+	memcpy(h + 16, dst, 4);
+	uint16_t sum = _fold(_sum16(0, h, 20));
+	h[10] = sum >> 8;
+	h[11] = sum & 0xFF;
+
+	// pseudo header
+	uint32_t psum = _sum16(0, src, 4);
+	psum = _sum16(psum, dst, 4);
+	psum += proto + l4len;
+	l4[csum_off] = 0;
+	l4[csum_off+1] = 0;
+	sum = _fold(_sum16(psum, l4, l4len));
+	l4[csum_off] = sum >> 8;
+	l4[csum_off+1] = sum & 0xFF;
+
+	memcpy(pkt + 20, l4, l4len);
+	_send(dir, PPP_IP, pkt, len);
+}
+
+// TCP segment between the local port and the server, 'data' NULL for random (encrypted) data
+//-------------------------------------------------------------------------
+static void _tcp(uint8_t dir, uint8_t flags, const uint8_t *data, int dlen)
+{
+	static uint8_t seg[MSS + 24];
+	int hlen = (flags & 0x02) ? 24 : 20;
+	uint32_t seq = (dir == GSM_PCAP_TX) ? local_seq : server_seq;
+	uint32_t ack = (dir == GSM_PCAP_TX) ? server_seq : local_seq;
+	uint16_t sport = (dir == GSM_PCAP_TX) ? 49153 : 443;
+	uint16_t dport = (dir == GSM_PCAP_TX) ? 443 : 49153;
+
+	memset(seg, 0, hlen);
+	seg[0] = sport >> 8;
+	seg[1] = sport & 0xFF;
+	seg[2] = dport >> 8;
+	seg[3] = dport & 0xFF;
+	for (int i=0; i<4; i++) {
+		seg[4+i] = seq >> (24 - (i * 8));
+		seg[8+i] = ack >> (24 - (i * 8));
+	}
+	seg[12] = (hlen / 4) << 4;
+	seg[13] = flags | ((flags & 0x02) ? 0 : 0x10);
+	seg[14] = (dir == GSM_PCAP_TX) ? 0x16 : 0x72;	// window 5840 / 29200
+	seg[15] = (dir == GSM_PCAP_TX) ? 0xD0 : 0x10;
+	if (flags & 0x02) {
+		// MSS option
+		seg[20] = 2;
+		seg[21] = 4;
+		seg[22] = MSS >> 8;
+		seg[23] = MSS & 0xFF;
+	}
+	for (int i=0; i<dlen; i++) seg[hlen+i] = (data) ? data[i] : _rand8();
+
+	if (dir == GSM_PCAP_TX) {
+		_ip(dir, 6, local_ip, server_ip, seg, hlen + dlen, 16);
+		local_seq += dlen + ((flags & 0x03) ? 1 : 0);
+	}
+	else {
+		_ip(dir, 6, server_ip, local_ip, seg, hlen + dlen, 16);
+		server_seq += dlen + ((flags & 0x03) ? 1 : 0);
+	}
+}
+
+// DNS query and response for the server's address
+//----------------
+static void _dns()
+{
+	static const uint8_t qname[] = "\x07" "example" "\x03" "com";
+	uint8_t udp[128];
+	int qlen = sizeof(qname) + 4;	// name with terminating zero, type, class
+
+	memset(udp, 0, sizeof(udp));
+	udp[0] = 0xC0;	// source port 49152
+	udp[2] = 0;
+	udp[3] = 53;
+	udp[8] = 0x5A;	// id
+	udp[9] = 0x3C;
+	udp[10] = 0x01;	// recursion desired
+	udp[13] = 1;	// one question
+	memcpy(udp + 20, qname, sizeof(qname));
+	udp[20 + sizeof(qname) + 1] = 1;	// type A
+	udp[20 + sizeof(qname) + 3] = 1;	// class IN
+	int len = 20 + qlen;
+	udp[4] = len >> 8;
+	udp[5] = len & 0xFF;
+	_ip(GSM_PCAP_TX, 17, local_ip, dns_ip, udp, len, 6);
+
+	// response with one answer: name pointer, type, class, TTL, address
+	udp[0] = 0;
+	udp[1] = 53;
+	udp[2] = 0xC0;
+	udp[3] = 0;
+	udp[10] = 0x81;
+	udp[11] = 0x80;
+	udp[15] = 1;
+	static const uint8_t answer[] = { 0xC0, 0x0C, 0, 1, 0, 1, 0, 0, 0x0E, 0x10, 0, 4 };
+	memcpy(udp + len, answer, sizeof(answer));
+	memcpy(udp + len + sizeof(answer), server_ip, 4);
+	len += sizeof(answer) + 4;
+	udp[4] = len >> 8;
+	udp[5] = len & 0xFF;
+	_ip(GSM_PCAP_RX, 17, dns_ip, local_ip, udp, len, 6);
+}
+
+//--------------------
+static void _session()
+{
+	static const uint8_t lcp_opts[] = { 1, 4, 0x05, 0xDC, 2, 6, 0, 0, 0, 0, 5, 6, 0x4E, 0x02, 0x7D, 0x11 };
+	static const uint8_t lcp_peer[] = { 2, 6, 0, 0, 0, 0, 3, 4, 0xC0, 0x23, 5, 6, 0x1A, 0x7E, 0x00, 0x93 };
+	static const uint8_t pap_req[] = { 0, 0 };
+	static const uint8_t pap_ack[] = { 0 };
+	static const uint8_t ipcp_req[] = { 3, 6, 0, 0, 0, 0, 0x81, 6, 0, 0, 0, 0, 0x83, 6, 0, 0, 0, 0 };
+	static const uint8_t ipcp_peer[] = { 3, 6, 10, 64, 64, 64 };
+	uint8_t ipcp_nak[18];
+	uint8_t echo[8] = { 0x4E, 0x02, 0x7D, 0x11, 0, 0, 0, 0 };
+	uint8_t hello[512];
+
+	// LCP: both sides request, acknowledge
+	_control(GSM_PCAP_TX, PPP_LCP, 1, 1, lcp_opts, sizeof(lcp_opts));
+	_control(GSM_PCAP_RX, PPP_LCP, 1, 1, lcp_peer, sizeof(lcp_peer));
+	_control(GSM_PCAP_TX, PPP_LCP, 2, 1, lcp_peer, sizeof(lcp_peer));
+	_control(GSM_PCAP_RX, PPP_LCP, 2, 1, lcp_opts, sizeof(lcp_opts));
+	// PAP with empty user and password
+	_control(GSM_PCAP_TX, PPP_PAP, 1, 1, pap_req, sizeof(pap_req));
+	_control(GSM_PCAP_RX, PPP_PAP, 2, 1, pap_ack, sizeof(pap_ack));
+	// IPCP: address and DNS servers are assigned by the peer
+	_control(GSM_PCAP_RX, PPP_IPCP, 1, 1, ipcp_peer, sizeof(ipcp_peer));
+	_control(GSM_PCAP_TX, PPP_IPCP, 2, 1, ipcp_peer, sizeof(ipcp_peer));
+	_control(GSM_PCAP_TX, PPP_IPCP, 1, 1, ipcp_req, sizeof(ipcp_req));
+	memcpy(ipcp_nak, ipcp_req, sizeof(ipcp_nak));
+	memcpy(ipcp_nak + 2, local_ip, 4);
+	memcpy(ipcp_nak + 8, dns_ip, 4);
+	memcpy(ipcp_nak + 14, dns_ip, 4);
+	ipcp_nak[17] = 4;
+	_control(GSM_PCAP_RX, PPP_IPCP, 3, 1, ipcp_nak, sizeof(ipcp_nak));
+	_control(GSM_PCAP_TX, PPP_IPCP, 1, 2, ipcp_nak, sizeof(ipcp_nak));
+	_control(GSM_PCAP_RX, PPP_IPCP, 2, 2, ipcp_nak, sizeof(ipcp_nak));
+
+	_dns();
+
+	// TCP connection and TLS handshake
+	_tcp(GSM_PCAP_TX, 0x02, NULL, 0);
+	_tcp(GSM_PCAP_RX, 0x12, NULL, 0);
+	_tcp(GSM_PCAP_TX, 0x00, NULL, 0);
+	for (int i=0; i<(int)sizeof(hello); i++) hello[i] = _rand8();
+	hello[0] = 0x16;	// handshake record
+	hello[1] = 0x03;
+	hello[2] = 0x01;
+	_tcp(GSM_PCAP_TX, 0x08, hello, 230);
+	_tcp(GSM_PCAP_RX, 0x00, NULL, 0);
+	// server hello and certificate chain
+	for (int i=0; i<3; i++) _tcp(GSM_PCAP_RX, (i == 2) ? 0x08 : 0x00, NULL, (i == 2) ? 812 : MSS);
+	_tcp(GSM_PCAP_TX, 0x00, NULL, 0);
+	_tcp(GSM_PCAP_TX, 0x08, NULL, 126);
+	_tcp(GSM_PCAP_RX, 0x08, NULL, 51);
+	// HTTP request
+	_tcp(GSM_PCAP_TX, 0x08, NULL, 187);
+
+	// Download, every second segment is acknowledged, LCP echo during the transfer
+	for (int i=0; i<DOWNLOAD_SEGMENTS; i++) {
+		_tcp(GSM_PCAP_RX, ((i % 8) == 7) ? 0x08 : 0x00, NULL, MSS);
+		if (i & 1) _tcp(GSM_PCAP_TX, 0x00, NULL, 0);
+		if (i == (DOWNLOAD_SEGMENTS / 2)) {
+			_control(GSM_PCAP_TX, PPP_LCP, 9, 1, echo, sizeof(echo));
+			memcpy(echo, lcp_peer + 12, 4);
+			_control(GSM_PCAP_RX, PPP_LCP, 10, 1, echo, sizeof(echo));
+		}
+	}
+	_tcp(GSM_PCAP_RX, 0x08, NULL, 377);
+	_tcp(GSM_PCAP_TX, 0x00, NULL, 0);
+
+	// Close
+	_tcp(GSM_PCAP_TX, 0x09, NULL, 31);	// TLS close notify with FIN
+	_tcp(GSM_PCAP_RX, 0x01, NULL, 0);
+	_tcp(GSM_PCAP_TX, 0x00, NULL, 0);
+	_control(GSM_PCAP_TX, PPP_LCP, 5, 2, NULL, 0);
+	_control(GSM_PCAP_RX, PPP_LCP, 6, 2, NULL, 0);
+}
+
+//==============================
+int main(int argc, char *argv[])
+{
+	if (argc != 2) {
+		printf("Usage: %s <file>\n", argv[0]);
+		return 2;
+	}
+
+	// the capture ring holds the whole session
+	if (gsm_pcap_start((DOWNLOAD_SEGMENTS + 64) * (MSS + 64)) == 0) return 1;
+	_session();
+	gsm_pcap_stop();
+
+	gsm_pcap_stats_t st;
+	gsm_pcap_getStats(&st);
+	if ((st.frames != nframes) || (st.dropped) || (st.truncated)) {
+		printf("Captured %u of %d frames\n", st.frames, nframes);
+		return 1;
+	}
+	if (gsm_pcap_save(argv[1]) != nframes) {
+		printf("Error saving '%s'\n", argv[1]);
+		return 1;
+	}
+	printf("Captured %u frames, %u bytes to '%s'\n", st.frames, st.bytes, argv[1]);
+	return 0;
+}
@@ -0,0 +1,940 @@
+/*
+ *  Simulated SIM800 modem for the host tests and benchmarks
+ *
+ *  Data sent to the host is kept in a ring with the time every chunk starts to arrive,
+ *  its bytes become readable one byte time after another. Data written by the host is queued
+ *  with the time it arrives to the modem and processed by the modem thread (or in the write call,
+ *  if it arrives at once). Linux only.
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "hdlc.h"
+#include "sim_modem.h"
+
+#define SIM_CHUNKS			1024	// max chunks in the modem to host ring
+#define SIM_TX_RING			262144	// host to modem data in flight
+#define SIM_LINE_MAX		256		// max command line length
+#define SIM_OUT_SIZE		8192	// command response buffer, without the SMS list
+#define SIM_WAIT_MAX_NS		10000000LL	// max modem thread sleep
+#define SIM_LOST_NS			3000000000LL	// frames not received back in this time are lost
+#define SIM_APN_MAX			64
+#define SIM_UART_FIFO		128		// UART hardware RX FIFO
+#define SIM_DROPS			256		// lost byte ranges not passed by the reader yet
+
+typedef struct
+{
+	uint64_t	start;			// index of the first byte in the ring data
+	uint32_t	len;
+	int64_t		t0;				// the first byte starts to arrive, ns
+	uint32_t	byte_ns;		// byte time, 0 for no line rate limit
+}sim_chunk_t;
+
+typedef struct
+{
+	uint64_t	end;			// index after the last byte in the ring data
+	int64_t		t_arrive;		// the data arrives to the modem, ns
+}sim_tx_chunk_t;
+
+// Bytes [from, to) of the modem to host data were lost
+typedef struct
+{
+	uint64_t	from;
+	uint64_t	to;
+}sim_drop_t;
+
+struct sim_modem
+{
+	sim_config_t	cfg;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;			// signalled on every change
+	pthread_t		thread;
+	int				running;
+	uint32_t		byte_ns;		// serial line byte time
+
+	// modem to host
+	uint8_t			*rx_ring;
+	uint64_t		rx_head;		// bytes read by the host
+	uint64_t		rx_tail;		// bytes sent
+	sim_chunk_t		chunks[SIM_CHUNKS];
+	int				ch_head;
+	int				ch_count;
+	int64_t			rx_line_free;	// the last sent byte is received, ns
+
+	// UART driver RX buffer without flow control (cfg.uart_rx_buf)
+	uint64_t		uart_seen;		// bytes arrived to the UART, received or lost
+	int64_t			uart_t;			// the arrivals are accounted up to this time, ns
+	uint64_t		uart_level;		// received bytes not read yet
+	sim_drop_t		drops[SIM_DROPS];
+	int				drop_head;
+	int				drop_count;
+	uint32_t		err_fifo;		// errors not reported to the host yet
+	uint32_t		err_full;
+
+	// load emulation, sim_set_stress()
+	int64_t			stress_ns;		// period, 0 if off
+	int64_t			isr_off_ns;
+	int64_t			stall_ns;
+	int64_t			isr_next;		// the next period with the interrupt disabled starts, ns
+	int64_t			stall_next;		// the reading task is preempted next time, ns
+
+	// host to modem
+	uint8_t			*tx_ring;
+	uint64_t		tx_head;		// bytes processed by the modem
+	uint64_t		tx_tail;		// bytes written by the host
+	sim_tx_chunk_t	tx_chunks[SIM_CHUNKS];
+	int				txc_head;
+	int				txc_count;
+	int64_t			tx_line_free;	// the last written byte is sent on the line, ns
+
+	// command mode
+	uint8_t			mode;
+	uint8_t			echo;
+	uint8_t			sms_text;		// receiving SMS text after "> " prompt
+	uint8_t			rf_on;
+	int				creg_mode;
+	char			apn[SIM_APN_MAX];
+	char			line[SIM_LINE_MAX];
+	int				line_len;
+	char			*out;			// response to the processed data
+	int				out_len;
+	int				out_size;
+
+	// data mode
+	hdlc_rx_t		deframer;
+	uint8_t			frame_buf[SIM_PAYLOAD_MAX + 16];
+	uint8_t			gen_on;
+	int				gen_payload;
+	int				gen_window;
+	uint8_t			gen_limit;		// the number of frames is limited
+	uint32_t		gen_left;		// frames left to send
+	uint32_t		seq;			// sequence number of the next sent frame
+	uint32_t		echo_next;		// expected sequence number of the next frame received back
+	int64_t			last_progress;	// last frame sent or received back, ns
+	uint32_t		rnd;
+
+	sim_stats_t		stats;
+};
+
+
+//---------------------
+static int64_t _nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t)ts.tv_sec * 1000000000LL) + ts.tv_nsec;
+}
+
+// Wait on the modem condition until 't' (ns), the lock must be held
+//-----------------------------------------------
+static void _waitUntil(sim_modem_t *m, int64_t t)
+{
+	struct timespec ts;
+	ts.tv_sec = t / 1000000000LL;
+	ts.tv_nsec = t % 1000000000LL;
+	pthread_cond_timedwait(&m->cond, &m->lock, &ts);
+}
+
+//-----------------------------------
+static uint32_t _rand(sim_modem_t *m)
+{
+	// xorshift32
+	m->rnd ^= m->rnd << 13;
+	m->rnd ^= m->rnd >> 17;
+	m->rnd ^= m->rnd << 5;
+	return m->rnd;
+}
+
+// ==== Modem to host ====
+
+// Queue data sent to the host, it starts to arrive after 'delay' ns
+// Returns 0 if there is no room
+//-----------------------------------------------------------------------------------------
+static int _rxPut(sim_modem_t *m, const uint8_t *data, int len, int64_t now, int64_t delay)
+{
+	if (len <= 0) return 1;
+	if (((m->rx_tail - m->rx_head) + len > m->cfg.rx_buf) || (m->ch_count >= SIM_CHUNKS)) return 0;
+
+	sim_chunk_t *c = &m->chunks[(m->ch_head + m->ch_count) % SIM_CHUNKS];
+	c->start = m->rx_tail;
+	c->len = len;
+	c->t0 = now + delay;
+	if (c->t0 < m->rx_line_free) c->t0 = m->rx_line_free;
+	c->byte_ns = m->byte_ns;
+	m->rx_line_free = c->t0 + ((int64_t)len * m->byte_ns);
+	m->ch_count++;
+
+	for (int i=0; i<len; i++) m->rx_ring[(m->rx_tail + i) % m->cfg.rx_buf] = data[i];
+	m->rx_tail += len;
+	pthread_cond_broadcast(&m->cond);
+	return 1;
+}
+
+// Get the number of bytes the host can read at 'now'
+// 'next' is set to the time 'want' more bytes arrive or the chunk being received ends, 0 if all data arrived
+//---------------------------------------------------------------------------------
+static uint64_t _rxReady(sim_modem_t *m, int64_t now, uint64_t want, int64_t *next)
+{
+	*next = 0;
+	for (int i=0; i<m->ch_count; i++) {
+		sim_chunk_t *c = &m->chunks[(m->ch_head + i) % SIM_CHUNKS];
+		uint64_t ready = 0;
+		if (now >= c->t0) {
+			if (c->byte_ns == 0) ready = c->len;
+			else {
+				ready = (uint64_t)(now - c->t0) / c->byte_ns;
+				if (ready > c->len) ready = c->len;
+			}
+		}
+		if (ready < c->len) {
+			uint64_t end = c->start + ready;
+			uint64_t got = (end > m->rx_head) ? end - m->rx_head : 0;
+			// wake up the reader once, not for every byte
+			uint64_t until = ready + ((want > got) ? want - got : 1);
+			if (until > c->len) until = c->len;
+			*next = c->t0 + ((int64_t)until * c->byte_ns);
+			return got;
+		}
+	}
+	return m->rx_tail - m->rx_head;
+}
+
+// Remove the read chunks
+//-----------------------------------
+static void _rxRetire(sim_modem_t *m)
+{
+	while (m->ch_count > 0) {
+		sim_chunk_t *c = &m->chunks[m->ch_head];
+		if ((c->start + c->len) > m->rx_head) break;
+		m->ch_head = (m->ch_head + 1) % SIM_CHUNKS;
+		m->ch_count--;
+	}
+}
+
+// ==== UART driver RX buffer without flow control ====
+
+// Get the index of the first byte which has not arrived at 't'
+//---------------------------------------------------
+static uint64_t _rxArrived(sim_modem_t *m, int64_t t)
+{
+	for (int i=0; i<m->ch_count; i++) {
+		sim_chunk_t *c = &m->chunks[(m->ch_head + i) % SIM_CHUNKS];
+		if (t < c->t0) return c->start;
+		if (c->byte_ns) {
+			uint64_t n = (uint64_t)(t - c->t0) / c->byte_ns;
+			if (n < c->len) return c->start + n;
+		}
+	}
+	return m->rx_tail;
+}
+
+// Bytes [from, to) are lost, the reader skips them
+//---------------------------------------------------------------
+static void _uartDrop(sim_modem_t *m, uint64_t from, uint64_t to)
+{
+	if (to <= from) return;
+	m->stats.rx_lost += to - from;
+	if (m->drop_count > 0) {
+		sim_drop_t *last = &m->drops[(m->drop_head + m->drop_count - 1) % SIM_DROPS];
+		if ((last->to == from) || (m->drop_count == SIM_DROPS)) {
+			// no room for another range, the received bytes between are lost too
+			m->stats.rx_lost += from - last->to;
+			m->uart_level -= from - last->to;
+			last->to = to;
+			return;
+		}
+	}
+	sim_drop_t *d = &m->drops[(m->drop_head + m->drop_count) % SIM_DROPS];
+	d->from = from;
+	d->to = to;
+	m->drop_count++;
+}
+
+// Move the data arrived up to 'now' into the RX buffer as the UART interrupt does,
+// periods with the interrupt disabled are accounted when they end
+//---------------------------------------------------
+static void _uartAccount(sim_modem_t *m, int64_t now)
+{
+	if ((m->stress_ns) && (m->mode != SIM_MODE_DATA)) {
+		// the load is emulated in data mode
+		m->isr_next = now + m->stress_ns;
+		m->stall_next = now + m->stress_ns;
+	}
+	while (m->uart_t < now) {
+		int64_t t_end = now;
+		int isr_off = 0;
+		if ((m->stress_ns) && (m->isr_off_ns)) {
+			if (m->uart_t < m->isr_next) {
+				if (t_end > m->isr_next) t_end = m->isr_next;
+			}
+			else {
+				t_end = m->isr_next + m->isr_off_ns;
+				if (now < t_end) break;
+				isr_off = 1;
+			}
+		}
+		uint64_t to = _rxArrived(m, t_end);
+		uint64_t n = to - m->uart_seen;
+		uint64_t room = m->cfg.uart_rx_buf - m->uart_level;
+		uint64_t got = n;
+		if (isr_off) {
+			// the FIFO keeps the first bytes, they are moved to the buffer when the interrupt is enabled again
+			if (got > SIM_UART_FIFO) {
+				got = SIM_UART_FIFO;
+				m->stats.fifo_overflows++;
+				m->err_fifo++;
+			}
+			m->isr_next += m->stress_ns;
+		}
+		if (got > room) {
+			got = room;
+			m->stats.buffer_full++;
+			m->err_full++;
+		}
+		_uartDrop(m, m->uart_seen + got, to);
+		m->uart_level += got;
+		m->uart_seen = to;
+		m->uart_t = t_end;
+	}
+}
+
+// Copy up to 'len' received bytes to 'buf', the lost bytes are skipped
+//---------------------------------------------------------
+static int _uartRead(sim_modem_t *m, uint8_t *buf, int len)
+{
+	int n = 0;
+	while (1) {
+		if ((m->drop_count > 0) && (m->rx_head >= m->drops[m->drop_head].from)) {
+			m->rx_head = m->drops[m->drop_head].to;
+			m->drop_head = (m->drop_head + 1) % SIM_DROPS;
+			m->drop_count--;
+			continue;
+		}
+		if (n >= len) break;
+		uint64_t end = m->uart_seen;
+		if ((m->drop_count > 0) && (m->drops[m->drop_head].from < end)) end = m->drops[m->drop_head].from;
+		if (end <= m->rx_head) break;
+		uint64_t k = end - m->rx_head;
+		if (k > (uint64_t)(len - n)) k = len - n;
+		for (uint64_t i=0; i<k; i++) buf[n++] = m->rx_ring[(m->rx_head + i) % m->cfg.rx_buf];
+		m->rx_head += k;
+		m->uart_level -= k;
+		m->stats.rx_bytes += k;
+	}
+	_rxRetire(m);
+	return n;
+}
+
+// ==== Command mode ====
+
+//---------------------------------------------------------
+static void _out(sim_modem_t *m, const char *data, int len)
+{
+	if (len < 0) len = strlen(data);
+	if ((m->out_len + len) > m->out_size) len = m->out_size - m->out_len;
+	memcpy(m->out + m->out_len, data, len);
+	m->out_len += len;
+}
+
+// Information response line
+//----------------------------------------------------
+static void _outInfo(sim_modem_t *m, const char *info)
+{
+	_out(m, "\r\n", 2);
+	_out(m, info, -1);
+	_out(m, "\r\n", 2);
+}
+
+#define SIM_OK			0
+#define SIM_ERROR		1
+#define SIM_CONNECT		2
+#define SIM_PROMPT		3
+
+// Execute one command, 'cmd' is without "AT" prefix and ';' separator
+// Information responses are added to the output, returns the final result SIM_xxx
+//--------------------------------------------------
+static int _simExec(sim_modem_t *m, const char *cmd)
+{
+	char buf[128];
+
+	if (cmd[0] == '\0') return SIM_OK;
+	if ((strcasecmp(cmd, "E0") == 0) || (strcasecmp(cmd, "E1") == 0)) {
+		m->echo = (cmd[1] == '1');
+		return SIM_OK;
+	}
+	if (strcasecmp(cmd, "Z") == 0) {
+		m->echo = 1;
+		return SIM_OK;
+	}
+	if (strcasecmp(cmd, "I") == 0) {
+		_outInfo(m, "SIM800 R14.18");
+		return SIM_OK;
+	}
+	if (strcasecmp(cmd, "H") == 0) return SIM_OK;
+	if ((strcasecmp(cmd, "+CGDATA=\"PPP\",1") == 0) || ((cmd[0] == 'D') || (cmd[0] == 'd'))) {
+		return (m->rf_on && m->apn[0]) ? SIM_CONNECT : SIM_ERROR;
+	}
+	if (strcasecmp(cmd, "+CGMM") == 0) {
+		_outInfo(m, m->cfg.model);
+		return SIM_OK;
+	}
+	if (strncasecmp(cmd, "+CFUN=", 6) == 0) {
+		m->rf_on = (atoi(cmd + 6) == 1);
+		return SIM_OK;
+	}
+	if (strcasecmp(cmd, "+CFUN?") == 0) {
+		sprintf(buf, "+CFUN: %d", (m->rf_on) ? 1 : 4);
+		_outInfo(m, buf);
+		return SIM_OK;
+	}
+	if (strcasecmp(cmd, "+CPIN?") == 0) {
+		_outInfo(m, "+CPIN: READY");
+		return SIM_OK;
+	}
+	if (strncasecmp(cmd, "+CREG=", 6) == 0) {
+		m->creg_mode = atoi(cmd + 6);
+		return SIM_OK;
+	}
+	if (strcasecmp(cmd, "+CREG?") == 0) {
+		if ((m->creg_mode == 2) && (m->rf_on)) sprintf(buf, "+CREG: 2,1,\"1A2B\",\"00C3\"");
+		else sprintf(buf, "+CREG: %d,%d", m->creg_mode, (m->rf_on) ? 1 : 0);
+		_outInfo(m, buf);
+		return SIM_OK;
+	}
+	if (strncasecmp(cmd, "+CGDCONT=", 9) == 0) {
+		const char *apn = strstr(cmd, ",\"");
+		apn = (apn) ? strstr(apn + 2, ",\"") : NULL;
+		if (apn == NULL) return SIM_ERROR;
+		snprintf(m->apn, sizeof(m->apn), "%s", apn + 2);
+		char *end = strchr(m->apn, '"');
+		if (end) *end = '\0';
+		return SIM_OK;
+	}
+	if (strcasecmp(cmd, "+CGDCONT?") == 0) {
+		snprintf(buf, sizeof(buf), "+CGDCONT: 1,\"IP\",\"%s\",\"0.0.0.0\",0,0", m->apn);
+		_outInfo(m, buf);
+		return SIM_OK;
+	}
+	if (strcasecmp(cmd, "+COPS?") == 0) {
+		_outInfo(m, (m->rf_on) ? "+COPS: 0,0,\"SIM Operator\"" : "+COPS: 0");
+		return SIM_OK;
+	}
+	if (strcasecmp(cmd, "+CCLK?") == 0) {
+		_outInfo(m, "+CCLK: \"26/10/18,12:30:45+08\"");
+		return SIM_OK;
+	}
+	if (strncasecmp(cmd, "+CMGL", 5) == 0) {
+		if (m->cfg.sms_list) _out(m, m->cfg.sms_list, -1);
+		return SIM_OK;
+	}
+	if (strncasecmp(cmd, "+CMGS=", 6) == 0) return SIM_PROMPT;
+	if ((strncasecmp(cmd, "+CNMI=", 6) == 0) || (strcasecmp(cmd, "+CMGF=1") == 0) || (strncasecmp(cmd, "+CMGD=", 6) == 0) ||
+			(strncasecmp(cmd, "+CLTS=", 6) == 0) || (strncasecmp(cmd, "+IFC=", 5) == 0) || (strncasecmp(cmd, "+IPR=", 5) == 0)) {
+		return SIM_OK;
+	}
+	// +CEREG, +CTZU, ... are not supported by SIM800
+	return SIM_ERROR;
+}
+
+// Execute the command line, commands after "AT" are separated with ';'
+//-------------------------------------------------
+static void _simCmdLine(sim_modem_t *m, char *line)
+{
+	while (*line == ' ') line++;
+	if (strncasecmp(line, "AT", 2) != 0) return;
+	m->stats.commands++;
+
+	int res = SIM_OK;
+	char *cmd = line + 2;
+	while (res == SIM_OK) {
+		char *end = cmd;
+		int quoted = 0;
+		while ((*end) && ((*end != ';') || (quoted))) {
+			if (*end == '"') quoted ^= 1;
+			end++;
+		}
+		int last = (*end == '\0');
+		*end = '\0';
+		res = _simExec(m, cmd);
+		if (last) break;
+		cmd = end + 1;
+	}
+
+	switch (res) {
+		case SIM_OK:
+			_out(m, "\r\nOK\r\n", -1);
+			// the SIM and network are ready when RF is turned on
+			if ((strncasecmp(line + 2, "+CFUN=1", 7) == 0)) _out(m, "\r\n+CPIN: READY\r\n\r\nCall Ready\r\n\r\nSMS Ready\r\n", -1);
+			break;
+		case SIM_CONNECT:
+			_out(m, "\r\nCONNECT\r\n", -1);
+			m->mode = SIM_MODE_DATA;
+			hdlc_rx_init(&m->deframer, m->frame_buf, sizeof(m->frame_buf));
+			m->deframer.accm = 0;
+			m->echo_next = m->seq;
+			break;
+		case SIM_PROMPT:
+			_out(m, "\r\n> ", -1);
+			m->sms_text = 1;
+			break;
+		default:
+			_out(m, "\r\nERROR\r\n", -1);
+			break;
+	}
+}
+
+//-------------------------------------------------------------------
+static void _simCommand(sim_modem_t *m, const uint8_t *data, int len)
+{
+	for (int i=0; i<len; i++) {
+		char c = data[i];
+		if (m->sms_text) {
+			if (c == 0x1A) {
+				m->sms_text = 0;
+				_out(m, "\r\n+CMGS: 12\r\n\r\nOK\r\n", -1);
+			}
+			else if (c == 0x1B) {
+				m->sms_text = 0;
+				_out(m, "\r\nOK\r\n", -1);
+			}
+			else if (m->echo) _out(m, &c, 1);
+			continue;
+		}
+		if (c == '\r') {
+			m->line[m->line_len] = '\0';
+			if (m->echo) {
+				_out(m, m->line, m->line_len);
+				_out(m, "\r", 1);
+			}
+			m->line_len = 0;
+			_simCmdLine(m, m->line);
+			continue;
+		}
+		// LF and other control characters (NUL sent after some commands) are ignored
+		if ((uint8_t)c < 0x20) continue;
+		if (m->line_len < (SIM_LINE_MAX - 1)) m->line[m->line_len++] = c;
+	}
+}
+
+// ==== Data mode ====
+
+// Frame written by the host
+//-------------------------------------------------------
+static void _simFrame(void *arg, uint8_t *frame, int len)
+{
+	sim_modem_t *m = (sim_modem_t *)arg;
+	static const uint8_t hdr[4] = { 0xFF, 0x03, 0x00, 0x21 };
+
+	if ((len < (4 + SIM_PAYLOAD_MIN)) || (memcmp(frame, hdr, 4) != 0)) {
+		m->stats.frames_other++;
+		return;
+	}
+	uint32_t seq;
+	int64_t t_sent;
+	memcpy(&seq, frame + 4, 4);
+	memcpy(&t_sent, frame + 8, 8);
+	if ((int32_t)(seq - m->echo_next) < 0) {
+		m->stats.frames_other++;
+		return;
+	}
+	int64_t now = _nowNs();
+	m->stats.frames_lost += seq - m->echo_next;
+	m->echo_next = seq + 1;
+	m->last_progress = now;
+
+	uint32_t rtt = (uint32_t)((now - t_sent) / 1000);
+	m->stats.frames_echoed++;
+	m->stats.payload_echoed += len - 4;
+	m->stats.rtt_sum_us += rtt;
+	if ((m->stats.rtt_min_us == 0) || (rtt < m->stats.rtt_min_us)) m->stats.rtt_min_us = rtt;
+	if (rtt > m->stats.rtt_max_us) m->stats.rtt_max_us = rtt;
+}
+
+// Send the next frame of the peer, returns 0 if there is no room
+//----------------------------------------------
+static int _simSend(sim_modem_t *m, int64_t now)
+{
+	uint8_t frame[SIM_PAYLOAD_MAX + 8];
+	uint8_t wire[(SIM_PAYLOAD_MAX + 8) * 2 + 2];
+	int len = 0;
+	int64_t t_sent = now + m->cfg.latency_us * 1000LL;
+
+	// the frame starts with a flag if the line is idle
+	int idle = (m->rx_line_free < t_sent);
+	int max_len = ((m->gen_payload + 8) * 2) + 2;
+	if (((m->rx_tail - m->rx_head) + max_len > m->cfg.rx_buf) || (m->ch_count >= SIM_CHUNKS)) return 0;
+
+	frame[len++] = 0xFF;
+	frame[len++] = 0x03;
+	frame[len++] = 0x00;
+	frame[len++] = 0x21;
+	memcpy(frame + len, &m->seq, 4);
+	len += 4;
+	// the round trip is measured from the time the frame leaves the peer
+	int64_t t_peer = now;
+	memcpy(frame + len, &t_peer, 8);
+	len += 8;
+	for (int i=SIM_PAYLOAD_MIN; i<m->gen_payload; i++) frame[len++] = _rand(m);
+	uint16_t fcs = hdlc_fcs16(HDLC_INITFCS, frame, len) ^ 0xFFFF;
+	frame[len++] = fcs & 0xFF;
+	frame[len++] = fcs >> 8;
+
+	int n = 0;
+	if (idle) wire[n++] = HDLC_FLAG;
+	for (int i=0; i<len; i++) {
+		if ((frame[i] == HDLC_FLAG) || (frame[i] == HDLC_ESCAPE)) {
+			wire[n++] = HDLC_ESCAPE;
+			wire[n++] = frame[i] ^ HDLC_TRANS;
+		}
+		else wire[n++] = frame[i];
+	}
+	wire[n++] = HDLC_FLAG;
+
+	_rxPut(m, wire, n, now, m->cfg.latency_us * 1000LL);
+	m->seq++;
+	if (m->gen_left > 0) m->gen_left--;
+	m->last_progress = now;
+	m->stats.frames_sent++;
+	m->stats.payload_sent += m->gen_payload;
+	m->stats.wire_sent += n;
+	return 1;
+}
+
+// Send the peer's frames allowed by the window and count
+//---------------------------------------------------
+static void _simGenerate(sim_modem_t *m, int64_t now)
+{
+	if ((m->gen_on == 0) || (m->mode != SIM_MODE_DATA)) return;
+
+	uint32_t inflight = m->seq - m->echo_next;
+	if ((m->gen_window > 0) && (inflight > 0) && ((now - m->last_progress) > SIM_LOST_NS)) {
+		// not received back
+		m->stats.frames_lost += inflight;
+		m->echo_next = m->seq;
+		inflight = 0;
+	}
+	while (((m->gen_limit == 0) || (m->gen_left > 0)) &&
+			((m->gen_window == 0) || (inflight < m->gen_window))) {
+		if (_simSend(m, now) == 0) break;
+		inflight++;
+	}
+}
+
+// ==== Host to modem ====
+
+// Process the data written by the host which arrived to the modem
+//--------------------------------------------------
+static void _simProcess(sim_modem_t *m, int64_t now)
+{
+	uint8_t data[512];
+
+	while ((m->txc_count > 0) && (m->tx_chunks[m->txc_head].t_arrive <= now)) {
+		sim_tx_chunk_t *c = &m->tx_chunks[m->txc_head];
+		uint64_t start = m->tx_head;
+		int len = (int)(c->end - start);
+		m->out_len = 0;
+		if ((m->mode == SIM_MODE_DATA) && (len == 3) && (m->tx_ring[start % SIM_TX_RING] == '+') &&
+				(m->tx_ring[(start + 1) % SIM_TX_RING] == '+') && (m->tx_ring[(start + 2) % SIM_TX_RING] == '+')) {
+			// escape to command mode
+			m->mode = SIM_MODE_CMD;
+			_out(m, "\r\nOK\r\n", -1);
+		}
+		else {
+			for (int off=0; off<len; ) {
+				int n = len - off;
+				if (n > (int)sizeof(data)) n = sizeof(data);
+				for (int i=0; i<n; i++) data[i] = m->tx_ring[(start + off + i) % SIM_TX_RING];
+				if (m->mode == SIM_MODE_CMD) _simCommand(m, data, n);
+				else {
+					uint32_t frames = 0, errors = 0, bytes = 0;
+					hdlc_deframe(&m->deframer, data, n, _simFrame, m, &frames, &errors, &bytes);
+					m->stats.fcs_errors += errors;
+				}
+				off += n;
+			}
+		}
+		m->tx_head = c->end;
+		m->txc_head = (m->txc_head + 1) % SIM_CHUNKS;
+		m->txc_count--;
+		_rxPut(m, (uint8_t *)m->out, m->out_len, now, 0);
+	}
+	pthread_cond_broadcast(&m->cond);
+}
+
+//--------------------------------
+static void *_simThread(void *arg)
+{
+	sim_modem_t *m = (sim_modem_t *)arg;
+
+	pthread_mutex_lock(&m->lock);
+	while (m->running) {
+		int64_t now = _nowNs();
+		_simProcess(m, now);
+		_simGenerate(m, now);
+		int64_t next = now + SIM_WAIT_MAX_NS;
+		if ((m->txc_count > 0) && (m->tx_chunks[m->txc_head].t_arrive < next)) next = m->tx_chunks[m->txc_head].t_arrive;
+		_waitUntil(m, next);
+	}
+	pthread_mutex_unlock(&m->lock);
+	return NULL;
+}
+
+// ==== Serial port operations ====
+
+//------------------------------------------------------------------------
+static int _simRead(void *arg, uint8_t *buf, int len, uint32_t timeout_ms)
+{
+	sim_modem_t *m = (sim_modem_t *)arg;
+	int n = 0;
+	int64_t next;
+
+	pthread_mutex_lock(&m->lock);
+	if ((m->cfg.uart_rx_buf) && (m->stall_ns) && (m->mode == SIM_MODE_DATA) && (_nowNs() >= m->stall_next)) {
+		// the reading task is preempted, the data keeps arriving
+		m->stall_next += m->stress_ns;
+		pthread_mutex_unlock(&m->lock);
+		usleep(m->stall_ns / 1000);
+		pthread_mutex_lock(&m->lock);
+	}
+	int64_t deadline = _nowNs() + ((int64_t)timeout_ms * 1000000LL);
+	while (n < len) {
+		int64_t now = _nowNs();
+		uint64_t ready = _rxReady(m, now, len - n, &next);
+		if (m->cfg.uart_rx_buf) {
+			_uartAccount(m, now);
+			int got = _uartRead(m, buf + n, len - n);
+			if (got > 0) {
+				n += got;
+				pthread_cond_broadcast(&m->cond);
+				deadline = now + ((int64_t)timeout_ms * 1000000LL);
+				continue;
+			}
+			// the data which arrived while the interrupt was disabled is seen when it is enabled again
+			if ((m->stress_ns) && (m->isr_off_ns) && (m->uart_t >= m->isr_next)) next = m->isr_next + m->isr_off_ns;
+		}
+		else if (ready > 0) {
+			if (ready > (uint64_t)(len - n)) ready = len - n;
+			for (uint64_t i=0; i<ready; i++) buf[n++] = m->rx_ring[(m->rx_head + i) % m->cfg.rx_buf];
+			m->rx_head += ready;
+			m->stats.rx_bytes += ready;
+			_rxRetire(m);
+			pthread_cond_broadcast(&m->cond);
+			// as the UART driver, wait for more data up to the timeout from the last received data
+			deadline = now + ((int64_t)timeout_ms * 1000000LL);
+			continue;
+		}
+		if (now >= deadline) break;
+		_waitUntil(m, ((next) && (next < deadline)) ? next : deadline);
+	}
+	pthread_mutex_unlock(&m->lock);
+	return n;
+}
+
+//-----------------------------------------------------------
+static int _simWrite(void *arg, const uint8_t *data, int len)
+{
+	sim_modem_t *m = (sim_modem_t *)arg;
+
+	pthread_mutex_lock(&m->lock);
+	int64_t now = _nowNs();
+	if (m->byte_ns) {
+		// wait for room in the TX buffer, the bytes leave it at the line rate
+		while (((m->tx_line_free - now) / m->byte_ns) + len > m->cfg.tx_buf) {
+			_waitUntil(m, m->tx_line_free - ((int64_t)(m->cfg.tx_buf - len) * m->byte_ns));
+			now = _nowNs();
+		}
+	}
+	while (((m->tx_tail - m->tx_head) + len > SIM_TX_RING) || (m->txc_count >= SIM_CHUNKS)) {
+		_waitUntil(m, now + SIM_WAIT_MAX_NS);
+		now = _nowNs();
+	}
+
+	int64_t start = (m->tx_line_free > now) ? m->tx_line_free : now;
+	m->tx_line_free = start + ((int64_t)len * m->byte_ns);
+	sim_tx_chunk_t *c = &m->tx_chunks[(m->txc_head + m->txc_count) % SIM_CHUNKS];
+	c->t_arrive = m->tx_line_free + ((m->mode == SIM_MODE_DATA) ? m->cfg.latency_us * 1000LL : 0);
+	for (int i=0; i<len; i++) m->tx_ring[(m->tx_tail + i) % SIM_TX_RING] = data[i];
+	m->tx_tail += len;
+	c->end = m->tx_tail;
+	m->txc_count++;
+	m->stats.tx_bytes += len;
+
+	// data arriving at once is processed now, the response is ready when the write returns
+	if (c->t_arrive <= now) _simProcess(m, now);
+	else pthread_cond_broadcast(&m->cond);
+	pthread_mutex_unlock(&m->lock);
+	return len;
+}
+
+//------------------------------
+static void _simFlush(void *arg)
+{
+	sim_modem_t *m = (sim_modem_t *)arg;
+
+	pthread_mutex_lock(&m->lock);
+	m->rx_head = m->rx_tail;
+	m->ch_count = 0;
+	m->uart_seen = m->rx_tail;
+	m->uart_t = _nowNs();
+	m->uart_level = 0;
+	m->drop_count = 0;
+	pthread_cond_broadcast(&m->cond);
+	pthread_mutex_unlock(&m->lock);
+}
+
+//--------------------------------------------------------------------------------
+static void _simErrors(void *arg, uint32_t *fifo_overflows, uint32_t *buffer_full)
+{
+	sim_modem_t *m = (sim_modem_t *)arg;
+
+	pthread_mutex_lock(&m->lock);
+	*fifo_overflows = m->err_fifo;
+	*buffer_full = m->err_full;
+	m->err_fifo = 0;
+	m->err_full = 0;
+	pthread_mutex_unlock(&m->lock);
+}
+
+const gsm_serial_t sim_serial = {
+	.read = _simRead,
+	.write = _simWrite,
+	.flush = _simFlush,
+	.errors = _simErrors
+};
+
+//========================================
+void sim_default_config(sim_config_t *cfg)
+{
+	memset(cfg, 0, sizeof(sim_config_t));
+	cfg->rx_buf = 65536;
+	cfg->tx_buf = 16384;
+	cfg->model = "SIMCOM_SIM800L";
+}
+
+//==============================================
+sim_modem_t *sim_create(const sim_config_t *cfg)
+{
+	sim_modem_t *m = calloc(1, sizeof(sim_modem_t));
+	if (m == NULL) return NULL;
+	memcpy(&m->cfg, cfg, sizeof(sim_config_t));
+	if (m->cfg.rx_buf < 4096) m->cfg.rx_buf = 4096;
+	if (m->cfg.tx_buf < 1024) m->cfg.tx_buf = 1024;
+	if (m->cfg.model == NULL) m->cfg.model = "SIMCOM_SIM800L";
+	m->out_size = SIM_OUT_SIZE + ((m->cfg.sms_list) ? strlen(m->cfg.sms_list) : 0);
+	m->rx_ring = malloc(m->cfg.rx_buf);
+	m->tx_ring = malloc(SIM_TX_RING);
+	m->out = malloc(m->out_size);
+	if ((m->rx_ring == NULL) || (m->tx_ring == NULL) || (m->out == NULL)) {
+		free(m->rx_ring);
+		free(m->tx_ring);
+		free(m->out);
+		free(m);
+		return NULL;
+	}
+	m->echo = 1;
+	m->rnd = 0x12345678;
+	m->uart_t = _nowNs();
+
+	pthread_mutex_init(&m->lock, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&m->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	sim_set_line(m, m->cfg.baud_rate, m->cfg.latency_us);
+	m->running = 1;
+	if (pthread_create(&m->thread, NULL, _simThread, m) != 0) {
+		free(m->rx_ring);
+		free(m->tx_ring);
+		free(m->out);
+		free(m);
+		return NULL;
+	}
+	return m;
+}
+
+//==============================
+void sim_destroy(sim_modem_t *m)
+{
+	pthread_mutex_lock(&m->lock);
+	m->running = 0;
+	pthread_cond_broadcast(&m->cond);
+	pthread_mutex_unlock(&m->lock);
+	pthread_join(m->thread, NULL);
+	pthread_mutex_destroy(&m->lock);
+	pthread_cond_destroy(&m->cond);
+	free(m->rx_ring);
+	free(m->tx_ring);
+	free(m->out);
+	free(m);
+}
+
+//========================================================================
+void sim_set_line(sim_modem_t *m, uint32_t baud_rate, uint32_t latency_us)
+{
+	pthread_mutex_lock(&m->lock);
+	m->cfg.baud_rate = baud_rate;
+	m->cfg.latency_us = latency_us;
+	// 8 data bits, start and stop bit
+	m->byte_ns = (baud_rate) ? (uint32_t)(10000000000ULL / baud_rate) : 0;
+	pthread_mutex_unlock(&m->lock);
+}
+
+//=============================================================================================
+void sim_set_stress(sim_modem_t *m, uint32_t period_ms, uint32_t isr_off_us, uint32_t stall_us)
+{
+	pthread_mutex_lock(&m->lock);
+	int64_t now = _nowNs();
+	m->stress_ns = (m->cfg.uart_rx_buf) ? (int64_t)period_ms * 1000000LL : 0;
+	m->isr_off_ns = (int64_t)isr_off_us * 1000LL;
+	m->stall_ns = (int64_t)stall_us * 1000LL;
+	m->isr_next = now + m->stress_ns;
+	m->stall_next = now + m->stress_ns;
+	pthread_mutex_unlock(&m->lock);
+}
+
+//==========================================================================
+void sim_data_start(sim_modem_t *m, int payload, int window, uint32_t count)
+{
+	if (payload < SIM_PAYLOAD_MIN) payload = SIM_PAYLOAD_MIN;
+	if (payload > SIM_PAYLOAD_MAX) payload = SIM_PAYLOAD_MAX;
+	pthread_mutex_lock(&m->lock);
+	m->gen_payload = payload;
+	m->gen_window = window;
+	m->gen_limit = (count > 0);
+	m->gen_left = count;
+	m->echo_next = m->seq;
+	m->last_progress = _nowNs();
+	m->gen_on = 1;
+	pthread_cond_broadcast(&m->cond);
+	pthread_mutex_unlock(&m->lock);
+}
+
+//================================
+void sim_data_stop(sim_modem_t *m)
+{
+	pthread_mutex_lock(&m->lock);
+	m->gen_on = 0;
+	pthread_mutex_unlock(&m->lock);
+}
+
+//=============================================================
+void sim_get_stats(sim_modem_t *m, sim_stats_t *stats, int rst)
+{
+	pthread_mutex_lock(&m->lock);
+	m->stats.mode = m->mode;
+	memcpy(stats, &m->stats, sizeof(sim_stats_t));
+	if (rst) {
+		// the frames in flight are received back after the reset, the window is not affected
+		memset(&m->stats, 0, sizeof(sim_stats_t));
+	}
+	pthread_mutex_unlock(&m->lock);
+}
@@ -0,0 +1,126 @@
+/*
+ *  Simulated SIM800 modem for the host tests and benchmarks
+ *
+ *  libGSM accesses the modem through the serial port operations 'sim_serial' (gsm_config_t.serial,
+ *  the modem is gsm_config_t.serial_arg). Reads behave as uart_read_bytes(): they wait for 'len'
+ *  bytes, returning earlier only when no more data arrives in 'timeout_ms'.
+ *
+ *  In command mode the AT commands used by libGSM are answered (initialization, registration,
+ *  SMS, network time). After CONNECT the modem is in data mode: it sends PPP frames generated by
+ *  the simulated peer (sim_data_start()) and counts the frames written by the host; own frames
+ *  sent back by the host (host_ppp_echo()) give the round trip time. "+++" returns to command mode.
+ *
+ *  The serial line rate and the network latency are emulated: every byte takes 10 bit times
+ *  in both directions, the data exchanged with the peer in data mode is delayed by the latency.
+ *
+ *  Without flow control (sim_config_t.uart_rx_buf) the UART driver's RX buffer is emulated:
+ *  the modem does not wait for the host, data arriving when the buffer is full is lost.
+ *  sim_set_stress() adds the load of a busy ESP32 in data mode: periods with the UART interrupt
+ *  disabled (data beyond the 128-byte hardware FIFO is lost) and with the reading task preempted.
+ *  The losses are reported to libGSM as UART FIFO overflow and buffer full events.
+ *
+*/
+
+#ifndef _SIM_MODEM_H_
+#define _SIM_MODEM_H_
+
+#include <stdint.h>
+#include "gsm_serial.h"
+
+#define SIM_MODE_CMD		0
+#define SIM_MODE_DATA		1
+#define SIM_PAYLOAD_MIN		12		// sequence number and send time
+#define SIM_PAYLOAD_MAX		1500
+
+typedef struct sim_modem sim_modem_t;
+
+typedef struct
+{
+	uint32_t	baud_rate;		// serial line rate, 0 for no limit
+	uint32_t	latency_us;		// one way network delay of the data exchanged with the peer
+	int			rx_buf;			// modem to host buffer (UART driver RX buffer) size
+	int			tx_buf;			// host to modem buffer (UART driver TX buffer) size, writes wait for room
+	int			uart_rx_buf;	// UART driver RX buffer without flow control, 0: the modem waits for room in 'rx_buf'
+	const char	*model;			// AT+CGMM response
+	const char	*sms_list;		// AT+CMGL response before OK, NULL for none
+}sim_config_t;
+
+typedef struct
+{
+	uint32_t	commands;		// AT command lines received
+	uint64_t	rx_bytes;		// bytes read by the host
+	uint64_t	tx_bytes;		// bytes written by the host
+	uint32_t	frames_sent;	// data frames sent by the peer
+	uint32_t	frames_echoed;	// peer's frames received back
+	uint32_t	frames_lost;	// peer's frames not received back
+	uint32_t	frames_other;	// other frames written by the host
+	uint32_t	fcs_errors;		// frames with bad FCS written by the host
+	uint64_t	payload_sent;	// information field bytes of the sent frames
+	uint64_t	payload_echoed;
+	uint64_t	wire_sent;		// bytes of the sent frames on serial line (escaped, with flags)
+	uint64_t	rtt_sum_us;		// round trip time of the echoed frames
+	uint32_t	rtt_min_us;
+	uint32_t	rtt_max_us;
+	uint32_t	fifo_overflows;	// UART FIFO overflows, data received while the interrupt was disabled was lost
+	uint32_t	buffer_full;	// UART RX buffer full events, data was lost
+	uint64_t	rx_lost;		// bytes lost
+	uint8_t		mode;			// SIM_MODE_xxx
+}sim_stats_t;
+
+// Serial port operations, the argument is the modem
+extern const gsm_serial_t sim_serial;
+
+/*
+ * Fill the configuration with defaults: no line rate limit and latency, 16 KB buffers, SIM800
+ */
+//=========================================
+void sim_default_config(sim_config_t *cfg);
+
+/*
+ * Create the modem and start its thread, the modem is in command mode with echo on
+ * Returns NULL on error
+ */
+//===============================================
+sim_modem_t *sim_create(const sim_config_t *cfg);
+
+/*
+ * Stop the modem thread and free the modem, libGSM must not use it anymore
+ */
+//===============================
+void sim_destroy(sim_modem_t *m);
+
+/*
+ * Change the serial line rate and the network latency, the data already sent is not affected
+ */
+//=========================================================================
+void sim_set_line(sim_modem_t *m, uint32_t baud_rate, uint32_t latency_us);
+
+/*
+ * Emulate the load in data mode, without flow control only ('uart_rx_buf' set)
+ * Every 'period_ms' the UART interrupt is disabled for 'isr_off_us' and the reading task
+ * is preempted for 'stall_us'; 'period_ms' = 0 turns the load off
+ */
+//==============================================================================================
+void sim_set_stress(sim_modem_t *m, uint32_t period_ms, uint32_t isr_off_us, uint32_t stall_us);
+
+/*
+ * Start sending data frames with 'payload' bytes information field in data mode
+ * At most 'window' frames are sent and not received back (0 for no limit, 1 for ping-pong),
+ * 'count' frames are sent (0 for no limit)
+ */
+//===========================================================================
+void sim_data_start(sim_modem_t *m, int payload, int window, uint32_t count);
+
+/*
+ * Stop sending data frames
+ */
+//=================================
+void sim_data_stop(sim_modem_t *m);
+
+/*
+ * Get the modem statistics, reset them if 'rst' = 1
+ */
+//==============================================================
+void sim_get_stats(sim_modem_t *m, sim_stats_t *stats, int rst);
+
+#endif
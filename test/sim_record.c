@@ -0,0 +1,59 @@
+/*
+ *  Record the libGSM initialization against the simulated modem
+ *
+ *    build/sim_record <file>
+ *
+ *  libGSM connects through the simulated SIM800 (sim_modem.c) with serial recording
+ *  enabled, the recording is saved to <file>. It is used by test_replay to check
+ *  that libGSM still sends the same commands; regenerate it when the command
+ *  sequence is changed on purpose. Recordings of a real modem (gsm_record_save(),
+ *  tools/gsm_rec.py) can be replayed the same way.
+ *
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libGSM.h"
+#include "gsm_serial.h"
+#include "sim_modem.h"
+
+//==============================
+int main(int argc, char *argv[])
+{
+	if (argc != 2) {
+		printf("Usage: %s <file>\n", argv[0]);
+		return 2;
+	}
+
+	sim_config_t scfg;
+	sim_default_config(&scfg);
+	sim_modem_t *sim = sim_create(&scfg);
+	if (sim == NULL) return 1;
+
+	gsm_config_t cfg;
+	gsm_defaultConfig(&cfg);
+	cfg.max_baud_rate = cfg.baud_rate;
+	cfg.rts_pin = -1;
+	cfg.cts_pin = -1;
+	cfg.serial = &sim_serial;
+	cfg.serial_arg = sim;
+	gsm_handle gsm = gsmCreate(&cfg);
+	if (gsm == NULL) return 1;
+
+	if (gsm_record_start(0) == 0) return 1;
+	if (ppposInit(gsm) != 1) {
+		printf("Not connected\n");
+		return 1;
+	}
+	gsm_record_stop();
+
+	int size = gsm_record_save(argv[1]);
+	if (size < 0) {
+		printf("Error saving '%s'\n", argv[1]);
+		return 1;
+	}
+	printf("Recorded %d bytes to '%s'\n", size, argv[1]);
+	// the PPPoS task is still running, exit without disconnecting
+	return 0;
+}
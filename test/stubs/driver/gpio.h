@@ -0,0 +1,19 @@
+/*
+ *  Host test stand-in for ESP-IDF driver/gpio.h, there are no pins on the host
+ *
+*/
+
+#ifndef _DRIVER_GPIO_H_
+#define _DRIVER_GPIO_H_
+
+#include "esp_system.h"
+
+typedef int gpio_num_t;
+
+typedef enum { GPIO_MODE_INPUT = 1, GPIO_MODE_OUTPUT = 2 } gpio_mode_t;
+typedef enum { GPIO_PULLUP_ONLY, GPIO_PULLDOWN_ONLY, GPIO_PULLUP_PULLDOWN, GPIO_FLOATING } gpio_pull_mode_t;
+
+static inline esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode) { return ESP_OK; }
+static inline esp_err_t gpio_set_pull_mode(gpio_num_t pin, gpio_pull_mode_t pull) { return ESP_OK; }
+
+#endif
@@ -0,0 +1,63 @@
+/*
+ *  Host test stand-in for ESP-IDF driver/uart.h
+ *
+ *  There is no UART on the host, libGSM instances use the serial port operations
+ *  (gsm_config_t.serial) of the simulated modem or the replay. The driver functions fail.
+ *
+*/
+
+#ifndef _DRIVER_UART_H_
+#define _DRIVER_UART_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+
+typedef int uart_port_t;
+
+#define UART_NUM_0				0
+#define UART_NUM_1				1
+#define UART_NUM_2				2
+#define UART_PIN_NO_CHANGE		(-1)
+
+typedef enum { UART_DATA_5_BITS, UART_DATA_6_BITS, UART_DATA_7_BITS, UART_DATA_8_BITS } uart_word_length_t;
+typedef enum { UART_PARITY_DISABLE, UART_PARITY_EVEN = 2, UART_PARITY_ODD } uart_parity_t;
+typedef enum { UART_STOP_BITS_1 = 1, UART_STOP_BITS_1_5, UART_STOP_BITS_2 } uart_stop_bits_t;
+typedef enum { UART_HW_FLOWCTRL_DISABLE, UART_HW_FLOWCTRL_RTS, UART_HW_FLOWCTRL_CTS, UART_HW_FLOWCTRL_CTS_RTS } uart_hw_flowcontrol_t;
+
+typedef struct
+{
+	int						baud_rate;
+	uart_word_length_t		data_bits;
+	uart_parity_t			parity;
+	uart_stop_bits_t		stop_bits;
+	uart_hw_flowcontrol_t	flow_ctrl;
+	uint8_t					rx_flow_ctrl_thresh;
+}uart_config_t;
+
+typedef enum
+{
+	UART_DATA, UART_BREAK, UART_BUFFER_FULL, UART_FIFO_OVF, UART_FRAME_ERR, UART_PARITY_ERR,
+	UART_DATA_BREAK, UART_PATTERN_DET, UART_EVENT_MAX
+}uart_event_type_t;
+
+typedef struct
+{
+	uart_event_type_t	type;
+	size_t				size;
+}uart_event_t;
+
+static inline esp_err_t uart_param_config(uart_port_t uart, const uart_config_t *cfg) { return ESP_FAIL; }
+static inline esp_err_t uart_set_pin(uart_port_t uart, int tx, int rx, int rts, int cts) { return ESP_FAIL; }
+static inline esp_err_t uart_driver_install(uart_port_t uart, int rx_size, int tx_size, int queue_size,
+		QueueHandle_t *queue, int flags) { return ESP_FAIL; }
+static inline esp_err_t uart_driver_delete(uart_port_t uart) { return ESP_OK; }
+static inline esp_err_t uart_set_baudrate(uart_port_t uart, uint32_t rate) { return ESP_FAIL; }
+static inline esp_err_t uart_set_hw_flow_ctrl(uart_port_t uart, uart_hw_flowcontrol_t flow, uint8_t thresh) { return ESP_FAIL; }
+static inline esp_err_t uart_flush(uart_port_t uart) { return ESP_OK; }
+static inline esp_err_t uart_wait_tx_done(uart_port_t uart, TickType_t ticks) { return ESP_OK; }
+static inline int uart_read_bytes(uart_port_t uart, uint8_t *buf, uint32_t len, TickType_t ticks) { return -1; }
+static inline int uart_write_bytes(uart_port_t uart, const char *data, size_t len) { return -1; }
+
+#endif
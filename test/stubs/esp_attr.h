@@ -0,0 +1,13 @@
+/*
+ *  Host test stand-in for ESP-IDF esp_attr.h, there is no RTC or IRAM on the host
+ *
+*/
+
+#ifndef _ESP_ATTR_H_
+#define _ESP_ATTR_H_
+
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+
+#endif
@@ -0,0 +1,17 @@
+/*
+ *  Host test stand-in for ESP-IDF esp_heap_caps.h
+ *
+*/
+
+#ifndef _ESP_HEAP_CAPS_H_
+#define _ESP_HEAP_CAPS_H_
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT		0x04
+#define MALLOC_CAP_INTERNAL	0x800
+#define MALLOC_CAP_SPIRAM	0x400
+
+#define heap_caps_malloc(size, caps)	malloc(size)
+
+#endif
@@ -0,0 +1,26 @@
+/*
+ *  Host test stand-in for ESP-IDF esp_log.h
+ *
+ *  Messages go to stderr, the level is set with HOST_LOG environment variable
+ *  (0 none, 1 errors, 2 warnings (default), 3 info, 4 debug)
+ *
+*/
+
+#ifndef _ESP_LOG_H_
+#define _ESP_LOG_H_
+
+#define ESP_LOG_ERROR	1
+#define ESP_LOG_WARN	2
+#define ESP_LOG_INFO	3
+#define ESP_LOG_DEBUG	4
+#define ESP_LOG_VERBOSE	5
+
+void host_log(int level, const char *tag, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOGE(tag, fmt, ...)		host_log(ESP_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)		host_log(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)		host_log(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...)		host_log(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...)		host_log(ESP_LOG_VERBOSE, tag, fmt, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,18 @@
+/*
+ *  Host test stand-in for ESP-IDF esp_system.h
+ *
+*/
+
+#ifndef _ESP_SYSTEM_H_
+#define _ESP_SYSTEM_H_
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK		0
+#define ESP_FAIL	-1
+
+uint32_t esp_random(void);
+
+#endif
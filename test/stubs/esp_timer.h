@@ -0,0 +1,14 @@
+/*
+ *  Host test stand-in for ESP-IDF esp_timer.h
+ *
+*/
+
+#ifndef _ESP_TIMER_H_
+#define _ESP_TIMER_H_
+
+#include <stdint.h>
+
+// Monotonic time in microseconds
+int64_t esp_timer_get_time(void);
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ *  Host test stand-in for FreeRTOS
+ *
+ *  Tasks are POSIX threads, queues and semaphores are built on pthread mutexes
+ *  and condition variables (host_port.c). The tick is one millisecond.
+ *  Statically allocated objects keep the host structures in the caller's buffer,
+ *  static task's stack buffer is not used (the thread has its own stack).
+ *
+*/
+
+#ifndef _FREERTOS_H_
+#define _FREERTOS_H_
+
+#include <stdint.h>
+#include <stdio.h>		// the ESP-IDF FreeRTOS headers include the C library headers too
+#include <stdlib.h>
+#include <pthread.h>
+#include "sdkconfig.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t StackType_t;
+typedef struct host_queue *QueueHandle_t;
+typedef QueueHandle_t SemaphoreHandle_t;
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+typedef pthread_mutex_t portMUX_TYPE;
+// buffers of statically allocated objects, large enough for the host structures
+typedef struct { uint64_t mem[32]; } StaticQueue_t;
+typedef StaticQueue_t StaticSemaphore_t;
+typedef struct { uint64_t mem[32]; } StaticTask_t;
+
+#define pdFALSE					0
+#define pdTRUE					1
+#define pdFAIL					0
+#define pdPASS					1
+#define portMAX_DELAY			0xFFFFFFFFUL
+#define configTICK_RATE_HZ		1000
+#define portTICK_PERIOD_MS		1
+#define portTICK_RATE_MS		portTICK_PERIOD_MS
+#define portNUM_PROCESSORS		2
+#define tskNO_AFFINITY			0x7FFFFFFF
+
+#define portMUX_INITIALIZER_UNLOCKED	PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux)		pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)		pthread_mutex_unlock(mux)
+
+// Queues
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *buf);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait);
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t wait);
+
+// Semaphores
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void);
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buf);
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(StaticSemaphore_t *buf);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem);
+#define vSemaphoreDelete(sem)	vQueueDelete(sem)
+
+// Tasks, only the calling task can be deleted, static tasks can't be deleted
+// priority is the thread's nice value, core the host CPU if there is one; see host_port.h
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+		UBaseType_t priority, TaskHandle_t *task, BaseType_t core);
+#define xTaskCreate(fn, name, stack, arg, priority, task) \
+		xTaskCreatePinnedToCore(fn, name, stack, arg, priority, task, tskNO_AFFINITY)
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+		UBaseType_t priority, StackType_t *stack_buf, StaticTask_t *task_buf, BaseType_t core);
+#define xTaskCreateStatic(fn, name, stack, arg, priority, stack_buf, task_buf) \
+		xTaskCreateStaticPinnedToCore(fn, name, stack, arg, priority, stack_buf, task_buf, tskNO_AFFINITY)
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+BaseType_t xPortGetCoreID(void);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+#endif
@@ -0,0 +1,6 @@
+/*
+ *  Host test stand-in for FreeRTOS task.h, everything is in FreeRTOS.h
+ *
+*/
+
+#include "freertos/FreeRTOS.h"
@@ -0,0 +1,6 @@
+/*
+ *  Host test stand-in for lwIP dns.h, see host_lwip.h
+ *
+*/
+
+#include "lwip/host_lwip.h"
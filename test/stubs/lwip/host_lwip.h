@@ -0,0 +1,97 @@
+/*
+ *  Host test stand-in for the parts of lwIP used by libGSM
+ *
+ *  The tcpip thread, pbufs and the PPP API are emulated in host_port.c: there is no IP stack,
+ *  the PPP link comes up when it is connected and the received frames are counted
+ *  (and optionally sent back, see host_ppp_echo()). Sockets are the host ones.
+ *
+*/
+
+#ifndef _HOST_LWIP_H_
+#define _HOST_LWIP_H_
+
+#include <stdint.h>
+
+typedef uint8_t u8_t;
+typedef int8_t s8_t;
+typedef uint16_t u16_t;
+typedef int16_t s16_t;
+typedef uint32_t u32_t;
+typedef int32_t s32_t;
+typedef s8_t err_t;
+
+#define ERR_OK			0
+#define ERR_MEM			-1
+#define ERR_ARG			-16
+
+#define LWIP_UNUSED_ARG(x)	(void)x
+
+// IPv4 only
+typedef struct
+{
+	u32_t	addr;
+}ip4_addr_t;
+typedef ip4_addr_t ip_addr_t;
+
+#define ip4_addr_get_u32(a)		((a)->addr)
+#define ip_2_ip4(a)				(a)
+#define ip_addr_isany(a)		(((a) == NULL) || ((a)->addr == 0))
+
+char *ipaddr_ntoa(const ip_addr_t *addr);
+
+struct netif
+{
+	ip_addr_t	ip_addr;
+	ip_addr_t	netmask;
+	ip_addr_t	gw;
+	void		*state;
+};
+
+#define netif_ip4_addr(n)		(&(n)->ip_addr)
+
+// pbuf, always a single contiguous buffer
+typedef enum { PBUF_TRANSPORT, PBUF_IP, PBUF_LINK, PBUF_RAW_TX, PBUF_RAW } pbuf_layer;
+typedef enum { PBUF_RAM, PBUF_ROM, PBUF_REF, PBUF_POOL } pbuf_type;
+
+struct pbuf
+{
+	struct pbuf	*next;
+	void		*payload;
+	u16_t		tot_len;
+	u16_t		len;
+};
+
+struct pbuf *pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type);
+u8_t pbuf_free(struct pbuf *p);
+u8_t pbuf_header(struct pbuf *p, s16_t header_size);
+err_t pbuf_take_at(struct pbuf *p, const void *data, u16_t len, u16_t offset);
+void pbuf_put_at(struct pbuf *p, u16_t offset, u8_t data);
+
+// tcpip thread
+typedef void (*tcpip_callback_fn)(void *ctx);
+
+err_t tcpip_callback_with_block(tcpip_callback_fn function, void *ctx, u8_t block);
+
+// statistics
+struct stats_link
+{
+	u32_t	xmit;
+	u32_t	recv;
+	u32_t	drop;
+	u32_t	chkerr;
+	u32_t	memerr;
+};
+
+struct stats_
+{
+	struct stats_link	link;
+};
+
+extern struct stats_ lwip_stats;
+
+#define LINK_STATS_INC(x)				(lwip_stats.x++)
+#define MIB2_STATS_NETIF_INC(n, x)		((void)(n))
+
+const ip_addr_t *dns_getserver(u8_t numdns);
+
+#endif
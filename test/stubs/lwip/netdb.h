@@ -0,0 +1,6 @@
+/*
+ *  Host test stand-in for lwIP netdb.h, the host resolver is used
+ *
+*/
+
+#include <netdb.h>
@@ -0,0 +1,6 @@
+/*
+ *  Host test stand-in for lwIP pppapi.h, see netif/ppp/ppp.h
+ *
+*/
+
+#include "netif/ppp/ppp.h"
@@ -0,0 +1,12 @@
+/*
+ *  Host test stand-in for lwIP sockets.h, the host sockets are used
+ *
+*/
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
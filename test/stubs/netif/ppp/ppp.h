@@ -0,0 +1,67 @@
+/*
+ *  Host test stand-in for lwIP PPP (ppp.h, pppos.h, ppp_impl.h and pppapi.h)
+ *
+ *  There is no PPP negotiation: pppapi_connect() opens the link and reports it up
+ *  from the tcpip thread, frames passed to ppp_input() are counted (host_port.c).
+ *
+*/
+
+#ifndef _HOST_PPP_H_
+#define _HOST_PPP_H_
+
+#include "lwip/host_lwip.h"
+
+#define PPP_IPV4_SUPPORT		1
+#define PPP_IPV6_SUPPORT		0
+#define VJ_SUPPORT				0
+#define PPP_MRU					1500
+#define PPP_ALLSTATIONS			0xFF
+#define PPP_UI					0x03
+
+#define PPPAUTHTYPE_NONE		0x00
+#define PPPAUTHTYPE_PAP			0x01
+
+enum
+{
+	PPPERR_NONE, PPPERR_PARAM, PPPERR_OPEN, PPPERR_DEVICE, PPPERR_ALLOC, PPPERR_USER, PPPERR_CONNECT,
+	PPPERR_AUTHFAIL, PPPERR_PROTOCOL, PPPERR_PEERDEAD, PPPERR_IDLETIMEOUT, PPPERR_CONNECTTIME, PPPERR_LOOPBACK
+};
+
+typedef struct ppp_pcb_s ppp_pcb;
+typedef u32_t (*pppos_output_cb_fn)(ppp_pcb *pcb, u8_t *data, u32_t len, void *ctx);
+typedef void (*ppp_link_status_cb_fn)(ppp_pcb *pcb, int err_code, void *ctx);
+
+typedef struct pppos_pcb_s
+{
+	ppp_pcb				*ppp;
+	pppos_output_cb_fn	output_cb;
+	unsigned int		open :1;
+	u8_t				in_accm[32];	// receive ACCM, one bit per character
+}pppos_pcb;
+
+struct ppp_pcb_s
+{
+	struct netif			*netif;
+	void					*link_ctx_cb;	// pppos_pcb
+	ppp_link_status_cb_fn	link_status_cb;
+	void					*ctx_cb;
+	pppos_pcb				pppos;
+	u32_t					in_frames;		// frames passed to ppp_input()
+	u32_t					in_bytes;
+	u32_t					out_frames;		// frames sent by the echo peer
+	u32_t					out_bytes;
+	u32_t					last_xmit;		// tick of the last sent frame
+};
+
+#define ppp_netif(ppp)			((ppp)->netif)
+
+ppp_pcb *pppapi_pppos_create(struct netif *pppif, pppos_output_cb_fn output_cb,
+		ppp_link_status_cb_fn link_status_cb, void *ctx_cb);
+err_t pppapi_set_default(ppp_pcb *pcb);
+void pppapi_set_auth(ppp_pcb *pcb, u8_t authtype, const char *user, const char *passwd);
+err_t pppapi_connect(ppp_pcb *pcb, u16_t holdoff);
+err_t pppapi_close(ppp_pcb *pcb, u8_t nocarrier);
+err_t ppp_free(ppp_pcb *pcb);
+void ppp_input(ppp_pcb *pcb, struct pbuf *pb);
+
+#endif
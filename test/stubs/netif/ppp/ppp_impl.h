@@ -0,0 +1,6 @@
+/*
+ *  Host test stand-in for lwIP ppp_impl.h, see ppp.h
+ *
+*/
+
+#include "netif/ppp/ppp.h"
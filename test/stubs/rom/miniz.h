@@ -0,0 +1,91 @@
+/*
+ *  Host test stand-in for the ESP32 ROM miniz inflater
+ *
+ *  Implements the tinfl_decompress() subset used by http_stream.c on top of zlib,
+ *  so the streaming reader can be tested on the host. As tinfl, the decoder can refer back
+ *  only as far as the wrapping output buffer size: zlib's window is set to it, data referring
+ *  further back fails (tinfl would output wrong data).
+ *
+*/
+
+#ifndef _ROM_MINIZ_H_
+#define _ROM_MINIZ_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <zlib.h>
+
+typedef uint8_t mz_uint8;
+typedef uint32_t mz_uint32;
+
+#define TINFL_LZ_DICT_SIZE 32768
+
+enum
+{
+	TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+	TINFL_FLAG_HAS_MORE_INPUT = 2,
+	TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+	TINFL_FLAG_COMPUTE_ADLER32 = 8
+};
+
+typedef enum
+{
+	TINFL_STATUS_BAD_PARAM = -3,
+	TINFL_STATUS_ADLER32_MISMATCH = -2,
+	TINFL_STATUS_FAILED = -1,
+	TINFL_STATUS_DONE = 0,
+	TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+	TINFL_STATUS_HAS_MORE_OUTPUT = 2
+}tinfl_status;
+
+typedef struct
+{
+	int			state;		// 0: not initialized, 1: inflating, 2: finished
+	z_stream	zs;
+}tinfl_decompressor;
+
+#define tinfl_init(r) do { (r)->state = 0; } while (0)
+
+//--------------------------------------------------------------------------------------------------------------------
+static inline tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_buf_next, size_t *pIn_buf_size,
+		mz_uint8 *pOut_buf_start, mz_uint8 *pOut_buf_next, size_t *pOut_buf_size, const mz_uint32 decomp_flags)
+{
+	if (r->state == 2) {
+		*pIn_buf_size = 0;
+		*pOut_buf_size = 0;
+		return TINFL_STATUS_DONE;
+	}
+	if (r->state == 0) {
+		// window of the wrapping output buffer size, a power of two
+		size_t size = (pOut_buf_next - pOut_buf_start) + *pOut_buf_size;
+		int wbits = 8;
+		while ((wbits < 15) && (((size_t)1 << wbits) < size)) wbits++;
+		if (((size_t)1 << wbits) != size) return TINFL_STATUS_BAD_PARAM;
+		memset(&r->zs, 0, sizeof(z_stream));
+		if (inflateInit2(&r->zs, (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? wbits : -wbits) != Z_OK) return TINFL_STATUS_BAD_PARAM;
+		r->state = 1;
+	}
+
+	r->zs.next_in = (Bytef *)pIn_buf_next;
+	r->zs.avail_in = *pIn_buf_size;
+	r->zs.next_out = pOut_buf_next;
+	r->zs.avail_out = *pOut_buf_size;
+	int res = inflate(&r->zs, Z_NO_FLUSH);
+	*pIn_buf_size -= r->zs.avail_in;
+	*pOut_buf_size -= r->zs.avail_out;
+
+	if (res == Z_STREAM_END) {
+		inflateEnd(&r->zs);
+		r->state = 2;
+		return TINFL_STATUS_DONE;
+	}
+	if ((res != Z_OK) && (res != Z_BUF_ERROR)) {
+		inflateEnd(&r->zs);
+		r->state = 2;
+		return (res == Z_DATA_ERROR) ? TINFL_STATUS_FAILED : TINFL_STATUS_BAD_PARAM;
+	}
+	return (r->zs.avail_out == 0) ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
+
+#endif
@@ -0,0 +1,21 @@
+/*
+ *  Host test configuration, replaces the sdkconfig.h generated by 'make menuconfig'
+ *
+*/
+
+#ifndef _SDKCONFIG_H_
+#define _SDKCONFIG_H_
+
+#define CONFIG_GSM_HTTP_COMPRESSION 1
+
+// libGSM, the modem is simulated (sim_modem.c) or replayed, the UART settings are not used
+#define CONFIG_GSM_TX 17
+#define CONFIG_GSM_RX 16
+#define CONFIG_GSM_BDRATE 115200
+#define CONFIG_GSM_APN "internet"
+#define CONFIG_GSM_INTERNET_USER ""
+#define CONFIG_GSM_INTERNET_PASSWORD ""
+#define CONFIG_GSM_MAX_MODEMS 2
+#define CONFIG_GSM_SERIAL_RECORD 1
+
+#endif
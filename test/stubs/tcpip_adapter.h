@@ -0,0 +1,12 @@
+/*
+ *  Host test stand-in for ESP-IDF tcpip_adapter.h
+ *
+*/
+
+#ifndef _TCPIP_ADAPTER_H_
+#define _TCPIP_ADAPTER_H_
+
+// Starts the tcpip thread of the host lwIP stand-in (host_port.c)
+void tcpip_adapter_init(void);
+
+#endif
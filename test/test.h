@@ -0,0 +1,31 @@
+/*
+ *  Minimal host test helpers
+ *
+*/
+
+#ifndef _TEST_H_
+#define _TEST_H_
+
+#include <stdio.h>
+
+static int test_checks = 0;
+static int test_failures = 0;
+
+#define CHECK(cond) do { \
+	test_checks++; \
+	if (!(cond)) { \
+		test_failures++; \
+		printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+	} \
+} while (0)
+
+#define RUN(test) do { \
+	int f = test_failures; \
+	test(); \
+	printf("%s %s\n", (test_failures == f) ? "PASS" : "FAIL", #test); \
+} while (0)
+
+#define TEST_RESULT() \
+	(printf("%d checks, %d failed\n", test_checks, test_failures), (test_failures) ? 1 : 0)
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ *  Host test of libGSM heap allocations after initialization
+ *
+ *  libGSM connects to the simulated SIM800, then the allocation counter (gsm_GetAllocCount())
+ *  is reset and the instance is disconnected and reconnected, the PPPoS task ended and started
+ *  again, AT commands, SMS read and RF off/on run while disconnected.
+ *  Built with CONFIG_GSM_STATIC_ALLOC (test_alloc_static) no allocation may be made after gsmCreate(),
+ *  without it (test_alloc) the allocations must be counted.
+ *
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "test.h"
+#include "libGSM.h"
+#include "sim_modem.h"
+
+
+//---------------------------------
+static void test_alloc_after_init()
+{
+	sim_config_t scfg;
+	sim_default_config(&scfg);
+	sim_modem_t *sim = sim_create(&scfg);
+	CHECK(sim != NULL);
+	if (sim == NULL) return;
+
+	gsm_config_t cfg;
+	gsm_defaultConfig(&cfg);
+	cfg.max_baud_rate = cfg.baud_rate;
+	cfg.rts_pin = -1;
+	cfg.cts_pin = -1;
+	cfg.serial = &sim_serial;
+	cfg.serial_arg = sim;
+	gsm_handle gsm = gsmCreate(&cfg);
+	CHECK(gsm != NULL);
+	if (gsm == NULL) return;
+
+	CHECK(ppposInit(gsm) == 1);
+	uint32_t init_allocs = gsm_GetAllocCount(1);
+
+	// Disconnect, AT commands in command mode, reconnect
+	ppposDisconnect(gsm, 0, 0);
+	CHECK(ppposStatus(gsm) == GSM_STATE_IDLE);
+	char resp[64];
+	CHECK(gsm_atCommand(gsm, "AT+CFUN?", NULL, 1000, resp, sizeof(resp)) == GSM_AT_OK);
+	CHECK(strstr(resp, "+CFUN: 1") != NULL);
+	SMS_Messages msgs;
+	memset(&msgs, 0, sizeof(SMS_Messages));
+	smsRead(gsm, &msgs, 0);
+	smsFree(&msgs);
+	CHECK(gsm_RFOff(gsm) == 1);
+	CHECK(gsm_RFOn(gsm) == 1);
+	CHECK(ppposInit(gsm) == 1);
+
+	// End the task and start it again
+	ppposDisconnect(gsm, 1, 0);
+	CHECK(ppposInit(gsm) == 1);
+
+	gsm_metrics_t m;
+	gsm_GetMetrics(gsm, &m, 0);
+	CHECK(m.connects == 3);
+
+	uint32_t allocs = gsm_GetAllocCount(0);
+	printf("  %u allocations to connect, %u after\n", init_allocs, allocs);
+	#ifdef CONFIG_GSM_STATIC_ALLOC
+	CHECK(allocs == 0);
+	#else
+	CHECK(init_allocs > 0);
+	CHECK(allocs > 0);
+	#endif
+	// the PPPoS task is left running
+}
+
+//========
+int main()
+{
+	RUN(test_alloc_after_init);
+	return TEST_RESULT();
+}
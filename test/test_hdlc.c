@@ -0,0 +1,210 @@
+/*
+ *  Host tests of the HDLC framing kernel (components/pppos/hdlc.c)
+ *
+ *  Random frames are escaped as the peer sends them and fed to the
+ *  deframer in random block sizes at random alignments, the results are
+ *  compared with a bitwise FCS-16 reference and the original frames.
+ *
+*/
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "test.h"
+#include "hdlc.h"
+
+#define MAX_FRAMES	64
+#define FRAME_MAX	1600
+
+typedef struct
+{
+	uint8_t		data[MAX_FRAMES][FRAME_MAX];
+	int			len[MAX_FRAMES];
+	int			count;
+}frames_t;
+
+
+// Bitwise FCS-16 (RFC 1662)
+//----------------------------------------------------------------
+static uint16_t ref_fcs16(uint16_t fcs, const uint8_t *data, int len)
+{
+	for (int i=0; i<len; i++) {
+		fcs ^= data[i];
+		for (int b=0; b<8; b++) fcs = (fcs & 1) ? ((fcs >> 1) ^ 0x8408) : (fcs >> 1);
+	}
+	return fcs;
+}
+
+// Append the frame with FCS, escaped as by the sender, characters in 'accm' are escaped too
+//-------------------------------------------------------------------------------------------
+static int escape_frame(uint8_t *out, const uint8_t *frame, int len, uint32_t accm, int bad_fcs)
+{
+	uint8_t buf[FRAME_MAX + 2];
+	memcpy(buf, frame, len);
+	uint16_t fcs = ref_fcs16(HDLC_INITFCS, frame, len) ^ 0xFFFF;
+	if (bad_fcs) fcs ^= 0x0100;
+	buf[len] = fcs & 0xFF;
+	buf[len+1] = fcs >> 8;
+
+	int n = 0;
+	for (int i=0; i<len+2; i++) {
+		uint8_t c = buf[i];
+		if ((c == HDLC_FLAG) || (c == HDLC_ESCAPE) || ((c < 0x20) && (accm & (1UL << c)))) {
+			out[n++] = HDLC_ESCAPE;
+			c ^= HDLC_TRANS;
+		}
+		out[n++] = c;
+		// control character inserted by the link, must be discarded
+		if ((accm & 1) && ((rand() % 50) == 0)) out[n++] = 0x00;
+	}
+	out[n++] = HDLC_FLAG;
+	return n;
+}
+
+//---------------------------------------------------
+static void on_frame(void *arg, uint8_t *frame, int len)
+{
+	frames_t *f = (frames_t *)arg;
+	if (f->count >= MAX_FRAMES) return;
+	memcpy(f->data[f->count], frame, len);
+	f->len[f->count] = len;
+	f->count++;
+}
+
+// Random frame, biased to contain the special characters
+//-------------------------------------------------------
+static int random_frame(uint8_t *frame, int max_len)
+{
+	static const uint8_t special[] = {HDLC_FLAG, HDLC_ESCAPE, 0x00, 0x11, 0x13, 0x1F, 0x20, 0x5E, 0x5D};
+	int len = 2 + (rand() % (max_len - 1));
+	int mode = rand() % 3;
+	for (int i=0; i<len; i++) {
+		if ((mode == 0) && ((rand() % 8) == 0)) frame[i] = special[rand() % sizeof(special)];
+		else if (mode == 1) frame[i] = 0x20 + (rand() % 0x5D);
+		else frame[i] = rand();
+	}
+	return len;
+}
+
+//======================
+static void test_fcs16()
+{
+	static uint8_t buf[4096 + 3];
+	for (int i=0; i<(int)sizeof(buf); i++) buf[i] = rand();
+
+	for (int n=0; n<200; n++) {
+		int off = rand() % 4;
+		int len = rand() % 4096;
+		CHECK(hdlc_fcs16(HDLC_INITFCS, buf + off, len) == ref_fcs16(HDLC_INITFCS, buf + off, len));
+	}
+	// data with its FCS appended gives the good FCS
+	uint16_t fcs = ref_fcs16(HDLC_INITFCS, buf, 100) ^ 0xFFFF;
+	buf[100] = fcs & 0xFF;
+	buf[101] = fcs >> 8;
+	CHECK(hdlc_fcs16(HDLC_INITFCS, buf, 102) == HDLC_GOODFCS);
+}
+
+// Deframe random frames in random blocks, with and without ACCM
+//=======================
+static void test_deframe()
+{
+	static uint8_t stream[MAX_FRAMES * (FRAME_MAX * 2 + 8) + 4];
+	static uint8_t sent[MAX_FRAMES][FRAME_MAX];
+	static frames_t rcvd;
+	static uint8_t fbuf[FRAME_MAX];
+	int sent_len[MAX_FRAMES];
+	int bad[MAX_FRAMES];
+
+	for (int run=0; run<200; run++) {
+		uint32_t accm = (run & 1) ? 0xFFFFFFFF : ((run & 2) ? 0x000A0001 : 0);
+		int nframes = 1 + (rand() % MAX_FRAMES);
+		int nbad = 0;
+		int slen = 0;
+		int off = rand() % 4;
+		uint8_t *s = stream + off;
+
+		s[slen++] = HDLC_FLAG;
+		for (int i=0; i<nframes; i++) {
+			sent_len[i] = random_frame(sent[i], (rand() % 4) ? 64 : 1500);
+			bad[i] = ((rand() % 10) == 0);
+			nbad += bad[i];
+			slen += escape_frame(s + slen, sent[i], sent_len[i], accm, bad[i]);
+			// shared flag or an extra flag between the frames
+			if (rand() % 2) s[slen++] = HDLC_FLAG;
+		}
+
+		hdlc_rx_t rx;
+		hdlc_rx_init(&rx, fbuf, sizeof(fbuf));
+		rx.accm = accm;
+		rcvd.count = 0;
+		uint32_t frames = 0, errors = 0, bytes = 0;
+		int pos = 0;
+		while (pos < slen) {
+			int n = 1 + (rand() % ((rand() % 2) ? 7 : 700));
+			if (n > (slen - pos)) n = slen - pos;
+			hdlc_deframe(&rx, s + pos, n, on_frame, &rcvd, &frames, &errors, &bytes);
+			pos += n;
+		}
+
+		CHECK(frames == nframes);
+		CHECK(errors == nbad);
+		CHECK(rcvd.count == (nframes - nbad));
+		uint32_t total = 0;
+		int r = 0;
+		for (int i=0; i<nframes; i++) {
+			total += sent_len[i] + 2;
+			if (bad[i]) continue;
+			CHECK((rcvd.len[r] == sent_len[i]) && (memcmp(rcvd.data[r], sent[i], sent_len[i]) == 0));
+			r++;
+		}
+		CHECK(bytes == total);
+
+		// hdlc_scan() counts the same (without ACCM)
+		if (accm == 0) {
+			hdlc_state_t st;
+			uint32_t sframes = 0, serrors = 0, sbytes = 0;
+			hdlc_reset(&st);
+			hdlc_scan(&st, s, slen, &sframes, &serrors, &sbytes);
+			CHECK((sframes == frames) && (serrors == errors) && (sbytes == bytes));
+		}
+	}
+}
+
+// Frames longer than the buffer are dropped and counted as errors
+//=========================
+static void test_overflow()
+{
+	static uint8_t stream[8192];
+	static frames_t rcvd;
+	uint8_t frame[1000];
+	uint8_t fbuf[256];
+
+	for (int i=0; i<(int)sizeof(frame); i++) frame[i] = i;
+	int slen = 0;
+	stream[slen++] = HDLC_FLAG;
+	slen += escape_frame(stream + slen, frame, 100, 0, 0);
+	slen += escape_frame(stream + slen, frame, 1000, 0, 0);
+	slen += escape_frame(stream + slen, frame, 254, 0, 0);
+	slen += escape_frame(stream + slen, frame, 255, 0, 0);
+
+	hdlc_rx_t rx;
+	hdlc_rx_init(&rx, fbuf, sizeof(fbuf));
+	rx.accm = 0;
+	rcvd.count = 0;
+	uint32_t frames = 0, errors = 0, bytes = 0;
+	hdlc_deframe(&rx, stream, slen, on_frame, &rcvd, &frames, &errors, &bytes);
+	CHECK(frames == 4);
+	CHECK(errors == 2);
+	CHECK((rcvd.count == 2) && (rcvd.len[0] == 100) && (rcvd.len[1] == 254));
+	CHECK(memcmp(rcvd.data[1], frame, 254) == 0);
+}
+
+//========
+int main()
+{
+	srand(1662);
+	RUN(test_fcs16);
+	RUN(test_deframe);
+	RUN(test_overflow);
+	return TEST_RESULT();
+}
@@ -0,0 +1,302 @@
+/*
+ *  Host tests of the streaming HTTP response reader (main/http_stream.c)
+ *
+ *  The response is read from memory in blocks of different sizes, so the
+ *  header lines, chunk framing and compressed data are split at every position.
+ *
+*/
+
+#include <string.h>
+#include <stdlib.h>
+#include <zlib.h>
+
+#include "test.h"
+#include "http_stream.h"
+
+typedef struct
+{
+	const char	*data;
+	int			len;
+	int			pos;
+	int			block;		// max bytes returned by one read
+}mem_reader_t;
+
+typedef struct
+{
+	char	buf[65536];
+	int		len;
+}body_t;
+
+static const int blocks[] = {1, 2, 3, 7, 64, 1460};
+#define NBLOCKS	(sizeof(blocks) / sizeof(int))
+
+
+//------------------------------------------------
+static int mem_read(void *ctx, char *buf, int len)
+{
+	mem_reader_t *r = (mem_reader_t *)ctx;
+	int n = r->len - r->pos;
+	if (n > r->block) n = r->block;
+	if (n > len) n = len;
+	memcpy(buf, r->data + r->pos, n);
+	r->pos += n;
+	return n;
+}
+
+//-------------------------------------------------------
+static int body_add(void *arg, const char *data, int len)
+{
+	body_t *b = (body_t *)arg;
+	if ((b->len + len) > (int)sizeof(b->buf)) return 1;
+	memcpy(b->buf + b->len, data, len);
+	b->len += len;
+	return 0;
+}
+
+// Read the response with the given read block size
+//-------------------------------------------------------------------------------------------------
+static int read_response(const char *data, int len, int block, http_response_t *resp, body_t *body)
+{
+	mem_reader_t r = { data, len, 0, block };
+	body->len = 0;
+	return http_read_response(mem_read, &r, resp, body_add, body);
+}
+
+// Build the response with the given header and binary body
+//----------------------------------------------------------------------------------------
+static int make_response(char *out, const char *header, const uint8_t *body, int body_len)
+{
+	int len = strlen(header);
+	memcpy(out, header, len);
+	memcpy(out + len, body, body_len);
+	return len + body_len;
+}
+
+// Compress with zlib, 'wbits' selects the format: 31 gzip, 15 zlib, -15 raw deflate
+//-----------------------------------------------------------------------------------------
+static int compress_data(const char *in, int in_len, uint8_t *out, int out_size, int wbits)
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, 9, Z_DEFLATED, wbits, 8, Z_DEFAULT_STRATEGY) != Z_OK) return -1;
+	zs.next_in = (Bytef *)in;
+	zs.avail_in = in_len;
+	zs.next_out = out;
+	zs.avail_out = out_size;
+	int res = deflate(&zs, Z_FINISH);
+	int len = out_size - zs.avail_out;
+	deflateEnd(&zs);
+	return (res == Z_STREAM_END) ? len : -1;
+}
+
+//----------------------------
+static const char *test_text()
+{
+	static char text[20000];
+	if (text[0] == '\0') {
+		int len = 0;
+		for (int i=0; len < (int)sizeof(text) - 64; i++) {
+			len += sprintf(text + len, "line %d: the quick brown fox jumps over the lazy dog\n", i);
+		}
+	}
+	return text;
+}
+
+//===============================
+static void test_content_length()
+{
+	const char *rsp = "HTTP/1.1 200 OK\r\nContent-Length: 11\r\nConnection: keep-alive\r\n\r\nhello worldEXTRA";
+	http_response_t resp;
+	body_t body;
+
+	for (int i=0; i<NBLOCKS; i++) {
+		CHECK(read_response(rsp, strlen(rsp), blocks[i], &resp, &body) == 0);
+		CHECK(resp.status == 200);
+		CHECK(resp.content_length == 11);
+		CHECK((body.len == 11) && (memcmp(body.buf, "hello world", 11) == 0));
+		CHECK(strstr(resp.header, "Connection: keep-alive") != NULL);
+	}
+}
+
+//========================
+static void test_chunked()
+{
+	const char *rsp = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+			"5\r\nhello\r\n1;ext=1\r\n \r\n5\r\nworld\r\n0\r\nX-Trailer: 1\r\n\r\n";
+	http_response_t resp;
+	body_t body;
+
+	for (int i=0; i<NBLOCKS; i++) {
+		CHECK(read_response(rsp, strlen(rsp), blocks[i], &resp, &body) == 0);
+		CHECK(resp.chunked == 1);
+		CHECK((body.len == 11) && (memcmp(body.buf, "hello world", 11) == 0));
+	}
+
+	const char *bad = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhelloX\r\n0\r\n\r\n";
+	CHECK(read_response(bad, strlen(bad), 1460, &resp, &body) == HTTP_ERR_CHUNK);
+	const char *cut = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhel";
+	CHECK(read_response(cut, strlen(cut), 1460, &resp, &body) == HTTP_ERR_READ);
+}
+
+// Framing headers after the stored header size must still be used
+//============================
+static void test_long_header()
+{
+	static char rsp[4096];
+	char cookie[100];
+	memset(cookie, 'c', sizeof(cookie)-1);
+	cookie[sizeof(cookie)-1] = '\0';
+	int len = sprintf(rsp, "HTTP/1.1 200 OK\r\nServer: test\r\n");
+	for (int i=0; i<8; i++) len += sprintf(rsp + len, "Set-Cookie: c%d=%s\r\n", i, cookie);
+	sprintf(rsp + len, "Content-Length: 4\r\n\r\nbodyGARBAGE");
+	http_response_t resp;
+	body_t body;
+
+	for (int i=0; i<NBLOCKS; i++) {
+		CHECK(read_response(rsp, strlen(rsp), blocks[i], &resp, &body) == 0);
+		CHECK(resp.content_length == 4);
+		CHECK((body.len == 4) && (memcmp(body.buf, "body", 4) == 0));
+		CHECK(strlen(resp.header) < HTTP_HEADER_MAX);
+		CHECK(strstr(resp.header, "Server: test") != NULL);
+	}
+}
+
+//========================
+static void test_no_body()
+{
+	const char *rsp = "HTTP/1.1 204 No Content\r\nContent-Length: 5\r\n\r\n";
+	const char *eof = "HTTP/1.0 200 OK\r\n\r\nuntil closed";
+	http_response_t resp;
+	body_t body;
+
+	CHECK(read_response(rsp, strlen(rsp), 1460, &resp, &body) == 0);
+	CHECK((resp.status == 204) && (body.len == 0));
+	CHECK(read_response(eof, strlen(eof), 3, &resp, &body) == 0);
+	CHECK((body.len == 12) && (memcmp(body.buf, "until closed", 12) == 0));
+	CHECK(read_response("HTTX/1.1 200\r\n\r\n", 16, 1460, &resp, &body) == HTTP_ERR_HEADER);
+}
+
+//=====================
+static void test_gzip()
+{
+	static uint8_t z[32768];
+	static char rsp[40000];
+	const char *text = test_text();
+	int tlen = strlen(text);
+	http_response_t resp;
+	body_t body;
+	char hdr[128];
+
+	int zlen = compress_data(text, tlen, z, sizeof(z), 31);
+	CHECK(zlen > 0);
+	sprintf(hdr, "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nContent-Length: %d\r\n\r\n", zlen);
+	int len = make_response(rsp, hdr, z, zlen);
+
+	for (int i=0; i<NBLOCKS; i++) {
+		CHECK(read_response(rsp, len, blocks[i], &resp, &body) == 0);
+		CHECK(resp.encoding == HTTP_ENC_GZIP);
+		CHECK((int)resp.body_bytes == zlen);
+		CHECK((int)resp.decoded_bytes == tlen);
+		CHECK((body.len == tlen) && (memcmp(body.buf, text, tlen) == 0));
+	}
+
+	// Corrupted CRC32 in the trailer
+	rsp[len - 8] ^= 0x01;
+	CHECK(read_response(rsp, len, 1460, &resp, &body) == HTTP_ERR_INFLATE);
+	rsp[len - 8] ^= 0x01;
+	// Wrong ISIZE
+	rsp[len - 1] ^= 0x01;
+	CHECK(read_response(rsp, len, 1460, &resp, &body) == HTTP_ERR_INFLATE);
+	rsp[len - 1] ^= 0x01;
+
+	// Wrong magic and compression method
+	int hlen = strlen(hdr);
+	rsp[hlen + 1] = 0x8C;
+	CHECK(read_response(rsp, len, 1460, &resp, &body) == HTTP_ERR_INFLATE);
+	rsp[hlen + 1] = 0x8B;
+	rsp[hlen + 2] = 7;
+	CHECK(read_response(rsp, len, 1460, &resp, &body) == HTTP_ERR_INFLATE);
+	rsp[hlen + 2] = 8;
+
+	// Trailer missing, the body ends with the connection close
+	sprintf(hdr, "HTTP/1.0 200 OK\r\nContent-Encoding: gzip\r\n\r\n");
+	len = make_response(rsp, hdr, z, zlen - 4);
+	CHECK(read_response(rsp, len, 1460, &resp, &body) == HTTP_ERR_INFLATE);
+}
+
+//========================
+static void test_deflate()
+{
+	static uint8_t z[32768];
+	static char rsp[40000];
+	const char *text = test_text();
+	int tlen = strlen(text);
+	http_response_t resp;
+	body_t body;
+	char hdr[128];
+
+	// zlib wrapped and raw deflate data are both accepted
+	int wbits[2] = {15, -15};
+	for (int w=0; w<2; w++) {
+		int zlen = compress_data(text, tlen, z, sizeof(z), wbits[w]);
+		CHECK(zlen > 0);
+		sprintf(hdr, "HTTP/1.1 200 OK\r\nContent-Encoding: deflate\r\nContent-Length: %d\r\n\r\n", zlen);
+		int len = make_response(rsp, hdr, z, zlen);
+
+		for (int i=0; i<NBLOCKS; i++) {
+			CHECK(read_response(rsp, len, blocks[i], &resp, &body) == 0);
+			CHECK(resp.encoding == HTTP_ENC_DEFLATE);
+			CHECK((body.len == tlen) && (memcmp(body.buf, text, tlen) == 0));
+		}
+
+		// Truncated stream
+		sprintf(hdr, "HTTP/1.1 200 OK\r\nContent-Encoding: deflate\r\nContent-Length: %d\r\n\r\n", zlen / 2);
+		len = make_response(rsp, hdr, z, zlen / 2);
+		CHECK(read_response(rsp, len, 1460, &resp, &body) == HTTP_ERR_INFLATE);
+	}
+}
+
+// The second half of the data repeats the first one, 24 KB back, the full deflate window is used
+//=======================
+static void test_window()
+{
+	static char data[49152];
+	static uint8_t z[65536];
+	static char rsp[66000];
+	http_response_t resp;
+	body_t body;
+	char hdr[128];
+
+	// incompressible (pseudo random) first half
+	uint32_t seed = 1;
+	for (int i=0; i<(int)sizeof(data)/2; i++) {
+		seed = (seed * 1103515245) + 12345;
+		data[i] = seed >> 16;
+	}
+	memcpy(data + sizeof(data)/2, data, sizeof(data)/2);
+
+	// gzip, zlib wrapped and raw deflate
+	int wbits[3] = {31, 15, -15};
+	for (int w=0; w<3; w++) {
+		int zlen = compress_data(data, sizeof(data), z, sizeof(z), wbits[w]);
+		CHECK((zlen > 0) && (zlen < (int)sizeof(data)*2/3));
+		sprintf(hdr, "HTTP/1.1 200 OK\r\nContent-Encoding: %s\r\nContent-Length: %d\r\n\r\n",
+				(w == 0) ? "gzip" : "deflate", zlen);
+		int len = make_response(rsp, hdr, z, zlen);
+		CHECK(read_response(rsp, len, 1460, &resp, &body) == 0);
+		CHECK((body.len == (int)sizeof(data)) && (memcmp(body.buf, data, sizeof(data)) == 0));
+	}
+}
+
+//========
+int main()
+{
+	RUN(test_content_length);
+	RUN(test_chunked);
+	RUN(test_long_header);
+	RUN(test_no_body);
+	RUN(test_gzip);
+	RUN(test_deflate);
+	RUN(test_window);
+	return TEST_RESULT();
+}
@@ -0,0 +1,89 @@
+/*
+ *  Host tests of the connection metrics (components/pppos/gsm_metrics.c)
+ *
+*/
+
+#include <string.h>
+#include <stdint.h>
+
+#include "test.h"
+#include "gsm_metrics.h"
+
+
+//==========================
+static void test_histogram()
+{
+	gsm_hist_t h;
+	memset(&h, 0, sizeof(h));
+
+	CHECK(gsm_hist_percentile(&h, 50) == 0);
+	gsm_hist_add(&h, 0);
+	gsm_hist_add(&h, 1);
+	gsm_hist_add(&h, 100);
+	gsm_hist_add(&h, 5000);
+	CHECK((h.count == 4) && (h.min == 0) && (h.max == 5000) && (h.sum == 5101));
+	CHECK((h.bucket[0] == 1) && (h.bucket[1] == 1) && (h.bucket[7] == 1) && (h.bucket[13] == 1));
+	CHECK(gsm_hist_percentile(&h, 50) == 1);
+	CHECK(gsm_hist_percentile(&h, 75) == 127);
+	CHECK(gsm_hist_percentile(&h, 100) == 5000);
+
+	// values above the last bucket limit
+	gsm_hist_add(&h, 0xFFFFFFFF);
+	CHECK(h.bucket[GSM_HIST_BUCKETS-1] == 1);
+	CHECK(gsm_hist_percentile(&h, 100) == 0xFFFFFFFF);
+}
+
+// JSON of the metrics with all values at max must fit into GSM_METRICS_JSON_MAX
+//=========================
+static void test_json_max()
+{
+	gsm_metrics_t m;
+	static char buf[GSM_METRICS_JSON_MAX + 256];
+
+	memset(&m, 0xFF, sizeof(m));
+	gsm_hist_t *hist[GSM_METRICS_HIST_NUM] = {&m.at_latency, &m.init_time, &m.connect_time, &m.session_time,
+			&m.at_queue_time, &m.reg_time, &m.recover_time};
+	for (int i=0; i<GSM_METRICS_HIST_NUM; i++) CHECK(hist[i]->sum == UINT64_MAX);
+
+	int len = gsm_metrics_toJSON(&m, buf, GSM_METRICS_JSON_MAX);
+	CHECK(len > 0);
+	CHECK(len == (int)strlen(buf));
+	CHECK(len < GSM_METRICS_JSON_MAX);
+	printf("  max JSON length %d, GSM_METRICS_JSON_MAX %d\n", len, GSM_METRICS_JSON_MAX);
+	CHECK((buf[0] == '{') && (buf[len-1] == '}'));
+
+	// too small buffer is reported
+	CHECK(gsm_metrics_toJSON(&m, buf, len) == 0);
+	CHECK(gsm_metrics_toJSON(&m, buf, len+1) == len);
+}
+
+//=====================
+static void test_pack()
+{
+	gsm_metrics_t m;
+	uint8_t buf[2048];
+
+	memset(&m, 0, sizeof(m));
+	gsm_hist_add(&m.at_latency, 100);
+	m.reconnects = 0x01020304;
+
+	int len = gsm_metrics_pack(&m, buf, sizeof(buf));
+	// header, histograms with used buckets, counters and disconnect counters
+	int hist_len = (GSM_METRICS_HIST_NUM * 21) + (8 * 4);
+	CHECK(len == 4 + hist_len + 1 + (GSM_METRICS_CNT_NUM * 4) + 1 + (GSM_METRICS_ERR_NUM * 4));
+	CHECK((buf[0] == 'G') && (buf[1] == 'M') && (buf[2] == GSM_METRICS_VERSION) && (buf[3] == GSM_METRICS_HIST_NUM));
+	// reconnects is the last counter
+	uint8_t *pcnt = buf + 4 + hist_len;
+	CHECK(pcnt[0] == GSM_METRICS_CNT_NUM);
+	CHECK(memcmp(pcnt + 1 + ((GSM_METRICS_CNT_NUM-1) * 4), "\x04\x03\x02\x01", 4) == 0);
+	CHECK(gsm_metrics_pack(&m, buf, len-1) == 0);
+}
+
+//========
+int main()
+{
+	RUN(test_histogram);
+	RUN(test_json_max);
+	RUN(test_pack);
+	return TEST_RESULT();
+}
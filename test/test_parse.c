@@ -0,0 +1,265 @@
+/*
+ *  Host tests of the modem response parsers (components/pppos/gsm_parse.c)
+ *
+ *  Unsolicited result code classification with and without the waiting command,
+ *  registration lines in URC and response form, modem time strings, AT+CMGL dumps and
+ *  PDP contexts in AT+CGDCONT? response.
+ *
+*/
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "test.h"
+#include "gsm_parse.h"
+
+static const char *cmgl_dump =
+	"\r\n+CMGL: 1,\"REC READ\",\"+385911234567\",\"\",\"26/10/17,09:15:02+08\"\r\n"
+	"First message\r\n"
+	"+CMGL: 4,\"REC UNREAD\",\"+385917654321\",,\"26/10/18,21:40:59-16\"\r\n"
+	"Second, with \"quotes\"\r\n"
+	"+CMGL: 12,\"STO SENT\",\"123\",\"\",\"26/10/18,07:00:00+00\"\r\n"
+	"\r\n"
+	"\r\nOK\r\n";
+
+
+//--------------------
+static void test_urc()
+{
+	// no command waiting
+	CHECK(gsm_parseURC("RING", NULL) == GSM_URC_RING);
+	CHECK(gsm_parseURC("NO CARRIER", NULL) == GSM_URC_NOCARRIER);
+	CHECK(gsm_parseURC("+CREG: 1,\"1A2B\",\"00C3\"", NULL) == GSM_URC_REG);
+	CHECK(gsm_parseURC("+CEREG: 5", NULL) == GSM_URC_REG);
+	CHECK(gsm_parseURC("+CMTI: \"SM\",3", NULL) == GSM_URC_SMS);
+	CHECK(gsm_parseURC("+CPIN: NOT READY", NULL) == GSM_URC_SIM);
+	CHECK(gsm_parseURC("UNDER-VOLTAGE WARNNING", NULL) == GSM_URC_POWER);
+	CHECK(gsm_parseURC("Call Ready", NULL) == GSM_URC_READY);
+	CHECK(gsm_parseURC("*PSUTTZ: 26/10/18,12:30:45\",\"+8\",0", NULL) == GSM_URC_TIME);
+	CHECK(gsm_parseURC("+PDP: DEACT", NULL) == GSM_URC_PDP);
+	CHECK(gsm_parseURC("OK", NULL) == GSM_URC_NONE);
+	CHECK(gsm_parseURC("+COPS: 0,0,\"Operator\"", NULL) == GSM_URC_NONE);
+	CHECK(gsm_parseURC("", NULL) == GSM_URC_NONE);
+
+	// response lines of the waiting command are not unsolicited
+	CHECK(gsm_parseURC("+CREG: 2,1,\"1A2B\",\"00C3\"", "AT+CREG?\r\n") == GSM_URC_NONE);
+	CHECK(gsm_parseURC("+CREG: (0-2)", "AT+CREG=?\r\n") == GSM_URC_NONE);
+	CHECK(gsm_parseURC("+CPIN: READY", "AT+CPIN?\r\n") == GSM_URC_NONE);
+	CHECK(gsm_parseURC("+CFUN: 1", "AT+CFUN?\r\n") == GSM_URC_NONE);
+	CHECK(gsm_parseURC("NO CARRIER", "ATH\r\n") == GSM_URC_NONE);
+	CHECK(gsm_parseURC("+CREG: 2,1,\"1A2B\",\"00C3\"", "AT+CFUN?;+CREG?;+COPS?\r\n") == GSM_URC_NONE);
+	CHECK(gsm_parseURC("+COPS: 0,0,\"Operator\"", "AT+CFUN?;+CREG?;+COPS?\r\n") == GSM_URC_NONE);
+	// set command has no such response, other commands' lines are unsolicited
+	CHECK(gsm_parseURC("+CREG: 1", "AT+CREG=2\r\n") == GSM_URC_REG);
+	CHECK(gsm_parseURC("+CREG: 1", "AT+CFUN?;+CREG=2\r\n") == GSM_URC_REG);
+	CHECK(gsm_parseURC("+CREG: 1", "AT+CEREG?\r\n") == GSM_URC_REG);
+	CHECK(gsm_parseURC("+CEREG: 1", "AT+CREG?\r\n") == GSM_URC_REG);
+	CHECK(gsm_parseURC("+CPIN: READY", "AT+CFUN=1\r\n") == GSM_URC_SIM);
+	CHECK(gsm_parseURC("RING", "AT+CMGL=\"ALL\"\r\n") == GSM_URC_RING);
+}
+
+//---------------------------
+static void test_urc_prefix()
+{
+	CHECK(gsm_isURCPrefix("", 0) == 1);
+	CHECK(gsm_isURCPrefix("+", 1) == 1);
+	CHECK(gsm_isURCPrefix("+CR", 3) == 1);
+	CHECK(gsm_isURCPrefix("+CREG: 1", 8) == 1);
+	CHECK(gsm_isURCPrefix("Call Re", 7) == 1);
+	CHECK(gsm_isURCPrefix("+CX", 3) == 0);
+	CHECK(gsm_isURCPrefix("OK", 2) == 0);
+	CHECK(gsm_isURCPrefix("CONNECT", 7) == 0);
+}
+
+//-----------------------------
+static void test_final_result()
+{
+	const char *r;
+	r = "\r\n+CFUN: 1\r\n\r\nOK\r\n";
+	CHECK(gsm_isFinalResult(r, strlen(r)) == 1);
+	r = "OK\r\n";
+	CHECK(gsm_isFinalResult(r, strlen(r)) == 1);
+	r = "\r\nERROR\r\n";
+	CHECK(gsm_isFinalResult(r, strlen(r)) == 1);
+	r = "\r\n+CME ERROR: 10\r\n";
+	CHECK(gsm_isFinalResult(r, strlen(r)) == 1);
+	r = "\r\n+CMS ERROR: 321\r\n";
+	CHECK(gsm_isFinalResult(r, strlen(r)) == 1);
+	// incomplete or not final
+	r = "\r\n+CFUN: 1\r\n\r\nOK";
+	CHECK(gsm_isFinalResult(r, strlen(r)) == 0);
+	r = "\r\n+CFUN: 1\r\n";
+	CHECK(gsm_isFinalResult(r, strlen(r)) == 0);
+	r = "\r\n+COPS: 0,0,\"OK\"\r\n";
+	CHECK(gsm_isFinalResult(r, strlen(r)) == 0);
+	r = "\r\nOKAY\r\n";
+	CHECK(gsm_isFinalResult(r, strlen(r)) == 0);
+	CHECK(gsm_isFinalResult("", 0) == 0);
+}
+
+//--------------------
+static void test_reg()
+{
+	gsm_reg_t reg;
+
+	// response to AT+CREG? with location
+	CHECK(gsm_parseReg("+CREG: 2,1,\"1A2B\",\"00C3\"", &reg) == 1);
+	CHECK(reg.type == GSM_REG_CS);
+	CHECK(reg.stat == GSM_REG_HOME);
+	CHECK(reg.lac == 0x1A2B);
+	CHECK(reg.ci == 0xC3);
+	CHECK(reg.act == 0);
+
+	// unsolicited, with access technology
+	CHECK(gsm_parseReg("+CEREG: 5,\"00A1\",\"01A2B3C4\",7", &reg) == 1);
+	CHECK(reg.type == GSM_REG_EPS);
+	CHECK(reg.stat == GSM_REG_ROAMING);
+	CHECK(reg.lac == 0xA1);
+	CHECK(reg.ci == 0x01A2B3C4);
+	CHECK(reg.act == 7);
+
+	// response without location, unsolicited status only
+	CHECK(gsm_parseReg("+CGREG: 0,2", &reg) == 1);
+	CHECK(reg.type == GSM_REG_GPRS);
+	CHECK(reg.stat == 2);
+	CHECK(reg.lac == 0);
+	CHECK(gsm_parseReg("+CREG: 1", &reg) == 1);
+	CHECK(GSM_REG_REGISTERED(reg.stat));
+	CHECK(gsm_parseReg("+CREG: 3", &reg) == 1);
+	CHECK(!GSM_REG_REGISTERED(reg.stat));
+
+	// empty location fields
+	CHECK(gsm_parseReg("+CEREG: 2,4,\"\",\"\",7", &reg) == 1);
+	CHECK(reg.stat == 4);
+	CHECK(reg.act == 7);
+
+	CHECK(gsm_parseReg("+CREG:", &reg) == 0);
+	CHECK(gsm_parseReg("+COPS: 0", &reg) == 0);
+	CHECK(gsm_parseReg("OK", &reg) == 0);
+}
+
+//---------------------
+static void test_time()
+{
+	struct tm tm;
+	int tz = 99;
+
+	CHECK(gsm_parseTime("26/10/18,12:30:45+08", &tm, &tz) == 1);
+	CHECK(tm.tm_year == 126);
+	CHECK(tm.tm_mon == 9);
+	CHECK(tm.tm_mday == 18);
+	CHECK(tm.tm_hour == 12);
+	CHECK(tm.tm_min == 30);
+	CHECK(tm.tm_sec == 45);
+	CHECK(tz == 8);
+
+	CHECK(gsm_parseTime("00/01/01,00:00:00-16", &tm, &tz) == 1);
+	CHECK(tm.tm_year == 100);
+	CHECK(tz == -16);
+
+	// time zone is optional
+	CHECK(gsm_parseTime("26/10/18,12:30:45", &tm, &tz) == 1);
+	CHECK(tz == 0);
+	CHECK(gsm_parseTime("26/10/18,12:30:45", &tm, NULL) == 1);
+
+	CHECK(gsm_parseTime("26/13/18,12:30:45+08", &tm, &tz) == 0);
+	CHECK(gsm_parseTime("26/10/32,12:30:45+08", &tm, &tz) == 0);
+	CHECK(gsm_parseTime("26/10/18,24:00:00+08", &tm, &tz) == 0);
+	CHECK(gsm_parseTime("26/10/18,12:60:00+08", &tm, &tz) == 0);
+	CHECK(gsm_parseTime("26/10/18", &tm, &tz) == 0);
+	CHECK(gsm_parseTime("", &tm, &tz) == 0);
+}
+
+//--------------------
+static void test_sms()
+{
+	SMS_Msg msg;
+	char text[64];
+	const char *p = cmgl_dump;
+
+	CHECK(gsm_parseSMSCount(cmgl_dump) == 3);
+	CHECK(gsm_parseSMSCount("\r\nOK\r\n") == 0);
+
+	CHECK(gsm_parseSMS(&p, &msg, text, sizeof(text)) == 1);
+	CHECK(msg.idx == 1);
+	CHECK(strcmp(msg.stat, "REC READ") == 0);
+	CHECK(strcmp(msg.from, "+385911234567") == 0);
+	CHECK(strcmp(msg.time, "26/10/17,09:15:02+08") == 0);
+	CHECK(strcmp(msg.msg, "First message") == 0);
+	CHECK(msg.msg == text);
+	CHECK(msg.tz == 2);
+	CHECK(msg.time_value != 0);
+
+	// empty name field, comma and quotes in the text
+	CHECK(gsm_parseSMS(&p, &msg, text, sizeof(text)) == 1);
+	CHECK(msg.idx == 4);
+	CHECK(strcmp(msg.stat, "REC UNREAD") == 0);
+	CHECK(strcmp(msg.from, "+385917654321") == 0);
+	CHECK(strcmp(msg.time, "26/10/18,21:40:59-16") == 0);
+	CHECK(strcmp(msg.msg, "Second, with \"quotes\"") == 0);
+	CHECK(msg.tz == -4);
+
+	// empty text, allocated text buffer
+	CHECK(gsm_parseSMS(&p, &msg, NULL, 0) == 1);
+	CHECK(msg.idx == 12);
+	CHECK((msg.msg != NULL) && (msg.msg[0] == '\0'));
+	free(msg.msg);
+
+	CHECK(gsm_parseSMS(&p, &msg, text, sizeof(text)) == -1);
+	CHECK(*p == '\0');
+
+	// text truncated to the buffer
+	p = cmgl_dump;
+	CHECK(gsm_parseSMS(&p, &msg, text, 6) == 1);
+	CHECK(strcmp(msg.msg, "First") == 0);
+
+	// incomplete message
+	p = "+CMGL: 1,\"REC READ\",\"+385911234567\",\"\",\"26/10/17,09:15:02+08\"\r\nFirst mes";
+	CHECK(gsm_parseSMS(&p, &msg, text, sizeof(text)) == 0);
+	p = "+CMGL: 1,\"REC READ\"";
+	CHECK(gsm_parseSMS(&p, &msg, text, sizeof(text)) == 0);
+}
+
+//--------------------
+static void test_pdp()
+{
+	char type[8];
+	char apn[16];
+	// the probe response of the warm start, the APN is set in another context
+	const char *resp = "AT+CGDCONT?\r\r\n"
+		"+CGDCONT: 3,\"IP\",\"internet\",\"0.0.0.0\",0,0\r\n"
+		"+CGDCONT: 11,\"IP\",\"m2m\",\"0.0.0.0\",0,0\r\n"
+		"+CGDCONT: 1,\"IPV6\",\"iot.provider.com\",\"0.0.0.0\",0,0\r\n"
+		"\r\nOK\r\n";
+
+	CHECK(gsm_parsePDPContext(resp, 1, type, sizeof(type), apn, sizeof(apn)) == 1);
+	CHECK(strcmp(type, "IPV6") == 0);
+	CHECK(strcmp(apn, "iot.provider.co") == 0);	// truncated
+	CHECK(gsm_parsePDPContext(resp, 3, type, sizeof(type), apn, sizeof(apn)) == 1);
+	CHECK(strcmp(type, "IP") == 0);
+	CHECK(strcmp(apn, "internet") == 0);
+	CHECK(gsm_parsePDPContext(resp, 11, type, sizeof(type), apn, sizeof(apn)) == 1);
+	CHECK(strcmp(apn, "m2m") == 0);
+	CHECK(gsm_parsePDPContext(resp, 2, type, sizeof(type), apn, sizeof(apn)) == 0);
+
+	// empty APN, fields at the line end
+	CHECK(gsm_parsePDPContext("+CGDCONT: 1,\"IP\",\"\"\r\n", 1, type, sizeof(type), apn, sizeof(apn)) == 1);
+	CHECK(apn[0] == '\0');
+	CHECK(gsm_parsePDPContext("+CGDCONT: 1,\"IP\"", 1, type, sizeof(type), apn, sizeof(apn)) == 1);
+	CHECK(strcmp(type, "IP") == 0);
+	CHECK(apn[0] == '\0');
+	CHECK(gsm_parsePDPContext("\r\nOK\r\n", 1, type, sizeof(type), apn, sizeof(apn)) == 0);
+}
+
+//========
+int main()
+{
+	RUN(test_urc);
+	RUN(test_urc_prefix);
+	RUN(test_final_result);
+	RUN(test_reg);
+	RUN(test_time);
+	RUN(test_sms);
+	RUN(test_pdp);
+	return TEST_RESULT();
+}
@@ -0,0 +1,78 @@
+/*
+ *  Host test of libGSM against a recording (components/pppos/gsm_serial.c replay backend)
+ *
+ *  The checked-in recording data/sim800_init.rec (made with sim_record against the
+ *  simulated SIM800) is replayed without delays while libGSM initializes the modem
+ *  and connects. Every byte libGSM writes must match the recording and all recorded
+ *  data must be consumed.
+ *
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "libGSM.h"
+#include "gsm_serial.h"
+
+#define REC_FILE	"data/sim800_init.rec"
+
+static uint8_t *rec;
+static int rec_size;
+
+
+//----------------------------------------------------
+static uint8_t *load_file(const char *path, int *size)
+{
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) return NULL;
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *data = malloc(*size);
+	if ((data) && (fread(data, 1, *size, f) != *size)) {
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+	return data;
+}
+
+//----------------------------
+static void test_replay_init()
+{
+	static gsm_replay_t rp;
+
+	CHECK(gsm_replay_init(&rp, rec, rec_size, 0, 0) == 1);
+
+	gsm_config_t cfg;
+	gsm_defaultConfig(&cfg);
+	cfg.max_baud_rate = cfg.baud_rate;
+	cfg.rts_pin = -1;
+	cfg.cts_pin = -1;
+	cfg.serial = &gsm_replay_serial;
+	cfg.serial_arg = &rp;
+	gsm_handle gsm = gsmCreate(&cfg);
+	CHECK(gsm != NULL);
+	if (gsm == NULL) return;
+
+	CHECK(ppposInit(gsm) == 1);
+	CHECK(ppposStatus(gsm) == GSM_STATE_CONNECTED);
+	CHECK(rp.tx_bytes > 0);
+	CHECK(rp.tx_mismatch == 0);
+	CHECK(gsm_replay_done(&rp));
+	// the recording ends connected, the PPPoS task is left running
+}
+
+//========
+int main()
+{
+	rec = load_file(REC_FILE, &rec_size);
+	if (rec == NULL) {
+		printf("Can't read '%s'\n", REC_FILE);
+		return 1;
+	}
+	RUN(test_replay_init);
+	return TEST_RESULT();
+}
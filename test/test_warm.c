@@ -0,0 +1,67 @@
+/*
+ *  Host test of the warm start (CONFIG_GSM_WARM_START) against the simulated modem
+ *
+ *  libGSM connects to the simulated SIM800 (cold start), then the PPPoS task is ended
+ *  with the modem left registered and RF on, as before deep sleep. The next ppposInit()
+ *  verifies the recorded state with one probe command and skips the verified steps,
+ *  the wake to CONNECT time (gsm_ConnectTime()) must be shorter than the cold one.
+ *
+*/
+
+#include <stdio.h>
+
+#include "test.h"
+#include "libGSM.h"
+#include "sim_modem.h"
+
+
+//--------------------------
+static void test_warm_start()
+{
+	sim_config_t scfg;
+	sim_default_config(&scfg);
+	sim_modem_t *sim = sim_create(&scfg);
+	CHECK(sim != NULL);
+	if (sim == NULL) return;
+
+	gsm_config_t cfg;
+	gsm_defaultConfig(&cfg);
+	cfg.max_baud_rate = cfg.baud_rate;
+	cfg.rts_pin = -1;
+	cfg.cts_pin = -1;
+	cfg.serial = &sim_serial;
+	cfg.serial_arg = sim;
+	gsm_handle gsm = gsmCreate(&cfg);
+	CHECK(gsm != NULL);
+	if (gsm == NULL) return;
+
+	// Cold start, the modem state is recorded before going online
+	uint8_t warm = 1;
+	CHECK(ppposInit(gsm) == 1);
+	uint32_t cold_ms = gsm_ConnectTime(gsm, &warm);
+	CHECK(warm == 0);
+	CHECK(cold_ms > 0);
+
+	// End the task, RF stays on (deep sleep), start again
+	ppposDisconnect(gsm, 1, 0);
+	CHECK(ppposStatus(gsm) != GSM_STATE_CONNECTED);
+	CHECK(ppposInit(gsm) == 1);
+	uint32_t warm_ms = gsm_ConnectTime(gsm, &warm);
+	CHECK(warm == 1);
+	CHECK(warm_ms < cold_ms);
+	printf("  cold start %u ms, warm start %u ms to CONNECT\n", cold_ms, warm_ms);
+
+	// RF turned off, the recorded state is not valid
+	ppposDisconnect(gsm, 1, 1);
+	CHECK(ppposInit(gsm) == 1);
+	gsm_ConnectTime(gsm, &warm);
+	CHECK(warm == 0);
+	// the PPPoS task is left running
+}
+
+//========
+int main()
+{
+	RUN(test_warm_start);
+	return TEST_RESULT();
+}
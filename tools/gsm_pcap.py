@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+#
+# Convert libGSM PPP capture dumped to console by gsm_pcap_dump() to pcap file
+#
+# Usage: gsm_pcap.py [console_log] output.pcap   (reads stdin if no log file is given)
+#
+# Hex lines "GSMPCAP:<hex>" between "GSMPCAP-BEGIN" and "GSMPCAP-END" are joined,
+# all other lines are ignored. If the log contains several dumps, the frames of all
+# dumps are written to the single output file.
+#
+
+import struct
+import sys
+
+PCAP_HDR_SIZE = 24
+REC_HDR_SIZE = 16
+
+
+def frames(dump):
+    # Return the records (header and data) of one dumped pcap file
+    if len(dump) < PCAP_HDR_SIZE:
+        return dump[:0], []
+    hdr = dump[:PCAP_HDR_SIZE]
+    recs = []
+    pos = PCAP_HDR_SIZE
+    while pos + REC_HDR_SIZE <= len(dump):
+        incl = struct.unpack("<I", dump[pos + 8:pos + 12])[0]
+        end = pos + REC_HDR_SIZE + incl
+        if end > len(dump):
+            print("truncated record at offset %d" % pos, file=sys.stderr)
+            break
+        recs.append(dump[pos:end])
+        pos = end
+    return hdr, recs
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: %s [console_log] output.pcap" % sys.argv[0], file=sys.stderr)
+        sys.exit(1)
+    src = open(sys.argv[1], errors="replace") if len(sys.argv) > 2 else sys.stdin
+
+    header = None
+    records = []
+    dump = None
+    for line in src:
+        line = line.strip()
+        if line.find("GSMPCAP-BEGIN") >= 0:
+            dump = bytearray()
+            continue
+        if line.find("GSMPCAP-END") >= 0:
+            if dump is not None:
+                hdr, recs = frames(bytes(dump))
+                if header is None and hdr:
+                    header = hdr
+                records += recs
+            dump = None
+            continue
+        pos = line.find("GSMPCAP:")
+        if (pos < 0) or (dump is None):
+            continue
+        try:
+            dump += bytes.fromhex(line[pos + 8:])
+        except ValueError:
+            print("bad dump line: %s" % line, file=sys.stderr)
+
+    if header is None:
+        print("no capture found", file=sys.stderr)
+        sys.exit(1)
+    with open(sys.argv[-1], "wb") as f:
+        f.write(header)
+        for rec in records:
+            f.write(rec)
+    print("%d frames written to %s" % (len(records), sys.argv[-1]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+#
+# libGSM UART recordings (see components/pppos/gsm_serial.h)
+#
+# Usage:
+#   gsm_rec.py console_log out.rec   convert the recording dumped by gsm_record_dump() to recording file
+#   gsm_rec.py -p file.rec           print the recording timeline and AT command timings
+#
+# Recording layout (little endian):
+#   header:  'G','S','M','R', u8 version, 3 reserved bytes
+#   records: u32 time (us), u16 length, u8 direction (0 rx, 1 tx), u8 instance, data
+#
+
+import struct
+import sys
+
+HDR_SIZE = 8
+EV_SIZE = 8
+
+
+def from_console(src):
+    rec = None
+    result = None
+    for line in src:
+        line = line.strip()
+        if line.find("GSMREC-BEGIN") >= 0:
+            rec = bytearray()
+            continue
+        if line.find("GSMREC-END") >= 0:
+            # the last dump in the log is used
+            if rec is not None:
+                result = bytes(rec)
+            rec = None
+            continue
+        pos = line.find("GSMREC-LOST:")
+        if pos >= 0:
+            print("warning: %s bytes were not recorded (buffer full)" % line[pos + 12:], file=sys.stderr)
+            continue
+        pos = line.find("GSMREC:")
+        if (pos >= 0) and (rec is not None):
+            rec += bytes.fromhex(line[pos + 7:])
+    return result
+
+
+def events(rec):
+    if (len(rec) < HDR_SIZE) or (rec[:4] != b"GSMR"):
+        raise ValueError("not a libGSM recording")
+    pos = HDR_SIZE
+    while pos + EV_SIZE <= len(rec):
+        t, length, direction, inst = struct.unpack("<IHBB", rec[pos:pos + EV_SIZE])
+        data = rec[pos + EV_SIZE:pos + EV_SIZE + length]
+        if len(data) < length:
+            break
+        yield t, direction, inst, data
+        pos += EV_SIZE + length
+
+
+def text(data):
+    return "".join(chr(c) if 0x20 <= c < 0x7F else "\\r" if c == 13 else "\\n" if c == 10 else "." for c in data)
+
+
+def print_rec(rec):
+    cmd = {}      # per instance: (command, time sent)
+    resp = {}     # per instance: response received so far
+    lat = []
+    connect = {}
+    for t, direction, inst, data in events(rec):
+        print("%12.3f ms  [%d] %s %s" % (t / 1000.0, inst, "<<" if direction == 0 else ">>", text(data[:80])))
+        if direction == 1:
+            if data.startswith(b"AT") or data == b"+++":
+                cmd[inst] = (data.strip(), t)
+                resp[inst] = b""
+            continue
+        if inst not in cmd:
+            continue
+        resp[inst] += data
+        if any(r in resp[inst] for r in (b"OK\r", b"ERROR", b"CONNECT", b"> ")):
+            c, t0 = cmd.pop(inst)
+            lat.append((c, (t - t0) / 1000.0))
+            if b"CONNECT" in resp[inst] and inst not in connect:
+                connect[inst] = t
+    if lat:
+        print("\nAT command latency:")
+        for c, ms in lat:
+            print("  %-40s %9.1f ms" % (text(c)[:40], ms))
+    for inst, t in connect.items():
+        print("Instance %d: CONNECT after %.1f ms" % (inst, t / 1000.0))
+
+
+def main():
+    if (len(sys.argv) == 3) and (sys.argv[1] == "-p"):
+        print_rec(open(sys.argv[2], "rb").read())
+        return
+    if len(sys.argv) != 3:
+        print("Usage: %s console_log out.rec | -p file.rec" % sys.argv[0], file=sys.stderr)
+        sys.exit(1)
+    rec = from_console(open(sys.argv[1], errors="replace"))
+    if rec is None:
+        print("no recording found", file=sys.stderr)
+        sys.exit(1)
+    with open(sys.argv[2], "wb") as f:
+        f.write(rec)
+    print("%d bytes, %d data blocks written to %s" % (len(rec), sum(1 for _ in events(rec)), sys.argv[2]))
+
+
+if __name__ == "__main__":
+    main()
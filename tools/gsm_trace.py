@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+#
+# Decode libGSM binary trace dumped to console by gsm_trace_dump()
+#
+# Usage: gsm_trace.py [console_log]   (reads stdin if no file is given)
+#
+# Lines "GSMTRC:<32 hex digits>" are decoded, all other lines are ignored.
+# Record layout (little endian, see components/pppos/gsm_trace.h):
+#   u32 seq, u32 timestamp (us), u8 event id, u8 instance, u16 arg0, u32 arg1
+#
+
+import struct
+import sys
+
+STATES = {0: "DISCONNECTED", 1: "CONNECTED", 89: "IDLE", 98: "FIRSTINIT"}
+
+PPPERR = ["NONE", "PARAM", "OPEN", "DEVICE", "ALLOC", "USER", "CONNECT", "AUTHFAIL",
+          "PROTOCOL", "PEERDEAD", "IDLETIMEOUT", "CONNECTTIME", "LOOPBACK"]
+
+UART_EVENTS = ["DATA", "BREAK", "BUFFER_FULL", "FIFO_OVF", "FRAME_ERR", "PARITY_ERR",
+               "DATA_BREAK", "PATTERN_DET"]
+
+AT_RESULT = {0: "ERROR", 1: "OK", 2: "OK(alt)", 0xFFFF: "TIMEOUT"}
+
+URC_CLASSES = ["NONE", "RING", "NO_CARRIER", "REG", "SMS", "SIM", "POWER", "READY", "TIME", "PDP"]
+
+
+def cmd_text(arg1):
+    txt = struct.pack("<I", arg1).rstrip(b"\0")
+    return "AT" + "".join(chr(c) if 0x20 <= c < 0x7F else "." for c in txt)
+
+
+def decode(evid, arg0, arg1):
+    if evid == 1:
+        return "UART_RX", "%d bytes, %d to lwIP" % (arg0, arg1)
+    if evid == 2:
+        return "UART_TX", "%d bytes" % arg0
+    if evid == 3:
+        name = UART_EVENTS[arg0] if arg0 < len(UART_EVENTS) else str(arg0)
+        return "UART_EVENT", name
+    if evid == 4:
+        return "AT_SEND", "%s... (%d bytes)" % (cmd_text(arg1), arg0)
+    if evid == 5:
+        return "AT_RESP", "%s after %.1f ms" % (AT_RESULT.get(arg0, str(arg0)), arg1 / 1000.0)
+    if evid == 6:
+        name = PPPERR[arg0] if arg0 < len(PPPERR) else str(arg0)
+        return "PPP_STATUS", "PPPERR_" + name
+    if evid == 7:
+        return "STATE", STATES.get(arg0, str(arg0))
+    if evid == 8:
+        return "FCS_ERR", "%d of %d frames" % (arg0, arg1)
+    if evid == 9:
+        return "URC", URC_CLASSES[arg0] if arg0 < len(URC_CLASSES) else str(arg0)
+    return "USER_%d" % evid if evid >= 128 else "EVENT_%d" % evid, "arg0=%d arg1=%d" % (arg0, arg1)
+
+
+def main():
+    src = open(sys.argv[1], errors="replace") if len(sys.argv) > 1 else sys.stdin
+    first = None
+    last_ts = None
+    base = 0
+    last_seq = None
+
+    for line in src:
+        line = line.strip()
+        pos = line.find("GSMTRC-LOST:")
+        if pos >= 0:
+            print("---- %s records lost ----" % line[pos + 12:])
+            last_seq = None
+            continue
+        pos = line.find("GSMTRC:")
+        if pos < 0:
+            continue
+        try:
+            rec = bytes.fromhex(line[pos + 7:pos + 7 + 32])
+            seq, ts, evid, inst, arg0, arg1 = struct.unpack("<IIBBHI", rec)
+        except ValueError:
+            continue
+
+        # 32-bit microsecond timestamp wraps every ~71 minutes
+        if (last_ts is not None) and (ts < last_ts) and ((last_ts - ts) > 0x80000000):
+            base += 1 << 32
+        last_ts = ts
+        t = base + ts
+        if first is None:
+            first = t
+        if (last_seq is not None) and (seq != last_seq + 1):
+            print("---- sequence gap: %d records ----" % (seq - last_seq - 1))
+        last_seq = seq
+
+        name, info = decode(evid, arg0, arg1)
+        print("%12.3f ms  [%d] %-11s %s" % ((t - first) / 1000.0, inst, name, info))
+
+
+if __name__ == "__main__":
+    main()